@@ -0,0 +1,15 @@
+# Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+FETCHCONTENT_DECLARE(
+        benchmark
+        GIT_REPOSITORY https://github.com/google/benchmark.git
+        GIT_TAG v1.8.3
+)
+
+SET(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+SET(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+SET(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+FETCHCONTENT_MAKEAVAILABLE(benchmark)
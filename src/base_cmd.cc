@@ -6,11 +6,17 @@
  */
 
 #include "base_cmd.h"
+
+#include <set>
+
+#include "cmd_stats.h"
 #include "common.h"
 #include "config.h"
 #include "log.h"
+#include "perf_stats.h"
 #include "pikiwidb.h"
 #include "praft/praft.h"
+#include "pstd/env.h"
 
 namespace pikiwidb {
 
@@ -31,6 +37,62 @@ bool BaseCmd::CheckArg(size_t num) const {
 
 std::vector<std::string> BaseCmd::CurrentKey(PClient* client) const { return std::vector<std::string>{client->Key()}; }
 
+bool BaseCmd::RedirectToRaftLeader(PClient* client) const {
+  if (client->Keys().empty()) {
+    // the command writes every group, it is sent to the node leading them all
+    std::set<std::string> leaders;
+    for (uint32_t i = 0; i < PRaft::GroupNum(); i++) {
+      leaders.insert(PRaft::Group(i).IsLeader() ? std::string() : PRaft::Group(i).GetLeaderAddress());
+    }
+    if (leaders.size() == 1 && leaders.begin()->empty()) {
+      return false;
+    }
+    if (leaders.size() == 1) {
+      client->SetRes(CmdRes::kErrOther, fmt::format("MOVED {}", *leaders.begin()));
+    } else {
+      client->SetRes(CmdRes::kErrOther, fmt::format("{} writes every raft group and no node leads them all, move "
+                                                    "their leaders to one node with RAFT.GROUP TRANSFER",
+                                                    client->CmdName()));
+    }
+    return true;
+  }
+
+  auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  for (const auto& key : client->Keys()) {
+    auto& group = PRaft::GroupOfInstance(storage->GetInstanceIDOfSlot(storage->GetSlot(key)));
+    if (!group.IsLeader()) {
+      client->SetRes(CmdRes::kErrOther, fmt::format("MOVED {}", group.GetLeaderAddress()));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BaseCmd::WaitForRaftReadIndex(PClient* client) const {
+  std::set<uint32_t> groups;
+  if (client->Keys().empty()) {
+    for (uint32_t i = 0; i < PRaft::GroupNum(); i++) {
+      groups.insert(i);
+    }
+  } else {
+    auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+    for (const auto& key : client->Keys()) {
+      auto inst_id = storage->GetInstanceIDOfSlot(storage->GetSlot(key));
+      groups.insert(PRaft::GroupOfInstance(inst_id).GetIndex());
+    }
+  }
+
+  bool lease = client->GetRaftReadMode() == RaftReadMode::kLease;
+  for (auto group : groups) {
+    auto s = PRaft::Group(group).WaitForReadIndex(lease);
+    if (!s.ok()) {
+      client->SetRes(CmdRes::kErrOther, fmt::format("Failed to get the read index: {}", s.error_str()));
+      return false;
+    }
+  }
+  return true;
+}
+
 void BaseCmd::Execute(PClient* client) {
   DEBUG("execute command: {}", client->CmdName());
 
@@ -40,12 +102,6 @@ void BaseCmd::Execute(PClient* client) {
       DEBUG("drop command: {}", client->CmdName());
       return client->SetRes(CmdRes::kErrOther, "PRAFT is not initialized");
     }
-
-    // 2. If PRAFT is initialized and the current node is not the leader, return a redirection message for write
-    // commands.
-    if (HasFlag(kCmdFlagsWrite) && !PRAFT.IsLeader()) {
-      return client->SetRes(CmdRes::kErrOther, fmt::format("MOVED {}", PRAFT.GetLeaderAddress()));
-    }
   }
 
   auto dbIndex = client->GetCurrentDB();
@@ -53,16 +109,87 @@ void BaseCmd::Execute(PClient* client) {
     PSTORE.GetBackend(dbIndex)->LockShared();
   }
 
+  client->ClearKeys();
   if (!DoInitial(client)) {
     return;
   }
-  DoCmd(client);
+
+  // 2. If the current node is not the leader of the raft group owning the slot of a key, return a redirection
+  // message for write commands. Those without keys write every group.
+  if (g_config.use_raft.load() && HasFlag(kCmdFlagsWrite) && RedirectToRaftLeader(client)) {
+    if (!HasFlag(kCmdFlagsExclusive)) {
+      PSTORE.GetBackend(dbIndex)->UnLockShared();
+    }
+    return;
+  }
+
+  // 3. Reads on a follower wait for the writes acknowledged before them unless the client reads stale data. The
+  // lock is released meanwhile, a group may have to reopen the storage to load a snapshot to catch up.
+  if (g_config.use_raft.load() && HasFlag(kCmdFlagsReadonly) && !HasFlag(kCmdFlagsAdmin) &&
+      client->GetRaftReadMode() != RaftReadMode::kStale) {
+    if (!HasFlag(kCmdFlagsExclusive)) {
+      PSTORE.GetBackend(dbIndex)->UnLockShared();
+    }
+    if (!WaitForRaftReadIndex(client)) {
+      return;
+    }
+    if (!HasFlag(kCmdFlagsExclusive)) {
+      PSTORE.GetBackend(dbIndex)->LockShared();
+    }
+  }
+  // 4. One call in perf-context-sample-rate is profiled, or all of them to keep the slow ones
+  auto perf_rate = g_config.perf_context_sample_rate.load(std::memory_order_relaxed);
+  bool perf_sampled = false;
+  if (perf_rate != 0 && ++perf_calls_ >= perf_rate) {
+    perf_calls_ = 0;
+    perf_sampled = true;
+  }
+  if (perf_sampled || g_config.perf_context_slower_than.load(std::memory_order_relaxed) != 0) {
+    DoCmdProfiled(client, perf_sampled);
+  } else {
+    DoCmd(client);
+  }
+  SampleHotKeys(client);
 
   if (!HasFlag(kCmdFlagsExclusive)) {
     PSTORE.GetBackend(dbIndex)->UnLockShared();
   }
 }
 
+void BaseCmd::DoCmdProfiled(PClient* client, bool sampled) {
+  PerfScope scope;
+  auto start = pstd::NowMicros();
+  DoCmd(client);
+  auto used = pstd::NowMicros() - start;
+  auto slower_than = g_config.perf_context_slower_than.load(std::memory_order_relaxed);
+  if (!sampled && (slower_than == 0 || used < slower_than)) {
+    return;
+  }
+
+  auto counters = scope.Counters();
+  auto db = client->GetCurrentDB();
+  int instance = -1;
+  if (!client->Keys().empty()) {
+    instance = PSTORE.GetBackend(db)->GetStorage()->GetDBInstance(client->Keys()[0])->GetIndex();
+  }
+  PerfStats::Instance().Record(StatName(), db, instance, counters);
+  client->Trace().perf = counters;
+  client->Trace().profiled = true;
+}
+
+void BaseCmd::SampleHotKeys(PClient* client) {
+  auto rate = g_config.hotkeys_sample_rate.load(std::memory_order_relaxed);
+  if (rate == 0 || client->Keys().empty() || ++hot_key_calls_ < rate) {
+    return;
+  }
+  hot_key_calls_ = 0;
+  // a sample stands for the calls since the last one
+  auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  for (const auto& key : client->Keys()) {
+    storage->RecordHotKey(key, rate);
+  }
+}
+
 std::string BaseCmd::ToBinlog(uint32_t exec_time, uint32_t term_id, uint64_t logic_id, uint32_t filenum,
                               uint64_t offset) {
   return "";
@@ -82,11 +209,21 @@ std::string BaseCmd::Name() const { return name_; }
 // std::shared_ptr<std::string> BaseCommand::GetResp() { return resp_.lock(); }
 uint32_t BaseCmd::GetCmdID() const { return cmd_id_; }
 
+void BaseCmd::RecordLatency(uint64_t usec) {
+  if (!latency_) {
+    latency_ = CmdStats::Instance().NewHistogram(StatName());
+  }
+  latency_->Record(usec);
+}
+
 // BaseCmdGroup
 BaseCmdGroup::BaseCmdGroup(const std::string& name, uint32_t flag) : BaseCmdGroup(name, -2, flag) {}
 BaseCmdGroup::BaseCmdGroup(const std::string& name, int16_t arity, uint32_t flag) : BaseCmd(name, arity, flag, 0) {}
 
-void BaseCmdGroup::AddSubCmd(std::unique_ptr<BaseCmd> cmd) { subCmds_[cmd->Name()] = std::move(cmd); }
+void BaseCmdGroup::AddSubCmd(std::unique_ptr<BaseCmd> cmd) {
+  cmd->SetStatName(name_ + "|" + cmd->Name());
+  subCmds_[cmd->Name()] = std::move(cmd);
+}
 
 BaseCmd* BaseCmdGroup::GetSubCmd(const std::string& cmdName) {
   auto subCmd = subCmds_.find(cmdName);
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "client.h"
+#include "pstd/pstd_histogram.h"
 #include "store.h"
 
 namespace pikiwidb {
@@ -42,6 +43,8 @@ const std::string kCmdNameRenameNX = "renamenx";
 // raft cmd
 const std::string kCmdNameRaftCluster = "raft.cluster";
 const std::string kCmdNameRaftNode = "raft.node";
+const std::string kCmdNameRaftGroup = "raft.group";
+const std::string kCmdNameRaftReadMode = "raft.readmode";
 
 // string cmd
 const std::string kCmdNameSet = "set";
@@ -87,7 +90,16 @@ const std::string kCmdNameDebug = "debug";
 const std::string kSubCmdNameDebugHelp = "help";
 const std::string kSubCmdNameDebugOOM = "oom";
 const std::string kSubCmdNameDebugSegfault = "segfault";
+const std::string kCmdNameSlots = "slots";
+const std::string kSubCmdNameSlotsInfo = "info";
+const std::string kSubCmdNameSlotsMigrate = "migrate";
+const std::string kSubCmdNameSlotsRebalance = "rebalance";
 const std::string kCmdNameInfo = "info";
+const std::string kCmdNameLatency = "latency";
+const std::string kCmdNameSlowlog = "slowlog";
+const std::string kCmdNameHotKeys = "hotkeys";
+const std::string kCmdNameBigKeys = "bigkeys";
+const std::string kCmdNameMonitor = "monitor";
 const std::string kCmdNameDbsize = "dbsize";
 const std::string kCmdNameBgsave = "bgsave";
 const std::string kCmdNameLastsave = "lastsave";
@@ -318,6 +330,11 @@ class BaseCmd : public std::enable_shared_from_this<BaseCmd> {
 
   uint32_t GetCmdID() const;
 
+  // Records the time the command took, called by the worker owning this command table only
+  void RecordLatency(uint64_t usec);
+  // The name of the command in the stats, such as config|get for a subcommand
+  void SetStatName(const std::string& name) { stat_name_ = name; }
+
  protected:
   // Execute a specific command
   virtual void DoCmd(PClient* client) = 0;
@@ -335,12 +352,30 @@ class BaseCmd : public std::enable_shared_from_this<BaseCmd> {
   uint32_t cmd_id_ = 0;
   uint32_t acl_category_ = 0;
 
+  std::string stat_name_;
+  pstd::Histogram* latency_ = nullptr;  // registered at the first call
+  uint32_t hot_key_calls_ = 0;          // the calls since the keys were last sampled
+  uint32_t perf_calls_ = 0;             // the calls since the last one profiled
+
  private:
   // The function to be executed first before executing `DoCmd`
   // What needs to be done at present are: extract the key in the command and fill it into the context
   // If this function returns false, then Do Cmd will not be executed
   virtual bool DoInitial(PClient* client) = 0;
 
+  // Replies "MOVED <addr>" with the leader of the raft group of a key of the command this node does not lead. A
+  // command without keys writes every group: it is sent to the node leading them all, or fails if there is none.
+  bool RedirectToRaftLeader(PClient* client) const;
+  // Waits until the groups owning the keys applied the writes acknowledged before, for the raft read mode of the
+  // client, false with an error set if they did not
+  bool WaitForRaftReadIndex(PClient* client) const;
+  // Reports the keys of one call in hotkeys-sample-rate to the hot keys of the storage
+  void SampleHotKeys(PClient* client);
+  // Runs DoCmd with the rocksdb perf context enabled, the counters are kept if sampled or slower than
+  // perf-context-slower-than
+  void DoCmdProfiled(PClient* client, bool sampled);
+  const std::string& StatName() const { return stat_name_.empty() ? name_ : stat_name_; }
+
   //  virtual void Clear(){};
   //  BaseCmd& operator=(const BaseCmd&);
 };
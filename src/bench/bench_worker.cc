@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "bench_worker.h"
+
+#include <strings.h>
+
+#include <charconv>
+#include <cstring>
+#include <iterator>
+
+#include "fmt/core.h"
+
+namespace pikiwidb {
+
+// The members of the hashes, sets and sorted sets written to and read
+constexpr uint64_t kMembers = 100;
+
+const char* BenchCommandName(BenchCommand cmd) {
+  static const char* const kNames[kBenchCommandNum] = {
+      "ping", "set", "get", "incr", "hset", "hget", "lpush", "lpop", "sadd", "zadd",
+  };
+  return kNames[cmd];
+}
+
+BenchCommand BenchCommandOf(std::string_view name) {
+  for (int i = 0; i < kBenchCommandNum; i++) {
+    auto cmd = static_cast<BenchCommand>(i);
+    if (name.size() == strlen(BenchCommandName(cmd)) &&
+        strncasecmp(name.data(), BenchCommandName(cmd), name.size()) == 0) {
+      return cmd;
+    }
+  }
+  return kBenchCommandNum;
+}
+
+int ParseReply(const char* data, int len, bool* is_error) {
+  if (len <= 0) {
+    return 0;
+  }
+  auto crlf = static_cast<const char*>(memmem(data, len, "\r\n", 2));
+  if (!crlf) {
+    return 0;
+  }
+  int line_len = static_cast<int>(crlf - data) + 2;
+
+  switch (data[0]) {
+    case '+':
+    case ':':
+      return line_len;
+    case '-':
+      *is_error = true;
+      return line_len;
+    case '$':
+    case '*': {
+      int64_t n = 0;
+      auto [end, ec] = std::from_chars(data + 1, crlf, n);
+      if (ec != std::errc() || end != crlf) {
+        return -1;
+      }
+      if (n < 0) {  // nil
+        return line_len;
+      }
+      if (data[0] == '$') {
+        int64_t reply_len = line_len + n + 2;
+        if (reply_len > len) {
+          return 0;
+        }
+        if (data[reply_len - 2] != '\r' || data[reply_len - 1] != '\n') {
+          return -1;
+        }
+        return static_cast<int>(reply_len);
+      }
+      int pos = line_len;
+      for (int64_t i = 0; i < n; i++) {
+        int element_len = ParseReply(data + pos, len - pos, is_error);
+        if (element_len <= 0) {
+          return element_len;
+        }
+        pos += element_len;
+      }
+      return pos;
+    }
+    default:
+      return -1;
+  }
+}
+
+BenchWorker::BenchWorker(const BenchWorkload& workload, int connections, uint64_t seed)
+    : workload_(workload), connections_(connections), engine_(seed) {
+  for (const auto& [cmd, weight] : workload_.mix) {
+    total_weight_ += weight;
+  }
+}
+
+void BenchWorker::Start() {
+  thread_ = std::thread([this] { Run(); });
+}
+
+void BenchWorker::Join() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BenchWorker::Run() {
+  loop_.Init();
+  loop_.SetName("bench-worker");
+
+  pending_connects_ = connections_;
+  for (int i = 0; i < connections_; i++) {
+    auto on_connect = [this](TcpConnection* conn) { OnConnect(conn); };
+    auto on_fail = [this](EventLoop*, const char* ip, int port) {
+      fmt::print(stderr, "can't connect to {}:{}\n", ip, port);
+      pending_connects_--;
+      failed_connections_++;
+    };
+    if (!loop_.Connect(workload_.host.c_str(), workload_.port, on_connect, on_fail)) {
+      pending_connects_--;
+      failed_connections_++;
+    }
+  }
+
+  loop_.ScheduleRepeatedly(100, [this] { CheckEnd(); });
+  loop_.Run();
+}
+
+void BenchWorker::OnConnect(TcpConnection* conn) {
+  pending_connects_--;
+  live_.insert(conn);
+
+  auto state = std::make_shared<ConnectionState>();
+  conn->SetNodelay(true);
+  conn->SetContext(state);
+  conn->SetMessageCallback([this](TcpConnection* c, const char* data, int len) { return OnReply(c, data, len); });
+  conn->SetOnDisconnect([this](TcpConnection* c) { OnDisconnect(c); });
+
+  for (int i = 0; i < workload_.pipeline && !ending_; i++) {
+    SendRequest(conn, state.get());
+  }
+}
+
+void BenchWorker::OnDisconnect(TcpConnection* conn) {
+  live_.erase(conn);
+  in_flight_ -= conn->GetContext<ConnectionState>()->in_flight.size();
+  if (!finished_) {
+    lost_connections_++;
+  }
+}
+
+int BenchWorker::OnReply(TcpConnection* conn, const char* data, int len) {
+  bool is_error = false;
+  int reply_len = ParseReply(data, len, &is_error);
+  if (reply_len <= 0) {
+    return reply_len;
+  }
+
+  auto state = conn->GetContext<ConnectionState>();
+  if (state->in_flight.empty()) {
+    fmt::print(stderr, "unexpected reply from {}:{}\n", conn->GetPeerIP(), conn->GetPeerPort());
+    return -1;
+  }
+  auto [cmd, sent] = state->in_flight.front();
+  state->in_flight.pop_front();
+  in_flight_--;
+
+  auto now = Clock::now();
+  histograms_[cmd].Record(std::chrono::duration_cast<std::chrono::microseconds>(now - sent).count());
+  if (is_error) {
+    errors_[cmd]++;
+  }
+  replies_.store(replies_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  if (now >= workload_.end) {
+    ending_ = true;
+  } else {
+    SendRequest(conn, state.get());
+  }
+  return reply_len;
+}
+
+void BenchWorker::SendRequest(TcpConnection* conn, ConnectionState* state) {
+  auto cmd = NextCommand();
+  request_.clear();
+  AppendRequest(cmd, &request_);
+  state->in_flight.push_back({cmd, Clock::now()});
+  in_flight_++;
+  conn->SendPacket(request_);
+}
+
+void BenchWorker::CheckEnd() {
+  if (finished_) {
+    return;
+  }
+  auto now = Clock::now();
+  if (now >= workload_.end) {
+    ending_ = true;
+  }
+  if ((ending_ && in_flight_ == 0) || now >= workload_.end + std::chrono::seconds(1) ||
+      (pending_connects_ == 0 && live_.empty())) {
+    Finish();
+  }
+}
+
+void BenchWorker::Finish() {
+  finished_ = true;
+  // closing erases them from live_
+  auto live = live_;
+  for (auto conn : live) {
+    conn->ActiveClose();
+  }
+  loop_.Stop();
+}
+
+BenchCommand BenchWorker::NextCommand() {
+  auto n = static_cast<uint32_t>(engine_() % total_weight_);
+  for (const auto& [cmd, weight] : workload_.mix) {
+    if (n < weight) {
+      return cmd;
+    }
+    n -= weight;
+  }
+  return workload_.mix.back().first;
+}
+
+void BenchWorker::AppendRequest(BenchCommand cmd, std::string* buf) {
+  auto out = std::back_inserter(*buf);
+  auto header = [out](int argc) { fmt::format_to(out, "*{}\r\n", argc); };
+  auto arg = [out](std::string_view value) { fmt::format_to(out, "${}\r\n{}\r\n", value.size(), value); };
+  // the keys of each type are apart, so that the commands of the mix don't hit keys of another type
+  auto key = [this](const char* type) { return fmt::format("{}:{:012}", type, workload_.keys->Next(engine_)); };
+  auto member = [this] { return fmt::format("member:{:02}", engine_() % kMembers); };
+
+  switch (cmd) {
+    case kBenchPing:
+      header(1);
+      arg("PING");
+      break;
+    case kBenchSet:
+      header(3);
+      arg("SET");
+      arg(key("string"));
+      arg(workload_.value);
+      break;
+    case kBenchGet:
+      header(2);
+      arg("GET");
+      arg(key("string"));
+      break;
+    case kBenchIncr:
+      header(2);
+      arg("INCR");
+      arg(key("counter"));
+      break;
+    case kBenchHSet:
+      header(4);
+      arg("HSET");
+      arg(key("hash"));
+      arg(member());
+      arg(workload_.value);
+      break;
+    case kBenchHGet:
+      header(3);
+      arg("HGET");
+      arg(key("hash"));
+      arg(member());
+      break;
+    case kBenchLPush:
+      header(3);
+      arg("LPUSH");
+      arg(key("list"));
+      arg(workload_.value);
+      break;
+    case kBenchLPop:
+      header(2);
+      arg("LPOP");
+      arg(key("list"));
+      break;
+    case kBenchSAdd:
+      header(3);
+      arg("SADD");
+      arg(key("set"));
+      arg(member());
+      break;
+    case kBenchZAdd:
+      header(4);
+      arg("ZADD");
+      arg(key("zset"));
+      arg(std::to_string(engine_() % 1000000));
+      arg(member());
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace pikiwidb
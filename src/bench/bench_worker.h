@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "net/event_loop.h"
+#include "pstd/pstd_histogram.h"
+
+#include "key_generator.h"
+
+namespace pikiwidb {
+
+// The commands a load is made of
+enum BenchCommand {
+  kBenchPing,
+  kBenchSet,
+  kBenchGet,
+  kBenchIncr,
+  kBenchHSet,
+  kBenchHGet,
+  kBenchLPush,
+  kBenchLPop,
+  kBenchSAdd,
+  kBenchZAdd,
+  kBenchCommandNum,
+};
+
+const char* BenchCommandName(BenchCommand cmd);
+// kBenchCommandNum if there is none named name, whatever its case
+BenchCommand BenchCommandOf(std::string_view name);
+
+struct BenchWorkload {
+  std::string host;
+  int port = 0;
+  int pipeline = 1;  // requests in flight per connection
+  std::string value;
+  // The commands with their weights in the load
+  std::vector<std::pair<BenchCommand, uint32_t>> mix;
+  const KeyGenerator* keys = nullptr;
+  std::chrono::steady_clock::time_point end;
+};
+
+// The length of the RESP reply at the start of data, 0 if it is incomplete, -1 if it is malformed
+int ParseReply(const char* data, int len, bool* is_error);
+
+/*
+ * Drives connections in an event loop of its own thread, each with
+ * workload.pipeline requests in flight until the end of the workload, and
+ * records the latencies of the replies in microseconds. A request is sent as
+ * soon as a reply comes back, so the latencies include the queueing in the
+ * server of the requests pipelined before.
+ */
+class BenchWorker {
+ public:
+  BenchWorker(const BenchWorkload& workload, int connections, uint64_t seed);
+
+  BenchWorker(const BenchWorker&) = delete;
+  void operator=(const BenchWorker&) = delete;
+
+  void Start();
+  // Waits for the replies in flight at the end of the workload, for a second at most
+  void Join();
+
+  // The replies so far, from any thread
+  uint64_t Replies() const { return replies_.load(std::memory_order_relaxed); }
+
+  // After Join
+  const pstd::Histogram& GetHistogram(BenchCommand cmd) const { return histograms_[cmd]; }
+  uint64_t GetErrors(BenchCommand cmd) const { return errors_[cmd]; }
+  int FailedConnections() const { return failed_connections_; }
+  int LostConnections() const { return lost_connections_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct InFlight {
+    BenchCommand cmd;
+    Clock::time_point sent;
+  };
+  struct ConnectionState {
+    std::deque<InFlight> in_flight;
+  };
+
+  void Run();
+  void OnConnect(TcpConnection* conn);
+  void OnDisconnect(TcpConnection* conn);
+  int OnReply(TcpConnection* conn, const char* data, int len);
+  void SendRequest(TcpConnection* conn, ConnectionState* state);
+  void CheckEnd();
+  // Closes the connections and stops the loop
+  void Finish();
+
+  BenchCommand NextCommand();
+  void AppendRequest(BenchCommand cmd, std::string* buf);
+
+  const BenchWorkload& workload_;
+  const int connections_;
+  std::mt19937_64 engine_;
+  uint32_t total_weight_ = 0;
+
+  EventLoop loop_;
+  std::thread thread_;
+
+  std::unordered_set<TcpConnection*> live_;
+  int pending_connects_ = 0;
+  int failed_connections_ = 0;
+  int lost_connections_ = 0;
+  uint64_t in_flight_ = 0;
+  bool ending_ = false;
+  bool finished_ = false;
+  std::string request_;
+
+  std::atomic<uint64_t> replies_ = 0;
+  std::array<pstd::Histogram, kBenchCommandNum> histograms_;
+  std::array<uint64_t, kBenchCommandNum> errors_{};
+};
+
+}  // namespace pikiwidb
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Microbenchmarks of the building blocks on the path of every request: the
+// request parser, the reply buffer, the key encoders, the slot hash, the
+// record locks, the cache and the merging iterator over the db instances.
+// Those shared between threads run with 1 to 8 threads over a few keys
+// (contended) and over many (spread), the others with 1 to 8 threads each
+// working on its own. Takes the google-benchmark flags, see storage_bench.
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "fmt/core.h"
+
+#include "pstd/lock_mgr.h"
+#include "pstd/log.h"
+#include "pstd/mutex_impl.h"
+#include "pstd/pikiwidb_slot.h"
+#include "pstd/scope_record_lock.h"
+
+#include "src/base_data_key_format.h"
+#include "src/base_key_format.h"
+#include "src/redis.h"
+#include "src/sharded_cache.h"
+#include "src/type_iterator.h"
+#include "storage/storage.h"
+
+#include "common.h"
+#include "proto_parser.h"
+#include "unbounded_buffer.h"
+
+namespace {
+
+constexpr int kMaxThreads = 8;
+
+// A key of size bytes, with a \0 every 16 bytes when escaped is set, which the key encoders escape
+std::string MakeKey(int64_t size, bool escaped) {
+  std::string key(size, 'k');
+  for (int64_t i = 15; escaped && i < size; i += 16) {
+    key[i] = '\0';
+  }
+  return key;
+}
+
+// Request parser and reply buffer
+
+// SET with a value of range(0) bytes
+void BM_ProtoParser(benchmark::State& state) {
+  auto value = std::string(state.range(0), 'v');
+  auto request = fmt::format("*3\r\n$3\r\nSET\r\n$16\r\nkey:000000000001\r\n${}\r\n{}\r\n", value.size(), value);
+
+  std::vector<std::string> params;
+  pikiwidb::PProtoParser parser(params);
+  for (auto _ : state) {
+    parser.Reset();
+    const char* ptr = request.data();
+    auto result = parser.ParseRequest(ptr, request.data() + request.size());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(request.size()));
+}
+BENCHMARK(BM_ProtoParser)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// The same request arriving in two reads, parsed from where the first one stopped
+void BM_ProtoParserSplit(benchmark::State& state) {
+  auto value = std::string(state.range(0), 'v');
+  auto request = fmt::format("*3\r\n$3\r\nSET\r\n$16\r\nkey:000000000001\r\n${}\r\n{}\r\n", value.size(), value);
+  auto half = request.size() / 2;
+
+  std::vector<std::string> params;
+  pikiwidb::PProtoParser parser(params);
+  for (auto _ : state) {
+    parser.Reset();
+    const char* ptr = request.data();
+    parser.ParseRequest(ptr, request.data() + half);
+    auto result = parser.ParseRequest(ptr, request.data() + request.size());
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProtoParserSplit)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// 16 bulk replies of range(0) bytes formatted, then sent
+void BM_UnboundedBuffer(benchmark::State& state) {
+  auto value = std::string(state.range(0), 'v');
+  pikiwidb::UnboundedBuffer reply;
+  for (auto _ : state) {
+    pikiwidb::PreFormatMultiBulk(16, &reply);
+    for (int i = 0; i < 16; i++) {
+      pikiwidb::FormatBulk(value, &reply);
+    }
+    benchmark::DoNotOptimize(reply.ReadAddr());
+    reply.AdjustReadPtr(reply.ReadableSize());
+    reply.Clear();
+  }
+  state.SetItemsProcessed(state.iterations() * 16);
+  state.SetBytesProcessed(state.iterations() * 16 * state.range(0));
+}
+BENCHMARK(BM_UnboundedBuffer)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Key encoders, over keys of range(0) bytes without (range(1) = 0) or with \0 to escape
+
+void BM_EncodeBaseKey(benchmark::State& state) {
+  auto key = MakeKey(state.range(0), state.range(1) != 0);
+  for (auto _ : state) {
+    storage::BaseKey base_key(key);
+    benchmark::DoNotOptimize(base_key.Encode());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeBaseKey)->ArgsProduct({{16, 256}, {0, 1}})->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_DecodeBaseKey(benchmark::State& state) {
+  auto key = MakeKey(state.range(0), state.range(1) != 0);
+  storage::BaseKey base_key(key);
+  auto encoded = base_key.Encode().ToString();
+  for (auto _ : state) {
+    storage::ParsedBaseKey parsed(encoded);
+    benchmark::DoNotOptimize(parsed.Key());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeBaseKey)->ArgsProduct({{16, 256}, {0, 1}})->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_EncodeBaseDataKey(benchmark::State& state) {
+  auto key = MakeKey(state.range(0), state.range(1) != 0);
+  std::string field(16, 'f');
+  for (auto _ : state) {
+    storage::BaseDataKey data_key(key, 1, field);
+    benchmark::DoNotOptimize(data_key.Encode());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeBaseDataKey)->ArgsProduct({{16, 256}, {0, 1}})->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_DecodeBaseDataKey(benchmark::State& state) {
+  auto key = MakeKey(state.range(0), state.range(1) != 0);
+  std::string field(16, 'f');
+  storage::BaseDataKey data_key(key, 1, field);
+  auto encoded = data_key.Encode().ToString();
+  for (auto _ : state) {
+    storage::ParsedBaseDataKey parsed(encoded);
+    benchmark::DoNotOptimize(parsed.Data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeBaseDataKey)->ArgsProduct({{16, 256}, {0, 1}})->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_GetSlotID(benchmark::State& state) {
+  auto key = MakeKey(state.range(0), false);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(GetSlotID(key));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GetSlotID)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Record locks and cache, shared by the threads, over range(0) keys
+
+std::vector<std::string> MakeKeys(int64_t count) {
+  std::vector<std::string> keys;
+  for (int64_t i = 0; i < count; i++) {
+    keys.push_back(fmt::format("key:{:012}", i));
+  }
+  return keys;
+}
+
+// As a Redis instance has it
+std::shared_ptr<pstd::lock::LockMgr> g_lock_mgr =
+    std::make_shared<pstd::lock::LockMgr>(1000, 0, std::make_shared<pstd::lock::MutexFactoryImpl>());
+
+void BM_LockMgr(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    const auto& key = keys[rng() % keys.size()];
+    g_lock_mgr->TryLock(key);
+    g_lock_mgr->UnLock(key);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockMgr)->Arg(16)->Arg(100000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_ScopeRecordLock(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  for (auto _ : state) {
+    pstd::lock::ScopeRecordLock l(g_lock_mgr, keys[rng() % keys.size()]);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ScopeRecordLock)->Arg(16)->Arg(100000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// 4 keys per lock, as MSET or a multi-key command takes them
+void BM_MultiScopeRecordLock(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> locked(4);
+  for (auto _ : state) {
+    for (auto& key : locked) {
+      key = keys[rng() % keys.size()];
+    }
+    pstd::lock::MultiScopeRecordLock l(g_lock_mgr, locked);
+  }
+  state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_MultiScopeRecordLock)->Arg(16)->Arg(100000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// The cache holds half of the keys, looked up 3 times for 1 update as the statistics of the keys are.
+// range(1) is the number of shards, 1 being a single mutex as the former LRUCache.
+std::unique_ptr<storage::ShardedCache<uint64_t>> g_cache;
+
+void BM_ShardedCache(benchmark::State& state) {
+  auto keys = MakeKeys(state.range(0));
+  if (state.thread_index() == 0) {
+    g_cache = std::make_unique<storage::ShardedCache<uint64_t>>(state.range(1));
+    g_cache->SetCapacity(keys.size() / 2);
+  }
+  std::mt19937_64 rng(state.thread_index());
+  uint64_t value = 0;
+  for (auto _ : state) {
+    auto n = rng();
+    const auto& key = keys[n % keys.size()];
+    if (n % 4 == 0) {
+      g_cache->Update(key, [](uint64_t& count) { count++; });
+    } else {
+      g_cache->Lookup(key, &value);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ShardedCache)
+    ->ArgsProduct({{16, 100000}, {1, storage::ShardedCache<uint64_t>::kDefaultShards}})
+    ->ThreadRange(1, kMaxThreads)
+    ->UseRealTime();
+
+// Merging iterator over the db instances, the first 100 of range(0) strings, as SCAN reads them
+
+storage::Storage* g_db = nullptr;
+
+// One key in each db instance, by index
+std::vector<std::string> InstanceKeys() {
+  std::vector<std::string> keys(g_db->GetDBInstanceNum());
+  size_t found = 0;
+  for (int i = 0; found < keys.size(); i++) {
+    auto key = fmt::format("probe:{}", i);
+    auto& slot = keys[g_db->GetDBInstance(key)->GetIndex()];
+    if (slot.empty()) {
+      slot = key;
+      found++;
+    }
+  }
+  return keys;
+}
+
+void BM_MergingIterator(benchmark::State& state) {
+  static int64_t populated = 0;
+  if (state.thread_index() == 0 && populated < state.range(0)) {
+    for (auto i = populated; i < state.range(0); i++) {
+      g_db->Set(fmt::format("string:{:012}", i), "v");
+    }
+    populated = state.range(0);
+  }
+  auto instance_keys = InstanceKeys();
+  std::vector<storage::IterSptr> iters(instance_keys.size());
+  int64_t keys = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < iters.size(); i++) {
+      iters[i].reset(g_db->GetDBInstance(instance_keys[i])->CreateIterator(storage::kStrings, "*", nullptr, nullptr));
+    }
+    storage::MergingIterator miter(iters);
+    for (int n = 0; miter.Valid() && n < 100; n++, keys++) {
+      benchmark::DoNotOptimize(miter.Key());
+      miter.Next();
+    }
+  }
+  state.SetItemsProcessed(keys);
+}
+BENCHMARK(BM_MergingIterator)->Arg(1000)->Arg(100000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  const char* path_env = std::getenv("CORE_BENCH_PATH");
+  std::string db_path = path_env != nullptr ? path_env : "/dev/shm/core_bench";
+  std::filesystem::remove_all(db_path);
+  mkdir(db_path.c_str(), 0755);
+  logger::Init((db_path + ".log").c_str());
+
+  storage::StorageOptions options;
+  options.options.create_if_missing = true;
+  options.db_instance_num = 3;
+  storage::Storage db;
+  auto s = db.Open(options, db_path);
+  if (!s.ok()) {
+    fmt::print(stderr, "open {} failed: {}\n", db_path, s.ToString());
+    return 1;
+  }
+  g_db = &db;
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  db.Close();
+  std::filesystem::remove_all(db_path);
+  return 0;
+}
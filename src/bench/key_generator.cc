@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "key_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pikiwidb {
+
+KeyGenerator::KeyGenerator(Distribution distribution, uint64_t keyspace, double theta)
+    : distribution_(distribution), keyspace_(std::max<uint64_t>(keyspace, 1)) {
+  if (distribution_ == Distribution::kZipfian) {
+    theta_ = theta;
+    zeta_n_ = Zeta(keyspace_, theta_);
+    alpha_ = 1 / (1 - theta_);
+    eta_ = (1 - std::pow(2.0 / static_cast<double>(keyspace_), 1 - theta_)) / (1 - Zeta(2, theta_) / zeta_n_);
+  }
+}
+
+double KeyGenerator::Zeta(uint64_t n, double theta) {
+  double sum = 0;
+  for (uint64_t i = 1; i <= n; i++) {
+    sum += 1 / std::pow(static_cast<double>(i), theta);
+  }
+  return sum;
+}
+
+uint64_t KeyGenerator::Next(std::mt19937_64& engine) const {
+  if (distribution_ == Distribution::kUniform) {
+    return std::uniform_int_distribution<uint64_t>(0, keyspace_ - 1)(engine);
+  }
+
+  double u = std::uniform_real_distribution<double>(0, 1)(engine);
+  double uz = u * zeta_n_;
+  if (uz < 1) {
+    return 0;
+  }
+  if (uz < 1 + std::pow(0.5, theta_)) {
+    return std::min<uint64_t>(1, keyspace_ - 1);
+  }
+  auto index = static_cast<uint64_t>(static_cast<double>(keyspace_) * std::pow(eta_ * u - eta_ + 1, alpha_));
+  return std::min(index, keyspace_ - 1);
+}
+
+}  // namespace pikiwidb
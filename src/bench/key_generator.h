@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+namespace pikiwidb {
+
+/*
+ * Draws the indexes of the keys of the requests in [0, keyspace), uniformly or
+ * following a Zipfian distribution of which index 0 is the hottest, as YCSB
+ * does after "Quickly Generating Billion-Record Synthetic Databases" by Gray et
+ * al. It is immutable once built, the threads draw with their own engine.
+ */
+class KeyGenerator {
+ public:
+  enum class Distribution { kUniform, kZipfian };
+
+  // theta is the skew of the Zipfian distribution, in (0, 1)
+  KeyGenerator(Distribution distribution, uint64_t keyspace, double theta);
+
+  uint64_t Next(std::mt19937_64& engine) const;
+
+ private:
+  static double Zeta(uint64_t n, double theta);
+
+  Distribution distribution_;
+  uint64_t keyspace_;
+  double theta_ = 0;
+  double zeta_n_ = 0;
+  double alpha_ = 0;
+  double eta_ = 0;
+};
+
+}  // namespace pikiwidb
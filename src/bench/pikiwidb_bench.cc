@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// pikiwidb-bench: a RESP load generator, sending a mix of commands over
+// pipelined connections for a while and reporting the throughput and the
+// latency percentiles of the replies.
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/core.h"
+#include "pstd/log.h"
+#include "pstd/pstd_histogram.h"
+
+#include "bench_worker.h"
+#include "key_generator.h"
+
+namespace {
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 9221;
+  int clients = 50;
+  int threads = 1;
+  int pipeline = 1;
+  int duration_s = 10;
+  int value_size = 64;
+  uint64_t keyspace = 100000;
+  pikiwidb::KeyGenerator::Distribution distribution = pikiwidb::KeyGenerator::Distribution::kUniform;
+  double zipf_theta = 0.99;
+  std::string mix = "set:1,get:1";
+};
+
+void Usage() {
+  std::cerr << "Usage:  ./pikiwidb-bench [options]\n\
+Options:\n\
+  --host <ip>              address of the server, default 127.0.0.1\n\
+  --port <port>            port of the server, default 9221\n\
+  --clients <n>            connections, default 50\n\
+  --threads <n>            event loops the connections are spread over, default 1\n\
+  --pipeline <n>           requests in flight per connection, default 1\n\
+  --duration <seconds>     default 10\n\
+  --value-size <bytes>     size of the values written, default 64\n\
+  --keyspace <n>           keys of each type, default 100000\n\
+  --distribution <name>    of the keys, uniform or zipfian, default uniform\n\
+  --zipf-theta <theta>     skew of the zipfian distribution in (0, 1), default 0.99\n\
+  --mix <cmd:weight,...>   commands sent and their weights, default set:1,get:1, of\n\
+                           ping set get incr hset hget lpush lpop sadd zadd\n\
+The log of the connections is written to ./pikiwidb-bench.log.\n";
+}
+
+template <typename T>
+bool ParseNumber(std::string_view str, T* value) {
+  auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), *value);
+  return ec == std::errc() && end == str.data() + str.size();
+}
+
+bool ParseArgs(int ac, char* av[], Options* options) {
+  for (int i = 0; i < ac; i++) {
+    std::string_view option(av[i]);
+    if (option == "-h" || option == "--help") {
+      Usage();
+      exit(0);
+    }
+    if (++i == ac) {
+      std::cerr << "Missing the value of " << option << std::endl;
+      return false;
+    }
+    std::string_view value(av[i]);
+
+    bool ok = true;
+    if (option == "--host") {
+      options->host = value;
+    } else if (option == "--port") {
+      ok = ParseNumber(value, &options->port) && options->port > 0 && options->port < 65536;
+    } else if (option == "--clients") {
+      ok = ParseNumber(value, &options->clients) && options->clients > 0;
+    } else if (option == "--threads") {
+      ok = ParseNumber(value, &options->threads) && options->threads > 0;
+    } else if (option == "--pipeline") {
+      ok = ParseNumber(value, &options->pipeline) && options->pipeline > 0;
+    } else if (option == "--duration") {
+      ok = ParseNumber(value, &options->duration_s) && options->duration_s > 0;
+    } else if (option == "--value-size") {
+      ok = ParseNumber(value, &options->value_size) && options->value_size >= 0;
+    } else if (option == "--keyspace") {
+      ok = ParseNumber(value, &options->keyspace) && options->keyspace > 0;
+    } else if (option == "--distribution") {
+      if (value == "uniform") {
+        options->distribution = pikiwidb::KeyGenerator::Distribution::kUniform;
+      } else if (value == "zipfian") {
+        options->distribution = pikiwidb::KeyGenerator::Distribution::kZipfian;
+      } else {
+        ok = false;
+      }
+    } else if (option == "--zipf-theta") {
+      options->zipf_theta = std::strtod(av[i], nullptr);
+      ok = options->zipf_theta > 0 && options->zipf_theta < 1;
+    } else if (option == "--mix") {
+      options->mix = value;
+    } else {
+      std::cerr << "Unknow option " << option << std::endl;
+      return false;
+    }
+
+    if (!ok) {
+      std::cerr << "Invalid value " << value << " of " << option << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ParseMix(std::string_view mix, std::vector<std::pair<pikiwidb::BenchCommand, uint32_t>>* commands) {
+  while (!mix.empty()) {
+    auto comma = mix.find(',');
+    auto item = mix.substr(0, comma);
+    mix = comma == std::string_view::npos ? std::string_view() : mix.substr(comma + 1);
+
+    auto colon = item.find(':');
+    uint32_t weight = 1;
+    if (colon != std::string_view::npos && !ParseNumber(item.substr(colon + 1), &weight)) {
+      return false;
+    }
+    auto cmd = pikiwidb::BenchCommandOf(item.substr(0, colon));
+    if (cmd == pikiwidb::kBenchCommandNum) {
+      return false;
+    }
+    if (weight > 0) {
+      commands->emplace_back(cmd, weight);
+    }
+  }
+  return !commands->empty();
+}
+
+void PrintLatencies(const char* name, const pstd::HistogramSnapshot& snapshot, uint64_t errors) {
+  if (snapshot.Count() == 0) {
+    return;
+  }
+  fmt::print("{:<8} {:>12} {:>8} {:>10.1f} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}\n", name, snapshot.Count(), errors,
+             static_cast<double>(snapshot.Sum()) / static_cast<double>(snapshot.Count()), snapshot.Percentile(50),
+             snapshot.Percentile(90), snapshot.Percentile(99), snapshot.Percentile(99.9), snapshot.Percentile(99.99),
+             snapshot.Percentile(100));
+}
+
+}  // namespace
+
+int main(int ac, char* av[]) {
+  Options options;
+  if (!ParseArgs(ac - 1, av + 1, &options)) {
+    Usage();
+    return 1;
+  }
+
+  pikiwidb::BenchWorkload workload;
+  if (!ParseMix(options.mix, &workload.mix)) {
+    std::cerr << "Invalid command mix " << options.mix << std::endl;
+    return 1;
+  }
+  logger::Init("./pikiwidb-bench.log");
+
+  pikiwidb::KeyGenerator keys(options.distribution, options.keyspace, options.zipf_theta);
+  workload.host = options.host;
+  workload.port = options.port;
+  workload.pipeline = options.pipeline;
+  workload.value.assign(options.value_size, 'x');
+  workload.keys = &keys;
+  auto start = std::chrono::steady_clock::now();
+  workload.end = start + std::chrono::seconds(options.duration_s);
+
+  // the connections spread evenly over the threads
+  int threads = std::min(options.threads, options.clients);
+  std::vector<std::unique_ptr<pikiwidb::BenchWorker>> workers;
+  for (int i = 0; i < threads; i++) {
+    int connections = options.clients / threads + (i < options.clients % threads ? 1 : 0);
+    workers.push_back(std::make_unique<pikiwidb::BenchWorker>(workload, connections, i + 1));
+  }
+  for (auto& worker : workers) {
+    worker->Start();
+  }
+
+  auto replies = [&workers] {
+    uint64_t replies = 0;
+    for (const auto& worker : workers) {
+      replies += worker->Replies();
+    }
+    return replies;
+  };
+  uint64_t last_replies = 0;
+  for (int second = 1; second <= options.duration_s; second++) {
+    std::this_thread::sleep_until(start + std::chrono::seconds(second));
+    auto now_replies = replies();
+    fmt::print("{:>4}s {:>12.0f} requests/s\n", second, static_cast<double>(now_replies - last_replies));
+    last_replies = now_replies;
+  }
+  for (auto& worker : workers) {
+    worker->Join();
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::array<pstd::HistogramSnapshot, pikiwidb::kBenchCommandNum> snapshots;
+  std::array<uint64_t, pikiwidb::kBenchCommandNum> errors{};
+  pstd::HistogramSnapshot all;
+  uint64_t all_errors = 0;
+  int failed_connections = 0;
+  int lost_connections = 0;
+  for (const auto& worker : workers) {
+    for (int i = 0; i < pikiwidb::kBenchCommandNum; i++) {
+      auto cmd = static_cast<pikiwidb::BenchCommand>(i);
+      snapshots[i].Merge(worker->GetHistogram(cmd));
+      all.Merge(worker->GetHistogram(cmd));
+      errors[i] += worker->GetErrors(cmd);
+      all_errors += worker->GetErrors(cmd);
+    }
+    failed_connections += worker->FailedConnections();
+    lost_connections += worker->LostConnections();
+  }
+
+  fmt::print("\n{} requests in {:.2f}s over {} connections with {} in flight each: {:.0f} requests/s\n", all.Count(),
+             elapsed, options.clients - failed_connections, options.pipeline,
+             static_cast<double>(all.Count()) / elapsed);
+  if (failed_connections > 0 || lost_connections > 0) {
+    fmt::print("{} connections failed, {} were lost\n", failed_connections, lost_connections);
+  }
+  fmt::print("\nlatencies in usec\n{:<8} {:>12} {:>8} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}\n", "command",
+             "requests", "errors", "avg", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+  for (int i = 0; i < pikiwidb::kBenchCommandNum; i++) {
+    PrintLatencies(pikiwidb::BenchCommandName(static_cast<pikiwidb::BenchCommand>(i)), snapshots[i], errors[i]);
+  }
+  PrintLatencies("all", all, all_errors);
+
+  return all.Count() > 0 ? 0 : 1;
+}
@@ -0,0 +1,592 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// raft-bench: starts a raft cluster of pikiwidb servers on loopback ports,
+// writes to its leader and reports the commit latencies, the apply lag of the
+// followers, the time a new node takes to install a snapshot and the time the
+// cluster takes to elect a leader again after losing its own.
+//
+// PRaft is a singleton configured by g_config, so the nodes run as child
+// processes rather than in this one.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/core.h"
+#include "pstd/pstd_histogram.h"
+
+#include "bench_worker.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string server = "./pikiwidb";
+  std::string dir = "./raft-bench";
+  int base_port = 18221;
+  int clients = 8;
+  int duration_s = 10;
+  int value_size = 64;
+  uint64_t keyspace = 100000;
+  int timeout_s = 30;
+};
+
+void Usage() {
+  std::cerr << "Usage:  ./raft-bench [options]\n\
+Options:\n\
+  --server <path>          the pikiwidb binary the nodes run, default ./pikiwidb\n\
+  --dir <path>             the data and logs of the nodes, default ./raft-bench\n\
+  --base-port <port>       port of the first node, the others follow by 100, default 18221\n\
+  --clients <n>            connections writing to the leader, default 8\n\
+  --duration <seconds>     of the writes, default 10\n\
+  --value-size <bytes>     size of the values written, default 64\n\
+  --keyspace <n>           keys written, default 100000\n\
+  --timeout <seconds>      to wait for each phase, default 30\n";
+}
+
+template <typename T>
+bool ParseNumber(std::string_view str, T* value) {
+  auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), *value);
+  return ec == std::errc() && end == str.data() + str.size();
+}
+
+bool ParseArgs(int ac, char* av[], Options* options) {
+  for (int i = 0; i < ac; i++) {
+    std::string_view option(av[i]);
+    if (option == "-h" || option == "--help") {
+      Usage();
+      exit(0);
+    }
+    if (++i == ac) {
+      std::cerr << "Missing the value of " << option << std::endl;
+      return false;
+    }
+    std::string_view value(av[i]);
+
+    bool ok = true;
+    if (option == "--server") {
+      options->server = value;
+    } else if (option == "--dir") {
+      options->dir = value;
+    } else if (option == "--base-port") {
+      // the raft port of a node is 10 above its own
+      ok = ParseNumber(value, &options->base_port) && options->base_port > 0 && options->base_port < 65536 - 400;
+    } else if (option == "--clients") {
+      ok = ParseNumber(value, &options->clients) && options->clients > 0;
+    } else if (option == "--duration") {
+      ok = ParseNumber(value, &options->duration_s) && options->duration_s > 0;
+    } else if (option == "--value-size") {
+      ok = ParseNumber(value, &options->value_size) && options->value_size >= 0;
+    } else if (option == "--keyspace") {
+      ok = ParseNumber(value, &options->keyspace) && options->keyspace > 0;
+    } else if (option == "--timeout") {
+      ok = ParseNumber(value, &options->timeout_s) && options->timeout_s > 0;
+    } else {
+      std::cerr << "Unknow option " << option << std::endl;
+      return false;
+    }
+
+    if (!ok) {
+      std::cerr << "Invalid value " << value << " of " << option << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// A blocking connection sending a command at a time
+class RespClient {
+ public:
+  RespClient() = default;
+  ~RespClient() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  RespClient(const RespClient&) = delete;
+  void operator=(const RespClient&) = delete;
+
+  bool Connect(int port) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+      return false;
+    }
+    // a killed node must not block the caller
+    timeval timeout{5, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int nodelay = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  }
+
+  // Sends the command and waits for its reply, false if the connection failed
+  bool Call(const std::vector<std::string>& argv, std::string* reply, bool* is_error) {
+    std::string request = fmt::format("*{}\r\n", argv.size());
+    for (const auto& arg : argv) {
+      request += fmt::format("${}\r\n{}\r\n", arg.size(), arg);
+    }
+    for (size_t sent = 0; sent < request.size();) {
+      auto n = send(fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) {
+        return false;
+      }
+      sent += n;
+    }
+
+    *is_error = false;
+    while (true) {
+      int len = pikiwidb::ParseReply(buffer_.data(), static_cast<int>(buffer_.size()), is_error);
+      if (len < 0) {
+        return false;
+      }
+      if (len > 0) {
+        reply->assign(buffer_, 0, len);
+        buffer_.erase(0, len);
+        return true;
+      }
+      char data[16 * 1024];
+      auto n = recv(fd_, data, sizeof(data), 0);
+      if (n <= 0) {
+        return false;
+      }
+      buffer_.append(data, n);
+    }
+  }
+
+ private:
+  int fd_ = -1;
+  std::string buffer_;
+};
+
+// Calls the command on a connection of its own, true if it replied without an error
+bool CallOnce(int port, const std::vector<std::string>& argv, std::string* reply = nullptr) {
+  RespClient client;
+  std::string result;
+  bool is_error = false;
+  if (!client.Connect(port) || !client.Call(argv, &result, &is_error)) {
+    return false;
+  }
+  if (reply) {
+    *reply = std::move(result);
+  }
+  return !is_error;
+}
+
+// The fields of INFO raft the harness follows, those of the first raft group
+struct RaftInfo {
+  std::string role;
+  std::string leader_id;
+  int64_t first_index = 0;
+  int64_t committed_index = 0;
+  int64_t applied_index = 0;
+
+  bool IsLeader() const { return strcasecmp(role.c_str(), "leader") == 0; }
+};
+
+bool GetRaftInfo(int port, RaftInfo* info) {
+  std::string reply;
+  if (!CallOnce(port, {"INFO", "raft"}, &reply) || reply.empty() || reply[0] != '$') {
+    return false;
+  }
+
+  std::string_view text(reply);
+  text.remove_prefix(text.find("\r\n") + 2);
+  while (!text.empty()) {
+    auto line = text.substr(0, text.find("\r\n"));
+    text.remove_prefix(std::min(text.size(), line.size() + 2));
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    auto key = line.substr(0, colon);
+    auto value = line.substr(colon + 1);
+    if (key == "raft_role") {
+      info->role = value;
+    } else if (key == "raft_leader_id") {
+      info->leader_id = value;
+    } else if (key == "raft_first_index") {
+      ParseNumber(value, &info->first_index);
+    } else if (key == "raft_committed_index") {
+      ParseNumber(value, &info->committed_index);
+    } else if (key == "raft_applied_index") {
+      ParseNumber(value, &info->applied_index);
+    }
+  }
+  return true;
+}
+
+// Polls until done returns true, the time it took or nothing after the timeout
+std::optional<Clock::duration> WaitFor(const std::function<bool()>& done, std::chrono::seconds timeout) {
+  auto start = Clock::now();
+  while (!done()) {
+    if (Clock::now() - start > timeout) {
+      return std::nullopt;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return Clock::now() - start;
+}
+
+double ToMillis(Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+struct Node {
+  int port = 0;
+  std::string dir;
+  pid_t pid = -1;
+};
+
+bool StartNode(const Options& options, Node* node) {
+  std::error_code ec;
+  std::filesystem::remove_all(node->dir, ec);
+  std::filesystem::create_directories(node->dir, ec);
+  if (ec) {
+    std::cerr << "Failed to create " << node->dir << ": " << ec.message() << std::endl;
+    return false;
+  }
+
+  // INFO raft reports the first group only
+  auto conf = node->dir + "/pikiwidb.conf";
+  std::ofstream(conf) << fmt::format(
+      "port {}\ndb-path {}/db/\nuse-raft yes\nraft-group-num 1\nraft-port-offset 10\ndaemonize no\n", node->port,
+      node->dir);
+
+  // or the child flushes what is buffered too
+  fflush(nullptr);
+  node->pid = fork();
+  if (node->pid < 0) {
+    std::cerr << "Failed to fork: " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (node->pid == 0) {
+    auto out = node->dir + "/stdout.log";
+    if (freopen(out.c_str(), "w", stdout) && freopen(out.c_str(), "a", stderr)) {
+      execl(options.server.c_str(), options.server.c_str(), conf.c_str(), nullptr);
+    }
+    _exit(127);
+  }
+
+  if (!WaitFor([node] { return CallOnce(node->port, {"PING"}); }, std::chrono::seconds(options.timeout_s))) {
+    std::cerr << "The node on port " << node->port << " did not start, see " << node->dir << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void StopNode(Node* node, int sig) {
+  if (node->pid > 0) {
+    kill(node->pid, sig);
+    waitpid(node->pid, nullptr, 0);
+    node->pid = -1;
+  }
+}
+
+// The running node which leads the cluster, nullptr if none does
+Node* FindLeader(std::vector<Node>& nodes) {
+  for (auto& node : nodes) {
+    RaftInfo info;
+    if (node.pid > 0 && GetRaftInfo(node.port, &info) && info.IsLeader()) {
+      return &node;
+    }
+  }
+  return nullptr;
+}
+
+bool Join(const Node& node, const Node& leader) {
+  std::string reply;
+  if (!CallOnce(node.port, {"RAFT.CLUSTER", "JOIN", fmt::format("127.0.0.1:{}", leader.port)}, &reply)) {
+    std::cerr << "The node on port " << node.port << " failed to join: " << reply << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Whether every running node but the leader applied the log up to index
+bool FollowersApplied(const std::vector<Node>& nodes, const Node* leader, int64_t index) {
+  for (const auto& node : nodes) {
+    RaftInfo info;
+    if (&node != leader && node.pid > 0 && (!GetRaftInfo(node.port, &info) || info.applied_index < index)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PrintLatencies(const char* name, const pstd::HistogramSnapshot& snapshot, const char* unit) {
+  if (snapshot.Count() == 0) {
+    fmt::print("{:<22} none\n", name);
+    return;
+  }
+  fmt::print("{:<22} {:>10} {:>10.1f} {:>8} {:>8} {:>8} {:>8} {:>8}  {}\n", name, snapshot.Count(),
+             static_cast<double>(snapshot.Sum()) / static_cast<double>(snapshot.Count()), snapshot.Percentile(50),
+             snapshot.Percentile(90), snapshot.Percentile(99), snapshot.Percentile(99.9), snapshot.Percentile(100),
+             unit);
+}
+
+/*
+ * Writes SETs of random keys to the leader on options.clients connections
+ * until end, a request at a time, recording the latencies of the replies in
+ * microseconds. A write is replied once committed and applied by the leader.
+ */
+class Writers {
+ public:
+  Writers(const Options& options, int port, Clock::time_point end) {
+    for (int i = 0; i < options.clients; i++) {
+      histograms_.push_back(std::make_unique<pstd::Histogram>());
+    }
+    for (int i = 0; i < options.clients; i++) {
+      threads_.emplace_back([this, &options, port, end, i] { Write(options, port, end, i); });
+    }
+  }
+
+  ~Writers() { Join(); }
+
+  void Join() {
+    for (auto& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+  uint64_t Writes() const { return writes_.load(std::memory_order_relaxed); }
+  uint64_t Errors() const { return errors_.load(std::memory_order_relaxed); }
+
+  pstd::HistogramSnapshot Latencies() const {
+    pstd::HistogramSnapshot snapshot;
+    for (const auto& histogram : histograms_) {
+      snapshot.Merge(*histogram);
+    }
+    return snapshot;
+  }
+
+ private:
+  void Write(const Options& options, int port, Clock::time_point end, int i) {
+    RespClient client;
+    if (!client.Connect(port)) {
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    std::mt19937_64 random(i + 1);
+    std::uniform_int_distribution<uint64_t> keys(0, options.keyspace - 1);
+    std::vector<std::string> argv{"SET", "", std::string(options.value_size, 'x')};
+    std::string reply;
+    while (Clock::now() < end) {
+      argv[1] = fmt::format("key:{}", keys(random));
+      auto start = Clock::now();
+      bool is_error = false;
+      if (!client.Call(argv, &reply, &is_error)) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (is_error) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      histograms_[i]->Record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+      writes_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  std::vector<std::unique_ptr<pstd::Histogram>> histograms_;
+  std::vector<std::thread> threads_;
+  std::atomic<uint64_t> writes_ = 0;
+  std::atomic<uint64_t> errors_ = 0;
+};
+
+int Run(const Options& options, std::vector<Node>& nodes) {
+  const std::chrono::seconds timeout(options.timeout_s);
+
+  // three nodes, the first of which initializes the cluster
+  for (int i = 0; i < 3; i++) {
+    if (!StartNode(options, &nodes[i])) {
+      return 1;
+    }
+  }
+  if (!CallOnce(nodes[0].port, {"RAFT.CLUSTER", "INIT"})) {
+    std::cerr << "Failed to initialize the cluster" << std::endl;
+    return 1;
+  }
+  if (!WaitFor([&nodes] { return FindLeader(nodes) == &nodes[0]; }, timeout)) {
+    std::cerr << "The first node did not become the leader" << std::endl;
+    return 1;
+  }
+  for (int i = 1; i < 3; i++) {
+    if (!Join(nodes[i], nodes[0])) {
+      return 1;
+    }
+  }
+  Node* leader = &nodes[0];
+  fmt::print("cluster of 3 nodes on ports {}, {} and {}, writing to {} for {}s\n", nodes[0].port, nodes[1].port,
+             nodes[2].port, leader->port, options.duration_s);
+
+  // the writes, sampling how many entries each follower is behind the leader meanwhile
+  auto start = Clock::now();
+  pstd::Histogram lag;
+  {
+    Writers writers(options, leader->port, start + std::chrono::seconds(options.duration_s));
+    while (Clock::now() < start + std::chrono::seconds(options.duration_s)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      RaftInfo leader_info;
+      if (!GetRaftInfo(leader->port, &leader_info)) {
+        continue;
+      }
+      for (const auto& node : nodes) {
+        RaftInfo info;
+        if (&node != leader && node.pid > 0 && GetRaftInfo(node.port, &info)) {
+          lag.Record(std::max<int64_t>(leader_info.committed_index - info.applied_index, 0));
+        }
+      }
+    }
+    writers.Join();
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    fmt::print("\n{} writes in {:.2f}s over {} connections: {:.0f} writes/s, {} errors\n", writers.Writes(), elapsed,
+               options.clients, static_cast<double>(writers.Writes()) / elapsed, writers.Errors());
+    fmt::print("\n{:<22} {:>10} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8}\n", "", "samples", "avg", "p50", "p90", "p99",
+               "p99.9", "max");
+    PrintLatencies("commit latency", writers.Latencies(), "usec");
+  }
+  pstd::HistogramSnapshot lag_snapshot;
+  lag_snapshot.Merge(lag);
+  PrintLatencies("follower apply lag", lag_snapshot, "entries");
+
+  // how long the followers take to apply what the leader committed once the writes stop
+  RaftInfo leader_info;
+  if (!GetRaftInfo(leader->port, &leader_info)) {
+    std::cerr << "Lost the leader" << std::endl;
+    return 1;
+  }
+  auto drained = WaitFor([&] { return FollowersApplied(nodes, leader, leader_info.committed_index); }, timeout);
+  if (!drained) {
+    std::cerr << "The followers did not catch up with index " << leader_info.committed_index << std::endl;
+    return 1;
+  }
+  fmt::print("\nfollowers applied up to index {} {:.1f}ms after the writes\n", leader_info.committed_index,
+             ToMillis(*drained));
+
+  /*
+   * A new node installs a snapshot when the leader no longer has the first
+   * entries of its log. braft keeps the log since the snapshot before last,
+   * so the leader snapshots twice with writes between.
+   */
+  auto snapshot_start = Clock::now();
+  if (!CallOnce(leader->port, {"RAFT.NODE", "DOSNAPSHOT"})) {
+    std::cerr << "Failed to snapshot the leader" << std::endl;
+    return 1;
+  }
+  fmt::print("\nleader snapshot taken in {:.1f}ms\n", ToMillis(Clock::now() - snapshot_start));
+  {
+    Writers writers(options, leader->port, Clock::now() + std::chrono::seconds(1));
+  }
+  if (!CallOnce(leader->port, {"RAFT.NODE", "DOSNAPSHOT"}) || !GetRaftInfo(leader->port, &leader_info)) {
+    std::cerr << "Failed to snapshot the leader" << std::endl;
+    return 1;
+  }
+  if (leader_info.first_index <= 1) {
+    fmt::print("the leader kept its whole log, the new node replays it rather than installing a snapshot\n");
+  }
+
+  Node& newcomer = nodes[3];
+  if (!StartNode(options, &newcomer)) {
+    return 1;
+  }
+  auto join_start = Clock::now();
+  if (!Join(newcomer, *leader)) {
+    return 1;
+  }
+  auto installed = WaitFor(
+      [&] {
+        RaftInfo info;
+        return GetRaftInfo(newcomer.port, &info) && info.applied_index >= leader_info.committed_index;
+      },
+      timeout);
+  if (!installed) {
+    std::cerr << "The new node did not catch up with index " << leader_info.committed_index << std::endl;
+    return 1;
+  }
+  fmt::print("new node caught up with index {} (log from {}) {:.1f}ms after joining\n", leader_info.committed_index,
+             leader_info.first_index, ToMillis(Clock::now() - join_start));
+
+  // the leader is killed, three of the four nodes are left to elect another
+  auto failover_start = Clock::now();
+  StopNode(leader, SIGKILL);
+  Node* new_leader = nullptr;
+  auto elected = WaitFor([&] { return (new_leader = FindLeader(nodes)) != nullptr; }, timeout);
+  if (!elected) {
+    std::cerr << "No leader was elected after killing the one on port " << leader->port << std::endl;
+    return 1;
+  }
+  auto writable = WaitFor([&] { return CallOnce(new_leader->port, {"SET", "failover", "1"}); }, timeout);
+  if (!writable) {
+    std::cerr << "The new leader on port " << new_leader->port << " did not accept writes" << std::endl;
+    return 1;
+  }
+  fmt::print("\nleader on port {} killed, {} elected in {:.1f}ms, accepting writes after {:.1f}ms\n", leader->port,
+             new_leader->port, ToMillis(*elected), ToMillis(Clock::now() - failover_start));
+
+  return 0;
+}
+
+}  // namespace
+
+int main(int ac, char* av[]) {
+  Options options;
+  if (!ParseArgs(ac - 1, av + 1, &options)) {
+    Usage();
+    return 1;
+  }
+
+  std::vector<Node> nodes(4);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    nodes[i].port = options.base_port + static_cast<int>(i) * 100;
+    nodes[i].dir = fmt::format("{}/node{}", options.dir, i);
+  }
+
+  int ret = Run(options, nodes);
+  for (auto& node : nodes) {
+    StopNode(&node, SIGTERM);
+  }
+  if (ret != 0) {
+    std::cerr << "The logs of the nodes are under " << options.dir << std::endl;
+  }
+  return ret;
+}
@@ -7,7 +7,13 @@
 
 #include "client.h"
 
+#include <sys/time.h>
+
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <functional>
 #include <memory>
 
 #include "fmt/core.h"
@@ -16,8 +22,10 @@
 #include "pstd/pstd_string.h"
 
 #include "base_cmd.h"
+#include "cmd_stats.h"
 #include "config.h"
 #include "pikiwidb.h"
+#include "slow_log.h"
 
 namespace pikiwidb {
 
@@ -145,8 +153,19 @@ CmdRes::~CmdRes() { message_.clear(); }
 
 thread_local PClient* PClient::s_current = nullptr;
 
-std::mutex monitors_mutex;
-std::set<std::weak_ptr<PClient>, std::owner_less<std::weak_ptr<PClient> > > monitors;
+// The monitors, copied on write so that the commands are fed to them without a lock
+using MonitorList = std::vector<std::weak_ptr<PClient>>;
+static std::mutex monitors_mutex;  // serializes the updates of monitors
+static std::shared_ptr<const MonitorList> monitors = std::make_shared<MonitorList>();
+static std::atomic<size_t> monitor_num = 0;
+static std::atomic<uint64_t> monitor_dropped_entries = 0;
+
+struct PClient::MonitorEntry {
+  timeval time;
+  int db;
+  std::string addr;  // of the client which sent the command
+  std::vector<std::string> params;
+};
 
 void PClient::SetSubCmdName(const std::string& name) {
   subCmdName_ = name;
@@ -262,6 +281,7 @@ int PClient::handlePacket(const char* start, int bytes) {
   }
 
   s_current = this;
+  trace_.received = RequestTrace::Now();
 
   const char* const end = start + bytes;
   const char* ptr = start;
@@ -339,7 +359,9 @@ int PClient::handlePacket(const char* start, int bytes) {
 
   DEBUG("client {}, cmd {}", conn->GetUniqueId(), cmdName_);
 
-  FeedMonitors(params_);
+  if (cmdName_ != kCmdNameAuth) {  // the password is not for the monitors
+    FeedMonitors(params_);
+  }
 
   //  const PCommandInfo* info = PCommandTable::GetCommandInfo(cmdName_);
 
@@ -348,6 +370,8 @@ int PClient::handlePacket(const char* start, int bytes) {
   //    return static_cast<int>(ptr - start);
   //  }
 
+  trace_.queued = RequestTrace::Now();
+  serving_.store(true, std::memory_order_relaxed);
   g_pikiwidb->SubmitFast(std::make_shared<CmdThreadPoolTask>(shared_from_this()));
 
   // check transaction
@@ -415,6 +439,30 @@ void PClient::executeCommand() {
 
 PClient* PClient::Current() { return s_current; }
 
+std::optional<RaftReadMode> ParseRaftReadMode(const std::string& mode) {
+  if (pstd::StringEqualCaseInsensitive(mode, "stale")) {
+    return RaftReadMode::kStale;
+  }
+  if (pstd::StringEqualCaseInsensitive(mode, "readindex")) {
+    return RaftReadMode::kReadIndex;
+  }
+  if (pstd::StringEqualCaseInsensitive(mode, "lease")) {
+    return RaftReadMode::kLease;
+  }
+  return std::nullopt;
+}
+
+const char* RaftReadModeName(RaftReadMode mode) {
+  switch (mode) {
+    case RaftReadMode::kReadIndex:
+      return "readindex";
+    case RaftReadMode::kLease:
+      return "lease";
+    default:
+      return "stale";
+  }
+}
+
 PClient::PClient(TcpConnection* obj)
     : tcp_connection_(std::static_pointer_cast<TcpConnection>(obj->shared_from_this())),
       dbno_(0),
@@ -422,12 +470,13 @@ PClient::PClient(TcpConnection* obj)
       name_("clientxxx"),
       parser_(params_) {
   auth_ = false;
+  raft_read_mode_ = ParseRaftReadMode(g_config.raft_read_mode.ToString()).value_or(RaftReadMode::kStale);
   reset();
 }
 
 int PClient::HandlePackets(pikiwidb::TcpConnection* obj, const char* start, int size) {
   int total = 0;
-  while (total < size) {
+  while (total < size && !serving_.load(std::memory_order_acquire)) {
     auto processed = handlePacket(start + total, size - total);
     if (processed <= 0) {
       break;
@@ -514,11 +563,49 @@ bool PClient::SendPacket(const evbuffer_iovec* iovecs, size_t nvecs) {
 }
 
 void PClient::WriteReply2Client() {
-  if (auto c = getTcpConnection(); c) {
+  auto c = getTcpConnection();
+  if (c) {
     c->SendPacket(Message());
   }
   Clear();
   reset();
+  traceRequest();
+
+  // the commands pipelined after this one are handled in the loop, after its reply is sent
+  serving_.store(false, std::memory_order_release);
+  if (c) {
+    c->HandleUnconsumedData();
+  }
+}
+
+void PClient::traceRequest() {
+  if (!serving_.load(std::memory_order_acquire) || trace_.received == 0 || trace_.queued == 0 ||
+      trace_.started == 0 || trace_.executed == 0 || trace_.replied == 0) {
+    trace_ = RequestTrace();
+    return;  // not served by the cmd thread pool
+  }
+  auto elapsed = [](int64_t from, int64_t to) { return static_cast<uint64_t>(std::max<int64_t>(to - from, 0)); };
+  auto now = RequestTrace::Now();
+  std::array<uint64_t, kRequestStageNum> stages{};
+  stages[kRequestStageParse] = elapsed(trace_.received, trace_.queued);
+  stages[kRequestStageQueue] = elapsed(trace_.queued, trace_.started);
+  stages[kRequestStageExecute] = elapsed(trace_.started, trace_.executed);
+  stages[kRequestStageCommit] = elapsed(trace_.executed, trace_.replied);
+  stages[kRequestStageWriteOut] = elapsed(trace_.replied, now);
+  auto used = elapsed(trace_.received, now);
+  std::optional<PerfCounters> perf;
+  if (trace_.profiled) {
+    perf = trace_.perf;
+  }
+  trace_ = RequestTrace();
+
+  auto& stats = CmdStats::Instance();
+  for (int stage = 0; stage < kRequestStageNum; stage++) {
+    stats.RecordStage(static_cast<RequestStage>(stage), stages[stage]);
+  }
+  if (PSlowLog::Instance().IsSlow(used)) {
+    PSlowLog::Instance().Record(params_, used, stages, perf, PeerIP() + ":" + std::to_string(PeerPort()), name_);
+  }
 }
 
 void PClient::Close() {
@@ -661,52 +748,137 @@ void PClient::TransferToSlaveThreads() {
   }
 }
 
-void PClient::AddCurrentToMonitor() {
-  std::unique_lock<std::mutex> guard(monitors_mutex);
-  monitors.insert(std::static_pointer_cast<PClient>(s_current->shared_from_this()));
+// Replaces the monitors by those still connected and accepted by keep, under monitors_mutex
+static void UpdateMonitors(const std::function<bool(const PClient&)>& keep, std::shared_ptr<PClient> added) {
+  auto list = std::make_shared<MonitorList>();
+  for (const auto& m : *monitors) {
+    if (auto monitor = m.lock(); monitor && keep(*monitor)) {
+      list->push_back(monitor);
+    }
+  }
+  if (added) {
+    list->push_back(added);
+  }
+  monitor_num.store(list->size(), std::memory_order_relaxed);
+  std::atomic_store_explicit(&monitors, std::shared_ptr<const MonitorList>(std::move(list)), std::memory_order_release);
+}
+
+void PClient::AddMonitor(PClient* client) {
+  // sent before any command fed, which the loop of the connection sends after
+  client->SendPacket("+OK" CRLF);
+
+  std::lock_guard guard(monitors_mutex);
+  UpdateMonitors([client](const PClient& monitor) { return &monitor != client; }, client->shared_from_this());
 }
 
 void PClient::FeedMonitors(const std::vector<std::string>& params) {
   assert(!params.empty());
 
-  {
-    std::unique_lock<std::mutex> guard(monitors_mutex);
-    if (monitors.empty()) {
-      return;
-    }
+  if (monitor_num.load(std::memory_order_relaxed) == 0) {
+    return;
   }
 
-  char buf[512];
-  int n = snprintf(buf, sizeof buf, "+[db%d %s:%d]: \"", s_current->GetCurrentDB(), s_current->PeerIP().c_str(),
-                   s_current->PeerPort());
+  // shared by the monitors, each formatting it in its own loop
+  auto entry = std::make_shared<MonitorEntry>();
+  gettimeofday(&entry->time, nullptr);
+  entry->db = s_current->GetCurrentDB();
+  entry->addr = fmt::format("{}:{}", s_current->PeerIP(), s_current->PeerPort());
+  entry->params = params;
 
-  assert(n > 0);
-
-  for (const auto& e : params) {
-    if (n < static_cast<int>(sizeof buf)) {
-      n += snprintf(buf + n, sizeof buf - n, "%s ", e.data());
+  bool expired = false;
+  auto list = std::atomic_load_explicit(&monitors, std::memory_order_acquire);
+  for (const auto& m : *list) {
+    if (auto monitor = m.lock()) {
+      monitor->pushMonitorEntry(entry);
     } else {
-      break;
+      expired = true;
     }
   }
 
-  --n;  // no space follow last param
+  if (expired) {
+    std::lock_guard guard(monitors_mutex);
+    UpdateMonitors([](const PClient&) { return true; }, nullptr);
+  }
+}
+
+size_t PClient::MonitorNum() { return monitor_num.load(std::memory_order_relaxed); }
 
+uint64_t PClient::MonitorDroppedEntries() { return monitor_dropped_entries.load(std::memory_order_relaxed); }
+
+void PClient::pushMonitorEntry(std::shared_ptr<const MonitorEntry> entry) {
   {
-    std::unique_lock<std::mutex> guard(monitors_mutex);
+    std::lock_guard guard(monitor_mutex_);
+    if (monitor_entries_.size() >= kMonitorQueueLimit) {
+      monitor_dropped_entries.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    monitor_entries_.push_back(std::move(entry));
+    if (monitor_draining_) {
+      return;
+    }
+    monitor_draining_ = true;
+  }
 
-    for (auto it(monitors.begin()); it != monitors.end();) {
-      auto m = it->lock();
-      if (m) {
-        m->SendPacket(buf, n);
-        m->SendPacket("\"" CRLF, 3);
+  auto conn = getTcpConnection();
+  if (!conn) {
+    return;  // the monitor is gone, and dropped at the next feed
+  }
+  conn->GetEventLoop()->Execute([weak = weak_from_this()]() {
+    if (auto monitor = weak.lock()) {
+      monitor->drainMonitorEntries();
+    }
+  });
+}
+
+// As redis does, with the non printable characters escaped
+static void AppendQuoted(std::string& message, const std::string& arg) {
+  message.push_back('"');
+  for (auto c : arg) {
+    switch (c) {
+      case '\\':
+      case '"':
+        message.push_back('\\');
+        message.push_back(c);
+        break;
+      case '\n':
+        message.append("\\n");
+        break;
+      case '\r':
+        message.append("\\r");
+        break;
+      case '\t':
+        message.append("\\t");
+        break;
+      default:
+        if (isprint(static_cast<unsigned char>(c))) {
+          message.push_back(c);
+        } else {
+          message.append(fmt::format("\\x{:02x}", static_cast<unsigned char>(c)));
+        }
+    }
+  }
+  message.push_back('"');
+}
 
-        ++it;
-      } else {
-        monitors.erase(it++);
-      }
+void PClient::drainMonitorEntries() {
+  std::vector<std::shared_ptr<const MonitorEntry>> entries;
+  {
+    std::lock_guard guard(monitor_mutex_);
+    entries.swap(monitor_entries_);
+    monitor_draining_ = false;
+  }
+
+  // +1339518083.107412 [0 127.0.0.1:60866] "keys" "*"
+  std::string message;
+  for (const auto& entry : entries) {
+    message += fmt::format("+{}.{:06} [{} {}]", entry->time.tv_sec, entry->time.tv_usec, entry->db, entry->addr);
+    for (const auto& param : entry->params) {
+      message.push_back(' ');
+      AppendQuoted(message, param);
     }
+    message += CRLF;
   }
+  SendPacket(message);
 }
 
 void PClient::SetKey(std::vector<std::string>& names) {
@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <span>
 #include <unordered_map>
@@ -14,6 +18,7 @@
 
 #include "common.h"
 #include "net/tcp_connection.h"
+#include "perf_stats.h"
 #include "proto_parser.h"
 #include "replication.h"
 #include "storage/storage.h"
@@ -107,6 +112,34 @@ enum class ClientState {
   kClosed,
 };
 
+// The steady clock microseconds a request reached each stage, 0 before it did
+struct RequestTrace {
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int64_t received = 0;  // the IO thread starts parsing it
+  int64_t queued = 0;    // it is submitted to the cmd thread pool
+  int64_t started = 0;   // a worker starts running it
+  int64_t executed = 0;  // the worker is done, its raft writes may not be applied yet
+  int64_t replied = 0;   // the reply is queued to a write thread
+
+  bool profiled = false;  // perf holds the rocksdb counters of the command
+  PerfCounters perf{};
+};
+
+// How a read served by a raft follower sees the writes acknowledged before it
+enum class RaftReadMode {
+  kStale,      // reads the local storage as it is
+  kReadIndex,  // waits until the commit index the leader confirmed is applied
+  kLease,      // as kReadIndex, the leader answers from its lease while valid
+};
+
+// Parses stale / readindex / lease, case insensitive
+std::optional<RaftReadMode> ParseRaftReadMode(const std::string& mode);
+const char* RaftReadModeName(RaftReadMode mode);
+
 class DB;
 struct PSlaveInfo;
 
@@ -186,6 +219,7 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
     keys_.emplace_back(name);
   }
   void SetKey(std::vector<std::string>& names);
+  void ClearKeys() { keys_.clear(); }
   const std::string& Key() const { return keys_.at(0); }
   const std::vector<std::string>& Keys() const { return keys_; }
   std::vector<storage::FieldValue>& Fvs() { return fvs_; }
@@ -197,8 +231,13 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
   PSlaveInfo* GetSlaveInfo() const { return slave_info_.get(); }
   void TransferToSlaveThreads();
 
-  static void AddCurrentToMonitor();
+  // MONITOR, the client is sent the commands of every client from now on
+  static void AddMonitor(PClient* client);
+  // Called for each command received, costs an atomic load unless a monitor is attached
   static void FeedMonitors(const std::vector<std::string>& params);
+  static size_t MonitorNum();
+  // The commands not sent to a monitor because too many were already waiting
+  static uint64_t MonitorDroppedEntries();
 
   void SetAuth() { auth_ = true; }
   bool GetAuth() const { return auth_; }
@@ -211,6 +250,11 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
 
   inline void SetState(ClientState state) { state_ = state; }
 
+  RequestTrace& Trace() { return trace_; }
+
+  RaftReadMode GetRaftReadMode() const { return raft_read_mode_; }
+  void SetRaftReadMode(RaftReadMode mode) { raft_read_mode_ = mode; }
+
   // All parameters of this command (including the command itself)
   // e.g：["set","key","value"]
   std::span<std::string> argv_;
@@ -226,6 +270,14 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
 
   bool isClusterCmdTarget() const;
 
+  struct MonitorEntry;
+  // Queues the command for this monitor, dropped if kMonitorQueueLimit are waiting
+  void pushMonitorEntry(std::shared_ptr<const MonitorEntry> entry);
+  // Formats and sends the commands queued, in the loop of the connection
+  void drainMonitorEntries();
+  // Records the stages of the request whose reply was just sent
+  void traceRequest();
+
   // TcpConnection's life is undetermined, so use weak ptr for safety.
   std::weak_ptr<TcpConnection> tcp_connection_;
 
@@ -264,6 +316,25 @@ class PClient : public std::enable_shared_from_this<PClient>, public CmdRes {
 
   ClientState state_;
 
+  // A command is being served, the next ones stay in the input buffer of the
+  // connection until its reply is sent. They run after its raft writes are
+  // applied, and its reply and theirs are built one after the other.
+  std::atomic<bool> serving_ = false;
+
+  RaftReadMode raft_read_mode_ = RaftReadMode::kStale;
+  // The request being served. A client serves one request at a time, see
+  // serving_, and the thread that writes a stage owns the trace until it hands
+  // the client on through a locked queue: the IO thread until it is queued,
+  // then the worker, the thread applying its raft writes, and the IO thread
+  // again, which records it before it parses the next request.
+  RequestTrace trace_;
+
+  // As a monitor, the commands fed by the threads of the other clients until its loop sends them
+  static constexpr size_t kMonitorQueueLimit = 10000;
+  std::mutex monitor_mutex_;
+  std::vector<std::shared_ptr<const MonitorEntry>> monitor_entries_;
+  bool monitor_draining_ = false;  // a drain is scheduled in the loop
+
   static thread_local PClient* s_current;
 };
 }  // namespace pikiwidb
@@ -8,12 +8,20 @@
 #include "cmd_admin.h"
 #include "db.h"
 
+#include <map>
+#include <vector>
+
 #include "braft/raft.h"
+#include "fmt/core.h"
 #include "rocksdb/version.h"
 
+#include "cmd_stats.h"
+#include "perf_stats.h"
 #include "pikiwidb.h"
+#include "slow_log.h"
 #include "praft/praft.h"
 #include "pstd/env.h"
+#include "pstd/pstd_string.h"
 #include "pstd/pstd_util.h"
 
 #include "store.h"
@@ -152,6 +160,14 @@ void InfoCmd::DoCmd(PClient* client) {
     InfoRaft(client);
   } else if (!strcasecmp(cmd.c_str(), "data")) {
     InfoData(client);
+  } else if (!strcasecmp(cmd.c_str(), "commandstats")) {
+    InfoCommandStats(client);
+  } else if (!strcasecmp(cmd.c_str(), "stagestats")) {
+    InfoStageStats(client);
+  } else if (!strcasecmp(cmd.c_str(), "perfstats")) {
+    InfoPerfStats(client);
+  } else if (!strcasecmp(cmd.c_str(), "monitors")) {
+    InfoMonitors(client);
   } else {
     client->SetRes(CmdRes::kErrOther, "the cmd is not supported");
   }
@@ -167,6 +183,10 @@ void InfoCmd::DoCmd(PClient* client) {
     raft_is_voting:yes
     raft_leader_id:1733428433
     raft_current_term:1
+    raft_first_index:1
+    raft_last_index:8
+    raft_committed_index:8
+    raft_applied_index:8
     raft_num_nodes:2
     raft_num_voting_nodes:2
     raft_node1:id=1733428433,state=connected,voting=yes,addr=localhost,port=5001,last_conn_secs=5,conn_errors=0,conn_oks=1
@@ -197,6 +217,10 @@ void InfoCmd::InfoRaft(PClient* client) {
   message += "raft_role:" + std::string(braft::state2str(node_status.state)) + "\r\n";
   message += "raft_leader_id:" + node_status.leader_id.to_string() + "\r\n";
   message += "raft_current_term:" + std::to_string(node_status.term) + "\r\n";
+  message += "raft_first_index:" + std::to_string(node_status.first_index) + "\r\n";
+  message += "raft_last_index:" + std::to_string(node_status.last_index) + "\r\n";
+  message += "raft_committed_index:" + std::to_string(node_status.committed_index) + "\r\n";
+  message += "raft_applied_index:" + std::to_string(node_status.known_applied_index) + "\r\n";
 
   if (PRAFT.IsLeader()) {
     std::vector<braft::PeerId> peers;
@@ -223,7 +247,111 @@ void InfoCmd::InfoData(PClient* client) {
   message += DATABASES_NUM + std::string(":") + std::to_string(pikiwidb::g_config.databases) + "\r\n";
   message += ROCKSDB_NUM + std::string(":") + std::to_string(pikiwidb::g_config.db_instance_num) + "\r\n";
   message += ROCKSDB_VERSION + std::string(":") + ROCKSDB_NAMESPACE::GetRocksVersionAsString() + "\r\n";
+  message += RAFT_GROUP_NUM + std::string(":") + std::to_string(PRaft::GroupNum()) + "\r\n";
+
+  client->AppendString(message);
+}
+
+static std::string FormatLatency(const pstd::HistogramSnapshot& snapshot) {
+  auto usec_per_call = snapshot.Count() == 0 ? 0 : static_cast<double>(snapshot.Sum()) / snapshot.Count();
+  return fmt::format("calls={},usec={},usec_per_call={:.2f},p50={},p99={},p999={}", snapshot.Count(), snapshot.Sum(),
+                     usec_per_call, snapshot.Percentile(50), snapshot.Percentile(99), snapshot.Percentile(99.9));
+}
+
+/*
+ * INFO commandstats
+ * The calls of each command called at least once, their latency in microseconds
+ * and its percentiles.
+ * Reply:
+ *   cmdstat_get:calls=2,usec=15,usec_per_call=7.50,p50=7,p99=8,p999=8
+ */
+void InfoCmd::InfoCommandStats(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
 
+  std::string message;
+  for (const auto& [name, snapshot] : CmdStats::Instance().GetSnapshots()) {
+    message += "cmdstat_" + name + ":" + FormatLatency(snapshot) + "\r\n";
+  }
+  client->AppendString(message);
+}
+
+/*
+ * INFO stagestats
+ * The time the requests spent in each stage, from their parse to their reply
+ * sent, in microseconds.
+ * Reply:
+ *   stagestat_parse:calls=2,usec=4,usec_per_call=2.00,p50=2,p99=2,p999=2
+ *   stagestat_queue:...
+ *   stagestat_execute:...
+ *   stagestat_commit:...
+ *   stagestat_write_out:...
+ */
+void InfoCmd::InfoStageStats(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+
+  auto snapshots = CmdStats::Instance().GetStageSnapshots();
+  std::string message;
+  for (int stage = 0; stage < kRequestStageNum; stage++) {
+    message += fmt::format("stagestat_{}:{}\r\n", RequestStageName(static_cast<RequestStage>(stage)),
+                           FormatLatency(snapshots[stage]));
+  }
+  client->AppendString(message);
+}
+
+// The counters of a perf aggregate, with their means per sample
+static std::string FormatPerf(const PerfStats::Aggregate& aggregate) {
+  auto message = fmt::format("samples={}", aggregate.samples);
+  for (int counter = 0; counter < kPerfCounterNum; counter++) {
+    message += fmt::format(",{}={:.2f}", PerfCounterName(static_cast<PerfCounter>(counter)),
+                           static_cast<double>(aggregate.counters[counter]) / static_cast<double>(aggregate.samples));
+  }
+  return message;
+}
+
+/*
+ * INFO perfstats
+ * The rocksdb PerfContext and IOStatsContext counters of the profiled calls,
+ * per call, by command and by rocksdb instance of db<db>_<instance>.
+ * Reply:
+ *   perfcmd_get:samples=2,block_cache_hits=1.00,block_reads=0.50,...
+ *   perfinst_db0_1:samples=2,block_cache_hits=1.00,block_reads=0.50,...
+ */
+void InfoCmd::InfoPerfStats(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+
+  auto& stats = PerfStats::Instance();
+  std::string message;
+  for (const auto& [name, aggregate] : stats.GetCmdStats()) {
+    message += "perfcmd_" + name + ":" + FormatPerf(aggregate) + "\r\n";
+  }
+  for (const auto& [instance, aggregate] : stats.GetInstanceStats()) {
+    message += fmt::format("perfinst_db{}_{}:{}\r\n", instance.first, instance.second, FormatPerf(aggregate));
+  }
+  client->AppendString(message);
+}
+
+/*
+ * INFO monitors
+ * The clients attached by MONITOR, and the commands not sent to them because
+ * too many were waiting for a monitor's loop.
+ * Reply:
+ *   monitors:1
+ *   monitor_dropped_entries:0
+ */
+void InfoCmd::InfoMonitors(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+
+  std::string message;
+  message += "monitors:" + std::to_string(PClient::MonitorNum()) + "\r\n";
+  message += "monitor_dropped_entries:" + std::to_string(PClient::MonitorDroppedEntries()) + "\r\n";
   client->AppendString(message);
 }
 
@@ -320,4 +448,357 @@ void CmdDebugSegfault::DoCmd(PClient* client) {
   *ptr = 0;
 }
 
+CmdSlots::CmdSlots(const std::string& name, int arity) : BaseCmdGroup(name, kCmdFlagsAdmin, kAclCategoryAdmin) {}
+
+bool CmdSlots::HasSubCommand() const { return true; }
+
+CmdSlotsInfo::CmdSlotsInfo(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly, kAclCategoryAdmin) {}
+
+bool CmdSlotsInfo::DoInitial(PClient* client) { return true; }
+
+/*
+ * Replies the number of slots of each instance and the progress of the last
+ * SLOTS MIGRATE or SLOTS REBALANCE:
+ *   [instances, [[instance, slots], ...],
+ *    migration, [status, idle|running|done|<error>, start_time, ..., end_time, ..., slots, ..., moved_slots, ...]]
+ */
+void CmdSlotsInfo::DoCmd(PClient* client) {
+  auto storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  auto inst_num = static_cast<int32_t>(storage->GetDBInstanceNum());
+  client->AppendArrayLen(4);
+  client->AppendString("instances");
+  client->AppendArrayLen(inst_num);
+  for (int32_t inst_id = 0; inst_id < inst_num; inst_id++) {
+    client->AppendArrayLen(2);
+    client->AppendInteger(inst_id);
+    client->AppendInteger(static_cast<int64_t>(storage->GetSlotsOfInstance(inst_id).size()));
+  }
+
+  auto report = storage->GetSlotsMigrationReport();
+  std::string status;
+  if (report.running) {
+    status = "running";
+  } else if (!report.error.empty()) {
+    status = report.error;
+  } else {
+    status = report.start_time == 0 ? "idle" : "done";
+  }
+  client->AppendString("migration");
+  client->AppendArrayLen(10);
+  client->AppendString("status");
+  client->AppendString(status);
+  client->AppendString("start_time");
+  client->AppendInteger(report.start_time);
+  client->AppendString("end_time");
+  client->AppendInteger(report.end_time);
+  client->AppendString("slots");
+  client->AppendInteger(report.slots);
+  client->AppendString("moved_slots");
+  client->AppendInteger(report.moved_slots);
+}
+
+CmdSlotsMigrate::CmdSlotsMigrate(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsWrite, kAclCategoryAdmin) {}
+
+bool CmdSlotsMigrate::DoInitial(PClient* client) { return true; }
+
+// SLOTS MIGRATE instance slot [slot ...], starts migrating the slots in the
+// background, SLOTS INFO tells when they are moved
+void CmdSlotsMigrate::DoCmd(PClient* client) {
+  // the instances are written directly, the followers would not see the move
+  if (g_config.use_raft.load()) {
+    return client->SetRes(CmdRes::kErrOther, "SLOTS MIGRATE is not replicated by raft");
+  }
+  int64_t inst_id = 0;
+  if (pstd::String2int(client->argv_[2], &inst_id) == 0) {
+    return client->SetRes(CmdRes::kInvalidInt);
+  }
+  std::vector<uint32_t> slots;
+  for (size_t i = 3; i < client->argv_.size(); i++) {
+    int64_t slot = 0;
+    if (pstd::String2int(client->argv_[i], &slot) == 0 || slot < 0) {
+      return client->SetRes(CmdRes::kInvalidInt);
+    }
+    slots.push_back(static_cast<uint32_t>(slot));
+  }
+  auto storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  auto s = storage->StartSlotsMigration(slots, static_cast<int32_t>(inst_id));
+  if (!s.ok()) {
+    return client->SetRes(CmdRes::kErrOther, s.ToString());
+  }
+  client->SetRes(CmdRes::kOK);
+}
+
+CmdSlotsRebalance::CmdSlotsRebalance(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsWrite, kAclCategoryAdmin) {}
+
+bool CmdSlotsRebalance::DoInitial(PClient* client) { return true; }
+
+// SLOTS REBALANCE [instance-num], starts spreading the slots over the first
+// instance-num instances, all of them by default, in the background and replies
+// the number of slots to move. Emptying the last instances lets the db be
+// reopened with fewer of them once SLOTS INFO tells the migration is done.
+void CmdSlotsRebalance::DoCmd(PClient* client) {
+  if (g_config.use_raft.load()) {
+    return client->SetRes(CmdRes::kErrOther, "SLOTS REBALANCE is not replicated by raft");
+  }
+  auto storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  auto inst_num = static_cast<int64_t>(storage->GetDBInstanceNum());
+  if (client->argv_.size() > 2 && pstd::String2int(client->argv_[2], &inst_num) == 0) {
+    return client->SetRes(CmdRes::kInvalidInt);
+  }
+  int32_t moving = 0;
+  auto s = storage->StartSlotsRebalance(static_cast<int32_t>(inst_num), &moving);
+  if (!s.ok()) {
+    return client->SetRes(CmdRes::kErrOther, s.ToString());
+  }
+  client->AppendInteger(moving);
+}
+
+LatencyCmd::LatencyCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly, kAclCategoryAdmin) {}
+
+bool LatencyCmd::DoInitial(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd != kHistogramCmd) {
+    client->SetRes(CmdRes::kErrOther, "LATENCY supports HISTOGRAM only");
+    return false;
+  }
+  return true;
+}
+
+// Replies as redis does, for each command its calls and the number of calls
+// under each power of two microseconds:
+//   [name, ["calls", calls, "histogram_usec", [1, count, 2, count, 4, count, ...]], ...]
+void LatencyCmd::DoCmd(PClient* client) {
+  std::map<std::string, pstd::HistogramSnapshot> snapshots;
+  if (client->argv_.size() == 2) {
+    snapshots = CmdStats::Instance().GetSnapshots();
+  } else {
+    for (size_t i = 2; i < client->argv_.size(); i++) {
+      auto name = client->argv_[i];
+      pstd::StringToLower(name);
+      if (auto snapshot = CmdStats::Instance().GetSnapshot(name); snapshot) {
+        snapshots.emplace(name, *snapshot);
+      }
+    }
+  }
+
+  client->AppendArrayLenUint64(snapshots.size() * 2);
+  for (const auto& [name, snapshot] : snapshots) {
+    // the calls under each power of two, which every bucket is either under or over
+    std::vector<std::pair<uint64_t, uint64_t>> counts;
+    uint64_t seen = 0;
+    size_t bucket = 0;
+    for (uint64_t bound = 1; seen < snapshot.Count(); bound <<= 1) {
+      for (; bucket < pstd::Histogram::kBucketNum && pstd::Histogram::BucketUpperBound(bucket) < bound; bucket++) {
+        seen += snapshot.CountOfBucket(bucket);
+      }
+      if (seen > 0) {
+        counts.emplace_back(bound, seen);
+      }
+    }
+
+    client->AppendString(name);
+    client->AppendArrayLen(4);
+    client->AppendString("calls");
+    client->AppendInteger(static_cast<int64_t>(snapshot.Count()));
+    client->AppendString("histogram_usec");
+    client->AppendArrayLenUint64(counts.size() * 2);
+    for (const auto& [upper, count] : counts) {
+      client->AppendInteger(static_cast<int64_t>(upper));
+      client->AppendInteger(static_cast<int64_t>(count));
+    }
+  }
+}
+
+SlowlogCmd::SlowlogCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly | kCmdFlagsSkipSlowlog, kAclCategoryAdmin) {}
+
+bool SlowlogCmd::DoInitial(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd != kGetCmd && cmd != kLenCmd && cmd != kResetCmd) {
+    client->SetRes(CmdRes::kErrOther, "SLOWLOG supports GET / LEN / RESET only");
+    return false;
+  }
+  return true;
+}
+
+// A log is replied as redis does, followed by the microseconds of each stage and the rocksdb counters of the
+// command if it was profiled, see perf-context-sample-rate:
+//   [id, time, usec, [arg ...], client_addr, client_name, [stage, usec, ...], [counter, value, ...]]
+void SlowlogCmd::DoCmd(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  auto& slow_log = PSlowLog::Instance();
+  if (cmd == kLenCmd) {
+    return client->AppendInteger(static_cast<int64_t>(slow_log.GetLogsCount()));
+  }
+  if (cmd == kResetCmd) {
+    slow_log.ClearLogs();
+    return client->SetRes(CmdRes::kOK);
+  }
+
+  int64_t count = 10;
+  if (client->argv_.size() > 3) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+  if (client->argv_.size() == 3 && (pstd::String2int(client->argv_[2], &count) == 0 || count < -1)) {
+    return client->SetRes(CmdRes::kErrOther, "count should be greater than or equal to -1");
+  }
+  auto logs = slow_log.GetLogs(count == -1 ? SIZE_MAX : static_cast<size_t>(count));
+  client->AppendArrayLenUint64(logs.size());
+  for (const auto& log : logs) {
+    client->AppendArrayLen(8);
+    client->AppendInteger(static_cast<int64_t>(log->id));
+    client->AppendInteger(log->time);
+    client->AppendInteger(static_cast<int64_t>(log->used));
+    client->AppendStringVector(log->cmds);
+    client->AppendString(log->client_addr);
+    client->AppendString(log->client_name);
+    client->AppendArrayLen(kRequestStageNum * 2);
+    for (int stage = 0; stage < kRequestStageNum; stage++) {
+      client->AppendString(RequestStageName(static_cast<RequestStage>(stage)));
+      client->AppendInteger(static_cast<int64_t>(log->stages[stage]));
+    }
+    if (!log->perf) {
+      client->AppendArrayLen(0);
+      continue;
+    }
+    client->AppendArrayLen(kPerfCounterNum * 2);
+    for (int counter = 0; counter < kPerfCounterNum; counter++) {
+      client->AppendString(PerfCounterName(static_cast<PerfCounter>(counter)));
+      client->AppendInteger(static_cast<int64_t>((*log->perf)[counter]));
+    }
+  }
+}
+
+HotKeysCmd::HotKeysCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly, kAclCategoryAdmin) {}
+
+bool HotKeysCmd::DoInitial(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd != kGetCmd && cmd != kResetCmd) {
+    client->SetRes(CmdRes::kErrOther, "HOTKEYS supports GET / RESET only");
+    return false;
+  }
+  return true;
+}
+
+/*
+ * HOTKEYS GET [count]
+ * The count keys of the current db read or written the most lately, sampled
+ * at hotkeys-sample-rate, with the estimates of their accesses:
+ *   [key, accesses, key, accesses, ...]
+ * HOTKEYS RESET
+ */
+void HotKeysCmd::DoCmd(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  if (cmd == kResetCmd) {
+    storage->ClearHotKeys();
+    return client->SetRes(CmdRes::kOK);
+  }
+
+  int64_t count = 10;
+  if (client->argv_.size() > 3) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+  if (client->argv_.size() == 3 && (pstd::String2int(client->argv_[2], &count) == 0 || count <= 0)) {
+    return client->SetRes(CmdRes::kErrOther, "count should be greater than 0");
+  }
+  auto hot_keys = storage->GetHotKeys(static_cast<size_t>(count));
+  client->AppendArrayLenUint64(hot_keys.size() * 2);
+  for (const auto& [key, accesses] : hot_keys) {
+    client->AppendString(key);
+    client->AppendInteger(static_cast<int64_t>(accesses));
+  }
+}
+
+BigKeysCmd::BigKeysCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly, kAclCategoryAdmin) {}
+
+bool BigKeysCmd::DoInitial(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd != kStartCmd && cmd != kGetCmd) {
+    client->SetRes(CmdRes::kErrOther, "BIGKEYS supports START / GET only");
+    return false;
+  }
+  if (client->argv_.size() > (cmd == kStartCmd ? 3 : 2)) {
+    client->SetRes(CmdRes::kWrongNum, client->CmdName());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * BIGKEYS START [count]
+ * Scans the current db in the background for the count largest hashes, sets,
+ * zsets and lists, by the counts in their meta values, at bigkeys-scan-rate.
+ * BIGKEYS GET
+ * The report of the last scan:
+ *   [status, idle|running|done|<error>, start_time, ..., end_time, ..., scanned_keys, ...,
+ *    keys, [[type, key, count], ...]]
+ */
+void BigKeysCmd::DoCmd(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  if (cmd == kStartCmd) {
+    int64_t count = 10;
+    if (client->argv_.size() == 3 && (pstd::String2int(client->argv_[2], &count) == 0 || count <= 0)) {
+      return client->SetRes(CmdRes::kErrOther, "count should be greater than 0");
+    }
+    auto s = storage->StartBigKeysScan(static_cast<size_t>(count), g_config.bigkeys_scan_rate.load());
+    if (!s.ok()) {
+      return client->SetRes(CmdRes::kErrOther, s.ToString());
+    }
+    return client->SetRes(CmdRes::kOK);
+  }
+
+  auto report = storage->GetBigKeysReport();
+  std::string status;
+  if (report.running) {
+    status = "running";
+  } else if (!report.error.empty()) {
+    status = report.error;
+  } else {
+    status = report.start_time == 0 ? "idle" : "done";
+  }
+  client->AppendArrayLen(10);
+  client->AppendString("status");
+  client->AppendString(status);
+  client->AppendString("start_time");
+  client->AppendInteger(report.start_time);
+  client->AppendString("end_time");
+  client->AppendInteger(report.end_time);
+  client->AppendString("scanned_keys");
+  client->AppendInteger(static_cast<int64_t>(report.scanned_keys));
+  client->AppendString("keys");
+  client->AppendArrayLenUint64(report.keys.size());
+  for (const auto& key : report.keys) {
+    client->AppendArrayLen(3);
+    client->AppendString(storage::DataTypeToString[key.type]);
+    client->AppendString(key.key);
+    client->AppendInteger(static_cast<int64_t>(key.count));
+  }
+}
+
+MonitorCmd::MonitorCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsAdmin | kCmdFlagsReadonly, kAclCategoryAdmin) {}
+
+bool MonitorCmd::DoInitial(PClient* client) { return true; }
+
+void MonitorCmd::DoCmd(PClient* client) {
+  // replied by AddMonitor, ahead of the commands fed
+  PClient::AddMonitor(client);
+  client->SetRes(CmdRes::kNone);
+}
+
 }  // namespace pikiwidb
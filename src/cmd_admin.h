@@ -124,6 +124,80 @@ class InfoCmd : public BaseCmd {
 
   void InfoRaft(PClient* client);
   void InfoData(PClient* client);
+  void InfoCommandStats(PClient* client);
+  void InfoStageStats(PClient* client);
+  void InfoPerfStats(PClient* client);
+  void InfoMonitors(PClient* client);
+};
+
+// LATENCY HISTOGRAM [command ...], the latency histograms of the commands, all those called by default
+class LatencyCmd : public BaseCmd {
+ public:
+  LatencyCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+
+  static constexpr std::string_view kHistogramCmd = "HISTOGRAM";
+};
+
+// SLOWLOG GET [count] | LEN | RESET
+class SlowlogCmd : public BaseCmd {
+ public:
+  SlowlogCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+
+  static constexpr std::string_view kGetCmd = "GET";
+  static constexpr std::string_view kLenCmd = "LEN";
+  static constexpr std::string_view kResetCmd = "RESET";
+};
+
+class HotKeysCmd : public BaseCmd {
+ public:
+  HotKeysCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+
+  static constexpr std::string_view kGetCmd = "GET";
+  static constexpr std::string_view kResetCmd = "RESET";
+};
+
+class BigKeysCmd : public BaseCmd {
+ public:
+  BigKeysCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+
+  static constexpr std::string_view kStartCmd = "START";
+  static constexpr std::string_view kGetCmd = "GET";
+};
+
+// MONITOR, the commands received by the server are streamed to the client from now on
+class MonitorCmd : public BaseCmd {
+ public:
+  MonitorCmd(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
 };
 
 class DbsizeCmd : public BaseCmd {
@@ -205,4 +279,51 @@ class CmdDebugSegfault : public BaseCmd {
   void DoCmd(PClient* client) override;
 };
 
+// Moves slots of keys between the rocksdb instances of the current db
+class CmdSlots : public BaseCmdGroup {
+ public:
+  CmdSlots(const std::string& name, int arity);
+
+  bool HasSubCommand() const override;
+
+ protected:
+  bool DoInitial(PClient* client) override { return true; };
+
+ private:
+  void DoCmd(PClient* client) override{};
+};
+
+class CmdSlotsInfo : public BaseCmd {
+ public:
+  CmdSlotsInfo(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+};
+
+class CmdSlotsMigrate : public BaseCmd {
+ public:
+  CmdSlotsMigrate(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+};
+
+class CmdSlotsRebalance : public BaseCmd {
+ public:
+  CmdSlotsRebalance(const std::string& name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient* client) override;
+
+ private:
+  void DoCmd(PClient* client) override;
+};
+
 }  // namespace pikiwidb
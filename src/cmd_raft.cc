@@ -20,6 +20,7 @@
 #include "config.h"
 #include "pikiwidb.h"
 #include "replication.h"
+#include "store.h"
 
 namespace pikiwidb {
 
@@ -122,10 +123,13 @@ void RaftNodeCmd::DoCmdRemove(PClient* client) {
 }
 
 void RaftNodeCmd::DoCmdSnapshot(PClient* client) {
-  auto s = PRAFT.DoSnapshot();
-  if (s.ok()) {
-    client->SetRes(CmdRes::kOK);
+  for (uint32_t i = 0; i < PRaft::GroupNum(); i++) {
+    auto s = PRaft::Group(i).DoSnapshot();
+    if (!s.ok()) {
+      return client->SetRes(CmdRes::kErrOther, fmt::format("Failed to snapshot group {}: {}", i, s.error_str()));
+    }
   }
+  client->SetRes(CmdRes::kOK);
 }
 
 RaftClusterCmd::RaftClusterCmd(const std::string& name, int16_t arity)
@@ -228,4 +232,114 @@ void RaftClusterCmd::DoCmdJoin(PClient* client) {
   client->Clear();
 }
 
+RaftGroupCmd::RaftGroupCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsRaft, kAclCategoryRaft) {}
+
+bool RaftGroupCmd::DoInitial(PClient* client) {
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd != kInfoCmd && cmd != kTransferCmd && cmd != kBalanceCmd) {
+    client->SetRes(CmdRes::kErrOther, "RAFT.GROUP supports INFO / TRANSFER / BALANCE only");
+    return false;
+  }
+  return true;
+}
+
+void RaftGroupCmd::DoCmd(PClient* client) {
+  if (!PRAFT.IsInitialized()) {
+    return client->SetRes(CmdRes::kErrOther, "Don't already cluster member");
+  }
+
+  auto cmd = client->argv_[1];
+  pstd::StringToUpper(cmd);
+  if (cmd == kInfoCmd) {
+    DoCmdInfo(client);
+  } else if (cmd == kTransferCmd) {
+    DoCmdTransfer(client);
+  } else {
+    DoCmdBalance(client);
+  }
+}
+
+void RaftGroupCmd::DoCmdInfo(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+
+  auto& storage = PSTORE.GetBackend(client->GetCurrentDB())->GetStorage();
+  std::string message;
+  message += RAFT_GROUP_NUM + std::string(":") + std::to_string(PRaft::GroupNum()) + "\r\n";
+  for (uint32_t i = 0; i < PRaft::GroupNum(); i++) {
+    auto& group = PRaft::Group(i);
+    std::string instances;
+    size_t slots = 0;
+    for (auto inst_id : group.GetInstances()) {
+      instances += (instances.empty() ? "" : ",") + std::to_string(inst_id);
+      slots += storage->GetSlotsOfInstance(inst_id).size();
+    }
+    auto node_status = group.GetNodeStatus();
+    message += fmt::format("raft_group{}:name={},role={},leader={},term={},instances={},slots={}\r\n", i,
+                           group.GetGroupName(), braft::state2str(node_status.state),
+                           node_status.leader_id.to_string(), node_status.term, instances, slots);
+  }
+  client->AppendString(message);
+}
+
+void RaftGroupCmd::DoCmdTransfer(PClient* client) {
+  if (client->argv_.size() != 4) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+
+  int64_t index = 0;
+  if (pstd::String2int(client->argv_[2], &index) == 0 || index < 0 || index >= PRaft::GroupNum()) {
+    return client->SetRes(CmdRes::kInvalidParameter, "Invalid raft group index " + client->argv_[2]);
+  }
+  auto s = PRaft::Group(static_cast<uint32_t>(index)).TransferLeader(client->argv_[3]);
+  if (!s.ok()) {
+    return client->SetRes(CmdRes::kErrOther, fmt::format("Failed to transfer leader: {}", s.error_str()));
+  }
+  client->SetRes(CmdRes::kOK);
+}
+
+void RaftGroupCmd::DoCmdBalance(PClient* client) {
+  if (client->argv_.size() != 2) {
+    return client->SetRes(CmdRes::kWrongNum, client->CmdName());
+  }
+  // the peers are listed by the leader of the group 0
+  if (!PRAFT.IsLeader()) {
+    return client->SetRes(CmdRes::kWrongLeader, PRAFT.GetLeaderID());
+  }
+
+  int32_t transferred = 0;
+  auto s = PRAFT.BalanceLeaders(&transferred);
+  if (!s.ok()) {
+    return client->SetRes(CmdRes::kErrOther, fmt::format("Failed to balance leaders: {}", s.error_str()));
+  }
+  client->AppendInteger(transferred);
+}
+
+RaftReadModeCmd::RaftReadModeCmd(const std::string& name, int16_t arity)
+    : BaseCmd(name, arity, kCmdFlagsRaft, kAclCategoryRaft) {}
+
+bool RaftReadModeCmd::DoInitial(PClient* client) {
+  if (client->argv_.size() > 2) {
+    client->SetRes(CmdRes::kWrongNum, client->CmdName());
+    return false;
+  }
+  return true;
+}
+
+void RaftReadModeCmd::DoCmd(PClient* client) {
+  if (client->argv_.size() == 1) {
+    return client->AppendString(RaftReadModeName(client->GetRaftReadMode()));
+  }
+
+  auto mode = ParseRaftReadMode(client->argv_[1]);
+  if (!mode) {
+    return client->SetRes(CmdRes::kErrOther, "RAFT.READMODE supports STALE / READINDEX / LEASE only");
+  }
+  client->SetRaftReadMode(*mode);
+  client->SetRes(CmdRes::kOK);
+}
+
 }  // namespace pikiwidb
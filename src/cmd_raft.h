@@ -80,4 +80,53 @@ class RaftClusterCmd : public BaseCmd {
   static constexpr std::string_view kJoinCmd = "JOIN";
 };
 
+/* RAFT.GROUP INFO
+ *   Lists the raft groups of this node, their role, leader, storage instances
+ *   and the number of slots they own.
+ * Reply:
+ *   $<len> raft_group_num:<n> raft_group<i>:name=...,role=...,leader=...,term=...,instances=...,slots=...
+ *
+ * RAFT.GROUP TRANSFER <index> <addr:port>
+ *   Transfers the leadership of a raft group to another peer of it.
+ * Reply:
+ *   +OK
+ *
+ * RAFT.GROUP BALANCE
+ *   Spreads the leaders of the raft groups evenly over the nodes, sent to the
+ *   leader of the group 0.
+ * Reply:
+ *   -WRONG_LEADER ||
+ *   :<number of groups whose leader was transferred>
+ */
+class RaftGroupCmd : public BaseCmd {
+ public:
+  RaftGroupCmd(const std::string &name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient *client) override;
+
+ private:
+  void DoCmd(PClient *client) override;
+  void DoCmdInfo(PClient *client);
+  void DoCmdTransfer(PClient *client);
+  void DoCmdBalance(PClient *client);
+
+  static constexpr std::string_view kInfoCmd = "INFO";
+  static constexpr std::string_view kTransferCmd = "TRANSFER";
+  static constexpr std::string_view kBalanceCmd = "BALANCE";
+};
+
+// Gets or sets how the reads of the connection served by a follower see the writes before them:
+// RAFT.READMODE [STALE | READINDEX | LEASE]
+class RaftReadModeCmd : public BaseCmd {
+ public:
+  RaftReadModeCmd(const std::string &name, int16_t arity);
+
+ protected:
+  bool DoInitial(PClient *client) override;
+
+ private:
+  void DoCmd(PClient *client) override;
+};
+
 }  // namespace pikiwidb
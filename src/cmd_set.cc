@@ -58,11 +58,10 @@ bool SUnionStoreCmd::DoInitial(PClient* client) {
 
 void SUnionStoreCmd::DoCmd(PClient* client) {
   std::vector<std::string> keys(client->Keys().begin() + 1, client->Keys().end());
-  std::vector<std::string> value_to_dest;
   int32_t ret = 0;
   storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())
                           ->GetStorage()
-                          ->SUnionstore(client->Keys().at(0), keys, value_to_dest, &ret);
+                          ->SUnionstore(client->Keys().at(0), keys, &ret);
   if (!s.ok()) {
     client->SetRes(CmdRes::kSyntaxErr, "sunionstore cmd error");
   }
@@ -134,13 +133,12 @@ bool SInterStoreCmd::DoInitial(PClient* client) {
 }
 
 void SInterStoreCmd::DoCmd(PClient* client) {
-  std::vector<std::string> value_to_dest;
   int32_t reply_num = 0;
 
   std::vector<std::string> inter_keys(client->argv_.begin() + 2, client->argv_.end());
   storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())
                           ->GetStorage()
-                          ->SInterstore(client->Key(), inter_keys, value_to_dest, &reply_num);
+                          ->SInterstore(client->Key(), inter_keys, &reply_num);
   if (!s.ok()) {
     client->SetRes(CmdRes::kSyntaxErr, "sinterstore cmd error");
     return;
@@ -304,12 +302,11 @@ bool SDiffstoreCmd::DoInitial(PClient* client) {
 }
 
 void SDiffstoreCmd::DoCmd(PClient* client) {
-  std::vector<std::string> value_to_dest;
   int32_t reply_num = 0;
   std::vector<std::string> diffstore_keys(client->argv_.begin() + 2, client->argv_.end());
   storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())
                           ->GetStorage()
-                          ->SDiffstore(client->Key(), diffstore_keys, value_to_dest, &reply_num);
+                          ->SDiffstore(client->Key(), diffstore_keys, &reply_num);
   if (!s.ok()) {
     client->SetRes(CmdRes::kSyntaxErr, "sdiffstore cmd error");
     return;
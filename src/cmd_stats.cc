@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "cmd_stats.h"
+
+namespace pikiwidb {
+
+const char* RequestStageName(RequestStage stage) {
+  switch (stage) {
+    case kRequestStageParse:
+      return "parse";
+    case kRequestStageQueue:
+      return "queue";
+    case kRequestStageExecute:
+      return "execute";
+    case kRequestStageCommit:
+      return "commit";
+    case kRequestStageWriteOut:
+      return "write_out";
+    default:
+      return "unknown";
+  }
+}
+
+CmdStats& CmdStats::Instance() {
+  static CmdStats stats;
+  return stats;
+}
+
+pstd::Histogram* CmdStats::NewHistogram(const std::string& name) {
+  std::lock_guard lock(mutex_);
+  auto& histograms = histograms_[name];
+  histograms.push_back(std::make_unique<pstd::Histogram>());
+  return histograms.back().get();
+}
+
+std::map<std::string, pstd::HistogramSnapshot> CmdStats::GetSnapshots() const {
+  std::map<std::string, pstd::HistogramSnapshot> snapshots;
+  std::lock_guard lock(mutex_);
+  for (const auto& [name, histograms] : histograms_) {
+    pstd::HistogramSnapshot snapshot;
+    for (const auto& histogram : histograms) {
+      snapshot.Merge(*histogram);
+    }
+    if (snapshot.Count() > 0) {
+      snapshots.emplace(name, snapshot);
+    }
+  }
+  return snapshots;
+}
+
+std::optional<pstd::HistogramSnapshot> CmdStats::GetSnapshot(const std::string& name) const {
+  std::lock_guard lock(mutex_);
+  auto it = histograms_.find(name);
+  if (it == histograms_.end()) {
+    return std::nullopt;
+  }
+  pstd::HistogramSnapshot snapshot;
+  for (const auto& histogram : it->second) {
+    snapshot.Merge(*histogram);
+  }
+  if (snapshot.Count() == 0) {
+    return std::nullopt;
+  }
+  return snapshot;
+}
+
+void CmdStats::RecordStage(RequestStage stage, uint64_t usec) {
+  thread_local std::array<pstd::Histogram*, kRequestStageNum> histograms{};
+  auto& histogram = histograms[stage];
+  if (!histogram) {
+    std::lock_guard lock(mutex_);
+    histogram = stage_histograms_[stage].emplace_back(std::make_unique<pstd::Histogram>()).get();
+  }
+  histogram->Record(usec);
+}
+
+std::array<pstd::HistogramSnapshot, kRequestStageNum> CmdStats::GetStageSnapshots() const {
+  std::array<pstd::HistogramSnapshot, kRequestStageNum> snapshots;
+  std::lock_guard lock(mutex_);
+  for (size_t stage = 0; stage < kRequestStageNum; stage++) {
+    for (const auto& histogram : stage_histograms_[stage]) {
+      snapshots[stage].Merge(*histogram);
+    }
+  }
+  return snapshots;
+}
+
+}  // namespace pikiwidb
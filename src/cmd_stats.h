@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "pstd/pstd_histogram.h"
+
+namespace pikiwidb {
+
+// The stages a request goes through, see RequestTrace
+enum RequestStage {
+  kRequestStageParse,     // the IO thread parses it
+  kRequestStageQueue,     // it waits for a cmd worker
+  kRequestStageExecute,   // the worker runs it
+  kRequestStageCommit,    // its raft writes wait to be applied
+  kRequestStageWriteOut,  // the reply waits for a write thread and is sent
+  kRequestStageNum,
+};
+
+const char* RequestStageName(RequestStage stage);
+
+/*
+ * The latency histograms of the commands and of the stages of the requests, in
+ * microseconds. Each command table of a worker, and each thread recording the
+ * stages, records its own histograms without contention, which are merged
+ * when read.
+ */
+class CmdStats {
+ public:
+  static CmdStats& Instance();
+
+  CmdStats(const CmdStats&) = delete;
+  void operator=(const CmdStats&) = delete;
+
+  // A histogram of the command named name, recorded by the calling thread only. It lives as long as the process.
+  pstd::Histogram* NewHistogram(const std::string& name);
+
+  // The merged histograms of the commands called at least once, by name
+  std::map<std::string, pstd::HistogramSnapshot> GetSnapshots() const;
+  std::optional<pstd::HistogramSnapshot> GetSnapshot(const std::string& name) const;
+
+  // Records the microseconds a request spent in stage, with a histogram of the calling thread
+  void RecordStage(RequestStage stage, uint64_t usec);
+  std::array<pstd::HistogramSnapshot, kRequestStageNum> GetStageSnapshots() const;
+
+ private:
+  CmdStats() = default;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::vector<std::unique_ptr<pstd::Histogram>>> histograms_;
+  std::array<std::vector<std::unique_ptr<pstd::Histogram>>, kRequestStageNum> stage_histograms_;
+};
+
+}  // namespace pikiwidb
@@ -60,6 +60,10 @@ void CmdTableManager::InitCmdTable() {
   ADD_SUBCOMMAND(Debug, Help, 2);
   ADD_SUBCOMMAND(Debug, OOM, 2);
   ADD_SUBCOMMAND(Debug, Segfault, 2);
+  ADD_COMMAND_GROUP(Slots, -2);
+  ADD_SUBCOMMAND(Slots, Info, 2);
+  ADD_SUBCOMMAND(Slots, Migrate, -4);
+  ADD_SUBCOMMAND(Slots, Rebalance, -2);
 
   // server
   ADD_COMMAND(Flushdb, 1);
@@ -69,10 +73,17 @@ void CmdTableManager::InitCmdTable() {
 
   // info
   ADD_COMMAND(Info, -1);
+  ADD_COMMAND(Latency, -2);
+  ADD_COMMAND(Slowlog, -2);
+  ADD_COMMAND(HotKeys, -2);
+  ADD_COMMAND(BigKeys, -2);
+  ADD_COMMAND(Monitor, 1);
 
   // raft
   ADD_COMMAND(RaftCluster, -1);
   ADD_COMMAND(RaftNode, -2);
+  ADD_COMMAND(RaftGroup, -2);
+  ADD_COMMAND(RaftReadMode, -1);
 
   // keyspace
   ADD_COMMAND(Del, -2);
@@ -58,6 +58,16 @@ void CmdThreadPool::SubmitSlow(const std::shared_ptr<CmdThreadPoolTask> &runner)
   slow_condition_.notify_one();
 }
 
+size_t CmdThreadPool::FastTaskNum() {
+  std::unique_lock rl(fast_mutex_);
+  return fast_tasks_.size();
+}
+
+size_t CmdThreadPool::SlowTaskNum() {
+  std::unique_lock rl(slow_mutex_);
+  return slow_tasks_.size();
+}
+
 void CmdThreadPool::Stop() { DoStop(); }
 
 void CmdThreadPool::DoStop() {
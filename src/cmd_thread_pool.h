@@ -71,6 +71,10 @@ class CmdThreadPool {
   // get the thread pool size
   inline int ThreadPollSize() const { return fast_thread_num_ + slow_thread_num_; };
 
+  // get the number of tasks waiting for a worker
+  size_t FastTaskNum();
+  size_t SlowTaskNum();
+
   ~CmdThreadPool();
 
  private:
@@ -6,11 +6,27 @@
  */
 
 #include "cmd_thread_pool_worker.h"
+#include "config.h"
 #include "log.h"
 #include "pikiwidb.h"
+#include "storage/async_commit.h"
 
 namespace pikiwidb {
 
+namespace {
+
+// Runs the command of task and records how long it took, the raft writes are
+// not waited for, only their appending to the log
+void RunAndRecord(const std::shared_ptr<CmdThreadPoolTask> &task, BaseCmd *cmd) {
+  auto &trace = task->Client()->Trace();
+  trace.started = RequestTrace::Now();
+  task->Run(cmd);
+  trace.executed = RequestTrace::Now();
+  cmd->RecordLatency(static_cast<uint64_t>(trace.executed - trace.started));
+}
+
+}  // namespace
+
 void CmdWorkThreadPoolWorker::Work() {
   while (running_) {
     LoadWork();
@@ -35,8 +51,25 @@ void CmdWorkThreadPoolWorker::Work() {
         g_pikiwidb->PushWriteTask(task->Client());
         continue;
       }
-      task->Run(cmdPtr);
-      g_pikiwidb->PushWriteTask(task->Client());
+      if (!cmdPtr->HasFlag(kCmdFlagsWrite) || !g_config.use_raft.load(std::memory_order_relaxed)) {
+        RunAndRecord(task, cmdPtr);
+        g_pikiwidb->PushWriteTask(task->Client());
+        continue;
+      }
+
+      // The worker does not wait for the raft writes of the command, the reply
+      // is sent once they are applied, and the next command of the client is
+      // not handled before. If one failed, its error replaces the reply the
+      // command built, the client must get a single reply.
+      auto commit = storage::AsyncCommit::Begin([client = task->Client()](const storage::Status &s) {
+        if (!s.ok()) {
+          client->Clear();
+          client->SetRes(CmdRes::kErrOther, s.ToString());
+        }
+        g_pikiwidb->PushWriteTask(client);
+      });
+      RunAndRecord(task, cmdPtr);
+      commit->Finish();
     }
     self_task_.clear();
   }
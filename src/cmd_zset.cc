@@ -270,10 +270,9 @@ bool ZInterstoreCmd::DoInitial(PClient* client) { return ZsetUIstoreParentCmd::D
 
 void ZInterstoreCmd::DoCmd(PClient* client) {
   int32_t count = 0;
-  std::vector<storage::ScoreMember> value_to_dest_;
   storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())
                           ->GetStorage()
-                          ->ZInterstore(dest_key_, keys_, weights_, aggregate_, value_to_dest_, &count);
+                          ->ZInterstore(dest_key_, keys_, weights_, aggregate_, &count);
   if (s.ok()) {
     client->AppendInteger(count);
   } else {
@@ -287,10 +286,9 @@ bool ZUnionstoreCmd::DoInitial(PClient* client) { return ZsetUIstoreParentCmd::D
 
 void ZUnionstoreCmd::DoCmd(PClient* client) {
   int32_t count = 0;
-  std::map<std::string, double> value_to_dest;
   storage::Status s = PSTORE.GetBackend(client->GetCurrentDB())
                           ->GetStorage()
-                          ->ZUnionstore(dest_key_, keys_, weights_, aggregate_, value_to_dest, &count);
+                          ->ZUnionstore(dest_key_, keys_, weights_, aggregate_, &count);
   if (s.ok()) {
     client->AppendInteger(count);
   } else {
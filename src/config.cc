@@ -42,6 +42,14 @@ static Status CheckYesNo(const std::string& value) {
   return Status::OK();
 }
 
+static Status CheckRaftReadMode(const std::string& value) {
+  if (!pstd::StringEqualCaseInsensitive(value, "stale") && !pstd::StringEqualCaseInsensitive(value, "readindex") &&
+      !pstd::StringEqualCaseInsensitive(value, "lease")) {
+    return Status::InvalidArgument("The value must be stale / readindex / lease.");
+  }
+  return Status::OK();
+}
+
 static Status CheckLogLevel(const std::string& value) {
   if (!pstd::StringEqualCaseInsensitive(value, "debug") && !pstd::StringEqualCaseInsensitive(value, "verbose") &&
       !pstd::StringEqualCaseInsensitive(value, "notice") && !pstd::StringEqualCaseInsensitive(value, "warning")) {
@@ -106,6 +114,7 @@ PConfig::PConfig() {
   AddString("ip", false, {&ip});
   AddNumberWihLimit<uint16_t>("port", false, &port, PORT_LIMIT_MIN, PORT_LIMIT_MAX);
   AddNumber("raft-port-offset", true, &raft_port_offset);
+  AddNumber("metrics-port", false, &metrics_port);
   AddNumber("timeout", true, &timeout);
   AddString("db-path", false, {&db_path});
   AddStrinWithFunc("loglevel", &CheckLogLevel, false, {&log_level});
@@ -124,7 +133,14 @@ PConfig::PConfig() {
   AddString("runid", false, {&run_id});
   AddNumber("small-compaction-threshold", true, &small_compaction_threshold);
   AddNumber("small-compaction-duration-threshold", true, &small_compaction_duration_threshold);
+  AddNumber("hotkeys-sample-rate", true, &hotkeys_sample_rate);
+  AddNumber("bigkeys-scan-rate", true, &bigkeys_scan_rate);
+  AddNumber("perf-context-sample-rate", true, &perf_context_sample_rate);
+  AddNumber("perf-context-slower-than", true, &perf_context_slower_than);
   AddBool("use-raft", &CheckYesNo, false, &use_raft);
+  AddNumberWihLimit<uint32_t>("raft-group-num", false, &raft_group_num, 1, ROCKSDB_INSTANCE_NUMBER_MAX);
+  AddStrinWithFunc("raft-read-mode", &CheckRaftReadMode, true, {&raft_read_mode});
+  AddBool("raft-protobuf-binlog", &CheckYesNo, true, &raft_protobuf_binlog);
 
   // rocksdb config
   AddNumber("rocksdb-max-subcompactions", false, &rocksdb_max_subcompactions);
@@ -141,12 +141,17 @@ class PConfig {
   std::atomic_uint64_t max_client_response_size = 1073741824;
   std::atomic_uint64_t small_compaction_threshold = 604800;
   std::atomic_uint64_t small_compaction_duration_threshold = 259200;
+  std::atomic_uint32_t hotkeys_sample_rate = 100;     // the keys of one call in 100 are sampled, 0 to disable
+  std::atomic_uint64_t bigkeys_scan_rate = 100000;    // the meta values BIGKEYS reads a second, 0 for no limit
+  std::atomic_uint32_t perf_context_sample_rate = 0;  // one call in it is profiled, 0 to disable
+  std::atomic_uint64_t perf_context_slower_than = 0;  // microseconds, every call is profiled to keep the slower
 
   std::atomic_bool daemonize = false;
   AtomicString pid_file = "./pikiwidb.pid";
   AtomicString ip = "127.0.0.1";
   std::atomic_uint16_t port = 9221;
   std::atomic_uint16_t raft_port_offset = 10;
+  std::atomic_uint16_t metrics_port = 0;  // serves /metrics over HTTP, 0 to disable
   AtomicString db_path = "./db/";
   AtomicString log_dir = "stdout";  // the log directory, differ from redis
   AtomicString log_level = "warning";
@@ -156,6 +161,12 @@ class PConfig {
   std::atomic_uint32_t slave_threads_num = 2;
   std::atomic<size_t> db_instance_num = 3;
   std::atomic_bool use_raft = true;
+  // raft groups of a node, each replicating its share of the storage instances
+  std::atomic_uint32_t raft_group_num = 1;
+  // how the new connections read on followers, see RaftReadMode
+  AtomicString raft_read_mode = "stale";
+  // write raft logs in the protobuf format, readable by nodes which do not know the flat one
+  std::atomic_bool raft_protobuf_binlog = false;
 
   std::atomic_uint32_t rocksdb_max_subcompactions = 0;
   // default 2
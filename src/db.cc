@@ -34,11 +34,13 @@ rocksdb::Status DB::Open() {
   storage_options.small_compaction_duration_threshold = g_config.small_compaction_duration_threshold.load();
 
   if (g_config.use_raft.load(std::memory_order_relaxed)) {
-    storage_options.append_log_function = [&r = PRAFT](const Binlog& log, std::promise<rocksdb::Status>&& promise) {
-      r.AppendLog(log, std::move(promise));
+    // the log of a storage instance is replicated by the raft group owning it
+    storage_options.append_log_function = [](storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+      PRaft::GroupOfInstance(static_cast<int32_t>(log.slot_idx())).AppendLog(std::move(log), std::move(done));
+    };
+    storage_options.do_snapshot_function = [](int32_t inst_id, storage::LogIndex log_index, bool sync) {
+      PRaft::GroupOfInstance(inst_id).DoSnapshot(log_index, sync);
     };
-    storage_options.do_snapshot_function =
-        std::bind(&pikiwidb::PRaft::DoSnapshot, &pikiwidb::PRAFT, std::placeholders::_1, std::placeholders::_2);
   }
 
   storage_options.db_instance_num = g_config.db_instance_num.load();
@@ -61,7 +63,7 @@ rocksdb::Status DB::Open() {
   return rocksdb::Status::OK();
 }
 
-void DB::CreateCheckpoint(const std::string& checkpoint_path, bool sync) {
+void DB::CreateCheckpoint(const std::string& checkpoint_path, bool sync, const std::vector<int32_t>& instances) {
   auto checkpoint_sub_path = checkpoint_path + '/' + std::to_string(db_index_);
   if (0 != pstd::CreatePath(checkpoint_sub_path)) {
     WARN("Create dir {} fail !", checkpoint_sub_path);
@@ -69,7 +71,7 @@ void DB::CreateCheckpoint(const std::string& checkpoint_path, bool sync) {
   }
 
   std::shared_lock sharedLock(storage_mutex_);
-  auto result = storage_->CreateCheckpoint(checkpoint_sub_path);
+  auto result = storage_->CreateCheckpoint(checkpoint_sub_path, instances);
   if (sync) {
     for (auto& r : result) {
       r.get();
@@ -77,7 +79,8 @@ void DB::CreateCheckpoint(const std::string& checkpoint_path, bool sync) {
   }
 }
 
-void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[maybe_unused]]) {
+void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[maybe_unused]],
+                              const std::vector<int32_t>& instances) {
   auto checkpoint_sub_path = checkpoint_path + '/' + std::to_string(db_index_);
   if (0 != pstd::IsDir(checkpoint_sub_path)) {
     WARN("Checkpoint dir {} does not exist!", checkpoint_sub_path);
@@ -92,7 +95,7 @@ void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[ma
 
   std::lock_guard<std::shared_mutex> lock(storage_mutex_);
   opened_ = false;
-  auto result = storage_->LoadCheckpoint(checkpoint_sub_path, db_path_);
+  auto result = storage_->LoadCheckpoint(checkpoint_sub_path, db_path_, instances);
 
   for (auto& r : result) {
     r.get();
@@ -108,11 +111,13 @@ void DB::LoadDBFromCheckpoint(const std::string& checkpoint_path, bool sync [[ma
   storage_options.options.periodic_compaction_seconds =
       g_config.rocksdb_periodic_second.load(std::memory_order_relaxed);
   if (g_config.use_raft.load(std::memory_order_relaxed)) {
-    storage_options.append_log_function = [&r = PRAFT](const Binlog& log, std::promise<rocksdb::Status>&& promise) {
-      r.AppendLog(log, std::move(promise));
+    // the log of a storage instance is replicated by the raft group owning it
+    storage_options.append_log_function = [](storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+      PRaft::GroupOfInstance(static_cast<int32_t>(log.slot_idx())).AppendLog(std::move(log), std::move(done));
+    };
+    storage_options.do_snapshot_function = [](int32_t inst_id, storage::LogIndex log_index, bool sync) {
+      PRaft::GroupOfInstance(inst_id).DoSnapshot(log_index, sync);
     };
-    storage_options.do_snapshot_function =
-        std::bind(&pikiwidb::PRaft::DoSnapshot, &pikiwidb::PRAFT, std::placeholders::_1, std::placeholders::_2);
   }
   storage_ = std::make_unique<storage::Storage>();
 
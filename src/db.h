@@ -9,6 +9,7 @@
 
 #include <filesystem>
 #include <string>
+#include <vector>
 
 #include "pstd/log.h"
 #include "pstd/noncopyable.h"
@@ -33,9 +34,10 @@ class DB {
 
   void UnLockShared() { storage_mutex_.unlock_shared(); }
 
-  void CreateCheckpoint(const std::string& path, bool sync);
+  // Of the storage instances in instances only, or of all of them if it is empty
+  void CreateCheckpoint(const std::string& path, bool sync, const std::vector<int32_t>& instances = {});
 
-  void LoadDBFromCheckpoint(const std::string& path, bool sync = true);
+  void LoadDBFromCheckpoint(const std::string& path, bool sync = true, const std::vector<int32_t>& instances = {});
 
   int GetDbIndex() { return db_index_; }
 
@@ -171,6 +171,7 @@ void IOThreadPool::Reset() {
 }
 
 void WorkIOThreadPool::PushWriteTask(std::shared_ptr<PClient> client) {
+  client->Trace().replied = RequestTrace::Now();
   auto pos = ++counter_ % worker_num_;
   std::unique_lock lock(*writeMutex_[pos]);
 
@@ -216,6 +217,17 @@ void WorkIOThreadPool::StartWorkers() {
     INFO("worker write thread {}, starting...", index);
     writeThreads_.push_back(std::move(t));
   }
+  writeQueueNum_.store(writeQueue_.size(), std::memory_order_release);
+}
+
+size_t WorkIOThreadPool::WriteTaskNum() {
+  size_t num = 0;
+  auto queues = writeQueueNum_.load(std::memory_order_acquire);
+  for (size_t i = 0; i < queues; ++i) {
+    std::unique_lock lock(*writeMutex_[i]);
+    num += writeQueue_[i].size();
+  }
+  return num;
 }
 
 void WorkIOThreadPool::Exit() {
@@ -233,6 +245,7 @@ void WorkIOThreadPool::Exit() {
     }
   }
   writeThreads_.clear();
+  writeQueueNum_ = 0;
   writeCond_.clear();
   writeQueue_.clear();
   writeMutex_.clear();
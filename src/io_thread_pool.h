@@ -95,6 +95,9 @@ class WorkIOThreadPool : public IOThreadPool {
   void Exit() override;
   void PushWriteTask(std::shared_ptr<PClient> client) override;
 
+  // get the number of replies waiting for a write thread
+  size_t WriteTaskNum();
+
  private:
   void StartWorkers() override;
 
@@ -103,6 +106,7 @@ class WorkIOThreadPool : public IOThreadPool {
   std::vector<std::unique_ptr<std::mutex>> writeMutex_;
   std::vector<std::unique_ptr<std::condition_variable>> writeCond_;
   std::vector<std::deque<std::shared_ptr<PClient>>> writeQueue_;
+  std::atomic<size_t> writeQueueNum_ = 0;  // the queues created, read by other threads
   std::atomic<uint64_t> counter_ = 0;
   bool writeRunning_ = true;
 };
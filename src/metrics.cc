@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "cmd_stats.h"
+#include "pikiwidb.h"
+#include "praft/praft.h"
+#include "store.h"
+
+namespace pikiwidb {
+
+// Summed over the column families of an instance, which have a block cache each unless share_block_cache is set
+static const char* const kRocksDBCFProperties[] = {
+    "rocksdb.estimate-num-keys",
+    "rocksdb.cur-size-all-mem-tables",
+    "rocksdb.num-immutable-mem-table",
+    "rocksdb.block-cache-usage",
+    "rocksdb.block-cache-pinned-usage",
+    "rocksdb.estimate-table-readers-mem",
+    "rocksdb.estimate-pending-compaction-bytes",
+    "rocksdb.total-sst-files-size",
+};
+
+// Of the whole instance
+static const char* const kRocksDBProperties[] = {
+    "rocksdb.num-running-flushes",
+    "rocksdb.num-running-compactions",
+    "rocksdb.actual-delayed-write-rate",
+    "rocksdb.is-write-stopped",
+};
+
+static const double kQuantiles[] = {0.5, 0.99, 0.999};
+
+// rocksdb.cur-size-all-mem-tables is exported as pikiwidb_rocksdb_cur_size_all_mem_tables
+static std::string MetricName(const std::string& property) {
+  std::string name = "pikiwidb_" + property;
+  std::replace(name.begin(), name.end(), '.', '_');
+  std::replace(name.begin(), name.end(), '-', '_');
+  return name;
+}
+
+static void AppendHeader(std::string* out, const std::string& name, const char* type, const char* help) {
+  fmt::format_to(std::back_inserter(*out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+// A summary of microseconds, labels are those of the series it belongs to
+static void AppendSummary(std::string* out, const char* name, const std::string& labels,
+                          const pstd::HistogramSnapshot& snapshot) {
+  for (auto quantile : kQuantiles) {
+    fmt::format_to(std::back_inserter(*out), "{}{{{},quantile=\"{}\"}} {}\n", name, labels, quantile,
+                   snapshot.Percentile(quantile * 100));
+  }
+  fmt::format_to(std::back_inserter(*out), "{}_sum{{{}}} {}\n{}_count{{{}}} {}\n", name, labels, snapshot.Sum(), name,
+                 labels, snapshot.Count());
+}
+
+static void AppendCommands(std::string* out) {
+  static const char* const kName = "pikiwidb_command_duration_usec";
+  AppendHeader(out, kName, "summary", "The microseconds the commands took to execute, by command.");
+  for (const auto& [cmd, snapshot] : CmdStats::Instance().GetSnapshots()) {
+    AppendSummary(out, kName, fmt::format("cmd=\"{}\"", cmd), snapshot);
+  }
+
+  static const char* const kStageName = "pikiwidb_request_stage_duration_usec";
+  AppendHeader(out, kStageName, "summary", "The microseconds the requests spent in each stage, by stage.");
+  auto snapshots = CmdStats::Instance().GetStageSnapshots();
+  for (int stage = 0; stage < kRequestStageNum; stage++) {
+    AppendSummary(out, kStageName, fmt::format("stage=\"{}\"", RequestStageName(static_cast<RequestStage>(stage))),
+                  snapshots[stage]);
+  }
+}
+
+static void AppendServer(std::string* out) {
+  AppendHeader(out, "pikiwidb_connected_clients", "gauge", "The client connections.");
+  fmt::format_to(std::back_inserter(*out), "pikiwidb_connected_clients {}\n", g_pikiwidb->GetConnectedClients());
+
+  AppendHeader(out, "pikiwidb_queued_tasks", "gauge", "The tasks waiting for a thread, by queue.");
+  fmt::format_to(std::back_inserter(*out), "pikiwidb_queued_tasks{{queue=\"fast_cmd\"}} {}\n",
+                 g_pikiwidb->GetFastCmdTaskNum());
+  fmt::format_to(std::back_inserter(*out), "pikiwidb_queued_tasks{{queue=\"slow_cmd\"}} {}\n",
+                 g_pikiwidb->GetSlowCmdTaskNum());
+  fmt::format_to(std::back_inserter(*out), "pikiwidb_queued_tasks{{queue=\"write\"}} {}\n",
+                 g_pikiwidb->GetWriteTaskNum());
+}
+
+static void AppendRocksDB(std::string* out) {
+  // the values of a property, by db then by instance
+  auto append_property = [out](const char* property, bool all_column_families) {
+    auto name = MetricName(property);
+    AppendHeader(out, name, "gauge", fmt::format("The {} property of each rocksdb instance.", property).c_str());
+    for (int db = 0; db < PSTORE.GetDBNumber(); db++) {
+      auto& backend = PSTORE.GetBackend(db);
+      std::map<int, uint64_t> values;
+      backend->LockShared();
+      if (all_column_families) {
+        backend->GetStorage()->GetAggregatedUsage(property, &values);
+      } else {
+        backend->GetStorage()->GetUsage(property, &values);
+      }
+      backend->UnLockShared();
+      for (const auto& [inst, value] : values) {
+        fmt::format_to(std::back_inserter(*out), "{}{{db=\"{}\",instance=\"{}\"}} {}\n", name, db, inst, value);
+      }
+    }
+  };
+
+  for (auto property : kRocksDBCFProperties) {
+    append_property(property, true);
+  }
+  for (auto property : kRocksDBProperties) {
+    append_property(property, false);
+  }
+}
+
+static void AppendRaft(std::string* out) {
+  std::vector<std::pair<uint32_t, braft::NodeStatus>> groups;
+  for (uint32_t i = 0; i < PRaft::GroupNum(); i++) {
+    if (PRaft::Group(i).IsInitialized()) {
+      groups.emplace_back(i, PRaft::Group(i).GetNodeStatus());
+    }
+  }
+  if (groups.empty()) {
+    return;
+  }
+
+  auto append_gauge = [out, &groups](const char* name, const char* help, auto&& value_of) {
+    AppendHeader(out, name, "gauge", help);
+    for (const auto& [group, status] : groups) {
+      fmt::format_to(std::back_inserter(*out), "{}{{group=\"{}\"}} {}\n", name, group, value_of(status));
+    }
+  };
+  append_gauge("pikiwidb_raft_term", "The current term of each raft group.",
+               [](const braft::NodeStatus& status) { return status.term; });
+  append_gauge("pikiwidb_raft_committed_index", "The last log index committed of each raft group.",
+               [](const braft::NodeStatus& status) { return status.committed_index; });
+  append_gauge("pikiwidb_raft_applied_index", "The last log index applied of each raft group.",
+               [](const braft::NodeStatus& status) { return status.known_applied_index; });
+  append_gauge("pikiwidb_raft_leader", "1 if the node leads the raft group.",
+               [](const braft::NodeStatus& status) { return status.state == braft::STATE_LEADER ? 1 : 0; });
+}
+
+std::string CollectMetrics() {
+  std::string out;
+  AppendCommands(&out);
+  AppendServer(&out);
+  AppendRocksDB(&out);
+  AppendRaft(&out);
+  return out;
+}
+
+void MetricsCollector::Start(std::chrono::milliseconds interval) {
+  text_ = CollectMetrics();
+  stop_ = false;
+  thread_ = std::thread(&MetricsCollector::Run, this, interval);
+}
+
+void MetricsCollector::Stop() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::string MetricsCollector::Get() {
+  std::lock_guard lock(mutex_);
+  return text_;
+}
+
+void MetricsCollector::Run(std::chrono::milliseconds interval) {
+  std::unique_lock lock(mutex_);
+  while (!cond_.wait_for(lock, interval, [this] { return stop_; })) {
+    lock.unlock();
+    auto text = CollectMetrics();
+    lock.lock();
+    text_ = std::move(text);
+  }
+}
+
+}  // namespace pikiwidb
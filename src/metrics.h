@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace pikiwidb {
+
+/*
+ * The metrics of the server in the Prometheus text format, served at /metrics
+ * on metrics-port. They are read from what the server already keeps: the
+ * latency histograms merged once per call, the queues locked as long as their
+ * sizes are read, and the integer properties rocksdb keeps up to date, so
+ * collecting them every second does not slow the requests down.
+ */
+std::string CollectMetrics();
+
+// Collects the metrics on its own thread every interval, so that a scrape is
+// answered from the IO loop without reading the storage there
+class MetricsCollector {
+ public:
+  ~MetricsCollector() { Stop(); }
+
+  void Start(std::chrono::milliseconds interval);
+  void Stop();
+
+  // The metrics last collected
+  std::string Get();
+
+ private:
+  void Run(std::chrono::milliseconds interval);
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;  // wakes the thread to stop
+  bool stop_ = false;
+  std::string text_;
+};
+
+}  // namespace pikiwidb
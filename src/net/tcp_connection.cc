@@ -174,6 +174,21 @@ bool TcpConnection::SendPacket(const evbuffer_iovec* iovecs, size_t nvecs) {
   return true;
 }
 
+void TcpConnection::HandleUnconsumedData() {
+  auto w_obj(weak_from_this());
+  loop_->Execute([w_obj]() {
+    auto c = w_obj.lock();
+    if (!c) {
+      return;  // connection already lost
+    }
+
+    auto tcp_conn = std::static_pointer_cast<TcpConnection>(c);
+    if (tcp_conn->state_ == State::kConnected) {
+      OnRecvData(tcp_conn->bev_, tcp_conn.get());
+    }
+  });
+}
+
 void TcpConnection::HandleConnect() {
   assert(loop_->InThisLoop());
   assert(state_ == State::kNone || state_ == State::kConnecting);
@@ -43,6 +43,9 @@ class TcpConnection : public EventObject {
   bool SendPacket(UnboundedBuffer& data) { return SendPacket(data.ReadAddr(), data.ReadableSize()); }
   bool SendPacket(const evbuffer_iovec* iovecs, size_t nvecs);
 
+  // Passes the data the message callback left unconsumed to it again, can be called from any thread
+  void HandleUnconsumedData();
+
   void SetNewConnCallback(NewTcpConnectionCallback cb) { on_new_conn_ = std::move(cb); }
   void SetOnDisconnect(TcpDisconnectCallback cb) { on_disconnect_ = std::move(cb); }
   void SetMessageCallback(TcpMessageCallback cb) { on_message_ = std::move(cb); }
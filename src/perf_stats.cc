@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "perf_stats.h"
+
+#include "rocksdb/iostats_context.h"
+#include "rocksdb/perf_context.h"
+#include "rocksdb/perf_level.h"
+
+namespace pikiwidb {
+
+const char* PerfCounterName(PerfCounter counter) {
+  static const char* const kNames[kPerfCounterNum] = {
+      "block_cache_hits",
+      "block_reads",
+      "block_read_bytes",
+      "block_read_nanos",
+      "memtable_gets",
+      "memtable_bloom_hits",
+      "memtable_bloom_misses",
+      "sst_bloom_hits",
+      "sst_bloom_misses",
+      "tombstones_skipped",
+      "keys_skipped",
+      "mutex_wait_nanos",
+      "condition_wait_nanos",
+      "io_read_bytes",
+      "io_read_nanos",
+  };
+  return kNames[counter];
+}
+
+PerfScope::PerfScope() {
+  rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTime);
+  rocksdb::get_perf_context()->Reset();
+  rocksdb::get_iostats_context()->Reset();
+}
+
+PerfScope::~PerfScope() { rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable); }
+
+PerfCounters PerfScope::Counters() const {
+  const auto* perf = rocksdb::get_perf_context();
+  const auto* iostats = rocksdb::get_iostats_context();
+  PerfCounters counters{};
+  counters[kPerfBlockCacheHits] = perf->block_cache_hit_count;
+  counters[kPerfBlockReads] = perf->block_read_count;
+  counters[kPerfBlockReadBytes] = perf->block_read_byte;
+  counters[kPerfBlockReadNanos] = perf->block_read_time;
+  counters[kPerfMemtableGets] = perf->get_from_memtable_count;
+  counters[kPerfMemtableBloomHits] = perf->bloom_memtable_hit_count;
+  counters[kPerfMemtableBloomMisses] = perf->bloom_memtable_miss_count;
+  counters[kPerfSstBloomHits] = perf->bloom_sst_hit_count;
+  counters[kPerfSstBloomMisses] = perf->bloom_sst_miss_count;
+  counters[kPerfTombstonesSkipped] = perf->internal_delete_skipped_count;
+  counters[kPerfKeysSkipped] = perf->internal_key_skipped_count;
+  counters[kPerfMutexWaitNanos] = perf->db_mutex_lock_nanos;
+  counters[kPerfConditionWaitNanos] = perf->db_condition_wait_nanos;
+  counters[kPerfIOReadBytes] = iostats->bytes_read;
+  counters[kPerfIOReadNanos] = iostats->read_nanos;
+  return counters;
+}
+
+PerfStats& PerfStats::Instance() {
+  static PerfStats stats;
+
+  return stats;
+}
+
+void PerfStats::Record(const std::string& cmd, int db, int instance, const PerfCounters& counters) {
+  auto add = [&counters](Aggregate& aggregate) {
+    aggregate.samples++;
+    for (int i = 0; i < kPerfCounterNum; i++) {
+      aggregate.counters[i] += counters[i];
+    }
+  };
+
+  std::lock_guard l(mutex_);
+  add(cmds_[cmd]);
+  if (instance >= 0) {
+    add(instances_[{db, instance}]);
+  }
+}
+
+std::map<std::string, PerfStats::Aggregate> PerfStats::GetCmdStats() const {
+  std::lock_guard l(mutex_);
+  return cmds_;
+}
+
+std::map<std::pair<int, int>, PerfStats::Aggregate> PerfStats::GetInstanceStats() const {
+  std::lock_guard l(mutex_);
+  return instances_;
+}
+
+}  // namespace pikiwidb
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace pikiwidb {
+
+// The rocksdb PerfContext and IOStatsContext counters of a profiled command
+enum PerfCounter {
+  kPerfBlockCacheHits,       // block_cache_hit_count
+  kPerfBlockReads,           // block_read_count
+  kPerfBlockReadBytes,       // block_read_byte
+  kPerfBlockReadNanos,       // block_read_time
+  kPerfMemtableGets,         // get_from_memtable_count
+  kPerfMemtableBloomHits,    // bloom_memtable_hit_count
+  kPerfMemtableBloomMisses,  // bloom_memtable_miss_count
+  kPerfSstBloomHits,         // bloom_sst_hit_count
+  kPerfSstBloomMisses,       // bloom_sst_miss_count
+  kPerfTombstonesSkipped,    // internal_delete_skipped_count
+  kPerfKeysSkipped,          // internal_key_skipped_count
+  kPerfMutexWaitNanos,       // db_mutex_lock_nanos
+  kPerfConditionWaitNanos,   // db_condition_wait_nanos
+  kPerfIOReadBytes,          // IOStatsContext bytes_read
+  kPerfIOReadNanos,          // IOStatsContext read_nanos
+  kPerfCounterNum,
+};
+
+using PerfCounters = std::array<uint64_t, kPerfCounterNum>;
+
+const char* PerfCounterName(PerfCounter counter);
+
+// Profiles the rocksdb calls of the calling thread while in scope, at the cost of timing them
+class PerfScope {
+ public:
+  PerfScope();
+  ~PerfScope();
+
+  PerfScope(const PerfScope&) = delete;
+  void operator=(const PerfScope&) = delete;
+
+  // The counters since the scope began
+  PerfCounters Counters() const;
+};
+
+/*
+ * The counters of the profiled commands, summed by command and by rocksdb
+ * instance. A command is profiled once in perf-context-sample-rate calls, or
+ * every call when perf-context-slower-than is set, of which those slower are
+ * kept. Few are kept, so they are summed under a lock.
+ */
+class PerfStats {
+ public:
+  struct Aggregate {
+    uint64_t samples = 0;
+    PerfCounters counters{};
+  };
+
+  static PerfStats& Instance();
+
+  PerfStats(const PerfStats&) = delete;
+  void operator=(const PerfStats&) = delete;
+
+  // instance is the rocksdb instance of the first key of the command in db, -1 if it has none
+  void Record(const std::string& cmd, int db, int instance, const PerfCounters& counters);
+
+  std::map<std::string, Aggregate> GetCmdStats() const;
+  // By db then instance
+  std::map<std::pair<int, int>, Aggregate> GetInstanceStats() const;
+
+ private:
+  PerfStats() = default;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Aggregate> cmds_;
+  std::map<std::pair<int, int>, Aggregate> instances_;
+};
+
+}  // namespace pikiwidb
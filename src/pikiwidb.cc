@@ -24,6 +24,7 @@
 #include "client.h"
 #include "config.h"
 #include "helper.h"
+#include "metrics.h"
 #include "pikiwidb_logo.h"
 #include "slow_log.h"
 #include "store.h"
@@ -109,14 +110,16 @@ void PikiwiDB::OnNewConnection(pikiwidb::TcpConnection* obj) {
 
   auto client = std::make_shared<pikiwidb::PClient>(obj);
   obj->SetContext(client);
+  connected_clients_.fetch_add(1, std::memory_order_relaxed);
 
   client->OnConnect();
 
   auto msg_cb = std::bind(&pikiwidb::PClient::HandlePackets, client.get(), std::placeholders::_1, std::placeholders::_2,
                           std::placeholders::_3);
   obj->SetMessageCallback(msg_cb);
-  obj->SetOnDisconnect([](pikiwidb::TcpConnection* obj) {
+  obj->SetOnDisconnect([this](pikiwidb::TcpConnection* obj) {
     INFO("disconnect from {}", obj->GetPeerIP());
+    connected_clients_.fetch_sub(1, std::memory_order_relaxed);
     obj->GetContext<pikiwidb::PClient>()->SetState(pikiwidb::ClientState::kClosed);
   });
   obj->SetNodelay(true);
@@ -170,13 +173,27 @@ bool PikiwiDB::Init() {
 
   PSTORE.Init(g_config.databases.load(std::memory_order_relaxed));
 
-  PSlowLog::Instance().SetThreshold(g_config.slow_log_time.load());
   PSlowLog::Instance().SetLogLimit(static_cast<std::size_t>(g_config.slow_log_max_len.load()));
 
   // init base loop
   auto loop = worker_threads_.BaseLoop();
   loop->ScheduleRepeatedly(1000, &PReplication::Cron, &PREPL);
 
+  auto metrics_port = g_config.metrics_port.load();
+  if (metrics_port != 0) {
+    metrics_collector_.Start(kMetricsCollectInterval);
+    metrics_server_ = worker_threads_.ListenHTTP(g_config.ip.ToString().c_str(), metrics_port);
+    metrics_server_->HandleFunc("/metrics",
+                                [this](const pikiwidb::HttpRequest&, std::shared_ptr<pikiwidb::HttpContext>) {
+                                  auto rsp = std::make_unique<pikiwidb::HttpResponse>();
+                                  rsp->SetCode(200);
+                                  rsp->SetStatus("OK");
+                                  rsp->SetHeader("Content-Type", "text/plain; version=0.0.4");
+                                  rsp->SetBody(metrics_collector_.Get());
+                                  return rsp;
+                                });
+  }
+
   // master ip
   if (!g_config.ip.empty()) {
     PREPL.SetMasterAddr(g_config.master_ip.ToString().c_str(), g_config.master_port.load());
@@ -206,6 +223,7 @@ void PikiwiDB::Run() {
 }
 
 void PikiwiDB::Stop() {
+  metrics_collector_.Stop();
   pikiwidb::PRAFT.ShutDown();
   pikiwidb::PRAFT.Join();
   pikiwidb::PRAFT.Clear();
@@ -9,6 +9,7 @@
 #include "cmd_thread_pool.h"
 #include "common.h"
 #include "io_thread_pool.h"
+#include "metrics.h"
 #include "net/tcp_connection.h"
 
 #define KPIKIWIDB_VERSION "4.0.0"
@@ -50,6 +51,11 @@ class PikiwiDB final {
 
   void PushWriteTask(const std::shared_ptr<pikiwidb::PClient>& client) { worker_threads_.PushWriteTask(client); }
 
+  uint64_t GetConnectedClients() const { return connected_clients_.load(std::memory_order_relaxed); }
+  size_t GetFastCmdTaskNum() { return cmd_threads_.FastTaskNum(); }
+  size_t GetSlowCmdTaskNum() { return cmd_threads_.SlowTaskNum(); }
+  size_t GetWriteTaskNum() { return worker_threads_.WriteTaskNum(); }
+
  public:
   PString cfg_file_;
   uint16_t port_{0};
@@ -65,6 +71,12 @@ class PikiwiDB final {
   pikiwidb::IOThreadPool slave_threads_;
   pikiwidb::CmdThreadPool cmd_threads_;
   //  pikiwidb::CmdTableManager cmd_table_manager_;
+  // /metrics answers with what the collector gathered at most this long ago
+  static constexpr std::chrono::milliseconds kMetricsCollectInterval{1000};
+  std::shared_ptr<pikiwidb::HttpServer> metrics_server_;
+  pikiwidb::MetricsCollector metrics_collector_;
+
+  std::atomic<uint64_t> connected_clients_ = 0;
 
   uint32_t cmd_id_ = 0;
 
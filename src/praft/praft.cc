@@ -7,14 +7,23 @@
 
 #include "praft.h"
 
+#include <algorithm>
 #include <cassert>
+#include <future>
+#include <map>
+#include <utility>
+#include <vector>
 
+#include "braft/cli.h"
 #include "braft/snapshot.h"
 #include "braft/util.h"
+#include "brpc/channel.h"
 #include "brpc/server.h"
+#include "gflags/gflags.h"
 
 #include "pstd/log.h"
 #include "pstd/pstd_string.h"
+#include "storage/flat_binlog.h"
 
 #include "binlog.pb.h"
 #include "config.h"
@@ -33,6 +42,46 @@
 
 namespace pikiwidb {
 
+namespace {
+
+// Converts the entries of a flat binlog for the followers which only read protobuf binlogs
+class ProtobufBinlogConverter : public rocksdb::WriteBatch::Handler {
+ public:
+  explicit ProtobufBinlogConverter(Binlog* log) : log_(log) {}
+
+  rocksdb::Status PutCF(uint32_t cf_idx, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    auto entry = log_->add_entries();
+    entry->set_cf_idx(cf_idx);
+    entry->set_op_type(OperateType::kPut);
+    entry->set_key(key.ToString());
+    entry->set_value(value.ToString());
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status DeleteCF(uint32_t cf_idx, const rocksdb::Slice& key) override {
+    auto entry = log_->add_entries();
+    entry->set_cf_idx(cf_idx);
+    entry->set_op_type(OperateType::kDelete);
+    entry->set_key(key.ToString());
+    return rocksdb::Status::OK();
+  }
+
+ private:
+  Binlog* log_ = nullptr;
+};
+
+// The lease changes how the peers vote, so it is only turned on once a lease read
+// is issued or served here, or the configured read mode is lease
+void EnableLeaderLease() {
+  static std::once_flag enabled;
+  std::call_once(enabled, [] {
+    google::SetCommandLineOption("raft_enable_leader_lease", "true");
+    INFO("leader lease enabled");
+  });
+}
+
+}  // namespace
+
 bool ClusterCmdContext::Set(ClusterCmdType cluster_cmd_type, PClient* client, std::string&& peer_ip, int port,
                             std::string&& peer_id) {
   std::unique_lock<std::mutex> lck(mtx_);
@@ -84,7 +133,27 @@ PRaft& PRaft::Instance() {
   return store;
 }
 
+PRaft& PRaft::Group(uint32_t index) {
+  static std::vector<std::unique_ptr<PRaft>> groups = [] {
+    std::vector<std::unique_ptr<PRaft>> groups;
+    for (uint32_t i = 1; i < GroupNum(); i++) {
+      groups.push_back(std::make_unique<PRaft>(i));
+    }
+    return groups;
+  }();
+  assert(index < GroupNum());
+  return index == 0 ? Instance() : *groups[index - 1];
+}
+
+uint32_t PRaft::GroupNum() {
+  // fixed once read, the logs of a group only hold the writes of its instances
+  static const uint32_t group_num = std::clamp<uint32_t>(
+      g_config.raft_group_num.load(), 1, std::max<uint32_t>(g_config.db_instance_num.load(), 1));
+  return group_num;
+}
+
 butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
+  assert(index_ == 0);
   if (node_ && server_) {
     return {0, "OK"};
   }
@@ -97,6 +166,10 @@ butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
     server_.reset();
     return ERROR_LOG_AND_STATUS("Failed to add service");
   }
+  if (server_->AddService(new PRaftServiceImpl(), brpc::SERVER_OWNS_SERVICE) != 0) {
+    server_.reset();
+    return ERROR_LOG_AND_STATUS("Failed to add praft service");
+  }
   // raft can share the same RPC server. Notice the second parameter, because
   // adding services into a running server is not allowed and the listen
   // address of this server is impossible to get before the server starts. You
@@ -117,7 +190,6 @@ butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
   }
   // It's ok to start PRaft;
   assert(group_id.size() == RAFT_GROUPID_LEN);
-  this->group_id_ = group_id;
 
   // FIXME: g_config.ip is default to 127.0.0.0, which may not work in cluster.
   raw_addr_ = g_config.ip.ToString() + ":" + std::to_string(port);
@@ -129,6 +201,27 @@ butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
   }
   butil::EndPoint addr(ip, port);
 
+  // lease reads are served by a leader without a round of heartbeats while its lease is valid
+  if (ParseRaftReadMode(g_config.raft_read_mode.ToString()) == RaftReadMode::kLease) {
+    EnableLeaderLease();
+  }
+  // The groups share the server, their nodes are told apart by the group name
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    auto s = Group(i).InitNode(group_id, addr, initial_conf_is_null);
+    if (!s.ok()) {
+      ShutDown();
+      Join();
+      Clear();
+      return s;
+    }
+  }
+  return {0, "OK"};
+}
+
+butil::Status PRaft::InitNode(const std::string& group_id, const butil::EndPoint& addr, bool initial_conf_is_null) {
+  group_id_ = group_id;
+  raw_addr_ = butil::endpoint2str(addr).c_str();
+
   // Default init in one node.
   // initial_conf takes effect only when the replication group is started from an empty node.
   // The Configuration is restored from the snapshot and log files when the data in the replication group is not empty.
@@ -142,7 +235,6 @@ butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
     initial_conf = raw_addr_ + ":0,";
   }
   if (node_options_.initial_conf.parse_from(initial_conf) != 0) {
-    server_.reset();
     return ERROR_LOG_AND_STATUS("Failed to parse configuration");
   }
 
@@ -151,23 +243,42 @@ butil::Status PRaft::Init(std::string& group_id, bool initial_conf_is_null) {
   node_options_.node_owns_fsm = false;
   node_options_.snapshot_interval_s = 0;
   std::string prefix = "local://" + g_config.db_path.ToString() + "_praft";
+  if (index_ != 0) {
+    prefix += "_" + std::to_string(index_);
+  }
   node_options_.log_uri = prefix + "/log";
   node_options_.raft_meta_uri = prefix + "/raft_meta";
   node_options_.snapshot_uri = prefix + "/snapshot";
   // node_options_.disable_cli = FLAGS_disable_cli;
-  snapshot_adaptor_ = new PPosixFileSystemAdaptor();
+  snapshot_adaptor_ = new PPosixFileSystemAdaptor(GetInstances());
   node_options_.snapshot_file_system_adaptor = &snapshot_adaptor_;
+  // a follower links the SST files it already has instead of copying them again
+  node_options_.filter_before_copy_remote = true;
 
-  node_ = std::make_unique<braft::Node>("pikiwidb", braft::PeerId(addr));  // group_id
+  node_ = std::make_unique<braft::Node>(GetGroupName(), braft::PeerId(addr));
   if (node_->init(node_options_) != 0) {
-    server_.reset();
     node_.reset();
     return ERROR_LOG_AND_STATUS("Failed to init raft node");
   }
+  static_cast<PPosixFileSystemAdaptor*>(snapshot_adaptor_.get())->SetCheckpointEnabled(true);
 
   return {0, "OK"};
 }
 
+std::string PRaft::GetGroupName() const {
+  // the group 0 keeps the name nodes used before there were several groups
+  return index_ == 0 ? "pikiwidb" : "pikiwidb_" + std::to_string(index_);
+}
+
+std::vector<int32_t> PRaft::GetInstances() const {
+  std::vector<int32_t> instances;
+  for (auto i = static_cast<int32_t>(index_); i < static_cast<int32_t>(g_config.db_instance_num.load());
+       i += static_cast<int32_t>(GroupNum())) {
+    instances.push_back(i);
+  }
+  return instances;
+}
+
 bool PRaft::IsLeader() const {
   if (!node_) {
     ERROR("Node is not initialized");
@@ -316,6 +427,7 @@ int PRaft::ProcessClusterCmdResponse(PClient* client, const char* start, int len
 void PRaft::CheckRocksDBConfiguration(PClient* client, PClient* join_client, const std::string& reply) {
   int databases_num = 0;
   int rocksdb_num = 0;
+  int raft_group_num = 1;  // not reported by the nodes running a single group
   std::string rockdb_version;
   std::string line;
   std::istringstream iss(reply);
@@ -338,6 +450,12 @@ void PRaft::CheckRocksDBConfiguration(PClient* client, PClient* join_client, con
         join_client->Clear();
         // If the join fails, clear clusterContext and set it again by using the join command
         cluster_cmd_ctx_.Clear();
+      } else if (key == RAFT_GROUP_NUM && pstd::String2int(value, &raft_group_num) == 0) {
+        join_client->SetRes(CmdRes::kErrOther, "Config of raft_group_num invalid");
+        join_client->SendPacket(join_client->Message());
+        join_client->Clear();
+        // If the join fails, clear clusterContext and set it again by using the join command
+        cluster_cmd_ctx_.Clear();
       } else if (key == ROCKSDB_VERSION) {
         rockdb_version = pstd::StringTrimRight(value, "\r");
       }
@@ -348,8 +466,9 @@ void PRaft::CheckRocksDBConfiguration(PClient* client, PClient* join_client, con
   int current_rocksdb_num = pikiwidb::g_config.db_instance_num;
   std::string current_rocksdb_version = ROCKSDB_NAMESPACE::GetRocksVersionAsString();
   if (current_databases_num != databases_num || current_rocksdb_num != rocksdb_num ||
-      current_rocksdb_version != rockdb_version) {
-    join_client->SetRes(CmdRes::kErrOther, "Config of databases_num, rocksdb_num or rocksdb_version mismatch");
+      current_rocksdb_version != rockdb_version || static_cast<int>(GroupNum()) != raft_group_num) {
+    join_client->SetRes(CmdRes::kErrOther,
+                        "Config of databases_num, rocksdb_num, rocksdb_version or raft_group_num mismatch");
     join_client->SendPacket(join_client->Message());
     join_client->Clear();
     // If the join fails, clear clusterContext and set it again by using the join command
@@ -484,43 +603,276 @@ int PRaft::ProcessClusterRemoveCmdResponse(PClient* client, const char* start, i
 
 butil::Status PRaft::AddPeer(const std::string& peer) {
   if (!node_) {
-    ERROR_LOG_AND_STATUS("Node is not initialized");
+    return ERROR_LOG_AND_STATUS("Node is not initialized");
+  }
+
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    auto s = Group(i).ChangePeer(peer, true);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {0, "OK"};
+}
+
+butil::Status PRaft::RemovePeer(const std::string& peer) {
+  if (!node_) {
+    return ERROR_LOG_AND_STATUS("Node is not initialized");
+  }
+
+  // the group 0 last, a node which failed to leave some group can be removed again
+  for (uint32_t i = GroupNum(); i-- > 0;) {
+    auto s = Group(i).ChangePeer(peer, false);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return {0, "OK"};
+}
+
+butil::Status PRaft::ChangePeer(const std::string& peer, bool add) {
+  if (!node_) {
+    return ERROR_LOG_AND_STATUS("Node is not initialized");
+  }
+
+  if (!node_->is_leader()) {
+    // the leader of another group may run on another node, it is reached by the cli service
+    braft::Configuration conf;
+    auto leader_id = node_->leader_id();
+    if (leader_id.is_empty()) {
+      return butil::Status(EAGAIN, "The group %s has no leader", GetGroupName().c_str());
+    }
+    conf.add_peer(leader_id);
+    auto s = add ? braft::cli::add_peer(GetGroupName(), conf, peer, braft::cli::CliOptions())
+                 : braft::cli::remove_peer(GetGroupName(), conf, peer, braft::cli::CliOptions());
+    if (!s.ok()) {
+      WARN("Failed to {} peer {} of group {}, status: {}", add ? "add" : "remove", peer, GetGroupName(),
+           s.error_str());
+    }
+    return s;
   }
 
   braft::SynchronizedClosure done;
-  node_->add_peer(peer, &done);
+  if (add) {
+    node_->add_peer(peer, &done);
+  } else {
+    node_->remove_peer(peer, &done);
+  }
   done.wait();
 
   if (!done.status().ok()) {
-    WARN("Failed to add peer {} to node {}, status: {}", peer, node_->node_id().to_string(), done.status().error_str());
+    WARN("Failed to {} peer {} of node {}, status: {}", add ? "add" : "remove", peer, node_->node_id().to_string(),
+         done.status().error_str());
     return done.status();
   }
 
   return {0, "OK"};
 }
 
-butil::Status PRaft::RemovePeer(const std::string& peer) {
+butil::Status PRaft::TransferLeader(const std::string& peer) {
   if (!node_) {
     return ERROR_LOG_AND_STATUS("Node is not initialized");
   }
 
+  braft::PeerId peer_id;
+  if (peer_id.parse(peer) != 0) {
+    return butil::Status(EINVAL, "Invalid peer %s", peer.c_str());
+  }
+  if (node_->is_leader()) {
+    if (node_->transfer_leadership_to(peer_id) != 0) {
+      return butil::Status(EINVAL, "Failed to transfer the leader of group %s to %s", GetGroupName().c_str(),
+                           peer.c_str());
+    }
+    return {0, "OK"};
+  }
+
+  braft::Configuration conf;
+  auto leader_id = node_->leader_id();
+  if (leader_id.is_empty()) {
+    return butil::Status(EAGAIN, "The group %s has no leader", GetGroupName().c_str());
+  }
+  conf.add_peer(leader_id);
+  return braft::cli::transfer_leader(GetGroupName(), conf, peer_id, braft::cli::CliOptions());
+}
+
+butil::Status PRaft::BalanceLeaders(int32_t* transferred) {
+  *transferred = 0;
+  std::vector<braft::PeerId> peers;
+  auto s = GetListPeers(&peers);
+  if (!s.ok()) {
+    return s;
+  }
+  if (peers.empty()) {
+    return {0, "OK"};
+  }
+
+  // Every node leads the same number of groups, give or take one, in the
+  // order of their addresses so that the result does not depend on the caller
+  std::sort(peers.begin(), peers.end());
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    auto& group = Group(i);
+    const auto& target = peers[i % peers.size()];
+    if (group.GetLeaderID() == target.to_string()) {
+      continue;
+    }
+    s = group.TransferLeader(target.to_string());
+    if (!s.ok()) {
+      return s;
+    }
+    ++*transferred;
+  }
+  return {0, "OK"};
+}
+
+butil::Status PRaft::WaitForReadIndex(bool lease) {
+  if (!node_) {
+    return ERROR_LOG_AND_STATUS("Node is not initialized");
+  }
+  if (lease) {
+    EnableLeaderLease();
+  }
+  auto deadline = std::chrono::steady_clock::now() + kReadIndexTimeout;
+  auto& batch = read_batches_[lease ? 1 : 0];
+  std::unique_lock lock(read_mutex_);
+  uint64_t ticket = ++batch.requested;
+  while (batch.confirmed < ticket) {
+    if (batch.in_flight) {
+      // the request in flight may have been sent before this read, the next one covers it
+      if (read_cond_.wait_until(lock, deadline) == std::cv_status::timeout && batch.confirmed < ticket) {
+        return butil::Status(ETIMEDOUT, "Timed out waiting for the read index");
+      }
+      continue;
+    }
+    batch.in_flight = true;
+    uint64_t covered = batch.requested;
+    lock.unlock();
+    int64_t index = 0;
+    auto s = RequestReadIndex(lease, &index);
+    lock.lock();
+    batch.in_flight = false;
+    if (s.ok()) {
+      batch.confirmed = std::max(batch.confirmed, covered);
+      batch.index = std::max(batch.index, index);
+    }
+    read_cond_.notify_all();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  int64_t index = batch.index;
+  lock.unlock();
+
+  if (!WaitForApplied(index, deadline)) {
+    return butil::Status(ETIMEDOUT, "Timed out applying the logs up to the read index");
+  }
+  return {0, "OK"};
+}
+
+butil::Status PRaft::GetReadIndex(bool lease, int64_t* index) {
+  if (!node_ || !node_->is_leader()) {
+    return butil::Status(EPERM, "Node is not the leader");
+  }
+  if (lease) {
+    EnableLeaderLease();
+  }
+  // not valid until the lease is renewed once enabled, the read falls back to a round of heartbeats
+  if (lease && node_->is_leader_lease_valid()) {
+    *index = GetNodeStatus().committed_index;
+    return {0, "OK"};
+  }
+
+  // The leader is still the leader once an empty log of its term is committed,
+  // every write acknowledged before is applied by then
+  butil::IOBuf data;
   braft::SynchronizedClosure done;
-  node_->remove_peer(peer, &done);
+  braft::Task task;
+  task.data = &data;
+  task.done = &done;
+  node_->apply(task);
   done.wait();
-
   if (!done.status().ok()) {
-    WARN("Failed to remove peer {} from node {}, status: {}", peer, node_->node_id().to_string(),
-         done.status().error_str());
     return done.status();
   }
+  *index = applied_index_.load();
+  return {0, "OK"};
+}
 
+butil::Status PRaft::RequestReadIndex(bool lease, int64_t* index) {
+  if (node_->is_leader()) {
+    return GetReadIndex(lease, index);
+  }
+  auto leader = node_->leader_id();
+  if (leader.is_empty()) {
+    return butil::Status(EAGAIN, "The leader of %s is unknown", GetGroupName().c_str());
+  }
+
+  auto channel = GetLeaderChannel(leader.addr);
+  if (!channel) {
+    return ERROR_LOG_AND_STATUS("Failed to init the channel to the leader");
+  }
+  PRaftService_Stub stub(channel.get());
+  brpc::Controller cntl;
+  ReadIndexRequest request;
+  request.set_group(index_);
+  request.set_lease(lease);
+  ReadIndexResponse response;
+  stub.ReadIndex(&cntl, &request, &response, nullptr);
+  if (cntl.Failed()) {
+    return butil::Status(cntl.ErrorCode(), cntl.ErrorText());
+  }
+  if (!response.success()) {
+    return butil::Status(EPERM, response.error());
+  }
+  *index = response.index();
   return {0, "OK"};
 }
 
+std::shared_ptr<brpc::Channel> PRaft::GetLeaderChannel(const butil::EndPoint& addr) {
+  std::lock_guard lock(leader_channel_mutex_);
+  if (leader_channel_ && leader_channel_addr_ == addr) {
+    return leader_channel_;
+  }
+  auto channel = std::make_shared<brpc::Channel>();
+  brpc::ChannelOptions options;
+  options.timeout_ms = static_cast<int32_t>(kReadIndexTimeout.count());
+  if (channel->Init(addr, &options) != 0) {
+    return nullptr;
+  }
+  // the requests in flight keep the channel to the former leader
+  leader_channel_ = std::move(channel);
+  leader_channel_addr_ = addr;
+  return leader_channel_;
+}
+
+bool PRaft::WaitForApplied(int64_t index, std::chrono::steady_clock::time_point deadline) {
+  if (applied_index_.load() >= index) {
+    return true;
+  }
+  ++apply_waiters_;
+  std::unique_lock lock(apply_mutex_);
+  bool applied = apply_cond_.wait_until(lock, deadline, [&] { return applied_index_.load() >= index; });
+  --apply_waiters_;
+  return applied;
+}
+
+void PRaft::SetAppliedIndex(int64_t index) {
+  applied_index_.store(index);
+  // a waiter counted after the load sees the new index before it waits
+  if (apply_waiters_.load() > 0) {
+    std::lock_guard lock(apply_mutex_);
+    apply_cond_.notify_all();
+  }
+}
+
 butil::Status PRaft::DoSnapshot(int64_t self_snapshot_index, bool is_sync) {
   if (!node_) {
     return ERROR_LOG_AND_STATUS("Node is not initialized");
   }
+  if (!is_sync) {
+    // asked by a flush, which may run while the storage is reopened by a group loading a snapshot
+    node_->snapshot(nullptr, self_snapshot_index);
+    return {0, "OK"};
+  }
   braft::SynchronizedClosure done;
   node_->snapshot(&done, self_snapshot_index);
   done.wait();
@@ -542,8 +894,11 @@ void PRaft::OnClusterCmdConnectionFailed([[maybe_unused]] EventLoop* loop, const
 
 // Shut this node and server down.
 void PRaft::ShutDown() {
-  if (node_) {
-    node_->shutdown(nullptr);
+  assert(index_ == 0);
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    if (auto& node = Group(i).node_; node) {
+      node->shutdown(nullptr);
+    }
   }
 
   if (server_) {
@@ -553,8 +908,11 @@ void PRaft::ShutDown() {
 
 // Blocking this thread until the node is eventually down.
 void PRaft::Join() {
-  if (node_) {
-    node_->join();
+  assert(index_ == 0);
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    if (auto& node = Group(i).node_; node) {
+      node->join();
+    }
   }
 
   if (server_) {
@@ -562,18 +920,30 @@ void PRaft::Join() {
   }
 }
 
-void PRaft::AppendLog(const Binlog& log, std::promise<rocksdb::Status>&& promise) {
+void PRaft::AppendLog(storage::FlatBinlog&& log, storage::CommitCallback&& callback) {
   assert(node_);
   assert(node_->is_leader());
   butil::IOBuf data;
-  butil::IOBufAsZeroCopyOutputStream wrapper(&data);
-  auto done = new PRaftWriteDoneClosure(std::move(promise));
-  if (!log.SerializeToZeroCopyStream(&wrapper)) {
-    done->SetStatus(rocksdb::Status::Incomplete("Failed to serialize binlog"));
-    done->Run();
-    return;
+  auto done = new PRaftWriteDoneClosure(std::move(callback));
+  if (g_config.raft_protobuf_binlog.load(std::memory_order_relaxed)) {
+    Binlog pb_log;
+    pb_log.set_db_id(log.db_id());
+    pb_log.set_slot_idx(log.slot_idx());
+    ProtobufBinlogConverter converter(&pb_log);
+    butil::IOBufAsZeroCopyOutputStream wrapper(&data);
+    if (!log.batch().Iterate(&converter).ok() || !pb_log.SerializeToZeroCopyStream(&wrapper)) {
+      done->SetStatus(rocksdb::Status::Incomplete("Failed to serialize binlog"));
+      done->Run();
+      return;
+    }
+  } else {
+    // The rep of the batch is referenced by the IOBuf, not copied, the log is freed with the last reference
+    auto owner = new storage::FlatBinlog(std::move(log));
+    const auto& rep = owner->batch().Data();
+    data.append_user_data(const_cast<char*>(rep.data()), rep.size(), [owner](void*) { delete owner; });
+    data.append(owner->EncodeTrailer());
   }
-  DEBUG("append binlog: {}", log.ShortDebugString());
+  DEBUG("append binlog: {} bytes", data.size());
   braft::Task task;
   task.data = &data;
   task.done = done;
@@ -582,8 +952,9 @@ void PRaft::AppendLog(const Binlog& log, std::promise<rocksdb::Status>&& promise
 
 // @braft::StateMachine
 void PRaft::Clear() {
-  if (node_) {
-    node_.reset();
+  assert(index_ == 0);
+  for (uint32_t i = 0; i < GroupNum(); i++) {
+    Group(i).node_.reset();
   }
 
   if (server_) {
@@ -592,52 +963,138 @@ void PRaft::Clear() {
 }
 
 void PRaft::on_apply(braft::Iterator& iter) {
-  // A batch of tasks are committed, which must be processed through
+  // A batch of tasks are committed, which must be processed through. They are
+  // all decoded first and applied together by ApplyLogs.
+  std::vector<CommittedLog> logs;
   for (; iter.valid(); iter.next()) {
-    auto done = iter.done();
-    brpc::ClosureGuard done_guard(done);
-
-    Binlog log;
-    butil::IOBufAsZeroCopyInputStream wrapper(iter.data());
-    bool success = log.ParseFromZeroCopyStream(&wrapper);
-    DEBUG("apply binlog{}: {}", iter.index(), log.ShortDebugString());
-
-    if (!success) {
-      static constexpr std::string_view kMsg = "Failed to parse from protobuf when on_apply";
-      ERROR(kMsg);
-      if (done) {  // in leader
-        dynamic_cast<PRaftWriteDoneClosure*>(done)->SetStatus(rocksdb::Status::Incomplete(kMsg));
+    if (iter.data().empty()) {
+      // appended by GetReadIndex, the logs before it are applied first
+      ApplyLogs(logs);
+      logs.clear();
+      SetAppliedIndex(iter.index());
+      if (iter.done()) {
+        braft::run_closure_in_bthread(iter.done());
+      }
+      continue;
+    }
+    CommittedLog committed{.index = iter.index(), .done = iter.done()};
+    auto s = DecodeLog(iter.data(), &committed.log);
+    if (!s.ok()) {
+      ERROR("Failed to decode binlog {}: {}", iter.index(), s.ToString());
+      ApplyLogs(logs);
+      if (committed.done) {  // in leader
+        dynamic_cast<PRaftWriteDoneClosure*>(committed.done)->SetStatus(s);
+        braft::run_closure_in_bthread(committed.done);
       }
-      braft::run_closure_in_bthread(done_guard.release());
       return;
     }
+    logs.push_back(std::move(committed));
+  }
+  ApplyLogs(logs);
+}
+
+rocksdb::Status PRaft::DecodeLog(const butil::IOBuf& data, storage::FlatBinlog* log) {
+  char first_byte = 0;
+  if (data.copy_to(&first_byte, 1) == 1 && storage::FlatBinlog::IsFlat(first_byte)) {
+    std::string rep;
+    data.copy_to(&rep);
+    return storage::FlatBinlog::Decode(std::move(rep), log);
+  }
+
+  // written by a leader using the protobuf format
+  Binlog pb_log;
+  butil::IOBufAsZeroCopyInputStream wrapper(data);
+  if (!pb_log.ParseFromZeroCopyStream(&wrapper)) {
+    return rocksdb::Status::Incomplete("Failed to parse from protobuf when on_apply");
+  }
+  return PSTORE.GetBackend(pb_log.db_id())->GetStorage()->ToFlatBinlog(pb_log, log);
+}
+
+void PRaft::ApplyLogs(std::vector<CommittedLog>& logs) {
+  // The logs of a storage instance are written at once, in log order, the
+  // instances are written in parallel since their logs are independent
+  std::map<std::pair<uint32_t, uint32_t>, std::vector<size_t>> instance_logs;
+  for (size_t i = 0; i < logs.size(); i++) {
+    instance_logs[{logs[i].log.db_id(), logs[i].log.slot_idx()}].push_back(i);
+  }
 
-    auto s = PSTORE.GetBackend(log.db_id())->GetStorage()->OnBinlogWrite(log, iter.index());
-    if (done) {  // in leader
-      dynamic_cast<PRaftWriteDoneClosure*>(done)->SetStatus(s);
+  auto apply = [&logs](const std::vector<size_t>& positions) {
+    uint32_t db_id = logs[positions.front()].log.db_id();
+    std::vector<std::pair<storage::FlatBinlog, int64_t>> group;
+    group.reserve(positions.size());
+    for (auto pos : positions) {
+      group.emplace_back(std::move(logs[pos].log), logs[pos].index);
     }
-    //  _applied_index = iter.index(); // consider to maintain a member applied_idx
-    braft::run_closure_in_bthread(done_guard.release());
+    DEBUG("apply binlog {} to {}: {} logs", group.front().second, group.back().second, group.size());
+    // another group may be reopening the storage to load its snapshot
+    auto& db = PSTORE.GetBackend(static_cast<int>(db_id));
+    db->LockShared();
+    auto s = db->GetStorage()->OnBinlogWrite(std::move(group));
+    db->UnLockShared();
+    for (auto pos : positions) {
+      logs[pos].status = s;
+    }
+  };
+
+  std::vector<std::future<void>> applying;
+  if (!instance_logs.empty()) {
+    for (auto it = std::next(instance_logs.begin()); it != instance_logs.end(); ++it) {
+      auto future = apply_pool_.ExecuteTask(apply, std::cref(it->second));
+      if (future.valid()) {
+        applying.push_back(std::move(future));
+      } else {
+        // the pool is shutting down and did not take the task
+        apply(it->second);
+      }
+    }
+    apply(instance_logs.begin()->second);
+  }
+  for (auto& future : applying) {
+    future.wait();
+  }
+
+  for (auto& committed : logs) {
+    if (committed.done) {  // in leader
+      dynamic_cast<PRaftWriteDoneClosure*>(committed.done)->SetStatus(committed.status);
+      braft::run_closure_in_bthread(committed.done);
+    }
+  }
+  if (!logs.empty()) {
+    SetAppliedIndex(logs.back().index);
   }
 }
 
 void PRaft::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
   assert(writer);
   brpc::ClosureGuard done_guard(done);
+
+  // The snapshot index is a log index the storage has flushed, so the snapshot
+  // is only its meta, which braft saves with the index. The checkpoint of the
+  // storage is generated if the snapshot is sent to a follower.
 }
 
 int PRaft::on_snapshot_load(braft::SnapshotReader* reader) {
   CHECK(!IsLeader()) << "Leader is not supposed to load snapshot";
   assert(reader);
-  auto reader_path = reader->get_path();                             // xx/snapshot_0000001
-  auto path = g_config.db_path.ToString() + std::to_string(db_id_);  // db/db_id
-  TasksVector tasks(1, {TaskType::kLoadDBFromCheckpoint, db_id_, {{TaskArg::kCheckpointPath, reader_path}}, true});
-  PSTORE.HandleTaskSpecificDB(tasks);
+  auto reader_path = reader->get_path();  // xx/snapshot_0000001
+  braft::SnapshotMeta meta;
+  if (reader->load_meta(&meta) == 0) {
+    SetAppliedIndex(meta.last_included_index());
+  }
+  if (!PPosixFileSystemAdaptor::HasCheckpoint(reader_path)) {
+    // a snapshot this node saved when it started, its storage holds more than the snapshot
+    INFO("snapshot {} has no checkpoint, keep the local storage", reader_path);
+    return 0;
+  }
+  // only the instances of this group are replaced, the others are replicated by their own groups
+  TaskContext task(TaskType::kLoadDBFromCheckpoint, db_id_, {{TaskArg::kCheckpointPath, reader_path}}, true);
+  task.instances = GetInstances();
+  PSTORE.HandleTaskSpecificDB(TasksVector(1, task));
   return 0;
 }
 
 void PRaft::on_leader_start(int64_t term) {
-  WARN("Node {} start to be leader, term={}", node_->node_id().to_string(), term);
+  WARN("Node {} start to be leader of group {}, term={}", node_->node_id().to_string(), GetGroupName(), term);
 }
 
 void PRaft::on_leader_stop(const butil::Status& status) {}
@@ -648,4 +1105,23 @@ void PRaft::on_configuration_committed(const ::braft::Configuration& conf) {}
 void PRaft::on_stop_following(const ::braft::LeaderChangeContext& ctx) {}
 void PRaft::on_start_following(const ::braft::LeaderChangeContext& ctx) {}
 
+void PRaftServiceImpl::ReadIndex(::google::protobuf::RpcController* controller,
+                                 const ::pikiwidb::ReadIndexRequest* request, ::pikiwidb::ReadIndexResponse* response,
+                                 ::google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  if (request->group() >= PRaft::GroupNum()) {
+    response->set_success(false);
+    response->set_error("Unknown raft group " + std::to_string(request->group()));
+    return;
+  }
+  int64_t index = 0;
+  auto s = PRaft::Group(request->group()).GetReadIndex(request->lease(), &index);
+  response->set_success(s.ok());
+  if (!s.ok()) {
+    response->set_error(s.error_str());
+    return;
+  }
+  response->set_index(index);
+}
+
 }  // namespace pikiwidb
@@ -7,8 +7,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
-#include <future>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <tuple>
@@ -16,10 +19,14 @@
 
 #include "braft/file_system_adaptor.h"
 #include "braft/raft.h"
+#include "brpc/channel.h"
 #include "brpc/server.h"
 #include "rocksdb/status.h"
 
 #include "client.h"
+#include "pstd/thread_pool.h"
+#include "storage/flat_binlog.h"
+#include "storage/storage.h"
 
 namespace pikiwidb {
 
@@ -31,6 +38,7 @@ namespace pikiwidb {
 #define ROCKSDB_VERSION "rocksdb_version"
 #define WRONG_LEADER "-ERR wrong leader"
 #define RAFT_GROUP_ID "raft_group_id:"
+#define RAFT_GROUP_NUM "raft_group_num"
 #define NOT_LEADER "Not leader"
 
 #define PRAFT PRaft::Instance()
@@ -78,37 +86,63 @@ class ClusterCmdContext {
 
 class PRaftWriteDoneClosure : public braft::Closure {
  public:
-  explicit PRaftWriteDoneClosure(std::promise<rocksdb::Status>&& promise) : promise_(std::move(promise)) {}
+  explicit PRaftWriteDoneClosure(storage::CommitCallback&& callback) : callback_(std::move(callback)) {}
 
   void Run() override {
-    promise_.set_value(result_);
+    callback_(result_);
     delete this;
   }
   void SetStatus(rocksdb::Status status) { result_ = std::move(status); }
 
  private:
-  std::promise<rocksdb::Status> promise_;
+  storage::CommitCallback callback_;
   rocksdb::Status result_{rocksdb::Status::Aborted("Unknown error")};
 };
 
+/*
+ * A raft group replicating the storage instances it owns.
+ *
+ * A node runs raft-group-num groups on the same brpc server, group g owns the
+ * storage instances i of every DB with i % raft-group-num == g, so the slots
+ * mapped to them, and logs their writes only. Each group elects its own leader,
+ * a write is served by the leader of the group owning the slots of its keys.
+ *
+ * The group 0, PRAFT, also runs the brpc server and the cluster commands. A
+ * node joins or leaves every group at once, through the leader of the group 0.
+ */
 class PRaft : public braft::StateMachine {
  public:
-  PRaft() = default;
+  explicit PRaft(uint32_t index = 0) : index_(index) {}
   ~PRaft() override = default;
 
   static PRaft& Instance();
+  static PRaft& Group(uint32_t index);
+  static PRaft& GroupOfInstance(int32_t inst_id) { return Group(inst_id % GroupNum()); }
+  static uint32_t GroupNum();
 
   //===--------------------------------------------------------------------===//
   // Braft API
   //===--------------------------------------------------------------------===//
+  // Starts the brpc server and the nodes of every group, called on the group 0
   butil::Status Init(std::string& group_id, bool initial_conf_is_null);
+  // Adds or removes a peer in every group, called on the leader of the group 0
   butil::Status AddPeer(const std::string& peer);
   butil::Status RemovePeer(const std::string& peer);
   butil::Status DoSnapshot(int64_t self_snapshot_index = 0, bool is_sync = true);
+  butil::Status TransferLeader(const std::string& peer);
+  // Spreads the leaders of the groups over the peers, called on the leader of the group 0
+  butil::Status BalanceLeaders(int32_t* transferred);
+
+  // Waits until this node applied the logs its group committed before the call, so that a read then sees every
+  // write acknowledged before it. The leader answers from its lease if lease is set and the lease is valid, or
+  // else confirms its leadership by committing an empty log. Concurrent reads share a request to the leader.
+  butil::Status WaitForReadIndex(bool lease);
+  // On the leader, the index a read started now waits for
+  butil::Status GetReadIndex(bool lease, int64_t* index);
 
   void ShutDown();
   void Join();
-  void AppendLog(const Binlog& log, std::promise<rocksdb::Status>&& promise);
+  void AppendLog(storage::FlatBinlog&& log, storage::CommitCallback&& callback);
   void Clear();
 
   //===--------------------------------------------------------------------===//
@@ -135,12 +169,46 @@ class PRaft : public braft::StateMachine {
   std::string GetNodeID() const;
   std::string GetPeerID() const;
   std::string GetGroupID() const;
+  std::string GetGroupName() const;
   braft::NodeStatus GetNodeStatus() const;
   butil::Status GetListPeers(std::vector<braft::PeerId>* peers);
 
-  bool IsInitialized() const { return node_ != nullptr && server_ != nullptr; }
+  uint32_t GetIndex() const { return index_; }
+  std::vector<int32_t> GetInstances() const;
+  bool IsInitialized() const { return node_ != nullptr && Instance().server_ != nullptr; }
 
  private:
+  // A log of the batch on_apply is applying
+  struct CommittedLog {
+    storage::FlatBinlog log;
+    int64_t index = 0;
+    braft::Closure* done = nullptr;  // only in leader
+    rocksdb::Status status;
+  };
+
+  // The reads of a mode waiting for a read index, one request at a time is sent for all the reads issued before it
+  struct ReadIndexBatch {
+    uint64_t requested = 0;  // reads issued
+    uint64_t confirmed = 0;  // reads whose read index is known
+    int64_t index = 0;
+    bool in_flight = false;
+  };
+
+  static constexpr std::chrono::milliseconds kReadIndexTimeout{2000};
+
+  butil::Status InitNode(const std::string& group_id, const butil::EndPoint& addr, bool initial_conf_is_null);
+  // Changes the peers of this group through its leader, which may run on another node
+  butil::Status ChangePeer(const std::string& peer, bool add);
+
+  static rocksdb::Status DecodeLog(const butil::IOBuf& data, storage::FlatBinlog* log);
+  void ApplyLogs(std::vector<CommittedLog>& logs);
+  void SetAppliedIndex(int64_t index);
+
+  butil::Status RequestReadIndex(bool lease, int64_t* index);
+  // The channel to the leader at addr, rebuilt when the leader moves
+  std::shared_ptr<brpc::Channel> GetLeaderChannel(const butil::EndPoint& addr);
+  bool WaitForApplied(int64_t index, std::chrono::steady_clock::time_point deadline);
+
   void on_apply(braft::Iterator& iter) override;
   void on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) override;
   int on_snapshot_load(braft::SnapshotReader* reader) override;
@@ -161,9 +229,22 @@ class PRaft : public braft::StateMachine {
   std::string raw_addr_;             // ip:port of this node
 
   scoped_refptr<braft::FileSystemAdaptor> snapshot_adaptor_ = nullptr;
-  ClusterCmdContext cluster_cmd_ctx_;  // context for cluster join/remove command
-  std::string group_id_;               // group id
-  int db_id_ = 0;                      // db_id
+  ClusterCmdContext cluster_cmd_ctx_;       // context for cluster join/remove command
+  std::string group_id_;                    // group id
+  uint32_t index_ = 0;                      // index of the raft group in this node
+  int db_id_ = 0;                           // db_id
+  pstd::ThreadPool apply_pool_;             // applies the logs of several storage instances in parallel
+  std::atomic<int64_t> applied_index_ = 0;  // the last log index applied
+
+  std::mutex read_mutex_;
+  std::condition_variable read_cond_;
+  ReadIndexBatch read_batches_[2];  // without and with lease
+  std::mutex leader_channel_mutex_;
+  butil::EndPoint leader_channel_addr_;
+  std::shared_ptr<brpc::Channel> leader_channel_;  // read index requests to the leader
+  std::mutex apply_mutex_;
+  std::condition_variable apply_cond_;  // notified when the applied index moves if there are waiters
+  std::atomic<int32_t> apply_waiters_ = 0;
 };
 
 }  // namespace pikiwidb
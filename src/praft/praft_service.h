@@ -23,4 +23,12 @@ class DummyServiceImpl : public DummyService {
   PRaft* praft_ = nullptr;
 };
 
+// Serves the read index of the groups this node leads to the followers
+class PRaftServiceImpl : public PRaftService {
+ public:
+  PRaftServiceImpl() = default;
+  void ReadIndex(::google::protobuf::RpcController* controller, const ::pikiwidb::ReadIndexRequest* request,
+                 ::pikiwidb::ReadIndexResponse* response, ::google::protobuf::Closure* done) override;
+};
+
 }  // namespace pikiwidb
@@ -10,10 +10,17 @@
 
 #include "psnapshot.h"
 
+#include <map>
+#include <optional>
+
 #include "braft/local_file_meta.pb.h"
 #include "butil/files/file_path.h"
+#include "rocksdb/options.h"
+#include "rocksdb/sst_file_reader.h"
+#include "rocksdb/unique_id.h"
 
 #include "pstd/log.h"
+#include "pstd/pstd_string.h"
 
 #include "config.h"
 #include "store.h"
@@ -22,10 +29,48 @@ namespace pikiwidb {
 
 extern PConfig g_config;
 
+namespace {
+
+// The unique id RocksDB writes in the properties of an SST file, derived from
+// the session and the number the file was created with. Hard links of a file
+// have its id, files of another content never do. Empty if it can't be read.
+std::string SstUniqueId(const std::filesystem::path& path, const rocksdb::Options& options) {
+  rocksdb::SstFileReader reader{options};
+  if (!reader.Open(path.string()).ok()) {
+    return {};
+  }
+  auto props = reader.GetTableProperties();
+  std::string unique_id;
+  if (!props || !rocksdb::GetUniqueIdFromTableProperties(*props, &unique_id).ok()) {
+    return {};
+  }
+  return rocksdb::Slice(unique_id).ToString(true);
+}
+
+// The options of the column families the SST files of a checkpoint belong to,
+// dir is <snapshot>/<db>/<instance>. The files are links of the live files of
+// the instance, which keep their names.
+std::map<std::string, rocksdb::Options> SstFileOptions(const std::filesystem::path& dir) {
+  std::map<std::string, rocksdb::Options> file_options;
+  int db_id = 0;
+  int inst_id = 0;
+  if (pstd::String2int(dir.filename().string(), &inst_id) == 0 ||
+      pstd::String2int(dir.parent_path().filename().string(), &db_id) == 0 || db_id < 0 ||
+      db_id >= PSTORE.GetDBNumber()) {
+    return file_options;
+  }
+  auto& backend = PSTORE.GetBackend(db_id);
+  backend->LockShared();
+  backend->GetStorage()->GetSstFileOptions(inst_id, &file_options);
+  backend->UnLockShared();
+  return file_options;
+}
+
+}  // namespace
+
 braft::FileAdaptor* PPosixFileSystemAdaptor::open(const std::string& path, int oflag,
                                                   const ::google::protobuf::Message* file_meta, butil::File::Error* e) {
   if ((oflag & IS_RDONLY) == 0) {  // This is a read operation
-    bool snapshots_exists = false;
     std::string snapshot_path;
 
     // parse snapshot path
@@ -40,18 +85,7 @@ braft::FileAdaptor* PPosixFileSystemAdaptor::open(const std::string& path, int o
     }
     // check whether snapshots have been created
     std::lock_guard<braft::raft_mutex_t> guard(mutex_);
-    if (!snapshot_path.empty()) {
-      for (const auto& entry : std::filesystem::directory_iterator(snapshot_path)) {
-        std::string filename = entry.path().filename().string();
-        if (entry.is_regular_file() || entry.is_directory()) {
-          if (filename != "." && filename != ".." && filename.find(PRAFT_SNAPSHOT_META_FILE) == std::string::npos) {
-            // If the path directory contains files other than raft_snapshot_meta, snapshots have been generated
-            snapshots_exists = true;
-            break;
-          }
-        }
-      }
-    }
+    bool snapshots_exists = !checkpoint_enabled_.load() || snapshot_path.empty() || HasCheckpoint(snapshot_path);
 
     // Snapshot generation
     if (!snapshots_exists) {
@@ -62,8 +96,9 @@ braft::FileAdaptor* PPosixFileSystemAdaptor::open(const std::string& path, int o
       assert(fs);
       snapshot_meta_memtable.load_from_file(fs, meta_path);
 
-      TasksVector tasks(1, {TaskType::kCheckpoint, 0, {{TaskArg::kCheckpointPath, snapshot_path}}, true});
-      PSTORE.HandleTaskSpecificDB(tasks);
+      TaskContext task(TaskType::kCheckpoint, 0, {{TaskArg::kCheckpointPath, snapshot_path}}, true);
+      task.instances = instances_;
+      PSTORE.HandleTaskSpecificDB(TasksVector(1, task));
       AddAllFiles(snapshot_path, &snapshot_meta_memtable, snapshot_path);
 
       auto rc = snapshot_meta_memtable.save_to_file(fs, meta_path);
@@ -83,6 +118,7 @@ void PPosixFileSystemAdaptor::AddAllFiles(const std::filesystem::path& dir,
                                           braft::LocalSnapshotMetaTable* snapshot_meta_memtable,
                                           const std::string& path) {
   assert(snapshot_meta_memtable);
+  std::optional<std::map<std::string, rocksdb::Options>> file_options;
   for (const auto& entry : std::filesystem::directory_iterator(dir)) {
     if (entry.is_directory()) {
       if (entry.path() != "." && entry.path() != "..") {
@@ -92,6 +128,19 @@ void PPosixFileSystemAdaptor::AddAllFiles(const std::filesystem::path& dir,
     } else {
       INFO("file_path = {}", std::filesystem::relative(entry.path(), path).string());
       braft::LocalFileMeta meta;
+      if (entry.path().extension() == ".sst") {
+        // SST files are immutable and shared by consecutive checkpoints, a
+        // follower keeps those it already has from the last snapshot it installed.
+        // A file compacted away since the checkpoint is sent without its id.
+        if (!file_options) {
+          file_options = SstFileOptions(dir);
+        }
+        if (auto it = file_options->find(entry.path().filename().string()); it != file_options->end()) {
+          if (auto unique_id = SstUniqueId(entry.path(), it->second); !unique_id.empty()) {
+            meta.set_checksum(unique_id);
+          }
+        }
+      }
       if (snapshot_meta_memtable->add_file(std::filesystem::relative(entry.path(), path), meta) != 0) {
         WARN("Failed to add file");
       }
@@ -99,4 +148,18 @@ void PPosixFileSystemAdaptor::AddAllFiles(const std::filesystem::path& dir,
   }
 }
 
+bool PPosixFileSystemAdaptor::HasCheckpoint(const std::string& snapshot_path) {
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(snapshot_path, ec)) {
+    std::string filename = entry.path().filename().string();
+    if (entry.is_regular_file() || entry.is_directory()) {
+      if (filename != "." && filename != ".." && filename.find(PRAFT_SNAPSHOT_META_FILE) == std::string::npos) {
+        // If the path directory contains other files, the checkpoint has been generated
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
 }  // namespace pikiwidb
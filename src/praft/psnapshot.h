@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "braft/file_system_adaptor.h"
 #include "braft/macros.h"
@@ -21,7 +25,8 @@ namespace pikiwidb {
 
 class PPosixFileSystemAdaptor : public braft::PosixFileSystemAdaptor {
  public:
-  PPosixFileSystemAdaptor() {}
+  // instances are the storage instances of the raft group the snapshots are of
+  explicit PPosixFileSystemAdaptor(std::vector<int32_t> instances) : instances_(std::move(instances)) {}
   ~PPosixFileSystemAdaptor() {}
 
   braft::FileAdaptor* open(const std::string& path, int oflag, const ::google::protobuf::Message* file_meta,
@@ -29,8 +34,18 @@ class PPosixFileSystemAdaptor : public braft::PosixFileSystemAdaptor {
   void AddAllFiles(const std::filesystem::path& dir, braft::LocalSnapshotMetaTable* snapshot_meta_memtable,
                    const std::string& path);
 
+  // A snapshot is saved with its log index only, the checkpoint of the storage
+  // is generated the first time the snapshot is opened to be sent to a follower.
+  // Not while the node starts, it loads its own snapshot then.
+  void SetCheckpointEnabled(bool enabled) { checkpoint_enabled_.store(enabled); }
+
+  // Whether the checkpoint of the storage was generated in, or copied to, a snapshot
+  static bool HasCheckpoint(const std::string& snapshot_path);
+
  private:
   braft::raft_mutex_t mutex_;
+  std::atomic_bool checkpoint_enabled_ = false;
+  std::vector<int32_t> instances_;
 };
 
 }  // namespace pikiwidb
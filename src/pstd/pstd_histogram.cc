@@ -0,0 +1,50 @@
+// Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "pstd/pstd_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pstd {
+
+uint64_t Histogram::BucketUpperBound(size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  auto shift = bucket / kSubBuckets - 1;
+  auto lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+  return lower + (uint64_t(1) << shift) - 1;
+}
+
+void HistogramSnapshot::Merge(const Histogram& histogram) {
+  uint64_t count = 0;
+  for (size_t i = 0; i < Histogram::kBucketNum; i++) {
+    auto bucket_count = histogram.buckets_[i].load(std::memory_order_relaxed);
+    buckets_[i] += bucket_count;
+    count += bucket_count;
+  }
+  // counted from the buckets the percentiles are computed from, which a value being recorded may not be in yet
+  count_ += count;
+  sum_ += histogram.sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t HistogramSnapshot::Percentile(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(std::ceil(percentile / 100 * static_cast<double>(count_)));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < Histogram::kBucketNum; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return Histogram::BucketUpperBound(i);
+    }
+  }
+  return Histogram::kMaxValue;
+}
+
+}  // namespace pstd
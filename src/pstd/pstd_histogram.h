@@ -0,0 +1,80 @@
+// Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace pstd {
+
+/*
+ * Counts non negative values, such as latencies in microseconds, in log-linear
+ * buckets as HdrHistogram does: values below kSubBuckets have a bucket each,
+ * the larger ones share buckets at most 1/kSubBuckets of their value wide.
+ *
+ * A histogram is recorded by a single thread, with plain loads and stores and
+ * no atomic read-modify-write, and read by any thread through
+ * HistogramSnapshot, which may miss the values being recorded.
+ */
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kMaxBits = 36;  // larger values are counted as the largest one
+  static constexpr uint64_t kMaxValue = (uint64_t(1) << kMaxBits) - 1;
+  static constexpr size_t kBucketNum = (kMaxBits - kSubBucketBits + 1) * kSubBuckets;
+
+  void Record(uint64_t value) {
+    Increase(buckets_[BucketOf(value)], 1);
+    Increase(sum_, value);
+  }
+
+  static size_t BucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    if (value > kMaxValue) {
+      value = kMaxValue;
+    }
+    int shift = std::bit_width(value) - 1 - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+  }
+
+  // The highest value counted in bucket
+  static uint64_t BucketUpperBound(size_t bucket);
+
+ private:
+  friend class HistogramSnapshot;
+
+  static void Increase(std::atomic<uint64_t>& counter, uint64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kBucketNum> buckets_{};
+  std::atomic<uint64_t> sum_ = 0;
+};
+
+// The counts of histograms merged, the percentiles are the upper bounds of their buckets
+class HistogramSnapshot {
+ public:
+  void Merge(const Histogram& histogram);
+
+  uint64_t Count() const { return count_; }
+  uint64_t Sum() const { return sum_; }
+  uint64_t CountOfBucket(size_t bucket) const { return buckets_[bucket]; }
+  // The value which percentile percents of the values are at most, 0 if there is none
+  uint64_t Percentile(double percentile) const;
+
+ private:
+  std::array<uint64_t, Histogram::kBucketNum> buckets_{};
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+};
+
+}  // namespace pstd
@@ -11,18 +11,42 @@
 
 namespace pstd::lock {
 
+namespace {
+
+thread_local DeferredUnlock* current_deferred_unlock = nullptr;
+
+}  // namespace
+
+DeferredUnlock* DeferredUnlock::Current() { return current_deferred_unlock; }
+
+void DeferredUnlock::SetCurrent(DeferredUnlock* deferred) { current_deferred_unlock = deferred; }
+
+void LockOrReclaim(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key) {
+  if (auto deferred = DeferredUnlock::Current(); deferred && deferred->Reclaim(lock_mgr, key)) {
+    return;
+  }
+  lock_mgr->TryLock(key);
+}
+
+void UnLockOrDefer(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key) {
+  if (auto deferred = DeferredUnlock::Current(); deferred && deferred->Defer(lock_mgr, key)) {
+    return;
+  }
+  lock_mgr->UnLock(key);
+}
+
 MultiScopeRecordLock::MultiScopeRecordLock(const std::shared_ptr<LockMgr>& lock_mgr,
                                            const std::vector<std::string>& keys)
     : lock_mgr_(lock_mgr), keys_(keys) {
   std::string pre_key;
   std::sort(keys_.begin(), keys_.end());
   if (!keys_.empty() && keys_[0].empty()) {
-    lock_mgr_->TryLock(pre_key);
+    LockOrReclaim(lock_mgr_, pre_key);
   }
 
   for (const auto& key : keys_) {
     if (pre_key != key) {
-      lock_mgr_->TryLock(key);
+      LockOrReclaim(lock_mgr_, key);
       pre_key = key;
     }
   }
@@ -30,12 +54,12 @@ MultiScopeRecordLock::MultiScopeRecordLock(const std::shared_ptr<LockMgr>& lock_
 MultiScopeRecordLock::~MultiScopeRecordLock() {
   std::string pre_key;
   if (!keys_.empty() && keys_[0].empty()) {
-    lock_mgr_->UnLock(pre_key);
+    UnLockOrDefer(lock_mgr_, pre_key);
   }
 
   for (const auto& key : keys_) {
     if (pre_key != key) {
-      lock_mgr_->UnLock(key);
+      UnLockOrDefer(lock_mgr_, key);
       pre_key = key;
     }
   }
@@ -48,13 +72,13 @@ void MultiRecordLock::Lock(const std::vector<std::string>& keys) {
   std::string pre_key;
   // consider internal_keys "" "" "a"
   if (!internal_keys.empty()) {
-    lock_mgr_->TryLock(internal_keys.front());
+    LockOrReclaim(lock_mgr_, internal_keys.front());
     pre_key = internal_keys.front();
   }
 
   for (const auto& key : internal_keys) {
     if (pre_key != key) {
-      lock_mgr_->TryLock(key);
+      LockOrReclaim(lock_mgr_, key);
       pre_key = key;
     }
   }
@@ -65,13 +89,13 @@ void MultiRecordLock::Unlock(const std::vector<std::string>& keys) {
   std::sort(internal_keys.begin(), internal_keys.end());
   std::string pre_key;
   if (!internal_keys.empty()) {
-    lock_mgr_->UnLock(internal_keys.front());
+    UnLockOrDefer(lock_mgr_, internal_keys.front());
     pre_key = internal_keys.front();
   }
 
   for (const auto& key : internal_keys) {
     if (pre_key != key) {
-      lock_mgr_->UnLock(key);
+      UnLockOrDefer(lock_mgr_, key);
       pre_key = key;
     }
   }
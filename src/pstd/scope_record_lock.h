@@ -8,6 +8,7 @@
 #pragma once
 
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -20,12 +21,37 @@ namespace pstd::lock {
 
 using Slice = rocksdb::Slice;
 
+/*
+ * Installed on a thread, takes over the record locks the thread releases and
+ * keeps those it wants locked until it unlocks them itself, possibly from
+ * another thread. The locks of a LockMgr are plain keys, not owned by threads.
+ */
+class DeferredUnlock {
+ public:
+  virtual ~DeferredUnlock() = default;
+
+  // Returns false if the key is to be unlocked right away
+  virtual bool Defer(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key) = 0;
+  // Returns true if the key is one taken over and not unlocked yet, it is
+  // handed back to the thread still locked
+  virtual bool Reclaim(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key) = 0;
+
+  static DeferredUnlock* Current();
+  // Pass nullptr to uninstall
+  static void SetCurrent(DeferredUnlock* deferred);
+};
+
+// Locks key, or takes it back from the DeferredUnlock of the thread if it still holds it
+void LockOrReclaim(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key);
+// Unlocks key unless the DeferredUnlock of the thread takes it over
+void UnLockOrDefer(const std::shared_ptr<LockMgr>& lock_mgr, const std::string& key);
+
 class ScopeRecordLock final : public pstd::noncopyable {
  public:
   ScopeRecordLock(const std::shared_ptr<LockMgr>& lock_mgr, const Slice& key) : lock_mgr_(lock_mgr), key_(key) {
-    lock_mgr_->TryLock(key_.ToString());
+    LockOrReclaim(lock_mgr_, key_.ToString());
   }
-  ~ScopeRecordLock() { lock_mgr_->UnLock(key_.ToString()); }
+  ~ScopeRecordLock() { UnLockOrDefer(lock_mgr_, key_.ToString()); }
 
  private:
   std::shared_ptr<LockMgr> const lock_mgr_;
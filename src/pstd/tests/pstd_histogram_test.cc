@@ -0,0 +1,76 @@
+// Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "pstd/pstd_histogram.h"
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using pstd::Histogram;
+using pstd::HistogramSnapshot;
+
+TEST(HistogramTest, Buckets) {
+  for (uint64_t value = 0; value < 1 << 20; value++) {
+    auto bucket = Histogram::BucketOf(value);
+    ASSERT_LT(bucket, Histogram::kBucketNum);
+    ASSERT_GE(Histogram::BucketUpperBound(bucket), value);
+    if (bucket > 0) {
+      ASSERT_LT(Histogram::BucketUpperBound(bucket - 1), value);
+    }
+    // a bucket is at most 1/16 of its values wide
+    ASSERT_LE(Histogram::BucketUpperBound(bucket) - value, value / Histogram::kSubBuckets);
+  }
+  EXPECT_EQ(Histogram::BucketOf(UINT64_MAX), Histogram::kBucketNum - 1);
+  EXPECT_EQ(Histogram::BucketUpperBound(Histogram::kBucketNum - 1), Histogram::kMaxValue);
+}
+
+TEST(HistogramTest, Percentiles) {
+  HistogramSnapshot empty;
+  EXPECT_EQ(empty.Percentile(50), 0);
+
+  Histogram histogram;
+  for (uint64_t value = 1; value <= 1000; value++) {
+    histogram.Record(value);
+  }
+  HistogramSnapshot snapshot;
+  snapshot.Merge(histogram);
+  EXPECT_EQ(snapshot.Count(), 1000);
+  EXPECT_EQ(snapshot.Sum(), 500500);
+  EXPECT_EQ(snapshot.Percentile(0), 1);
+  EXPECT_EQ(snapshot.Percentile(50), 511);
+  EXPECT_EQ(snapshot.Percentile(99), 991);
+  EXPECT_EQ(snapshot.Percentile(100), 1023);
+}
+
+TEST(HistogramTest, MergeThreads) {
+  constexpr int kThreads = 4;
+  constexpr uint64_t kValues = 100000;
+  std::vector<Histogram> histograms(kThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&histogram = histograms[i], i] {
+      for (uint64_t value = 0; value < kValues; value++) {
+        histogram.Record(value % 100 + i * 100);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  HistogramSnapshot snapshot;
+  for (const auto& histogram : histograms) {
+    snapshot.Merge(histogram);
+  }
+  EXPECT_EQ(snapshot.Count(), kThreads * kValues);
+  EXPECT_LE(snapshot.Percentile(25), 100);
+  EXPECT_GE(snapshot.Percentile(100), 399);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
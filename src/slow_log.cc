@@ -5,67 +5,102 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
-#include <sys/time.h>
-#include <fstream>
+#include <algorithm>
+#include <ctime>
 
+#include "config.h"
 #include "log.h"
 #include "slow_log.h"
 
 namespace pikiwidb {
 
+// As redis does, the arguments kept of a log
+static constexpr std::size_t kSlowLogMaxArgc = 32;
+static constexpr std::size_t kSlowLogMaxArgLen = 128;
+
 PSlowLog& PSlowLog::Instance() {
   static PSlowLog slog;
 
   return slog;
 }
 
-PSlowLog::PSlowLog() : threshold_(0), logger_(nullptr) {}
-
-PSlowLog::~PSlowLog() {}
-
-void PSlowLog::SetThreshold(unsigned int v) { threshold_ = v; }
+void PSlowLog::SetLogLimit(std::size_t maxCount) {
+  logMaxCount_ = maxCount;
+  slots_ = maxCount > 0 ? std::make_unique<Slot[]>(maxCount) : nullptr;
+}
 
-void PSlowLog::SetLogLimit(std::size_t maxCount) { logMaxCount_ = maxCount; }
+bool PSlowLog::IsSlow(uint64_t used) const {
+  return logMaxCount_ > 0 && used >= g_config.slow_log_time.load(std::memory_order_relaxed);
+}
 
-void PSlowLog::Begin() {
-  if (!threshold_) {
+void PSlowLog::Record(const std::vector<PString>& cmds, uint64_t used,
+                      const std::array<uint64_t, kRequestStageNum>& stages, const std::optional<PerfCounters>& perf,
+                      const std::string& client_addr, const std::string& client_name) {
+  if (logMaxCount_ == 0 || cmds.empty() || cmds[0] == "slowlog") {
     return;
   }
 
-  timeval begin;
-  gettimeofday(&begin, 0);
-  beginUs_ = begin.tv_sec * 1000000 + begin.tv_usec;
-}
-
-void PSlowLog::EndAndStat(const std::vector<PString>& cmds) {
-  if (!threshold_ || beginUs_ == 0) {
-    return;
+  auto item = std::make_shared<SlowLogItem>();
+  item->time = ::time(nullptr);
+  item->used = used;
+  item->stages = stages;
+  item->perf = perf;
+  item->client_addr = client_addr;
+  item->client_name = client_name;
+  auto argc = std::min(cmds.size(), kSlowLogMaxArgc);
+  for (std::size_t i = 0; i < argc; i++) {
+    if (argc < cmds.size() && i + 1 == argc) {
+      item->cmds.push_back("... (" + std::to_string(cmds.size() - argc + 1) + " more arguments)");
+    } else if (cmds[i].size() > kSlowLogMaxArgLen) {
+      item->cmds.push_back(cmds[i].substr(0, kSlowLogMaxArgLen) + "... (" +
+                           std::to_string(cmds[i].size() - kSlowLogMaxArgLen) + " more bytes)");
+    } else {
+      item->cmds.push_back(cmds[i]);
+    }
   }
+  INFO("+ Used:(us) {}, {}", used, item->cmds[0]);
 
-  timeval end;
-  gettimeofday(&end, 0);
-  auto used = end.tv_sec * 1000000 + end.tv_usec - beginUs_;
+  auto id = nextId_.fetch_add(1, std::memory_order_relaxed);
+  item->id = id;
+  Store(slots_[id % logMaxCount_], std::move(item));
+}
 
-  if (used >= threshold_) {
-    INFO("+ Used:(us) {}", used);
+void PSlowLog::ClearLogs() { firstId_.store(nextId_.load()); }
 
-    for (const auto& param : cmds) {
-      INFO("{}", param);
-    }
+std::size_t PSlowLog::GetLogsCount() const {
+  auto count = nextId_.load() - firstId_.load();
+  return std::min<std::size_t>(count, logMaxCount_);
+}
 
-    if (cmds[0] == "slowlog") {
-      return;
+std::vector<std::shared_ptr<const SlowLogItem>> PSlowLog::GetLogs(std::size_t count) const {
+  std::vector<std::shared_ptr<const SlowLogItem>> logs;
+  auto first = firstId_.load();
+  auto next = nextId_.load();
+  count = std::min(count, GetLogsCount());
+  for (auto id = next; id > first && logs.size() < count && next - id < logMaxCount_; id--) {
+    auto item = Load(slots_[(id - 1) % logMaxCount_]);
+    // the slot is either being written or already holds a newer log
+    if (item && item->id == id - 1) {
+      logs.push_back(std::move(item));
     }
+  }
+  return logs;
+}
 
-    SlowLogItem item;
-    item.used = static_cast<unsigned>(used);
-    item.cmds = cmds;
+std::shared_ptr<const SlowLogItem> PSlowLog::Load(const Slot& slot) const {
+  while (slot.busy.test_and_set(std::memory_order_acquire)) {
+  }
+  auto item = slot.item;
+  slot.busy.clear(std::memory_order_release);
+  return item;
+}
 
-    logs_.emplace_front(std::move(item));
-    if (logs_.size() > logMaxCount_) {
-      logs_.pop_back();
-    }
+void PSlowLog::Store(Slot& slot, std::shared_ptr<const SlowLogItem>&& item) {
+  while (slot.busy.test_and_set(std::memory_order_acquire)) {
   }
+  slot.item.swap(item);
+  slot.busy.clear(std::memory_order_release);
+  // the replaced log is freed out of the slot
 }
 
 }  // namespace pikiwidb
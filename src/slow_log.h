@@ -7,24 +7,35 @@
 
 #pragma once
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <vector>
 
+#include "cmd_stats.h"
 #include "common.h"
-
-class Logger;
+#include "perf_stats.h"
 
 namespace pikiwidb {
 
 struct SlowLogItem {
-  unsigned used;
+  uint64_t id = 0;
+  int64_t time = 0;   // unix time in seconds the reply was sent
+  uint64_t used = 0;  // microseconds from the parse to the reply sent
   std::vector<PString> cmds;
-
-  SlowLogItem() : used(0) {}
-
-  SlowLogItem(SlowLogItem&& item) noexcept : used(item.used), cmds(std::move(item.cmds)) {}
+  std::string client_addr;
+  std::string client_name;
+  std::array<uint64_t, kRequestStageNum> stages{};  // microseconds of each stage
+  std::optional<PerfCounters> perf;                 // the rocksdb counters if the command was profiled
 };
 
+/*
+ * The latest requests slower than slowlog-log-slower-than microseconds. They
+ * are kept in a ring of slowlog-max-len slots, a request takes the next slot
+ * with an atomic increment, so the threads sending replies never wait for
+ * each other unless they wrap around to the same slot.
+ */
 class PSlowLog {
  public:
   static PSlowLog& Instance();
@@ -32,26 +43,35 @@ class PSlowLog {
   PSlowLog(const PSlowLog&) = delete;
   void operator=(const PSlowLog&) = delete;
 
-  void Begin();
-  void EndAndStat(const std::vector<PString>& cmds);
-
-  void SetThreshold(unsigned int);
+  // Called at startup, before any request is logged
   void SetLogLimit(std::size_t maxCount);
 
-  void ClearLogs() { logs_.clear(); }
-  std::size_t GetLogsCount() const { return logs_.size(); }
-  const std::deque<SlowLogItem>& GetLogs() const { return logs_; }
+  bool IsSlow(uint64_t used) const;
+  // Logs a slow request, called by any thread
+  void Record(const std::vector<PString>& cmds, uint64_t used, const std::array<uint64_t, kRequestStageNum>& stages,
+              const std::optional<PerfCounters>& perf, const std::string& client_addr, const std::string& client_name);
+
+  void ClearLogs();
+  std::size_t GetLogsCount() const;
+  // The count latest logs, newest first
+  std::vector<std::shared_ptr<const SlowLogItem>> GetLogs(std::size_t count) const;
 
  private:
-  PSlowLog();
-  ~PSlowLog();
+  // The log is swapped in and out of a slot under its flag, held for a pointer copy only
+  struct Slot {
+    mutable std::atomic_flag busy;
+    std::shared_ptr<const SlowLogItem> item;
+  };
+
+  PSlowLog() = default;
 
-  unsigned int threshold_;
-  long long beginUs_;
-  Logger* logger_;
+  std::shared_ptr<const SlowLogItem> Load(const Slot& slot) const;
+  void Store(Slot& slot, std::shared_ptr<const SlowLogItem>&& item);
 
-  std::size_t logMaxCount_;
-  std::deque<SlowLogItem> logs_;
+  std::unique_ptr<Slot[]> slots_;
+  std::size_t logMaxCount_ = 0;
+  std::atomic<uint64_t> nextId_ = 0;
+  std::atomic<uint64_t> firstId_ = 0;  // the logs before are cleared
 };
 
 }  // namespace pikiwidb
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Throughput of every bitmap kernel supported by this cpu.
+// Usage: bitmap_bench [bitmap size in MB, default 64] [rounds, default 10]
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "fmt/core.h"
+
+#include "src/bitmap_kernels.h"
+
+template <typename F>
+double MeasureGBps(size_t bytes, int rounds, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    f();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return static_cast<double>(bytes) * rounds / elapsed.count() / (1 << 30);
+}
+
+int main(int argc, char* argv[]) {
+  size_t size_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 10;
+  size_t len = size_mb << 20;
+
+  std::mt19937_64 rng(0);
+  std::string src(len, '\0');
+  std::string dst(len, '\0');
+  for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word = rng();
+    memcpy(src.data() + i, &word, sizeof(word));
+  }
+  // a sparse bitmap whose only set bit is at the end, the worst case of BITPOS
+  std::string sparse(len, '\0');
+  sparse.back() = 1;
+
+  auto src_data = reinterpret_cast<const uint8_t*>(src.data());
+  auto dst_data = reinterpret_cast<uint8_t*>(dst.data());
+  auto sparse_data = reinterpret_cast<const uint8_t*>(sparse.data());
+
+  fmt::print("bitmap size {}MB, {} rounds, GB/s\n", size_mb, rounds);
+  fmt::print("{:<8} {:>8} {:>8} {:>8} {:>8} {:>8}\n", "kernel", "count", "and", "xor", "not", "bitpos");
+  for (const auto kernel : storage::SupportedBitmapKernels()) {
+    volatile uint64_t sink = 0;
+    double count = MeasureGBps(len, rounds, [&] { sink = sink + kernel->count(src_data, len); });
+    double bit_and = MeasureGBps(len, rounds, [&] { kernel->bitop(storage::kBitOpAnd, dst_data, src_data, len); });
+    double bit_xor = MeasureGBps(len, rounds, [&] { kernel->bitop(storage::kBitOpXor, dst_data, src_data, len); });
+    double bit_not = MeasureGBps(len, rounds, [&] { kernel->bitop(storage::kBitOpNot, dst_data, nullptr, len); });
+    double bitpos = MeasureGBps(len, rounds, [&] { sink = sink + kernel->find_first(sparse_data, len, 1); });
+    fmt::print("{:<8} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}\n", kernel->name, count, bit_and, bit_xor, bit_not,
+               bitpos);
+  }
+  return 0;
+}
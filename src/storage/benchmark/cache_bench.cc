@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Throughput of ShardedCache under contention, with one shard (a single
+// mutex, as the former LRUCache) and with the default number of shards.
+// Usage: cache_bench [max threads, default 16] [ops per thread, default 1000000]
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/core.h"
+
+#include "src/sharded_cache.h"
+
+constexpr size_t kCapacity = 5000;
+constexpr size_t kKeySpace = 10000;
+
+// Mixed statistics-like workload: 3 updates for 1 lookup, over twice more keys than the capacity
+double MeasureMops(size_t num_shards, int threads, int ops) {
+  storage::ShardedCache<uint64_t> cache(num_shards);
+  cache.SetCapacity(kCapacity);
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < kKeySpace; i++) {
+    keys.push_back("h_key_" + std::to_string(i));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      std::mt19937 rng(t);
+      uint64_t value = 0;
+      for (int i = 0; i < ops; i++) {
+        const auto& key = keys[rng() % kKeySpace];
+        if (i % 4 == 0) {
+          cache.Lookup(key, &value);
+        } else {
+          cache.Update(key, [](uint64_t& count) { count++; });
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return static_cast<double>(threads) * ops / elapsed.count() / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+  int max_threads = argc > 1 ? std::atoi(argv[1]) : 16;
+  int ops = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+  fmt::print("capacity {}, {} keys, {} ops per thread, Mops/s\n", kCapacity, kKeySpace, ops);
+  constexpr size_t kShards = storage::ShardedCache<uint64_t>::kDefaultShards;
+  fmt::print("{:<8} {:>10} {:>10}\n", "threads", "1 shard", fmt::format("{} shards", kShards));
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double single = MeasureMops(1, threads, ops);
+    double sharded = MeasureMops(kShards, threads, ops);
+    fmt::print("{:<8} {:>10.2f} {:>10.2f}\n", threads, single, sharded);
+  }
+  return 0;
+}
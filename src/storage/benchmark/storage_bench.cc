@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+// Latency and throughput of the storage::Storage commands, over value sizes,
+// collection sizes and thread counts. The db is opened under
+// STORAGE_BENCH_PATH, by default in /dev/shm so that the disk stays out of the
+// figures. Takes the google-benchmark flags, e.g. to compare two commits:
+//   storage_bench --benchmark_out=before.json --benchmark_out_format=json
+//   compare.py benchmarks before.json after.json
+// with compare.py from the tools of google-benchmark.
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "fmt/core.h"
+
+#include "pstd/log.h"
+#include "storage/storage.h"
+
+namespace {
+
+constexpr int kMaxThreads = 8;
+// Strings per value size, and collections per collection size
+constexpr int64_t kKeySpace = 20000;
+constexpr int64_t kCollections = 16;
+// Keys written to by the write benchmarks, per thread
+constexpr int64_t kWriteKeySpace = 1000;
+constexpr size_t kElementSize = 32;
+
+storage::Storage* g_db = nullptr;
+
+std::string Key(const std::string& prefix, int64_t n) { return fmt::format("{}_{:08}", prefix, n); }
+
+std::string Element(int64_t n) { return fmt::format("{:0{}}", n, kElementSize); }
+
+// Fills the db once for all the runs and threads of the benchmarks reading from it
+void PopulateOnce(const std::string& name, const std::function<storage::Status()>& populate) {
+  static std::mutex mutex;
+  static std::set<std::string> populated;
+  std::lock_guard l(mutex);
+  if (populated.count(name) != 0) {
+    return;
+  }
+  auto s = populate();
+  if (!s.ok()) {
+    fmt::print(stderr, "populate {} failed: {}\n", name, s.ToString());
+    std::exit(1);
+  }
+  populated.insert(name);
+}
+
+std::string StringPrefix(int64_t value_size) { return fmt::format("string_{}", value_size); }
+
+void PopulateStrings(int64_t value_size) {
+  PopulateOnce(StringPrefix(value_size), [value_size] {
+    std::string value(value_size, 'v');
+    for (int64_t i = 0; i < kKeySpace; i++) {
+      auto s = g_db->Set(Key(StringPrefix(value_size), i), value);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return storage::Status::OK();
+  });
+}
+
+// kCollections collections of each size, of which members are Element(0) to Element(size - 1)
+std::string CollectionPrefix(const char* type, int64_t size) { return fmt::format("{}_{}", type, size); }
+
+void PopulateHashes(int64_t size) {
+  PopulateOnce(CollectionPrefix("hash", size), [size] {
+    for (int64_t c = 0; c < kCollections; c++) {
+      int32_t ret = 0;
+      for (int64_t i = 0; i < size; i++) {
+        auto s = g_db->HSet(Key(CollectionPrefix("hash", size), c), Element(i), Element(i), &ret);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    return storage::Status::OK();
+  });
+}
+
+void PopulateSets(int64_t size) {
+  PopulateOnce(CollectionPrefix("set", size), [size] {
+    for (int64_t c = 0; c < kCollections; c++) {
+      // consecutive sets overlap by half
+      std::vector<std::string> members;
+      for (int64_t i = 0; i < size; i++) {
+        members.push_back(Element(c * size / 2 + i));
+      }
+      int32_t ret = 0;
+      auto s = g_db->SAdd(Key(CollectionPrefix("set", size), c), members, &ret);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return storage::Status::OK();
+  });
+}
+
+void PopulateLists(int64_t size) {
+  PopulateOnce(CollectionPrefix("list", size), [size] {
+    std::vector<std::string> values;
+    for (int64_t i = 0; i < size; i++) {
+      values.push_back(Element(i));
+    }
+    for (int64_t c = 0; c < kCollections; c++) {
+      uint64_t ret = 0;
+      auto s = g_db->LPush(Key(CollectionPrefix("list", size), c), values, &ret);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return storage::Status::OK();
+  });
+}
+
+void PopulateZSets(int64_t size) {
+  PopulateOnce(CollectionPrefix("zset", size), [size] {
+    std::vector<storage::ScoreMember> score_members;
+    for (int64_t i = 0; i < size; i++) {
+      score_members.emplace_back(static_cast<double>(i), Element(i));
+    }
+    for (int64_t c = 0; c < kCollections; c++) {
+      int32_t ret = 0;
+      auto s = g_db->ZAdd(Key(CollectionPrefix("zset", size), c), score_members, &ret);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return storage::Status::OK();
+  });
+}
+
+// Stops the benchmark on a failed command, not found being a failure too
+bool Check(benchmark::State& state, const storage::Status& s) {
+  if (s.ok()) {
+    return true;
+  }
+  state.SkipWithError(s.ToString().c_str());
+  return false;
+}
+
+// Strings
+
+void BM_Set(benchmark::State& state) {
+  std::string value(state.range(0), 'v');
+  auto prefix = fmt::format("set_t{}", state.thread_index());
+  int64_t i = 0;
+  for (auto _ : state) {
+    if (!Check(state, g_db->Set(Key(prefix, i++ % kWriteKeySpace), value))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Set)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_Get(benchmark::State& state) {
+  PopulateStrings(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::string value;
+  for (auto _ : state) {
+    if (!Check(state, g_db->Get(Key(StringPrefix(state.range(0)), rng() % kKeySpace), &value))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Get)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// range(0) keys of 256 bytes values per call
+void BM_MGet(benchmark::State& state) {
+  PopulateStrings(256);
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> keys(state.range(0));
+  std::vector<storage::ValueStatus> vss;
+  for (auto _ : state) {
+    for (auto& key : keys) {
+      key = Key(StringPrefix(256), rng() % kKeySpace);
+    }
+    if (!Check(state, g_db->MGet(keys, &vss))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MGet)->RangeMultiplier(8)->Range(16, 1024)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Hashes
+
+void BM_HSet(benchmark::State& state) {
+  std::string value(state.range(0), 'v');
+  auto prefix = fmt::format("hset_t{}", state.thread_index());
+  std::mt19937_64 rng(state.thread_index());
+  int32_t ret = 0;
+  for (auto _ : state) {
+    auto n = rng();
+    if (!Check(state, g_db->HSet(Key(prefix, n % kCollections), Element(n % kWriteKeySpace), value, &ret))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HSet)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_HGetall(benchmark::State& state) {
+  PopulateHashes(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<storage::FieldValue> fvs;
+  for (auto _ : state) {
+    fvs.clear();
+    if (!Check(state, g_db->HGetall(Key(CollectionPrefix("hash", state.range(0)), rng() % kCollections), &fvs))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HGetall)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// 16 fields per call out of hashes of range(0) fields
+void BM_HMGet(benchmark::State& state) {
+  PopulateHashes(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> fields(16);
+  std::vector<storage::ValueStatus> vss;
+  for (auto _ : state) {
+    for (auto& field : fields) {
+      field = Element(rng() % state.range(0));
+    }
+    if (!Check(state, g_db->HMGet(Key(CollectionPrefix("hash", state.range(0)), rng() % kCollections), fields, &vss))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fields.size());
+}
+BENCHMARK(BM_HMGet)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Sets
+
+// range(0) members per call
+void BM_SAdd(benchmark::State& state) {
+  auto prefix = fmt::format("sadd_t{}", state.thread_index());
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> members(state.range(0));
+  int32_t ret = 0;
+  for (auto _ : state) {
+    for (auto& member : members) {
+      member = Element(rng() % kWriteKeySpace);
+    }
+    if (!Check(state, g_db->SAdd(Key(prefix, rng() % kCollections), members, &ret))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SAdd)->RangeMultiplier(16)->Range(1, 256)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_SMembers(benchmark::State& state) {
+  PopulateSets(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> members;
+  for (auto _ : state) {
+    members.clear();
+    if (!Check(state, g_db->SMembers(Key(CollectionPrefix("set", state.range(0)), rng() % kCollections), &members))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SMembers)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Two consecutive sets of range(0) members, which share half of them
+void BM_SInter(benchmark::State& state) {
+  PopulateSets(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> keys(2);
+  std::vector<std::string> members;
+  for (auto _ : state) {
+    auto c = static_cast<int64_t>(rng() % (kCollections - 1));
+    keys[0] = Key(CollectionPrefix("set", state.range(0)), c);
+    keys[1] = Key(CollectionPrefix("set", state.range(0)), c + 1);
+    members.clear();
+    if (!Check(state, g_db->SInter(keys, &members))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_SInter)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Lists
+
+void BM_LPush(benchmark::State& state) {
+  auto prefix = fmt::format("lpush_t{}", state.thread_index());
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> values{std::string(state.range(0), 'v')};
+  uint64_t ret = 0;
+  for (auto _ : state) {
+    if (!Check(state, g_db->LPush(Key(prefix, rng() % kCollections), values, &ret))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LPush)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_LRange(benchmark::State& state) {
+  PopulateLists(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<std::string> values;
+  for (auto _ : state) {
+    values.clear();
+    if (!Check(state,
+               g_db->LRange(Key(CollectionPrefix("list", state.range(0)), rng() % kCollections), 0, -1, &values))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_LRange)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Inserts before the middle element of lists of range(0) elements. Each list
+// takes as many inserts as it had elements, then the next one is pushed.
+void BM_LInsert(benchmark::State& state) {
+  auto size = state.range(0);
+  std::vector<std::string> values;
+  for (int64_t i = 0; i < size; i++) {
+    values.push_back(Element(i));
+  }
+  auto pivot = Element(size / 2);
+  // fresh lists for every run and thread
+  static std::atomic<int64_t> next_list = 0;
+  auto prefix = fmt::format("linsert_{}", size);
+  int64_t inserted = size;
+  std::string key;
+  int64_t ret = 0;
+  for (auto _ : state) {
+    if (inserted == size) {
+      state.PauseTiming();
+      uint64_t len = 0;
+      key = Key(prefix, next_list++);
+      auto s = g_db->LPush(key, values, &len);
+      inserted = 0;
+      state.ResumeTiming();
+      if (!Check(state, s)) {
+        break;
+      }
+    }
+    if (!Check(state, g_db->LInsert(key, storage::Before, pivot, Element(inserted++), &ret))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LInsert)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Sorted sets
+
+void BM_ZAdd(benchmark::State& state) {
+  auto prefix = fmt::format("zadd_t{}", state.thread_index());
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<storage::ScoreMember> score_members(1);
+  int32_t ret = 0;
+  for (auto _ : state) {
+    auto n = rng();
+    score_members[0].score = static_cast<double>(n % 1000000);
+    score_members[0].member = Element(n % kWriteKeySpace);
+    if (!Check(state, g_db->ZAdd(Key(prefix, n % kCollections), score_members, &ret))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ZAdd)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_ZRange(benchmark::State& state) {
+  PopulateZSets(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  std::vector<storage::ScoreMember> score_members;
+  for (auto _ : state) {
+    score_members.clear();
+    if (!Check(state, g_db->ZRange(Key(CollectionPrefix("zset", state.range(0)), rng() % kCollections), 0, -1,
+                                   &score_members))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ZRange)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+void BM_ZRank(benchmark::State& state) {
+  PopulateZSets(state.range(0));
+  std::mt19937_64 rng(state.thread_index());
+  int32_t rank = 0;
+  for (auto _ : state) {
+    auto key = Key(CollectionPrefix("zset", state.range(0)), rng() % kCollections);
+    if (!Check(state, g_db->ZRank(key, Element(rng() % state.range(0)), &rank))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ZRank)->RangeMultiplier(16)->Range(16, 4096)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// Keyspace, over the kKeySpace strings of 16 bytes values
+
+// range(0) keys per call, from the start again once the cursor is back to 0
+void BM_Scan(benchmark::State& state) {
+  PopulateStrings(16);
+  int64_t cursor = 0;
+  std::vector<std::string> keys;
+  for (auto _ : state) {
+    keys.clear();
+    cursor = g_db->Scan(storage::kStrings, cursor, StringPrefix(16) + "_*", state.range(0), &keys);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Scan)->RangeMultiplier(10)->Range(10, 1000)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+// A pattern matching one key in 100
+void BM_Keys(benchmark::State& state) {
+  PopulateStrings(16);
+  std::vector<std::string> keys;
+  for (auto _ : state) {
+    keys.clear();
+    if (!Check(state, g_db->Keys(storage::kStrings, StringPrefix(16) + "_*00", &keys))) {
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kKeySpace);
+}
+BENCHMARK(BM_Keys)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  const char* path_env = std::getenv("STORAGE_BENCH_PATH");
+  std::string db_path = path_env != nullptr ? path_env : "/dev/shm/storage_bench";
+  std::filesystem::remove_all(db_path);
+  mkdir(db_path.c_str(), 0755);
+  // the log of the db stays out of the report on stdout
+  logger::Init((db_path + ".log").c_str());
+
+  storage::StorageOptions options;
+  options.options.create_if_missing = true;
+  options.db_instance_num = 3;
+  storage::Storage db;
+  auto s = db.Open(options, db_path);
+  if (!s.ok()) {
+    fmt::print(stderr, "open {} failed: {}\n", db_path, s.ToString());
+    return 1;
+  }
+  g_db = &db;
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  db.Close();
+  std::filesystem::remove_all(db_path);
+  return 0;
+}
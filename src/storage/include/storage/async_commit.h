@@ -0,0 +1,92 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef __ASYNC_COMMIT_H__
+#define __ASYNC_COMMIT_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pstd/scope_record_lock.h"
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * Lets a thread issue raft writes without waiting for them to be applied.
+ *
+ * While an AsyncCommit is installed on a thread, a BinlogBatch committed by
+ * the thread hands its log to raft and returns OK at once, the write is
+ * reported to the AsyncCommit when it is applied. The record locks the
+ * writing function releases afterwards stay locked until then, so the next
+ * write of those keys from another thread reads what this one wrote.
+ *
+ * The installing thread itself takes back the keys it locks again, once the
+ * writes it suspended so far are applied, and waits for them the same way
+ * before it reads a key they hold, so it reads what it wrote. The keys stay
+ * locked throughout, until its last write of them is applied.
+ *
+ * The done callback runs once, after Finish and the last write of the
+ * AsyncCommit, with OK or the first error of its writes. It may run on the
+ * thread calling Finish or on the one applying the last write.
+ */
+class AsyncCommit : public pstd::lock::DeferredUnlock, public std::enable_shared_from_this<AsyncCommit> {
+ public:
+  using DoneCallback = std::function<void(const Status&)>;
+
+  explicit AsyncCommit(DoneCallback&& done) : done_(std::move(done)) {}
+
+  // Creates an AsyncCommit and installs it on the calling thread
+  static std::shared_ptr<AsyncCommit> Begin(DoneCallback&& done);
+  // The one installed on the calling thread, if any
+  static AsyncCommit* Current();
+
+  // Uninstalls it from the calling thread, no write is added after that
+  void Finish();
+
+  // Called by a batch of the installing thread in place of waiting for its
+  // log, returns the callback to run once the log is applied
+  CommitCallback Suspend();
+
+  // Called by the installing thread before it reads key, waits until the
+  // writes suspended so far are applied if one of them holds key
+  void WaitForWritesOf(const std::string& key);
+
+  bool Defer(const std::shared_ptr<pstd::lock::LockMgr>& lock_mgr, const std::string& key) override;
+  bool Reclaim(const std::shared_ptr<pstd::lock::LockMgr>& lock_mgr, const std::string& key) override;
+
+ private:
+  struct PendingWrite {
+    std::mutex mutex;
+    std::condition_variable applied;
+    bool done = false;
+    std::vector<std::pair<std::shared_ptr<pstd::lock::LockMgr>, std::string>> locked_keys;
+  };
+
+  void Complete(const std::shared_ptr<PendingWrite>& write, const Status& s);
+  void WaitApplied();
+  void Release();
+
+  DoneCallback done_;
+  // Writes in flight, plus one until Finish
+  std::atomic<int> pending_{1};
+
+  std::mutex mutex_;
+  Status status_;
+
+  // The writes suspended, the last one takes over the keys unlocked
+  // afterwards. Only used by the installing thread.
+  std::vector<std::shared_ptr<PendingWrite>> writes_;
+};
+
+}  // namespace storage
+
+#endif  // __ASYNC_COMMIT_H__
@@ -0,0 +1,62 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef __FLAT_BINLOG_H__
+#define __FLAT_BINLOG_H__
+
+#include <cstdint>
+#include <string>
+
+#include "rocksdb/status.h"
+#include "rocksdb/write_batch.h"
+
+namespace storage {
+
+/*
+ * A raft log entry in the flat format: the rep of the rocksdb::WriteBatch of
+ * the write, followed by a trailer
+ *
+ *   | WriteBatch rep | db_id (4B) | slot_idx (4B) | version (1B) | kTrailerMagic (1B) |
+ *
+ * The leader puts the entries into the batch once and hands its rep to raft,
+ * every node gives the received rep back to a WriteBatch and writes it, the
+ * entries are never decoded or copied one by one. The column family ids of
+ * the batch are the ColumnFamilyIndex of the column families.
+ *
+ * The rep starts with the sequence number of the batch, 0 until it is written,
+ * while a serialized pikiwidb::Binlog starts with a field tag, never 0, so the
+ * two formats are told apart by the first byte.
+ */
+class FlatBinlog {
+ public:
+  static constexpr uint8_t kVersion = 1;
+  static constexpr char kTrailerMagic = 'F';
+  static constexpr size_t kTrailerSize = 2 * sizeof(uint32_t) + 2;
+
+  FlatBinlog() = default;
+  FlatBinlog(uint32_t db_id, uint32_t slot_idx) : db_id_(db_id), slot_idx_(slot_idx) {}
+
+  uint32_t db_id() const { return db_id_; }
+  uint32_t slot_idx() const { return slot_idx_; }
+  rocksdb::WriteBatch* batch() { return &batch_; }
+  const rocksdb::WriteBatch& batch() const { return batch_; }
+
+  // To be sent right after batch().Data()
+  std::string EncodeTrailer() const;
+
+  static bool IsFlat(char first_byte) { return first_byte == '\0'; }
+
+  // Takes data, a rep followed by its trailer, over
+  static rocksdb::Status Decode(std::string&& data, FlatBinlog* log);
+
+ private:
+  uint32_t db_id_ = 0;
+  uint32_t slot_idx_ = 0;
+  rocksdb::WriteBatch batch_;
+};
+
+}  // namespace storage
+
+#endif  // __FLAT_BINLOG_H__
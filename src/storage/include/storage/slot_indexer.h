@@ -7,21 +7,83 @@
 #define __SLOT_INDEXER_H__
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
 #include <vector>
 
+#include "rocksdb/status.h"
+
 namespace storage {
-// Manage slots to rocksdb indexes
-// TODO(wangshaoyi): temporarily mock return
+
+/*
+ * Maps the slots of keys to rocksdb instances.
+ *
+ * A key with slot id (see GetSlotID) s is in slot s % SlotNum(). A new table
+ * has kSlotsPerInstance slots for each instance and gives slot i to instance
+ * i % inst_num, so a key stays in the instance slot_id % inst_num used before
+ * the table existed. The table is saved in the db path, slots are moved
+ * between instances online by Storage::MigrateSlots and the number of slots
+ * never changes afterwards, even if the number of instances does.
+ *
+ * Every access to the keys of a slot holds its mutex shared, the mapping of a
+ * slot is only changed while holding it exclusively.
+ *
+ * A slot being migrated is marked with the instance holding copies of its
+ * keys without owning it, the destination until the slot is moved there and
+ * the former owner afterwards. The marks are saved with the table, so the
+ * copies left by a migration that did not finish can be deleted.
+ */
 class SlotIndexer {
  public:
-  explicit SlotIndexer(int32_t inst_num) : inst_num_(inst_num) { assert(inst_num > 0); }
+  static constexpr uint32_t kSlotsPerInstance = 1024;
+  static constexpr const char* kTableFile = "SLOT_TABLE";
+
+  explicit SlotIndexer(int32_t inst_num);
   SlotIndexer() = delete;
   ~SlotIndexer() {}
-  uint32_t GetInstanceID(uint32_t slot_id) { return slot_id % inst_num_; }
-  void ReshardSlots(const std::vector<uint32_t>& slots) {}
+
+  // Loads the table saved in db_path, or saves the new one if there is none.
+  // Fails if a slot belongs to an instance out of inst_num.
+  rocksdb::Status Open(const std::string& db_path);
+
+  uint32_t SlotNum() const { return slot_num_; }
+  uint32_t GetSlot(uint32_t slot_id) const { return slot_id % slot_num_; }
+  uint32_t GetInstanceID(uint32_t slot_id) const { return table_[GetSlot(slot_id)].load(std::memory_order_acquire); }
+  std::shared_mutex& GetSlotMutex(uint32_t slot) { return slot_mutexes_[slot]; }
+
+  // Gives slot to inst_id and saves the table, the caller holds the slot mutex exclusively.
+  // The slot is marked with its former instance, which still holds its keys.
+  rocksdb::Status MoveSlot(uint32_t slot, uint32_t inst_id);
+  std::vector<uint32_t> GetSlotsOfInstance(uint32_t inst_id) const;
+
+  // Marks the slots set in slots as migrating to inst_id and saves the table
+  rocksdb::Status MarkMigrating(const std::vector<bool>& slots, uint32_t inst_id);
+  // Unmarks the slots set in slots once their copies are deleted and saves the table
+  rocksdb::Status UnmarkMigrating(const std::vector<bool>& slots);
+  // The slots marked with each instance, empty for an instance with none
+  std::vector<std::vector<bool>> GetMigratingSlots() const;
+  bool HasMigratingSlots() const { return migrating_num_.load(std::memory_order_acquire) > 0; }
 
  private:
+  static constexpr int32_t kNotMigrating = -1;
+
+  // Saves the table, the caller holds mutex_
+  rocksdb::Status Save() const;
+
   int32_t inst_num_ = 3;
+  uint32_t slot_num_ = 0;
+  std::string path_;
+  std::unique_ptr<std::atomic<uint32_t>[]> table_;
+  std::unique_ptr<std::shared_mutex[]> slot_mutexes_;
+
+  // Guards the marks and the saving of the table
+  mutable std::mutex mutex_;
+  // The instance holding copies of each slot, or kNotMigrating
+  std::vector<int32_t> migrating_;
+  std::atomic<uint32_t> migrating_num_ = 0;
 };
 }  // namespace storage
 
@@ -12,8 +12,12 @@
 #include <future>
 #include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -43,6 +47,7 @@ inline const std::string PROPERTY_TYPE_ROCKSDB_ESTIMATE_TABLE_READER_MEM = "rock
 inline const std::string PROPERTY_TYPE_ROCKSDB_BACKGROUND_ERRORS = "rocksdb.background-errors";
 
 inline constexpr size_t BATCH_DELETE_LIMIT = 100;
+inline constexpr size_t STORE_BATCH_LIMIT = 512;
 inline constexpr size_t COMPACT_THRESHOLD_COUNT = 2000;
 
 inline constexpr uint64_t kNoFlush = std::numeric_limits<uint64_t>::max();
@@ -56,13 +61,18 @@ using Env = rocksdb::Env;
 using LogIndex = int64_t;
 
 class Redis;
+class MemberIterator;
+class FlatBinlog;
 enum class OptionType;
 
-template <typename T1, typename T2>
-class LRUCache;
+template <typename V>
+class ShardedCache;
 
-using AppendLogFunction = std::function<void(const pikiwidb::Binlog&, std::promise<Status>&&)>;
-using DoSnapshotFunction = std::function<void(LogIndex, bool)>;
+// Runs once the log handed to an AppendLogFunction is applied, or failed
+using CommitCallback = std::function<void(const Status&)>;
+using AppendLogFunction = std::function<void(FlatBinlog&&, CommitCallback&&)>;
+// Asks to snapshot an instance whose column families flushed every log up to the given index
+using DoSnapshotFunction = std::function<void(int32_t inst_id, LogIndex, bool)>;
 
 struct StorageOptions {
   mutable rocksdb::Options options;
@@ -110,6 +120,32 @@ struct KeyInfo {
   }
 };
 
+// A collection found by a big keys scan
+struct BigKeyInfo {
+  DataType type;
+  std::string key;
+  uint64_t count = 0;  // its fields, members or elements
+};
+
+struct BigKeysReport {
+  bool running = false;
+  int64_t start_time = 0;  // unix time in seconds
+  int64_t end_time = 0;
+  uint64_t scanned_keys = 0;
+  std::string error;  // why the last scan did not complete
+  // The largest collections of each type, the largest first
+  std::vector<BigKeyInfo> keys;
+};
+
+struct SlotsMigrationReport {
+  bool running = false;
+  int64_t start_time = 0;  // unix time in seconds
+  int64_t end_time = 0;
+  int32_t slots = 0;  // to move
+  int32_t moved_slots = 0;
+  std::string error;  // why the last migration did not complete
+};
+
 struct ValueStatus {
   std::string value;
   Status status;
@@ -179,6 +215,23 @@ struct BGTask {
       : type(_type), operation(_opeation), argv(_argv) {}
 };
 
+// An instance along with the shared lock of the slot it was looked up for,
+// the slot does not move to another instance until it is destroyed
+class InstanceRef {
+ public:
+  InstanceRef(std::unique_ptr<Redis>& inst, uint32_t slot, std::shared_lock<std::shared_mutex>&& lock)
+      : inst_(&inst), slot_(slot), lock_(std::move(lock)) {}
+
+  Redis* operator->() const { return inst_->get(); }
+  Redis* get() const { return inst_->get(); }
+  uint32_t slot() const { return slot_; }
+
+ private:
+  std::unique_ptr<Redis>* inst_;
+  uint32_t slot_;
+  std::shared_lock<std::shared_mutex> lock_;
+};
+
 class Storage {
  public:
   Storage();
@@ -188,22 +241,63 @@ class Storage {
 
   Status Close();
 
-  std::vector<std::future<Status>> CreateCheckpoint(const std::string& checkpoint_path);
+  // Of the instances in inst_ids only, or of all of them if it is empty
+  std::vector<std::future<Status>> CreateCheckpoint(const std::string& checkpoint_path,
+                                                    const std::vector<int32_t>& inst_ids = {});
 
   Status CreateCheckpointInternal(const std::string& checkpoint_path, int db_index);
 
-  std::vector<std::future<Status>> LoadCheckpoint(const std::string& checkpoint_path, const std::string& db_path);
+  std::vector<std::future<Status>> LoadCheckpoint(const std::string& checkpoint_path, const std::string& db_path,
+                                                  const std::vector<int32_t>& inst_ids = {});
 
   Status LoadCheckpointInternal(const std::string& dump_path, const std::string& db_path, int index);
 
   Status LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key);
 
-  Status StoreCursorStartKey(const DataType& dtype, int64_t cursor, char type, const std::string& next_key);
+  // Remembers next_key and returns the cursor that resumes from it
+  int64_t StoreCursorStartKey(const DataType& dtype, char type, const std::string& next_key);
 
   std::unique_ptr<Redis>& GetDBInstance(const Slice& key);
 
   std::unique_ptr<Redis>& GetDBInstance(const std::string& key);
 
+  // Slots Commands
+
+  size_t GetDBInstanceNum() const { return db_instance_num_; }
+
+  uint32_t GetSlotNum() const { return slot_indexer_->SlotNum(); }
+
+  uint32_t GetSlot(const std::string& key) const;
+
+  int32_t GetInstanceIDOfSlot(uint32_t slot) const { return static_cast<int32_t>(slot_indexer_->GetInstanceID(slot)); }
+
+  std::vector<uint32_t> GetSlotsOfInstance(int32_t inst_id) const { return slot_indexer_->GetSlotsOfInstance(inst_id); }
+
+  // Whether an instance may hold copies of the keys of slots it does not own
+  bool HasMigratingSlots() const { return slot_indexer_->HasMigratingSlots(); }
+
+  // Moves slots to instance inst_id while they are read and written. The keys
+  // are copied from a snapshot, then the ones written meanwhile, and each slot
+  // is switched over under its lock once few of its keys remain to be copied.
+  // The copies are then deleted from the former instances, scans leave them
+  // out meanwhile. The slots stay marked in the slot table until then, the
+  // copies left by a crash are deleted when the storage is opened again. Not
+  // supported with raft, where a log names the instance it is applied to.
+  Status MigrateSlots(const std::vector<uint32_t>& slots, int32_t inst_id);
+
+  // Migrates slots so that the first inst_num instances own the same number
+  // of slots, give or take one, and the others none. moved is set to the
+  // number of slots migrated. Each instance is read once for all the
+  // instances its slots go to.
+  Status RebalanceSlots(int32_t inst_num, int32_t* moved);
+
+  // Same as above in a thread of their own, one migration at a time. The
+  // arguments are checked before it starts, moving is set to the number of
+  // slots to migrate. The progress is in GetSlotsMigrationReport().
+  Status StartSlotsMigration(const std::vector<uint32_t>& slots, int32_t inst_id);
+  Status StartSlotsRebalance(int32_t inst_num, int32_t* moving);
+  SlotsMigrationReport GetSlotsMigrationReport();
+
   // Strings Commands
 
   // Set key to hold the string value. if key
@@ -460,8 +554,7 @@ class Storage {
   //   key3 = {a, c, e}
   //   SDIFFSTORE destination key1 key2 key3
   //   destination = {b, d}
-  Status SDiffstore(const Slice& destination, const std::vector<std::string>& keys,
-                    std::vector<std::string>& value_to_dest, int32_t* ret);
+  Status SDiffstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret);
 
   // Returns the members of the set resulting from the intersection of all the
   // given sets.
@@ -484,8 +577,7 @@ class Storage {
   //   key3 = {a, c, e}
   //   SINTERSTORE destination key1 key2 key3
   //   destination = {a, c}
-  Status SInterstore(const Slice& destination, const std::vector<std::string>& keys,
-                     std::vector<std::string>& value_to_dest, int32_t* ret);
+  Status SInterstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret);
 
   // Returns if member is a member of the set stored at key.
   Status SIsmember(const Slice& key, const Slice& member, int32_t* ret);
@@ -544,8 +636,7 @@ class Storage {
   //   key3 = {c, d, e}
   //   SUNIONSTORE destination key1 key2 key3
   //   destination = {a, b, c, d, e}
-  Status SUnionstore(const Slice& destination, const std::vector<std::string>& keys,
-                     std::vector<std::string>& value_to_dest, int32_t* ret);
+  Status SUnionstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret);
 
   // See SCAN for SSCAN documentation.
   Status SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
@@ -904,7 +995,7 @@ class Storage {
   //
   // If destination already exists, it is overwritten.
   Status ZUnionstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
-                     AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret);
+                     AGGREGATE agg, int32_t* ret);
 
   // Computes the intersection of numkeys sorted sets given by the specified
   // keys, and stores the result in destination. It is mandatory to provide the
@@ -921,7 +1012,7 @@ class Storage {
   //
   // If destination already exists, it is overwritten.
   Status ZInterstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
-                     AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret);
+                     AGGREGATE agg, int32_t* ret);
 
   // When all the elements in a sorted set are inserted with the same score, in
   // order to force lexicographical ordering, this command returns all the
@@ -1079,7 +1170,8 @@ class Storage {
   // HyperLogLog
   enum {
     kMaxKeys = 255,
-    kPrecision = 17,
+    // 2^14 registers of 6 bits, the same as Redis
+    kPrecision = 14,
   };
   // Adds all the element arguments to the HyperLogLog data structure stored
   // at the variable name specified as first argument.
@@ -1113,22 +1205,72 @@ class Storage {
   Status GetUsage(const std::string& property, uint64_t* result);
   Status GetUsage(const std::string& property, std::map<int, uint64_t>* type_result);
   uint64_t GetProperty(const std::string& property);
+  // The integer property of each instance, summed over its column families
+  Status GetAggregatedUsage(const std::string& property, std::map<int, uint64_t>* inst_result);
+  // The options of the column family of each live SST file of an instance, by file name
+  Status GetSstFileOptions(int inst_id, std::map<std::string, rocksdb::Options>* file_options);
 
   Status GetKeyNum(std::vector<KeyInfo>* key_infos);
   Status StopScanKeyNum();
 
+  // A sampled read or write of key, standing for weight accesses
+  void RecordHotKey(const Slice& key, uint64_t weight);
+  // The count most accessed keys of all the instances lately, the hottest first
+  std::vector<std::pair<std::string, uint64_t>> GetHotKeys(size_t count);
+  void ClearHotKeys();
+
+  // Starts scanning the meta column families of all the instances in a thread of
+  // its own for the top largest collections of each type, reading at most
+  // keys_per_second meta values a second, 0 for no limit. The data column
+  // families are not read and the block cache is not filled.
+  Status StartBigKeysScan(size_t top, uint64_t keys_per_second);
+  BigKeysReport GetBigKeysReport();
+
   rocksdb::DB* GetDBByIndex(int index);
 
   Status SetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options);
   void GetRocksDBInfo(std::string& info);
-  Status OnBinlogWrite(const pikiwidb::Binlog& log, LogIndex log_idx);
+  // The flat form of a log written by a leader which still uses the protobuf format
+  Status ToFlatBinlog(const pikiwidb::Binlog& log, FlatBinlog* flat_log) const;
+  Status OnBinlogWrite(FlatBinlog&& log, LogIndex log_idx);
+  // Applies consecutive logs of one instance, in log index order, with a single
+  // write. If it fails none of them is written.
+  Status OnBinlogWrite(std::vector<std::pair<FlatBinlog, LogIndex>>&& logs);
 
  private:
+  // Opens an ordered member iterator for each key, the slot of a missing key is left empty
+  Status OpenMemberIterators(const DataType& dtype, const std::vector<std::string>& keys,
+                             std::vector<std::unique_ptr<MemberIterator>>* iters);
+  Status PfMergeRegisters(const std::vector<std::string>& keys, uint8_t* max_registers);
+
+  // The instance of key, its slot is locked shared unless locked is a ref of the same slot
+  InstanceRef LockDBInstance(const Slice& key, const InstanceRef* locked = nullptr);
+  // targets holds the instance each slot goes to, or kNoTarget
+  static constexpr int32_t kNoTarget = -1;
+  static int32_t CountMovingSlots(const std::vector<int32_t>& targets);
+  Status PlanSlotsMigration(const std::vector<uint32_t>& slots, int32_t inst_id, std::vector<int32_t>* targets) const;
+  Status PlanSlotsRebalance(int32_t inst_num, std::vector<int32_t>* targets) const;
+  Status MigrateSlotsTo(const std::vector<int32_t>& targets);
+  // Moves the slots of instance src_id to their targets, in a single pass over it
+  Status MigrateSlotsFrom(int32_t src_id, const std::vector<int32_t>& targets);
+  Status StartMigrateThread(std::vector<int32_t>&& targets);
+  void StopSlotsMigration();
+  // Deletes the copies of the slots marked migrating, left by migrations that did not finish
+  Status DeleteMigratingSlots();
+  Status DoScanBigKeys(size_t top, uint64_t keys_per_second);
+  void StopBigKeysScan();
+
   std::vector<std::unique_ptr<Redis>> insts_;
   std::unique_ptr<SlotIndexer> slot_indexer_;
+  // One migration at a time
+  std::mutex migrate_mutex_;
+  std::thread migrate_thread_;
+  std::atomic<bool> migrate_should_exit_ = false;
+  std::mutex migrate_report_mutex_;
+  SlotsMigrationReport migrate_report_;
   std::atomic<bool> is_opened_ = false;
 
-  std::unique_ptr<LRUCache<std::string, std::string>> cursors_store_;
+  std::unique_ptr<ShardedCache<std::string>> cursors_store_;
 
   // Storage start the background thread for compaction task
   pthread_t bg_tasks_thread_id_ = 0;
@@ -1139,6 +1281,12 @@ class Storage {
   std::atomic<int> current_task_type_ = kNone;
   std::atomic<bool> bg_tasks_should_exit_ = false;
 
+  // One big keys scan at a time
+  std::thread bigkeys_thread_;
+  std::atomic<bool> bigkeys_should_exit_ = false;
+  std::mutex bigkeys_mutex_;
+  BigKeysReport bigkeys_report_;
+
   // For scan keys in data base
   std::atomic<bool> scan_keynum_exit_ = false;
   size_t db_instance_num_ = 3;
@@ -42,7 +42,8 @@ enum ColumnFamilyIndex {
   kZsetsMetaCF = 7,
   kZsetsDataCF = 8,
   kZsetsScoreCF = 9,
-  kColumnFamilyNum = 10,
+  kTypeDirectoryCF = 10,
+  kColumnFamilyNum = 11,
 };
 
 const static char kNeedTransformCharacter = '\u0000';
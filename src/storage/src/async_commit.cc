@@ -0,0 +1,125 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/async_commit.h"
+
+#include <algorithm>
+
+namespace storage {
+
+std::shared_ptr<AsyncCommit> AsyncCommit::Begin(DoneCallback&& done) {
+  auto commit = std::make_shared<AsyncCommit>(std::move(done));
+  pstd::lock::DeferredUnlock::SetCurrent(commit.get());
+  return commit;
+}
+
+AsyncCommit* AsyncCommit::Current() {
+  return dynamic_cast<AsyncCommit*>(pstd::lock::DeferredUnlock::Current());
+}
+
+void AsyncCommit::Finish() {
+  if (pstd::lock::DeferredUnlock::Current() == this) {
+    pstd::lock::DeferredUnlock::SetCurrent(nullptr);
+  }
+  writes_.clear();
+  Release();
+}
+
+CommitCallback AsyncCommit::Suspend() {
+  auto write = std::make_shared<PendingWrite>();
+  writes_.push_back(write);
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  return [self = shared_from_this(), write](const Status& s) { self->Complete(write, s); };
+}
+
+bool AsyncCommit::Defer(const std::shared_ptr<pstd::lock::LockMgr>& lock_mgr, const std::string& key) {
+  if (writes_.empty()) {
+    return false;
+  }
+  auto& last_write = writes_.back();
+  std::lock_guard lock(last_write->mutex);
+  if (last_write->done) {
+    return false;
+  }
+  last_write->locked_keys.emplace_back(lock_mgr, key);
+  return true;
+}
+
+bool AsyncCommit::Reclaim(const std::shared_ptr<pstd::lock::LockMgr>& lock_mgr, const std::string& key) {
+  bool reclaimed = false;
+  for (const auto& write : writes_) {
+    std::lock_guard lock(write->mutex);
+    auto& keys = write->locked_keys;
+    auto it = std::find_if(keys.begin(), keys.end(),
+                           [&](const auto& locked) { return locked.first == lock_mgr && locked.second == key; });
+    if (it != keys.end()) {
+      keys.erase(it);
+      reclaimed = true;
+      break;
+    }
+  }
+  if (reclaimed) {
+    WaitApplied();
+  }
+  return reclaimed;
+}
+
+void AsyncCommit::WaitForWritesOf(const std::string& key) {
+  bool written = false;
+  for (const auto& write : writes_) {
+    std::lock_guard lock(write->mutex);
+    const auto& keys = write->locked_keys;
+    if (std::any_of(keys.begin(), keys.end(), [&](const auto& locked) { return locked.second == key; })) {
+      written = true;
+      break;
+    }
+  }
+  if (written) {
+    WaitApplied();
+  }
+}
+
+void AsyncCommit::WaitApplied() {
+  // the key may have been written along with the writes of other instances
+  for (const auto& write : writes_) {
+    std::unique_lock lock(write->mutex);
+    write->applied.wait(lock, [&write]() { return write->done; });
+  }
+}
+
+void AsyncCommit::Complete(const std::shared_ptr<PendingWrite>& write, const Status& s) {
+  std::vector<std::pair<std::shared_ptr<pstd::lock::LockMgr>, std::string>> locked_keys;
+  {
+    std::lock_guard lock(write->mutex);
+    write->done = true;
+    locked_keys.swap(write->locked_keys);
+  }
+  write->applied.notify_all();
+  for (const auto& [lock_mgr, key] : locked_keys) {
+    lock_mgr->UnLock(key);
+  }
+
+  if (!s.ok()) {
+    std::lock_guard lock(mutex_);
+    if (status_.ok()) {
+      status_ = s;
+    }
+  }
+  Release();
+}
+
+void AsyncCommit::Release() {
+  if (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+  Status s;
+  {
+    std::lock_guard lock(mutex_);
+    s = status_;
+  }
+  done_(s);
+}
+
+}  // namespace storage
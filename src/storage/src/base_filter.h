@@ -31,6 +31,11 @@ class BaseMetaFilter : public rocksdb::CompactionFilter {
     TRACE("[MetaFilter], key: %s, count = %d, timestamp: %llu, cur_time: %d, version: %llu", key.ToString().c_str(),
           parsed_base_meta_value.Count(), parsed_base_meta_value.Etime(), cur_time, parsed_base_meta_value.Version());
 
+    // A *STORE is staging the members of the key, see Redis::SetsStore
+    if (parsed_base_meta_value.StagingVersion() != 0) {
+      TRACE("Reserve[Staging]");
+      return false;
+    }
     if (parsed_base_meta_value.Etime() != 0 && parsed_base_meta_value.Etime() < cur_time &&
         parsed_base_meta_value.Version() < cur_time) {
       TRACE("Drop[Stale & version < cur_time]");
@@ -92,6 +97,7 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
         ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
         cur_meta_version_ = parsed_base_meta_value.Version();
         cur_meta_etime_ = parsed_base_meta_value.Etime();
+        cur_staging_version_ = parsed_base_meta_value.StagingVersion();
       } else if (s.IsNotFound()) {
         meta_not_found_ = true;
       } else {
@@ -106,6 +112,13 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
       return true;
     }
 
+    // Staged by a *STORE that has not published its meta yet, even if the
+    // current meta has expired meanwhile
+    if (cur_staging_version_ != 0 && cur_staging_version_ == parsed_base_data_key.Version()) {
+      TRACE("Reserve[data_key_version == staging_version]");
+      return false;
+    }
+
     int64_t unix_time;
     rocksdb::Env::Default()->GetCurrentTime(&unix_time);
     if (cur_meta_etime_ != 0 && cur_meta_etime_ < static_cast<uint64_t>(unix_time)) {
@@ -116,6 +129,10 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
     if (cur_meta_version_ > parsed_base_data_key.Version()) {
       TRACE("Drop[data_key_version < cur_meta_version]");
       return true;
+    } else if (cur_meta_version_ < parsed_base_data_key.Version()) {
+      // Left by a *STORE that failed or was interrupted before publishing
+      TRACE("Drop[data_key_version > cur_meta_version]");
+      return true;
     } else {
       TRACE("Reserve[data_key_version == cur_meta_version]");
       return false;
@@ -132,6 +149,7 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
   mutable bool meta_not_found_ = false;
   mutable uint64_t cur_meta_version_ = 0;
   mutable uint64_t cur_meta_etime_ = 0;
+  mutable uint64_t cur_staging_version_ = 0;
   int meta_cf_index_ = 0;
 };
 
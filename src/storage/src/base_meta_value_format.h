@@ -16,6 +16,9 @@ namespace storage {
 /*
  * | value | version | reserve | cdate | timestamp |
  * |       |    8B   |   16B   |   8B  |     8B    |
+ *
+ * The first 8 bytes of reserve hold the staging version, the version a *STORE
+ * writes the new members of the key under before it publishes them, or 0.
  */
 // TODO(wangshaoyi): reformat encode, AppendTimestampAndVersion
 class BaseMetaValue : public InternalValue {
@@ -120,9 +123,22 @@ class ParsedBaseMetaValue : public ParsedInternalValue {
     this->SetCount(0);
     this->SetEtime(0);
     this->SetCtime(0);
+    this->SetStagingVersion(0);
     return this->UpdateVersion();
   }
 
+  // The data of this version is kept by the compaction filters though it is not
+  // the version of the meta value, see Redis::SetsStore
+  uint64_t StagingVersion() { return DecodeFixed64(reserve_); }
+
+  void SetStagingVersion(uint64_t version) {
+    EncodeFixed64(reserve_, version);
+    if (value_) {
+      char* dst = const_cast<char*>(value_->data()) + value_->size() - kBaseMetaValueSuffixLength + kVersionLength;
+      EncodeFixed64(dst, version);
+    }
+  }
+
   bool IsValid() override { return !IsStale() && Count() != 0; }
 
   bool check_set_count(size_t count) {
@@ -14,8 +14,9 @@
 
 #include "rocksdb/db.h"
 
-#include "binlog.pb.h"
 #include "src/redis.h"
+#include "storage/async_commit.h"
+#include "storage/flat_binlog.h"
 #include "storage/storage.h"
 #include "storage/storage_define.h"
 
@@ -61,34 +62,30 @@ class RocksBatch : public Batch {
 
 class BinlogBatch : public Batch {
  public:
-  BinlogBatch(AppendLogFunction func, int32_t index, uint32_t seconds = 10)
-      : func_(std::move(func)), seconds_(seconds) {
-    binlog_.set_db_id(0);
-    binlog_.set_slot_idx(index);
-  }
+  BinlogBatch(AppendLogFunction func, int32_t index, const std::vector<rocksdb::ColumnFamilyHandle*>& handles,
+              uint32_t seconds = 10)
+      : func_(std::move(func)), binlog_(0, index), handles_(handles), seconds_(seconds) {}
 
   void Put(ColumnFamilyIndex cf_idx, const Slice& key, const Slice& value) override {
-    auto entry = binlog_.add_entries();
-    entry->set_cf_idx(cf_idx);
-    entry->set_op_type(pikiwidb::OperateType::kPut);
-    entry->set_key(key.ToString());
-    entry->set_value(value.ToString());
+    binlog_.batch()->Put(handles_[cf_idx], key, value);
     cnt_++;
   }
 
   void Delete(ColumnFamilyIndex cf_idx, const Slice& key) override {
-    auto entry = binlog_.add_entries();
-    entry->set_cf_idx(cf_idx);
-    entry->set_op_type(pikiwidb::OperateType::kDelete);
-    entry->set_key(key.ToString());
+    binlog_.batch()->Delete(handles_[cf_idx], key);
     cnt_++;
   }
 
   Status Commit() override {
     // FIXME(longfar): We should make sure that in non-RAFT mode, the code doesn't run here
-    std::promise<Status> promise;
-    auto future = promise.get_future();
-    func_(binlog_, std::move(promise));
+    if (auto commit = AsyncCommit::Current(); commit) {
+      // the AsyncCommit of the thread is told the result
+      func_(std::move(binlog_), commit->Suspend());
+      return Status::OK();
+    }
+    auto promise = std::make_shared<std::promise<Status>>();
+    auto future = promise->get_future();
+    func_(std::move(binlog_), [promise](const Status& s) { promise->set_value(s); });
     auto status = future.wait_for(std::chrono::seconds(seconds_));
     if (status == std::future_status::timeout) {
       return Status::Incomplete("Wait for write timeout");
@@ -98,13 +95,15 @@ class BinlogBatch : public Batch {
 
  private:
   AppendLogFunction func_;
-  pikiwidb::Binlog binlog_;
+  FlatBinlog binlog_;
+  const std::vector<rocksdb::ColumnFamilyHandle*>& handles_;
   uint32_t seconds_ = 10;
 };
 
 inline auto Batch::CreateBatch(Redis* redis) -> std::unique_ptr<Batch> {
   if (redis->GetAppendLogFunction()) {
-    return std::make_unique<BinlogBatch>(redis->GetAppendLogFunction(), redis->GetIndex(), redis->GetRaftTimeout());
+    return std::make_unique<BinlogBatch>(redis->GetAppendLogFunction(), redis->GetIndex(),
+                                         redis->GetColumnFamilyHandles(), redis->GetRaftTimeout());
   }
   return std::make_unique<RocksBatch>(redis->GetDB(), redis->GetWriteOptions(), redis->GetColumnFamilyHandles());
 }
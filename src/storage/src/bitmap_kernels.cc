@@ -0,0 +1,288 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bitmap_kernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define BITMAP_KERNELS_X86 1
+#endif
+
+namespace storage {
+
+namespace {
+
+inline uint64_t LoadWord(const uint8_t* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+inline void StoreWord(uint8_t* p, uint64_t word) { memcpy(p, &word, sizeof(word)); }
+
+// Load 8 bytes so that the first byte is the most significant one
+inline uint64_t LoadWordBigEndian(const uint8_t* p) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return __builtin_bswap64(LoadWord(p));
+#else
+  return LoadWord(p);
+#endif
+}
+
+inline uint64_t ScalarCountImpl(const uint8_t* data, size_t len) {
+  uint64_t count = 0;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    count += __builtin_popcountll(LoadWord(data + i));
+  }
+  for (; i < len; i++) {
+    count += __builtin_popcount(data[i]);
+  }
+  return count;
+}
+
+inline void ScalarBitOpImpl(BitOpType op, uint8_t* dst, const uint8_t* src, size_t len) {
+  size_t i = 0;
+  switch (op) {
+    case kBitOpNot:
+      for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        StoreWord(dst + i, ~LoadWord(dst + i));
+      }
+      for (; i < len; i++) {
+        dst[i] = static_cast<uint8_t>(~dst[i]);
+      }
+      break;
+    case kBitOpAnd:
+      for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        StoreWord(dst + i, LoadWord(dst + i) & LoadWord(src + i));
+      }
+      for (; i < len; i++) {
+        dst[i] &= src[i];
+      }
+      break;
+    case kBitOpOr:
+      for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        StoreWord(dst + i, LoadWord(dst + i) | LoadWord(src + i));
+      }
+      for (; i < len; i++) {
+        dst[i] |= src[i];
+      }
+      break;
+    case kBitOpXor:
+      for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        StoreWord(dst + i, LoadWord(dst + i) ^ LoadWord(src + i));
+      }
+      for (; i < len; i++) {
+        dst[i] ^= src[i];
+      }
+      break;
+    case kBitOpDefault:
+      break;
+  }
+}
+
+inline int64_t ScalarFindFirstImpl(const uint8_t* data, size_t len, int bit) {
+  // looking for a clear bit is looking for a set bit in the complement
+  const uint64_t flip = bit ? 0 : ~static_cast<uint64_t>(0);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word = LoadWordBigEndian(data + i) ^ flip;
+    if (word != 0) {
+      return static_cast<int64_t>(i * 8 + __builtin_clzll(word));
+    }
+  }
+  for (; i < len; i++) {
+    auto byte = static_cast<uint8_t>(data[i] ^ static_cast<uint8_t>(flip));
+    if (byte != 0) {
+      return static_cast<int64_t>(i * 8 + __builtin_clz(byte) - 24);
+    }
+  }
+  return -1;
+}
+
+uint64_t ScalarCount(const uint8_t* data, size_t len) { return ScalarCountImpl(data, len); }
+
+void ScalarBitOp(BitOpType op, uint8_t* dst, const uint8_t* src, size_t len) { ScalarBitOpImpl(op, dst, src, len); }
+
+int64_t ScalarFindFirst(const uint8_t* data, size_t len, int bit) { return ScalarFindFirstImpl(data, len, bit); }
+
+#ifdef BITMAP_KERNELS_X86
+
+// The scalar kernels with the popcnt instruction instead of the bit twiddling
+// fallback of __builtin_popcountll, the build only assumes sse4.2.
+__attribute__((target("popcnt"))) uint64_t PopcntCount(const uint8_t* data, size_t len) {
+  return ScalarCountImpl(data, len);
+}
+
+/*
+ * AVX2 kernels, 32 bytes per step.
+ * The count looks the bit count of each nibble up with a byte shuffle and
+ * sums the bytes of every 64 bit lane with sad (Mula's algorithm).
+ */
+__attribute__((target("avx2"))) inline __m256i Avx2Load(const uint8_t* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+__attribute__((target("avx2"))) uint64_t Avx2Count(const uint8_t* data, size_t len) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+                                          2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i total = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = Avx2Load(data + i);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+  }
+  uint64_t count = static_cast<uint64_t>(_mm256_extract_epi64(total, 0)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(total, 1)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(total, 2)) +
+                   static_cast<uint64_t>(_mm256_extract_epi64(total, 3));
+  return count + ScalarCountImpl(data + i, len - i);
+}
+
+__attribute__((target("avx2"))) void Avx2BitOp(BitOpType op, uint8_t* dst, const uint8_t* src, size_t len) {
+  size_t i = 0;
+  const __m256i ones = _mm256_set1_epi8(-1);
+  for (; i + 32 <= len; i += 32) {
+    auto d = reinterpret_cast<__m256i*>(dst + i);
+    switch (op) {
+      case kBitOpNot:
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), ones));
+        break;
+      case kBitOpAnd:
+        _mm256_storeu_si256(d, _mm256_and_si256(_mm256_loadu_si256(d), Avx2Load(src + i)));
+        break;
+      case kBitOpOr:
+        _mm256_storeu_si256(d, _mm256_or_si256(_mm256_loadu_si256(d), Avx2Load(src + i)));
+        break;
+      case kBitOpXor:
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d), Avx2Load(src + i)));
+        break;
+      case kBitOpDefault:
+        return;
+    }
+  }
+  ScalarBitOpImpl(op, dst + i, src ? src + i : nullptr, len - i);
+}
+
+__attribute__((target("avx2"))) int64_t Avx2FindFirst(const uint8_t* data, size_t len, int bit) {
+  // skip the blocks which are all 0 (looking for 1) or all 1 (looking for 0)
+  const __m256i ones = _mm256_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = Avx2Load(data + i);
+    if (bit ? !_mm256_testz_si256(v, v) : !_mm256_testc_si256(v, ones)) {
+      break;
+    }
+  }
+  int64_t pos = ScalarFindFirstImpl(data + i, len - i, bit);
+  return pos == -1 ? -1 : static_cast<int64_t>(i * 8) + pos;
+}
+
+/*
+ * AVX-512 kernels, 64 bytes per step. The count uses the same nibble lookup
+ * as AVX2, which only needs avx512bw rather than the less common vpopcntdq.
+ */
+__attribute__((target("avx512f,avx512bw"))) uint64_t Avx512Count(const uint8_t* data, size_t len) {
+  // bytes 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 in every 128 bit lane
+  const __m512i lookup = _mm512_set4_epi32(0x04030302, 0x03020201, 0x03020201, 0x02010100);
+  const __m512i low_mask = _mm512_set1_epi8(0x0f);
+  __m512i total = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i v = _mm512_loadu_si512(data + i);
+    __m512i lo = _mm512_and_si512(v, low_mask);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low_mask);
+    __m512i cnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo), _mm512_shuffle_epi8(lookup, hi));
+    total = _mm512_add_epi64(total, _mm512_sad_epu8(cnt, _mm512_setzero_si512()));
+  }
+  alignas(64) uint64_t lanes[8];
+  _mm512_store_si512(lanes, total);
+  uint64_t count = 0;
+  for (auto lane : lanes) {
+    count += lane;
+  }
+  return count + ScalarCountImpl(data + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void Avx512BitOp(BitOpType op, uint8_t* dst, const uint8_t* src,
+                                                              size_t len) {
+  size_t i = 0;
+  const __m512i ones = _mm512_set1_epi8(-1);
+  for (; i + 64 <= len; i += 64) {
+    switch (op) {
+      case kBitOpNot:
+        _mm512_storeu_si512(dst + i, _mm512_xor_si512(_mm512_loadu_si512(dst + i), ones));
+        break;
+      case kBitOpAnd:
+        _mm512_storeu_si512(dst + i, _mm512_and_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+        break;
+      case kBitOpOr:
+        _mm512_storeu_si512(dst + i, _mm512_or_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+        break;
+      case kBitOpXor:
+        _mm512_storeu_si512(dst + i, _mm512_xor_si512(_mm512_loadu_si512(dst + i), _mm512_loadu_si512(src + i)));
+        break;
+      case kBitOpDefault:
+        return;
+    }
+  }
+  ScalarBitOpImpl(op, dst + i, src ? src + i : nullptr, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw"))) int64_t Avx512FindFirst(const uint8_t* data, size_t len, int bit) {
+  const __m512i ones = _mm512_set1_epi8(-1);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i v = _mm512_loadu_si512(data + i);
+    if (bit ? _mm512_test_epi64_mask(v, v) != 0 : _mm512_cmpneq_epi64_mask(v, ones) != 0) {
+      break;
+    }
+  }
+  int64_t pos = ScalarFindFirstImpl(data + i, len - i, bit);
+  return pos == -1 ? -1 : static_cast<int64_t>(i * 8) + pos;
+}
+
+#endif  // BITMAP_KERNELS_X86
+
+const BitmapKernels kScalarKernels{"scalar", ScalarCount, ScalarBitOp, ScalarFindFirst};
+#ifdef BITMAP_KERNELS_X86
+const BitmapKernels kPopcntKernels{"popcnt", PopcntCount, ScalarBitOp, ScalarFindFirst};
+const BitmapKernels kAvx2Kernels{"avx2", Avx2Count, Avx2BitOp, Avx2FindFirst};
+const BitmapKernels kAvx512Kernels{"avx512", Avx512Count, Avx512BitOp, Avx512FindFirst};
+#endif
+
+}  // namespace
+
+const BitmapKernels& ScalarBitmapKernels() { return kScalarKernels; }
+
+std::vector<const BitmapKernels*> SupportedBitmapKernels() {
+  std::vector<const BitmapKernels*> kernels{&kScalarKernels};
+#ifdef BITMAP_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("popcnt")) {
+    kernels.push_back(&kPopcntKernels);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(&kAvx2Kernels);
+  }
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+    kernels.push_back(&kAvx512Kernels);
+  }
+#endif
+  return kernels;
+}
+
+const BitmapKernels& BestBitmapKernels() {
+  static const BitmapKernels* best = SupportedBitmapKernels().back();
+  return *best;
+}
+
+}  // namespace storage
@@ -0,0 +1,48 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAP_KERNELS_H_
+#define SRC_BITMAP_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * Kernels over the raw bytes of a string used as a bitmap. Bits are numbered
+ * from the most significant bit of the first byte, as in SETBIT/BITPOS.
+ *
+ * Several implementations are compiled in and the widest one supported by
+ * the running cpu is picked once, so the same binary runs everywhere.
+ */
+struct BitmapKernels {
+  const char* name;
+
+  // Number of set bits in data[0, len)
+  uint64_t (*count)(const uint8_t* data, size_t len);
+
+  // dst[i] = dst[i] op src[i] for i in [0, len), kBitOpNot ignores src
+  void (*bitop)(BitOpType op, uint8_t* dst, const uint8_t* src, size_t len);
+
+  // Offset of the first bit equal to bit in data[0, len), or -1 if there is none
+  int64_t (*find_first)(const uint8_t* data, size_t len, int bit);
+};
+
+// Portable word at a time implementation, the reference of the others
+const BitmapKernels& ScalarBitmapKernels();
+
+// The fastest implementation supported by the cpu
+const BitmapKernels& BestBitmapKernels();
+
+// All the implementations supported by the cpu, scalar first
+std::vector<const BitmapKernels*> SupportedBitmapKernels();
+
+}  // namespace storage
+
+#endif  // SRC_BITMAP_KERNELS_H_
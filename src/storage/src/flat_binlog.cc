@@ -0,0 +1,49 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/flat_binlog.h"
+
+#include <utility>
+
+#include "src/coding.h"
+
+namespace storage {
+
+namespace {
+
+// sequence number and count
+constexpr size_t kWriteBatchHeaderSize = 12;
+
+}  // namespace
+
+std::string FlatBinlog::EncodeTrailer() const {
+  std::string trailer(kTrailerSize, '\0');
+  EncodeFixed32(trailer.data(), db_id_);
+  EncodeFixed32(trailer.data() + sizeof(uint32_t), slot_idx_);
+  trailer[kTrailerSize - 2] = static_cast<char>(kVersion);
+  trailer[kTrailerSize - 1] = kTrailerMagic;
+  return trailer;
+}
+
+rocksdb::Status FlatBinlog::Decode(std::string&& data, FlatBinlog* log) {
+  if (data.size() < kWriteBatchHeaderSize + kTrailerSize || !IsFlat(data[0])) {
+    return rocksdb::Status::Corruption("Malformed flat binlog");
+  }
+  const char* trailer = data.data() + data.size() - kTrailerSize;
+  if (trailer[kTrailerSize - 1] != kTrailerMagic) {
+    return rocksdb::Status::Corruption("Malformed flat binlog trailer");
+  }
+  if (static_cast<uint8_t>(trailer[kTrailerSize - 2]) > kVersion) {
+    return rocksdb::Status::NotSupported("Flat binlog version is newer than this node");
+  }
+  log->db_id_ = DecodeFixed32(trailer);
+  log->slot_idx_ = DecodeFixed32(trailer + sizeof(uint32_t));
+  // shrinking keeps the buffer, the rep is moved into the batch as is
+  data.resize(data.size() - kTrailerSize);
+  log->batch_ = rocksdb::WriteBatch(std::move(data));
+  return rocksdb::Status::OK();
+}
+
+}  // namespace storage
@@ -0,0 +1,109 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/hot_keys.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "src/murmurhash.h"
+
+namespace storage {
+
+uint32_t HotKeys::SketchAdd(uint64_t hash, uint64_t weight) {
+  // double hashing over the two halves of the hash, as KeyStatistics does
+  std::array<size_t, kSketchDepth> indexes;
+  uint32_t estimate = UINT32_MAX;
+  uint64_t h1 = hash;
+  uint64_t h2 = (hash >> 32) | 1;
+  for (size_t row = 0; row < kSketchDepth; row++) {
+    indexes[row] = row * kSketchWidth + ((h1 + row * h2) & (kSketchWidth - 1));
+    estimate = std::min(estimate, sketch_[indexes[row]].load(std::memory_order_relaxed));
+  }
+  // conservative update: only the counters below the new estimate are raised
+  auto target = static_cast<uint32_t>(std::min<uint64_t>(estimate + weight, UINT32_MAX));
+  for (auto index : indexes) {
+    if (sketch_[index].load(std::memory_order_relaxed) < target) {
+      sketch_[index].store(target, std::memory_order_relaxed);
+    }
+  }
+  return target;
+}
+
+void HotKeys::Record(const Slice& key, uint64_t weight) {
+  auto hash = static_cast<uint64_t>(MurmurHash(key.data(), static_cast<int>(key.size()), 0));
+  auto estimate = SketchAdd(hash, weight);
+  if (aging_budget_.fetch_sub(1, std::memory_order_relaxed) == 1) {
+    Age();
+  }
+  if (estimate <= admit_threshold_.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  std::lock_guard l(top_mutex_);
+  auto it = std::find_if(top_.begin(), top_.end(), [&key](const auto& entry) { return key == Slice(entry.first); });
+  if (it != top_.end()) {
+    it->second = estimate;
+  } else if (top_.size() < kTopK) {
+    top_.emplace_back(key.ToString(), estimate);
+  } else {
+    auto coldest = std::min_element(top_.begin(), top_.end(),
+                                    [](const auto& a, const auto& b) { return a.second < b.second; });
+    if (coldest->second >= estimate) {
+      return;
+    }
+    coldest->first.assign(key.data(), key.size());
+    coldest->second = estimate;
+  }
+  UpdateAdmitThreshold();
+}
+
+void HotKeys::UpdateAdmitThreshold() {
+  uint32_t threshold = 0;
+  if (top_.size() == kTopK) {
+    threshold = static_cast<uint32_t>(
+        std::min_element(top_.begin(), top_.end(), [](const auto& a, const auto& b) { return a.second < b.second; })
+            ->second);
+  }
+  admit_threshold_.store(threshold, std::memory_order_relaxed);
+}
+
+void HotKeys::Age() {
+  for (auto& counter : sketch_) {
+    counter.store(counter.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard l(top_mutex_);
+    for (auto& entry : top_) {
+      entry.second >>= 1;
+    }
+    UpdateAdmitThreshold();
+  }
+  aging_budget_.store(kAgingSamples, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<std::string, uint64_t>> HotKeys::Top(size_t count) const {
+  std::vector<std::pair<std::string, uint64_t>> top;
+  {
+    std::lock_guard l(top_mutex_);
+    top = top_;
+  }
+  std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+  if (top.size() > count) {
+    top.resize(count);
+  }
+  return top;
+}
+
+void HotKeys::Clear() {
+  std::lock_guard l(top_mutex_);
+  for (auto& counter : sketch_) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  top_.clear();
+  admit_threshold_.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace storage
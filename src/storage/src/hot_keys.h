@@ -0,0 +1,71 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_HOT_KEYS_H_
+#define SRC_HOT_KEYS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+#include "pstd/pstd_mutex.h"
+
+namespace storage {
+
+using Slice = rocksdb::Slice;
+
+/*
+ * The most accessed keys of an instance, estimated from the sampled reads and
+ * writes reported to Record().
+ *
+ * A count-min sketch estimates the accesses of any key, the kTopK keys with the
+ * highest estimates are kept by name. Most keys are cold: their estimate stays
+ * below the least accessed key of the full top list, and recording them takes
+ * no lock. The sketch and the top list are halved every kAgingSamples samples,
+ * so the keys reported are those hot lately.
+ */
+class HotKeys {
+ public:
+  static constexpr size_t kTopK = 64;
+  static constexpr size_t kSketchWidth = 4096;
+  static constexpr size_t kSketchDepth = 4;
+  static constexpr int64_t kAgingSamples = kSketchWidth * 8;
+
+  HotKeys() = default;
+
+  // A sampled access of key standing for weight accesses
+  void Record(const Slice& key, uint64_t weight);
+
+  // The count hottest keys with the estimates of their accesses, the hottest first
+  std::vector<std::pair<std::string, uint64_t>> Top(size_t count) const;
+
+  void Clear();
+
+ private:
+  // Adds weight to the counters of hash and returns its new estimate
+  uint32_t SketchAdd(uint64_t hash, uint64_t weight);
+  void Age();
+  // The lock of the top list must be held
+  void UpdateAdmitThreshold();
+
+  std::array<std::atomic<uint32_t>, kSketchWidth * kSketchDepth> sketch_{};
+  // Samples left before the sketch and the top list are halved
+  std::atomic<int64_t> aging_budget_ = kAgingSamples;
+  // A key joins the full top list with a higher estimate only
+  std::atomic<uint32_t> admit_threshold_ = 0;
+
+  mutable pstd::Mutex top_mutex_;
+  std::vector<std::pair<std::string, uint64_t>> top_;
+};
+
+}  // namespace storage
+
+#endif  // SRC_HOT_KEYS_H_
@@ -0,0 +1,192 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/key_statistics.h"
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+
+#include "src/murmurhash.h"
+
+namespace storage {
+
+namespace {
+
+constexpr size_t kMinSketchWidth = 1024;
+// The sketch is aged after this many updates per counter of a row
+constexpr int64_t kSketchSamplesPerCounter = 10;
+
+size_t RoundUpPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+}  // namespace
+
+uint64_t KeyStatistics::Slot::AvgDuration() const {
+  if (duration_count < kDurationWindow) {
+    return 0;
+  }
+  auto [min, max] = std::minmax_element(durations.begin(), durations.end());
+  uint64_t sum = 0;
+  for (auto duration : durations) {
+    sum += duration;
+  }
+  return (sum - *max - *min) / (kDurationWindow - 2);
+}
+
+void KeyStatistics::SetCapacity(size_t capacity) {
+  std::lock_guard l(table_mutex_);
+  capacity_.store(capacity, std::memory_order_relaxed);
+  if (capacity == 0) {
+    sketch_.reset();
+    slots_.reset();
+    sketch_mask_ = 0;
+    bucket_mask_ = 0;
+    return;
+  }
+
+  size_t width = RoundUpPowerOfTwo(std::max(capacity, kMinSketchWidth));
+  sketch_mask_ = width - 1;
+  sketch_ = std::make_unique<std::atomic<uint32_t>[]>(width * kSketchDepth);
+  for (size_t i = 0; i < width * kSketchDepth; i++) {
+    sketch_[i].store(0, std::memory_order_relaxed);
+  }
+  sketch_budget_.store(static_cast<int64_t>(width) * kSketchSamplesPerCounter, std::memory_order_relaxed);
+
+  size_t buckets = RoundUpPowerOfTwo((capacity + kWays - 1) / kWays);
+  bucket_mask_ = buckets - 1;
+  slots_ = std::make_unique<Slot[]>(buckets * kWays);
+}
+
+uint64_t KeyStatistics::Fingerprint(const DataType& dtype, const Slice& key) {
+  auto fingerprint = static_cast<uint64_t>(MurmurHash(key.data(), static_cast<int>(key.size()), dtype + 1));
+  return fingerprint | 1;
+}
+
+uint32_t KeyStatistics::Estimate(uint64_t fingerprint) const {
+  uint32_t estimate = UINT32_MAX;
+  // double hashing over the two halves of the fingerprint
+  uint64_t h1 = fingerprint;
+  uint64_t h2 = (fingerprint >> 32) | 1;
+  for (size_t row = 0; row < kSketchDepth; row++) {
+    size_t index = row * (sketch_mask_ + 1) + ((h1 + row * h2) & sketch_mask_);
+    estimate = std::min(estimate, sketch_[index].load(std::memory_order_relaxed));
+  }
+  return estimate;
+}
+
+void KeyStatistics::SketchAdd(uint64_t fingerprint, uint64_t count) {
+  // conservative update: only the counters at the minimum are raised
+  uint64_t target = std::min<uint64_t>(Estimate(fingerprint) + count, UINT32_MAX);
+  uint64_t h1 = fingerprint;
+  uint64_t h2 = (fingerprint >> 32) | 1;
+  for (size_t row = 0; row < kSketchDepth; row++) {
+    size_t index = row * (sketch_mask_ + 1) + ((h1 + row * h2) & sketch_mask_);
+    if (sketch_[index].load(std::memory_order_relaxed) < target) {
+      sketch_[index].store(static_cast<uint32_t>(target), std::memory_order_relaxed);
+    }
+  }
+  if (sketch_budget_.fetch_sub(1, std::memory_order_relaxed) == 1) {
+    Age();
+  }
+}
+
+void KeyStatistics::Age() {
+  // Halving keeps the estimates of keys which stopped being used from staying high forever
+  size_t width = sketch_mask_ + 1;
+  for (size_t i = 0; i < width * kSketchDepth; i++) {
+    sketch_[i].store(sketch_[i].load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+  }
+  sketch_budget_.store(static_cast<int64_t>(width) * kSketchSamplesPerCounter, std::memory_order_relaxed);
+}
+
+KeyStatistics::Slot* KeyStatistics::FindOrAdmit(uint64_t fingerprint) {
+  Slot* bucket = &slots_[((fingerprint >> 1) & bucket_mask_) * kWays];
+  Slot* victim = nullptr;
+  uint32_t victim_estimate = UINT32_MAX;
+  for (size_t way = 0; way < kWays; way++) {
+    Slot* slot = &bucket[way];
+    if (slot->fingerprint == fingerprint) {
+      return slot;
+    }
+    uint32_t estimate = slot->fingerprint == 0 ? 0 : Estimate(slot->fingerprint);
+    if (estimate < victim_estimate) {
+      victim = slot;
+      victim_estimate = estimate;
+    }
+  }
+  if (victim->fingerprint != 0 && Estimate(fingerprint) <= victim_estimate) {
+    return nullptr;
+  }
+  *victim = Slot();
+  victim->fingerprint = fingerprint;
+  return victim;
+}
+
+bool KeyStatistics::AddModifyCount(const DataType& dtype, const Slice& key, uint64_t count, Activity* activity) {
+  std::shared_lock table_lock(table_mutex_);
+  if (!slots_) {
+    return false;
+  }
+  uint64_t fingerprint = Fingerprint(dtype, key);
+  SketchAdd(fingerprint, count);
+
+  std::lock_guard l(bucket_locks_[((fingerprint >> 1) & bucket_mask_) % kLockStripes]);
+  Slot* slot = FindOrAdmit(fingerprint);
+  if (!slot) {
+    return false;
+  }
+  slot->modify_count += count;
+  activity->modify_count = slot->modify_count;
+  activity->avg_duration = slot->AvgDuration();
+  return true;
+}
+
+bool KeyStatistics::AddDuration(const DataType& dtype, const Slice& key, uint64_t duration, Activity* activity) {
+  std::shared_lock table_lock(table_mutex_);
+  if (!slots_) {
+    return false;
+  }
+  uint64_t fingerprint = Fingerprint(dtype, key);
+  SketchAdd(fingerprint, 1);
+
+  std::lock_guard l(bucket_locks_[((fingerprint >> 1) & bucket_mask_) % kLockStripes]);
+  Slot* slot = FindOrAdmit(fingerprint);
+  if (!slot) {
+    return false;
+  }
+  slot->durations[slot->duration_count++ % kDurationWindow] = duration;
+  activity->modify_count = slot->modify_count;
+  activity->avg_duration = slot->AvgDuration();
+  return true;
+}
+
+void KeyStatistics::Remove(const DataType& dtype, const Slice& key) {
+  std::shared_lock table_lock(table_mutex_);
+  if (!slots_) {
+    return;
+  }
+  uint64_t fingerprint = Fingerprint(dtype, key);
+  size_t bucket = (fingerprint >> 1) & bucket_mask_;
+  std::lock_guard l(bucket_locks_[bucket % kLockStripes]);
+  for (size_t way = 0; way < kWays; way++) {
+    Slot* slot = &slots_[bucket * kWays + way];
+    if (slot->fingerprint == fingerprint) {
+      *slot = Slot();
+    }
+  }
+}
+
+uint64_t KeyStatistics::EstimateActivity(const DataType& dtype, const Slice& key) const {
+  std::shared_lock table_lock(table_mutex_);
+  return sketch_ ? Estimate(Fingerprint(dtype, key)) : 0;
+}
+
+}  // namespace storage
@@ -0,0 +1,98 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_KEY_STATISTICS_H_
+#define SRC_KEY_STATISTICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "rocksdb/slice.h"
+
+#include "pstd/pstd_mutex.h"
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * Modify counts and durations of the most active keys of an instance, kept in
+ * memory allocated once by SetCapacity(), so updating them never allocates.
+ *
+ * Every update goes to a count-min sketch, which estimates how active any key
+ * is. The keys themselves are tracked in a set associative table of capacity
+ * slots, kWays slots per bucket: a key missing from its bucket takes a free
+ * slot, or the slot of the least active key of the bucket if it is estimated
+ * more active. A slot keeps the fingerprint of its key, its modify count and
+ * its last kDurationWindow durations in a ring.
+ */
+class KeyStatistics {
+ public:
+  static constexpr size_t kWays = 8;
+  static constexpr size_t kDurationWindow = 12;
+  static constexpr size_t kSketchDepth = 4;
+
+  struct Activity {
+    uint64_t modify_count = 0;
+    // 0 until kDurationWindow durations were recorded
+    uint64_t avg_duration = 0;
+  };
+
+  KeyStatistics() = default;
+
+  // Drops all the statistics, 0 disables them
+  void SetCapacity(size_t capacity);
+  size_t Capacity() const { return capacity_.load(std::memory_order_relaxed); }
+
+  // Both return false if key is not tracked, *activity is then left untouched
+  bool AddModifyCount(const DataType& dtype, const Slice& key, uint64_t count, Activity* activity);
+  bool AddDuration(const DataType& dtype, const Slice& key, uint64_t duration, Activity* activity);
+
+  void Remove(const DataType& dtype, const Slice& key);
+
+  // Count-min estimate of the updates of key since it was last aged
+  uint64_t EstimateActivity(const DataType& dtype, const Slice& key) const;
+
+ private:
+  struct Slot {
+    // 0 for a free slot
+    uint64_t fingerprint = 0;
+    uint64_t modify_count = 0;
+    uint64_t duration_count = 0;
+    std::array<uint64_t, kDurationWindow> durations{};
+
+    uint64_t AvgDuration() const;
+  };
+
+  static constexpr size_t kLockStripes = 64;
+
+  static uint64_t Fingerprint(const DataType& dtype, const Slice& key);
+  uint32_t Estimate(uint64_t fingerprint) const;
+  void SketchAdd(uint64_t fingerprint, uint64_t count);
+  void Age();
+
+  // Returns the slot of fingerprint, admitting it if it is active enough, or nullptr.
+  // The lock of its bucket must be held.
+  Slot* FindOrAdmit(uint64_t fingerprint);
+
+  std::atomic<size_t> capacity_ = 0;
+  // Guards the allocations below, updates only share it
+  mutable pstd::RWMutex table_mutex_;
+
+  size_t sketch_mask_ = 0;
+  std::unique_ptr<std::atomic<uint32_t>[]> sketch_;
+  // Updates left before all the counters of the sketch are halved
+  std::atomic<int64_t> sketch_budget_ = 0;
+
+  size_t bucket_mask_ = 0;
+  std::unique_ptr<Slot[]> slots_;
+  std::array<pstd::Mutex, kLockStripes> bucket_locks_;
+};
+
+}  // namespace storage
+
+#endif  // SRC_KEY_STATISTICS_H_
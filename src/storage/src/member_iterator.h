@@ -0,0 +1,104 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_MEMBER_ITERATOR_H_
+#define SRC_MEMBER_ITERATOR_H_
+
+#include <memory>
+#include <string>
+
+#include "rocksdb/db.h"
+#include "rocksdb/options.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/status.h"
+
+#include "pstd/noncopyable.h"
+#include "src/base_data_key_format.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * Iterates the data keys of one hash/set/zset in member order.
+ * All data keys of a version share the prefix | reserve1 | key | version |
+ * and are followed by | member | reserve2 |, so the iteration order is the
+ * bytewise order of the members. The iterator owns the snapshot under which
+ * the meta value was read, so the members are consistent with that meta.
+ */
+class MemberIterator : public pstd::noncopyable {
+ public:
+  MemberIterator(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const rocksdb::Snapshot* snapshot,
+                 const Slice& key, uint64_t version, int32_t count)
+      : db_(db), snapshot_(snapshot), count_(count) {
+    BaseDataKey prefix_key(key, version, Slice());
+    prefix_ = prefix_key.EncodeSeekKey().ToString();
+
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = snapshot_;
+    // members are consumed sequentially, let rocksdb grow the readahead
+    read_options.adaptive_readahead = true;
+    iter_.reset(db_->NewIterator(read_options, handle));
+  }
+
+  ~MemberIterator() {
+    iter_.reset();
+    db_->ReleaseSnapshot(snapshot_);
+  }
+
+  void SeekToFirst() { iter_->Seek(prefix_); }
+
+  void Seek(const Slice& member) {
+    seek_key_.assign(prefix_);
+    seek_key_.append(member.data(), member.size());
+    iter_->Seek(seek_key_);
+  }
+
+  // Moves to the first member which is not less than target. The target is
+  // usually close to the current position during a merge, so try a few
+  // Next() before paying for a Seek().
+  void SeekForward(const Slice& target) {
+    for (int step = 0; Valid() && member().compare(target) < 0; ++step) {
+      if (step == kMaxNextBeforeSeek) {
+        Seek(target);
+        return;
+      }
+      Next();
+    }
+  }
+
+  void Next() { iter_->Next(); }
+
+  bool Valid() const { return iter_->Valid() && iter_->key().starts_with(prefix_); }
+
+  // The returned slice is valid until the iterator is moved.
+  Slice member() const {
+    Slice key = iter_->key();
+    return Slice(key.data() + prefix_.size(), key.size() - prefix_.size() - kSuffixReserveLength);
+  }
+
+  // User value of the current member, e.g. the encoded score of a zset member.
+  Slice value() const {
+    Slice value = iter_->value();
+    return Slice(value.data(), value.size() - kSuffixReserveLength - kTimestampLength);
+  }
+
+  Status status() const { return iter_->status(); }
+
+  // Number of members recorded in the meta value
+  int32_t Count() const { return count_; }
+
+ private:
+  static constexpr int kMaxNextBeforeSeek = 8;
+
+  rocksdb::DB* db_ = nullptr;
+  const rocksdb::Snapshot* snapshot_ = nullptr;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  std::string prefix_;
+  std::string seek_key_;
+  int32_t count_ = 0;
+};
+
+}  // namespace storage
+#endif  // SRC_MEMBER_ITERATOR_H_
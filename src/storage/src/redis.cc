@@ -3,17 +3,25 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
 #include <sstream>
 
+#include "fmt/core.h"
 #include "pstd/log.h"
 #include "rocksdb/env.h"
 
 #include "src/base_filter.h"
+#include "src/base_key_format.h"
 #include "src/lists_filter.h"
 #include "src/mutex.h"
 #include "src/redis.h"
+#include "src/scan_cursor.h"
+#include "src/scope_snapshot.h"
+#include "src/slot_migration.h"
 #include "src/strings_filter.h"
+#include "src/type_directory.h"
 #include "src/zsets_filter.h"
+#include "storage/util.h"
 
 #define ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(type)              \
   type##_cf_ops.table_properties_collector_factories.push_back( \
@@ -36,9 +44,8 @@ Redis::Redis(Storage* const s, int32_t index)
       lock_mgr_(std::make_shared<LockMgr>(1000, 0, std::make_shared<MutexFactoryImpl>())),
       small_compaction_threshold_(5000),
       small_compaction_duration_threshold_(10000) {
-  statistics_store_ = std::make_unique<LRUCache<std::string, KeyStatistics>>();
-  scan_cursors_store_ = std::make_unique<LRUCache<std::string, std::string>>();
-  spop_counts_store_ = std::make_unique<LRUCache<std::string, size_t>>();
+  scan_cursors_store_ = std::make_unique<ShardedCache<std::string>>();
+  spop_counts_store_ = std::make_unique<ShardedCache<size_t>>();
   default_compact_range_options_.exclusive_manual_compaction = false;
   default_compact_range_options_.change_level = true;
   spop_counts_store_->SetCapacity(1000);
@@ -65,7 +72,7 @@ Redis::~Redis() {
 Status Redis::Open(const StorageOptions& storage_options, const std::string& db_path) {
   append_log_function_ = storage_options.append_log_function;
   raft_timeout_s_ = storage_options.raft_timeout_s;
-  statistics_store_->SetCapacity(storage_options.statistics_max_size);
+  key_statistics_.SetCapacity(storage_options.statistics_max_size);
   small_compaction_threshold_ = storage_options.small_compaction_threshold;
 
   rocksdb::BlockBasedTableOptions table_ops(storage_options.table_options);
@@ -149,6 +156,13 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   zset_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_data_cf_table_ops));
   zset_score_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_score_cf_table_ops));
 
+  // type directory column-family options
+  rocksdb::ColumnFamilyOptions type_directory_cf_ops(storage_options.options);
+  type_directory_cf_ops.merge_operator = std::make_shared<TypeDirectoryMergeOperator>();
+  type_directory_cf_ops.max_successive_merges = kTypeDirectoryMaxSuccessiveMerges;
+  type_directory_cf_ops.compaction_filter_factory = std::make_shared<TypeDirectoryFilterFactory>(&db_, &handles_);
+  type_directory_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_ops));
+
   if (append_log_function_) {
     // Add log index table property collector factory to each column family
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(string);
@@ -161,10 +175,14 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(zset_meta);
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(zset_data);
     ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(zset_score);
+    ADD_TABLE_PROPERTY_COLLECTOR_FACTORY(type_directory);
 
     // Add a listener on flush to purge log index collector
     db_ops.listeners.push_back(std::make_shared<LogIndexAndSequenceCollectorPurger>(
-        &handles_, &log_index_collector_, &log_index_of_all_cfs_, storage_options.do_snapshot_function));
+        &handles_, &log_index_collector_, &log_index_of_all_cfs_,
+        [do_snapshot = storage_options.do_snapshot_function, index = index_](LogIndex log_index, bool sync) {
+          do_snapshot(index, log_index, sync);
+        }));
   }
 
   std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
@@ -182,17 +200,38 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   column_families.emplace_back("zset_meta_cf", zset_meta_cf_ops);
   column_families.emplace_back("zset_data_cf", zset_data_cf_ops);
   column_families.emplace_back("zset_score_cf", zset_score_cf_ops);
+  // type directory CF, created when a database written before it is opened
+  column_families.emplace_back(kTypeDirectoryCFName, type_directory_cf_ops);
+  db_ops.create_missing_column_families = true;
 
+  std::vector<std::string> existing_column_families;
+  bool created = !rocksdb::DB::ListColumnFamilies(db_ops, db_path, &existing_column_families).ok();
   auto s = rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
   if (!s.ok()) {
     return s;
   }
   assert(!handles_.empty());
+  for (size_t i = 0; i < handles_.size(); i++) {
+    // the flat binlog names a column family by its id
+    if (handles_[i]->GetID() != i) {
+      return Status::Corruption(
+          fmt::format("column family {} has id {}", handles_[i]->GetName(), handles_[i]->GetID()));
+    }
+  }
+  auto type_directory_db = new TypeDirectoryDB(db_, handles_);
+  db_ = type_directory_db;
+  s = type_directory_db->BuildIfNeeded(db_path, created);
+  if (!s.ok()) {
+    return s;
+  }
+  slot_tracking_db_ = new SlotTrackingDB(db_);
+  db_ = slot_tracking_db_;
   return log_index_of_all_cfs_.Init(this);
 }
 
-Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                                std::string* start_point) {
+namespace {
+
+std::string ScanCursorIndexKey(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor) {
   std::string index_key;
   index_key.append(1, DataTypeTag[type]);
   index_key.append("_");
@@ -201,24 +240,81 @@ Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Sl
   index_key.append(pattern.ToString());
   index_key.append("_");
   index_key.append(std::to_string(cursor));
-  return scan_cursors_store_->Lookup(index_key, start_point);
+  return index_key;
 }
 
-Status Redis::StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                                 const std::string& next_point) {
-  std::string index_key;
-  index_key.append(1, DataTypeTag[type]);
-  index_key.append("_");
-  index_key.append(key.ToString());
-  index_key.append("_");
-  index_key.append(pattern.ToString());
-  index_key.append("_");
-  index_key.append(std::to_string(cursor));
-  return scan_cursors_store_->Insert(index_key, next_point);
+}  // namespace
+
+Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
+                                std::string* start_point) {
+  ScanCursor scan_cursor;
+  if (!scan_cursor.Decode(cursor)) {
+    return Status::NotFound();
+  }
+  Status s = scan_cursors_store_->Lookup(ScanCursorIndexKey(type, key, pattern, cursor), start_point);
+  if (!s.ok() || !scan_cursor.Matches(*start_point)) {
+    // The exact position is gone from the store, go on from the one carried by the cursor
+    *start_point = scan_cursor.prefix();
+  }
+  if (isTailWildcard(pattern.ToString())) {
+    *start_point = std::max(*start_point, std::string(pattern.data(), pattern.size() - 1));
+  }
+  return Status::OK();
+}
+
+int64_t Redis::StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern,
+                                  const std::string& next_point) {
+  int64_t cursor = ScanCursor(type, next_point).Encode();
+  scan_cursors_store_->Insert(ScanCursorIndexKey(type, key, pattern, cursor), next_point);
+  return cursor;
+}
+
+Status Redis::NewMemberIterator(const DataType& dtype, const Slice& key, std::unique_ptr<MemberIterator>* iter) {
+  ColumnFamilyIndex meta_cf;
+  ColumnFamilyIndex data_cf;
+  switch (dtype) {
+    case DataType::kHashes:
+      meta_cf = kHashesMetaCF;
+      data_cf = kHashesDataCF;
+      break;
+    case DataType::kSets:
+      meta_cf = kSetsMetaCF;
+      data_cf = kSetsDataCF;
+      break;
+    case DataType::kZSets:
+      meta_cf = kZsetsMetaCF;
+      data_cf = kZsetsDataCF;
+      break;
+    default:
+      return Status::InvalidArgument("Invalid data type for member iterator");
+  }
+
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot = db_->GetSnapshot();
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  BaseMetaKey base_meta_key(key);
+  Status s = db_->Get(read_options, handles_[meta_cf], base_meta_key.Encode(), &meta_value);
+  if (s.ok()) {
+    ParsedBaseMetaValue parsed_meta_value(&meta_value);
+    if (parsed_meta_value.IsStale()) {
+      s = Status::NotFound("Stale");
+    } else if (parsed_meta_value.Count() == 0) {
+      s = Status::NotFound();
+    } else {
+      // the iterator takes over the snapshot
+      *iter = std::make_unique<MemberIterator>(db_, handles_[data_cf], snapshot, key, parsed_meta_value.Version(),
+                                               parsed_meta_value.Count());
+      return Status::OK();
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+  return s;
 }
 
 Status Redis::SetMaxCacheStatisticKeys(size_t max_cache_statistic_keys) {
-  statistics_store_->SetCapacity(max_cache_statistic_keys);
+  key_statistics_.SetCapacity(max_cache_statistic_keys);
   return Status::OK();
 }
 
@@ -278,43 +374,32 @@ Status Redis::SetSmallCompactionDurationThreshold(uint64_t small_compaction_dura
   return Status::OK();
 }
 
-Status Redis::UpdateSpecificKeyStatistics(const DataType& dtype, const std::string& key, uint64_t count) {
-  if ((statistics_store_->Capacity() != 0U) && (count != 0U) && (small_compaction_threshold_ != 0U)) {
-    KeyStatistics data;
-    std::string lkp_key;
-    lkp_key.append(1, DataTypeTag[dtype]);
-    lkp_key.append(key);
-    statistics_store_->Lookup(lkp_key, &data);
-    data.AddModifyCount(count);
-    statistics_store_->Insert(lkp_key, data);
-    AddCompactKeyTaskIfNeeded(dtype, key, data.ModifyCount(), data.AvgDuration());
+Status Redis::UpdateSpecificKeyStatistics(const DataType& dtype, const Slice& key, uint64_t count) {
+  if ((key_statistics_.Capacity() != 0U) && (count != 0U) && (small_compaction_threshold_ != 0U)) {
+    KeyStatistics::Activity activity;
+    if (key_statistics_.AddModifyCount(dtype, key, count, &activity)) {
+      AddCompactKeyTaskIfNeeded(dtype, key, activity.modify_count, activity.avg_duration);
+    }
   }
   return Status::OK();
 }
 
-Status Redis::UpdateSpecificKeyDuration(const DataType& dtype, const std::string& key, uint64_t duration) {
-  if ((statistics_store_->Capacity() != 0U) && (duration != 0U) && (small_compaction_duration_threshold_ != 0U)) {
-    KeyStatistics data;
-    std::string lkp_key;
-    lkp_key.append(1, DataTypeTag[dtype]);
-    lkp_key.append(key);
-    statistics_store_->Lookup(lkp_key, &data);
-    data.AddDuration(duration);
-    statistics_store_->Insert(lkp_key, data);
-    AddCompactKeyTaskIfNeeded(dtype, key, data.ModifyCount(), data.AvgDuration());
+Status Redis::UpdateSpecificKeyDuration(const DataType& dtype, const Slice& key, uint64_t duration) {
+  if ((key_statistics_.Capacity() != 0U) && (duration != 0U) && (small_compaction_duration_threshold_ != 0U)) {
+    KeyStatistics::Activity activity;
+    if (key_statistics_.AddDuration(dtype, key, duration, &activity)) {
+      AddCompactKeyTaskIfNeeded(dtype, key, activity.modify_count, activity.avg_duration);
+    }
   }
   return Status::OK();
 }
 
-Status Redis::AddCompactKeyTaskIfNeeded(const DataType& dtype, const std::string& key, uint64_t total,
-                                        uint64_t duration) {
+Status Redis::AddCompactKeyTaskIfNeeded(const DataType& dtype, const Slice& key, uint64_t total, uint64_t duration) {
   if (total < small_compaction_threshold_ || duration < small_compaction_duration_threshold_) {
     return Status::OK();
   } else {
-    std::string lkp_key(1, DataTypeTag[dtype]);
-    lkp_key.append(key);
-    storage_->AddBGTask({dtype, kCompactRange, {key}});
-    statistics_store_->Remove(lkp_key);
+    storage_->AddBGTask({dtype, kCompactRange, {key.ToString()}});
+    key_statistics_.Remove(dtype, key);
   }
   return Status::OK();
 }
@@ -423,6 +508,25 @@ Status Redis::GetProperty(const std::string& property, uint64_t* out) {
   return Status::OK();
 }
 
+Status Redis::GetAggregatedProperty(const std::string& property, uint64_t* out) {
+  *out = 0;
+  if (!db_->GetAggregatedIntProperty(property, out)) {
+    return Status::InvalidArgument("not an integer property: " + property);
+  }
+  return Status::OK();
+}
+
+bool Redis::OwnsEntry(const Slice& key) const {
+  if (!storage_->HasMigratingSlots()) {
+    return true;
+  }
+  std::string user_key;
+  if (!DecodeKeyOfEntry(key, &user_key)) {
+    return true;
+  }
+  return storage_->GetInstanceIDOfSlot(storage_->GetSlot(user_key)) == index_;
+}
+
 Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
   key_infos->resize(5);
   rocksdb::Status s;
@@ -450,6 +554,69 @@ Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
   return Status::OK();
 }
 
+Status Redis::ScanBigKeys(const DataType& type, size_t top, const std::function<bool()>& pace,
+                          std::vector<BigKeyInfo>* keys) {
+  ColumnFamilyIndex cf_index;
+  switch (type) {
+    case DataType::kHashes:
+      cf_index = kHashesMetaCF;
+      break;
+    case DataType::kSets:
+      cf_index = kSetsMetaCF;
+      break;
+    case DataType::kLists:
+      cf_index = kListsMetaCF;
+      break;
+    case DataType::kZSets:
+      cf_index = kZsetsMetaCF;
+      break;
+    default:
+      return Status::InvalidArgument("not a collection type");
+  }
+  if (top == 0) {
+    return Status::OK();
+  }
+
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  // a min heap of the largest collections so far
+  auto larger = [](const BigKeyInfo& a, const BigKeyInfo& b) { return a.count > b.count; };
+  std::vector<BigKeyInfo> heap;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(iterator_options, handles_[cf_index]));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!pace()) {
+      return Status::Incomplete("big keys scan stopped");
+    }
+    uint64_t count = 0;
+    if (type == DataType::kLists) {
+      ParsedListsMetaValue parsed_lists_meta_value(iter->value());
+      count = parsed_lists_meta_value.IsStale() ? 0 : parsed_lists_meta_value.Count();
+    } else {
+      ParsedBaseMetaValue parsed_meta_value(iter->value());
+      count = parsed_meta_value.IsStale() ? 0 : parsed_meta_value.Count();
+    }
+    if (count == 0 || (heap.size() == top && count <= heap.front().count) || !OwnsEntry(iter->key())) {
+      continue;
+    }
+    ParsedBaseMetaKey parsed_meta_key(iter->key());
+    heap.push_back({type, parsed_meta_key.Key().ToString(), count});
+    std::push_heap(heap.begin(), heap.end(), larger);
+    if (heap.size() > top) {
+      std::pop_heap(heap.begin(), heap.end(), larger);
+      heap.pop_back();
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  keys->insert(keys->end(), std::make_move_iterator(heap.begin()), std::make_move_iterator(heap.end()));
+  return Status::OK();
+}
+
 void Redis::ScanDatabase() {
   ScanStrings();
   ScanHashes();
@@ -6,6 +6,7 @@
 #ifndef SRC_REDIS_H_
 #define SRC_REDIS_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -19,9 +20,12 @@
 #include "pstd/log.h"
 #include "src/custom_comparator.h"
 #include "src/debug.h"
+#include "src/hot_keys.h"
+#include "src/key_statistics.h"
 #include "src/lock_mgr.h"
-#include "src/lru_cache.h"
+#include "src/member_iterator.h"
 #include "src/mutex_impl.h"
+#include "src/sharded_cache.h"
 #include "src/type_iterator.h"
 #include "storage/storage.h"
 #include "storage/storage_define.h"
@@ -33,59 +37,35 @@ namespace storage {
 using Status = rocksdb::Status;
 using Slice = rocksdb::Slice;
 
+class SlotTrackingDB;
+
+// Receives the members produced by a streaming set operation, see Redis::SetsStore
+using MemberSink = std::function<Status(const Slice& member)>;
+using MemberSource = std::function<Status(const MemberSink& sink)>;
+// Same as above for the members and scores of a streaming sorted set operation, see Redis::ZsetsStore
+using ScoreMemberSink = std::function<Status(const Slice& member, double score)>;
+using ScoreMemberSource = std::function<Status(const ScoreMemberSink& sink)>;
+
 class Redis {
  public:
   Redis(Storage* storage, int32_t index);
   virtual ~Redis();
 
   rocksdb::DB* GetDB() { return db_; }
+  SlotTrackingDB* GetSlotTrackingDB() { return slot_tracking_db_; }
 
-  struct KeyStatistics {
-    size_t window_size;
-    std::deque<uint64_t> durations;
-
-    uint64_t modify_count;
-
-    KeyStatistics() : KeyStatistics(10) {}
-
-    KeyStatistics(size_t size) : window_size(size + 2), modify_count(0) {}
-
-    void AddDuration(uint64_t duration) {
-      durations.push_back(duration);
-      while (durations.size() > window_size) {
-        durations.pop_front();
-      }
-    }
-    uint64_t AvgDuration() {
-      if (durations.size() < window_size) {
-        return 0;
-      }
-      uint64_t min = durations[0];
-      uint64_t max = durations[0];
-      uint64_t sum = 0;
-      for (auto duration : durations) {
-        if (duration < min) {
-          min = duration;
-        }
-        if (duration > max) {
-          max = duration;
-        }
-        sum += duration;
-      }
-      return (sum - max - min) / (durations.size() - 2);
-    }
-    void AddModifyCount(uint64_t count) { modify_count += count; }
-    uint64_t ModifyCount() { return modify_count; }
-  };
-
+  // Reports the duration of a read of key when it goes out of scope
   struct KeyStatisticsDurationGuard {
     Redis* ctx;
-    std::string key;
+    Slice key;
     uint64_t start_us;
     DataType dtype;
-    KeyStatisticsDurationGuard(Redis* that, const DataType type, const std::string& key)
-        : ctx(that), key(key), start_us(pstd::NowMicros()), dtype(type) {}
+    KeyStatisticsDurationGuard(Redis* that, const DataType type, const Slice& key)
+        : ctx(that), key(key), start_us(that->key_statistics_.Capacity() != 0 ? pstd::NowMicros() : 0), dtype(type) {}
     ~KeyStatisticsDurationGuard() {
+      if (start_us == 0) {
+        return;
+      }
       uint64_t end_us = pstd::NowMicros();
       uint64_t duration = end_us > start_us ? end_us - start_us : 0;
       ctx->UpdateSpecificKeyDuration(dtype, key, duration);
@@ -93,6 +73,7 @@ class Redis {
   };
 
   int GetIndex() const { return index_; }
+  HotKeys& GetHotKeys() { return hot_keys_; }
 
   Status SetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options);
   void SetWriteWalOptions(const bool is_wal_disable);
@@ -106,6 +87,8 @@ class Redis {
                               const ColumnFamilyType& type = kMetaAndData);
 
   virtual Status GetProperty(const std::string& property, uint64_t* out);
+  // The integer property summed over all the column families
+  Status GetAggregatedProperty(const std::string& property, uint64_t* out);
   bool IsApplied(size_t cf_idx, LogIndex logidx) const { return log_index_of_all_cfs_.IsApplied(cf_idx, logidx); }
   void UpdateAppliedLogIndexOfColumnFamily(size_t cf_idx, LogIndex logidx, SequenceNumber seqno) {
     log_index_of_all_cfs_.Update(cf_idx, logidx, seqno);
@@ -114,6 +97,10 @@ class Redis {
   void StartingPhaseEnd() { is_starting_ = false; }
 
   Status ScanKeyNum(std::vector<KeyInfo>* key_info);
+  // Appends the top largest collections of type by the counts of its meta column family. pace is called before
+  // each meta value is read, the scan stops once it returns false.
+  Status ScanBigKeys(const DataType& type, size_t top, const std::function<bool()>& pace,
+                     std::vector<BigKeyInfo>* keys);
   Status ScanStringsKeyNum(KeyInfo* key_info);
   Status ScanHashesKeyNum(KeyInfo* key_info);
   Status ScanListsKeyNum(KeyInfo* key_info);
@@ -176,6 +163,9 @@ class Redis {
                std::string& value_to_dest, int64_t* ret);
   Status Decrby(const Slice& key, int64_t value, int64_t* ret);
   Status Get(const Slice& key, std::string* value);
+  // Reads in one MultiGet whether key is a live string and the type directory
+  // bits of the collection types which may hold it
+  Status LookupKeyTypes(const Slice& key, bool* is_string, uint8_t* collection_types);
   Status GetWithTTL(const Slice& key, std::string* value, uint64_t* ttl);
   Status GetBit(const Slice& key, int64_t offset, int32_t* ret);
   Status Getrange(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret);
@@ -201,6 +191,11 @@ class Redis {
   Status BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t end_offset, int64_t* ret);
   Status PKSetexAt(const Slice& key, const Slice& value, uint64_t timestamp);
 
+  // HyperLogLog Commands, the values are strings in the format of Redis
+  Status PfAdd(const Slice& key, const std::vector<std::string>& values, bool* update);
+  // Merges the registers of dest into max_registers and stores them as dest
+  Status PfMerge(const Slice& dest, uint8_t* max_registers, std::string* value_to_dest);
+
   // Hash Commands
   Status HDel(const Slice& key, const std::vector<std::string>& fields, int32_t* ret);
   Status HExists(const Slice& key, const Slice& field);
@@ -258,6 +253,13 @@ class Redis {
   Status SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                std::vector<std::string>* members, int64_t* next_cursor);
   Status AddAndGetSpopCount(const std::string& key, uint64_t* count);
+  // Overwrite destination with the members produced by source. The members
+  // are written in batches of at most STORE_BATCH_LIMIT, so the result of a
+  // *STORE command is never held in memory or committed as a single write.
+  // They are staged under a new version and the meta value is written by the
+  // last batch only, so readers see either the old destination or the whole
+  // result, and a failed store leaves the old destination untouched.
+  Status SetsStore(const Slice& destination, const MemberSource& source, int32_t* ret);
   Status ResetSpopCount(const std::string& key);
 
   // Lists commands
@@ -302,6 +304,8 @@ class Redis {
                      AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret);
   Status ZInterstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
                      AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret);
+  // Overwrite destination with the members and scores produced by source, staged and published like SetsStore
+  Status ZsetsStore(const Slice& destination, const ScoreMemberSource& source, int32_t* ret);
   Status ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                      std::vector<std::string>* members);
   Status ZLexcount(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
@@ -313,6 +317,11 @@ class Redis {
   Status ZPopMax(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
   Status ZPopMin(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
 
+  // Iterate the members of a hash/set/zset in member order, the iterator is
+  // bound to the snapshot the meta value was read from.
+  // Return NotFound if the key does not exist, is stale or empty.
+  Status NewMemberIterator(const DataType& dtype, const Slice& key, std::unique_ptr<MemberIterator>* iter);
+
   void ScanDatabase();
   void ScanStrings();
   void ScanHashes();
@@ -335,29 +344,35 @@ class Redis {
     options.fill_cache = false;
     options.iterate_lower_bound = lower_bound;
     options.iterate_upper_bound = upper_bound;
+    TypeIterator* iter = nullptr;
     switch (type) {
       case 'k':
-        return new StringsIterator(options, db_, handles_[kStringsCF], pattern);
+        iter = new StringsIterator(options, db_, handles_[kStringsCF], pattern);
         break;
       case 'h':
-        return new HashesIterator(options, db_, handles_[kHashesMetaCF], pattern);
+        iter = new HashesIterator(options, db_, handles_[kHashesMetaCF], pattern);
         break;
       case 's':
-        return new SetsIterator(options, db_, handles_[kSetsMetaCF], pattern);
+        iter = new SetsIterator(options, db_, handles_[kSetsMetaCF], pattern);
         break;
       case 'l':
-        return new ListsIterator(options, db_, handles_[kListsMetaCF], pattern);
+        iter = new ListsIterator(options, db_, handles_[kListsMetaCF], pattern);
         break;
       case 'z':
-        return new ZsetsIterator(options, db_, handles_[kZsetsMetaCF], pattern);
+        iter = new ZsetsIterator(options, db_, handles_[kZsetsMetaCF], pattern);
         break;
       default:
         WARN("Invalid datatype to create iterator");
         return nullptr;
     }
-    return nullptr;
+    iter->SetOwnership([this](const Slice& key) { return OwnsEntry(key); });
+    return iter;
   }
 
+  // Whether the user key of an entry belongs to this instance, the copies of
+  // a slot being migrated do not and are left out of the scans of all instances
+  bool OwnsEntry(const Slice& key) const;
+
   LogIndexOfColumnFamilies& GetLogIndexOfColumnFamilies() { return log_index_of_all_cfs_; }
 
   LogIndexAndSequenceCollector& GetCollector() { return log_index_collector_; }
@@ -368,6 +383,8 @@ class Redis {
   Storage* const storage_;
   std::shared_ptr<LockMgr> lock_mgr_;
   rocksdb::DB* db_ = nullptr;
+  // The outermost layer of db_
+  SlotTrackingDB* slot_tracking_db_ = nullptr;
 
   std::vector<rocksdb::ColumnFamilyHandle*> handles_;
   rocksdb::WriteOptions default_write_options_;
@@ -375,18 +392,20 @@ class Redis {
   rocksdb::CompactRangeOptions default_compact_range_options_;
 
   // For Scan
-  std::unique_ptr<LRUCache<std::string, std::string>> scan_cursors_store_;
-  std::unique_ptr<LRUCache<std::string, size_t>> spop_counts_store_;
+  std::unique_ptr<ShardedCache<std::string>> scan_cursors_store_;
+  std::unique_ptr<ShardedCache<size_t>> spop_counts_store_;
 
   Status GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
                            std::string* start_point);
-  Status StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor,
-                            const std::string& next_point);
+  // Remembers next_point and returns the cursor that resumes from it
+  int64_t StoreScanNextPoint(const DataType& type, const Slice& key, const Slice& pattern,
+                             const std::string& next_point);
 
   // For Statistics
   std::atomic_uint64_t small_compaction_threshold_;
   std::atomic_uint64_t small_compaction_duration_threshold_;
-  std::unique_ptr<LRUCache<std::string, KeyStatistics>> statistics_store_;
+  KeyStatistics key_statistics_;
+  HotKeys hot_keys_;
 
   // For raft
   uint32_t raft_timeout_s_ = 10;
@@ -395,9 +414,9 @@ class Redis {
   LogIndexOfColumnFamilies log_index_of_all_cfs_;
   bool is_starting_{true};
 
-  Status UpdateSpecificKeyStatistics(const DataType& dtype, const std::string& key, uint64_t count);
-  Status UpdateSpecificKeyDuration(const DataType& dtype, const std::string& key, uint64_t duration);
-  Status AddCompactKeyTaskIfNeeded(const DataType& dtype, const std::string& key, uint64_t count, uint64_t duration);
+  Status UpdateSpecificKeyStatistics(const DataType& dtype, const Slice& key, uint64_t count);
+  Status UpdateSpecificKeyDuration(const DataType& dtype, const Slice& key, uint64_t duration);
+  Status AddCompactKeyTaskIfNeeded(const DataType& dtype, const Slice& key, uint64_t count, uint64_t duration);
 };
 
 }  //  namespace storage
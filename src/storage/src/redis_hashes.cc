@@ -40,6 +40,9 @@ Status Redis::ScanHashesKeyNum(KeyInfo* key_info) {
 
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kHashesMetaCF]);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!OwnsEntry(iter->key())) {
+      continue;
+    }
     ParsedHashesMetaValue parsed_hashes_meta_value(iter->value());
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       invaild_keys++;
@@ -167,7 +170,7 @@ Status Redis::HDel(const Slice& key, const std::vector<std::string>& fields, int
     return s;
   }
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   return s;
 }
 
@@ -226,7 +229,7 @@ Status Redis::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
       version = parsed_hashes_meta_value.Version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -269,7 +272,7 @@ Status Redis::HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, uin
       version = parsed_hashes_meta_value.Version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -355,7 +358,7 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   return s;
 }
 
@@ -436,7 +439,7 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   return s;
 }
 
@@ -461,7 +464,7 @@ Status Redis::HKeys(const Slice& key, std::vector<std::string>* fields) {
       version = parsed_hashes_meta_value.Version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -612,7 +615,7 @@ Status Redis::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
     }
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   return s;
 }
 
@@ -677,7 +680,7 @@ Status Redis::HSet(const Slice& key, const Slice& field, const Slice& value, int
     return s;
   }
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   return s;
 }
 
@@ -755,7 +758,7 @@ Status Redis::HVals(const Slice& key, std::vector<std::string>* values) {
       version = parsed_hashes_meta_value.Version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedBaseDataValue parsed_internal_value(iter->value());
@@ -788,7 +791,6 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
   }
 
   int64_t rest = count;
-  int64_t step_length = count;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
 
@@ -809,7 +811,6 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
       uint64_t version = parsed_hashes_meta_value.Version();
       s = GetScanStartPoint(DataType::kHashes, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -821,7 +822,7 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
       HashesDataKey hashes_data_prefix(key, version, sub_field);
       HashesDataKey hashes_start_data_key(key, version, start_point);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(hashes_start_data_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -835,10 +836,9 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
         std::string next_field = parsed_hashes_data_key.field().ToString();
-        StoreScanNextPoint(DataType::kHashes, key, pattern, *next_cursor, next_field);
+        *next_cursor = StoreScanNextPoint(DataType::kHashes, key, pattern, next_field);
       } else {
         *next_cursor = 0;
       }
@@ -875,7 +875,7 @@ Status Redis::HScanx(const Slice& key, const std::string& start_field, const std
       HashesDataKey hashes_data_prefix(key, version, Slice());
       HashesDataKey hashes_start_data_key(key, version, start_field);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(hashes_start_data_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1007,7 +1007,7 @@ Status Redis::PKHScanRange(const Slice& key, const Slice& field_start, const std
       HashesDataKey hashes_data_prefix(key, version, Slice());
       HashesDataKey hashes_start_data_key(key, version, field_start);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(start_no_limit ? prefix : hashes_start_data_key.Encode());
            iter->Valid() && remain > 0 && iter->key().starts_with(prefix); iter->Next()) {
@@ -1070,7 +1070,7 @@ Status Redis::PKHRScanRange(const Slice& key, const Slice& field_start, const st
       HashesDataKey hashes_data_prefix(key, version, Slice());
       HashesDataKey hashes_start_data_key(key, start_key_version, start_key_field);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kHashes, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->SeekForPrev(hashes_start_data_key.Encode().ToString());
            iter->Valid() && remain > 0 && iter->key().starts_with(prefix); iter->Prev()) {
@@ -1141,7 +1141,7 @@ Status Redis::HashesDel(const Slice& key) {
       uint32_t statistic = parsed_hashes_meta_value.Count();
       parsed_hashes_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kHashesMetaCF], base_meta_key.Encode(), meta_value);
-      UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
     }
   }
   return s;
@@ -1245,12 +1245,12 @@ Status Redis::HashesRename(const Slice& key, Redis* new_inst, const Slice& newke
     // copy a new hash with newkey
     statistic = parsed_hashes_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kHashesMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey, statistic);
 
     // HashesDel key
     parsed_hashes_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kHashesMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   }
   return s;
 }
@@ -1286,12 +1286,12 @@ Status Redis::HashesRenamenx(const Slice& key, Redis* new_inst, const Slice& new
     // copy a new hash with newkey
     statistic = parsed_hashes_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kHashesMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kHashes, newkey, statistic);
 
     // HashesDel key
     parsed_hashes_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kHashesMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kHashes, key, statistic);
   }
   return s;
 }
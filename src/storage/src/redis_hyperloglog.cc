@@ -4,112 +4,569 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include "src/redis_hyperloglog.h"
+
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <string>
-#include "src/storage_murmur3.h"
+
+#include "src/base_key_format.h"
+#include "src/batch.h"
+#include "src/redis.h"
+#include "src/scope_record_lock.h"
+#include "src/strings_value_format.h"
 
 namespace storage {
 
-const int32_t HLL_HASH_SEED = 313;
+namespace {
+
+constexpr char kMagic[] = "HYLL";
+constexpr uint8_t kDense = 0;
+constexpr uint8_t kSparse = 1;
+constexpr int kRegisterMax = (1 << 6) - 1;
+constexpr double kAlphaInf = 0.721347520444481703680;
+
+// Sparse opcodes:
+//   ZERO  00xxxxxx          1 to 64 zero registers
+//   XZERO 01xxxxxx yyyyyyyy 1 to 16384 zero registers
+//   VAL   1vvvvvxx          1 to 4 registers of value 1 to 32
+constexpr int kSparseZeroMaxLen = 64;
+constexpr int kSparseValMaxValue = 32;
+constexpr int kSparseValMaxLen = 4;
+
+inline bool SparseIsZero(const uint8_t* p) { return (*p & 0xc0) == 0; }
+inline bool SparseIsXZero(const uint8_t* p) { return (*p & 0xc0) == 0x40; }
+inline int SparseZeroLen(const uint8_t* p) { return (*p & 0x3f) + 1; }
+inline int SparseXZeroLen(const uint8_t* p) { return (((*p & 0x3f) << 8) | *(p + 1)) + 1; }
+inline int SparseValValue(const uint8_t* p) { return ((*p >> 2) & 0x1f) + 1; }
+inline int SparseValLen(const uint8_t* p) { return (*p & 0x3) + 1; }
+inline void SparseValSet(uint8_t* p, int val, int len) { *p = (((val - 1) << 2) | (len - 1)) | 0x80; }
+inline void SparseZeroSet(uint8_t* p, int len) { *p = len - 1; }
+inline void SparseXZeroSet(uint8_t* p, int len) {
+  int l = len - 1;
+  *p = (l >> 8) | 0x40;
+  *(p + 1) = l & 0xff;
+}
+
+// Writes a run of len zero registers, returns the number of bytes used
+inline int SparseZeroRunSet(uint8_t* p, int len) {
+  if (len > kSparseZeroMaxLen) {
+    SparseXZeroSet(p, len);
+    return 2;
+  }
+  SparseZeroSet(p, len);
+  return 1;
+}
+
+// Registers are packed 6 bits each, least significant bits first
+inline uint8_t DenseGetRegister(const uint8_t* registers, uint32_t index) {
+  uint32_t byte = index * 6 / 8;
+  uint32_t fb = index * 6 & 7;
+  unsigned int val = registers[byte] >> fb;
+  if (fb > 2) {
+    val |= static_cast<unsigned int>(registers[byte + 1]) << (8 - fb);
+  }
+  return val & kRegisterMax;
+}
+
+inline void DenseSetRegister(uint8_t* registers, uint32_t index, uint8_t val) {
+  uint32_t byte = index * 6 / 8;
+  uint32_t fb = index * 6 & 7;
+  registers[byte] &= ~(kRegisterMax << fb);
+  registers[byte] |= val << fb;
+  if (fb > 2) {
+    registers[byte + 1] &= ~(kRegisterMax >> (8 - fb));
+    registers[byte + 1] |= val >> (8 - fb);
+  }
+}
 
-HyperLogLog::HyperLogLog(uint8_t precision, std::string origin_register) {
-  b_ = precision;
-  m_ = 1 << precision;
-  alpha_ = Alpha();
-  register_ = std::make_unique<char[]>(m_);
-  for (uint32_t i = 0; i < m_; ++i) {
-    register_[i] = 0;
+// Four registers are packed in every three bytes, decode them a group at a time
+template <typename F>
+inline void ForEachDenseGroup(const uint8_t* dense, F&& f) {
+  for (int i = 0; i < HyperLogLog::kRegisters; i += 4) {
+    const uint8_t* p = dense + i / 4 * 3;
+    f(i, p[0] & kRegisterMax, ((p[0] >> 6) | (p[1] << 2)) & kRegisterMax, ((p[1] >> 4) | (p[2] << 4)) & kRegisterMax,
+      p[2] >> 2);
   }
-  if (!origin_register.empty()) {
-    for (uint32_t i = 0; i < m_; ++i) {
-      register_[i] = origin_register[i];
+}
+
+// MurmurHash64A as used by Redis, endian neutral
+uint64_t HllHash(const void* key, size_t len) {
+  const uint64_t m = 0xc6a4a7935bd1e995;
+  const int r = 47;
+  uint64_t h = 0xadc83b19ULL ^ (len * m);
+  auto data = static_cast<const uint8_t*>(key);
+  const uint8_t* end = data + (len - (len & 7));
+
+  while (data != end) {
+    uint64_t k;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&k, data, sizeof(uint64_t));
+#else
+    k = static_cast<uint64_t>(data[0]);
+    for (int i = 1; i < 8; i++) {
+      k |= static_cast<uint64_t>(data[i]) << (8 * i);
     }
+#endif
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+    data += 8;
+  }
+
+  switch (len & 7) {
+    case 7:
+      h ^= static_cast<uint64_t>(data[6]) << 48;
+      [[fallthrough]];
+    case 6:
+      h ^= static_cast<uint64_t>(data[5]) << 40;
+      [[fallthrough]];
+    case 5:
+      h ^= static_cast<uint64_t>(data[4]) << 32;
+      [[fallthrough]];
+    case 4:
+      h ^= static_cast<uint64_t>(data[3]) << 24;
+      [[fallthrough]];
+    case 3:
+      h ^= static_cast<uint64_t>(data[2]) << 16;
+      [[fallthrough]];
+    case 2:
+      h ^= static_cast<uint64_t>(data[1]) << 8;
+      [[fallthrough]];
+    case 1:
+      h ^= static_cast<uint64_t>(data[0]);
+      h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+// Register index of an element and the length of the run of zeros (plus one)
+// in the remaining hash bits.
+uint8_t PatternLen(const char* element, size_t len, uint32_t* index) {
+  uint64_t hash = HllHash(element, len);
+  *index = hash & (HyperLogLog::kRegisters - 1);
+  hash >>= HyperLogLog::kP;
+  hash |= 1ULL << HyperLogLog::kQ;
+  return static_cast<uint8_t>(__builtin_ctzll(hash) + 1);
+}
+
+// The estimator of Otmar Ertl, "New cardinality estimation algorithms for
+// HyperLogLog sketches", which only needs the histogram of the registers.
+double Tau(double x) {
+  if (x == 0. || x == 1.) {
+    return 0.;
   }
+  double z_prime;
+  double y = 1.0;
+  double z = 1 - x;
+  do {
+    x = sqrt(x);
+    z_prime = z;
+    y *= 0.5;
+    z -= pow(1 - x, 2) * y;
+  } while (z_prime != z);
+  return z / 3;
 }
 
-HyperLogLog::~HyperLogLog() = default;
+double Sigma(double x) {
+  if (x == 1.) {
+    return INFINITY;
+  }
+  double z_prime;
+  double y = 1;
+  double z = x;
+  do {
+    x *= x;
+    z_prime = z;
+    z += x * y;
+    y += y;
+  } while (z_prime != z);
+  return z;
+}
+
+uint64_t CountHistogram(const int* histogram) {
+  double m = HyperLogLog::kRegisters;
+  double z = m * Tau((m - histogram[HyperLogLog::kQ + 1]) / m);
+  for (int j = HyperLogLog::kQ; j >= 1; --j) {
+    z += histogram[j];
+    z *= 0.5;
+  }
+  z += m * Sigma(histogram[0] / m);
+  return static_cast<uint64_t>(llroundl(kAlphaInf * m * m / z));
+}
+
+}  // namespace
+
+HyperLogLog::HyperLogLog(std::string* value) : value_(value) {
+  if (value_->empty()) {
+    value_->assign(kHeaderSize + 2, '\0');
+    memcpy(value_->data(), kMagic, 4);
+    (*value_)[4] = static_cast<char>(kSparse);
+    SparseXZeroSet(reinterpret_cast<uint8_t*>(value_->data()) + kHeaderSize, kRegisters);
+  }
+}
 
-std::string HyperLogLog::Add(const char* value, uint32_t len) {
-  uint32_t hash_value;
-  MurmurHash3_x86_32(value, static_cast<int32_t>(len), HLL_HASH_SEED, static_cast<void*>(&hash_value));
-  uint32_t index = hash_value & ((1 << b_) - 1);
-  uint8_t rank = Nctz((hash_value >> b_), static_cast<int32_t>(32 - b_));
-  if (rank > register_[index]) {
-    register_[index] = static_cast<char>(rank);
+bool HyperLogLog::IsValid() const {
+  if (value_->size() < kHeaderSize || memcmp(value_->data(), kMagic, 4) != 0) {
+    return false;
   }
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  auto encoding = static_cast<uint8_t>((*value_)[4]);
+  if (encoding == kDense) {
+    return value_->size() == kDenseSize;
   }
-  return result;
+  return encoding == kSparse;
+}
+
+bool HyperLogLog::IsDense() const { return static_cast<uint8_t>((*value_)[4]) == kDense; }
+
+void HyperLogLog::InvalidateCache() { (*value_)[15] = static_cast<char>((*value_)[15] | (1 << 7)); }
+
+int HyperLogLog::Add(const char* element, size_t len) {
+  uint32_t index;
+  uint8_t count = PatternLen(element, len, &index);
+  return IsDense() ? DenseSet(index, count) : SparseSet(index, count);
 }
 
-double HyperLogLog::Estimate() const {
-  double estimate = FirstEstimate();
-  if (estimate <= 2.5 * m_) {
-    uint32_t zeros = CountZero();
-    if (zeros != 0) {
-      estimate = m_ * log(static_cast<double>(m_) / zeros);
+int HyperLogLog::DenseSet(uint32_t index, uint8_t count) {
+  auto registers = reinterpret_cast<uint8_t*>(value_->data()) + kHeaderSize;
+  if (count <= DenseGetRegister(registers, index)) {
+    return 0;
+  }
+  DenseSetRegister(registers, index, count);
+  InvalidateCache();
+  return 1;
+}
+
+// Port of hllSparseSet() of Redis: find the opcode covering index and split
+// it into at most three opcodes, promoting to dense when the value no longer
+// fits a VAL opcode or the value grows too large.
+int HyperLogLog::SparseSet(uint32_t index, uint8_t count) {
+  if (count > kSparseValMaxValue) {
+    return SparseToDense() ? DenseSet(index, count) : -1;
+  }
+
+  // Work on offsets, the string may be reallocated below
+  size_t end = value_->size();
+  size_t pos = kHeaderSize;
+  size_t prev = 0;
+  bool has_prev = false;
+  uint32_t first = 0;
+  uint32_t span = 0;
+  auto data = [this](size_t offset) { return reinterpret_cast<uint8_t*>(value_->data()) + offset; };
+  while (pos < end) {
+    size_t oplen = 1;
+    if (SparseIsZero(data(pos))) {
+      span = SparseZeroLen(data(pos));
+    } else if (SparseIsXZero(data(pos))) {
+      span = SparseXZeroLen(data(pos));
+      oplen = 2;
+    } else {
+      span = SparseValLen(data(pos));
     }
-  } else if (estimate > pow(2, 32) / 30.0) {
-    estimate = log1p(estimate * -1 / pow(2, 32)) * pow(2, 32) * -1;
+    if (index <= first + span - 1) {
+      break;
+    }
+    prev = pos;
+    has_prev = true;
+    pos += oplen;
+    first += span;
+  }
+  if (span == 0 || pos >= end) {
+    return -1;
+  }
+
+  bool is_zero = SparseIsZero(data(pos));
+  bool is_xzero = SparseIsXZero(data(pos));
+  bool is_val = !is_zero && !is_xzero;
+  size_t next = pos + (is_xzero ? 2 : 1);
+  int runlen = is_zero ? SparseZeroLen(data(pos)) : (is_xzero ? SparseXZeroLen(data(pos)) : SparseValLen(data(pos)));
+
+  bool updated = false;
+  if (is_val) {
+    int old_count = SparseValValue(data(pos));
+    if (old_count >= count) {
+      return 0;
+    }
+    if (runlen == 1) {
+      SparseValSet(data(pos), count, 1);
+      updated = true;
+    }
+  } else if (is_zero && runlen == 1) {
+    SparseValSet(data(pos), count, 1);
+    updated = true;
+  }
+
+  if (!updated) {
+    // Replace the opcode by: [run before index] VAL(count, 1) [run after index]
+    uint8_t seq[5];
+    uint8_t* n = seq;
+    uint32_t last = first + span - 1;
+    if (is_zero || is_xzero) {
+      if (index != first) {
+        n += SparseZeroRunSet(n, static_cast<int>(index - first));
+      }
+      SparseValSet(n++, count, 1);
+      if (index != last) {
+        n += SparseZeroRunSet(n, static_cast<int>(last - index));
+      }
+    } else {
+      int cur_val = SparseValValue(data(pos));
+      if (index != first) {
+        SparseValSet(n++, cur_val, static_cast<int>(index - first));
+      }
+      SparseValSet(n++, count, 1);
+      if (index != last) {
+        SparseValSet(n++, cur_val, static_cast<int>(last - index));
+      }
+    }
+
+    auto seq_len = static_cast<size_t>(n - seq);
+    size_t old_len = is_xzero ? 2 : 1;
+    if (seq_len > old_len && value_->size() + seq_len - old_len > kSparseMaxBytes) {
+      return SparseToDense() ? DenseSet(index, count) : -1;
+    }
+    if (seq_len > old_len) {
+      value_->resize(value_->size() + seq_len - old_len);
+    }
+    if (seq_len != old_len) {
+      memmove(data(pos + seq_len), data(next), end - next);
+    }
+    if (seq_len < old_len) {
+      value_->resize(value_->size() - (old_len - seq_len));
+    }
+    memcpy(data(pos), seq, seq_len);
+    end = value_->size();
   }
-  return estimate;
+
+  // Merge the adjacent VAL opcodes of the same value around the update
+  pos = has_prev ? prev : kHeaderSize;
+  int scan_len = 5;
+  while (pos < end && scan_len--) {
+    if (SparseIsXZero(data(pos))) {
+      pos += 2;
+      continue;
+    } else if (SparseIsZero(data(pos))) {
+      pos++;
+      continue;
+    }
+    if (pos + 1 < end && !SparseIsZero(data(pos + 1)) && !SparseIsXZero(data(pos + 1))) {
+      int v1 = SparseValValue(data(pos));
+      int v2 = SparseValValue(data(pos + 1));
+      if (v1 == v2) {
+        int len = SparseValLen(data(pos)) + SparseValLen(data(pos + 1));
+        if (len <= kSparseValMaxLen) {
+          SparseValSet(data(pos + 1), v1, len);
+          memmove(data(pos), data(pos + 1), end - pos - 1);
+          value_->resize(--end);
+          continue;
+        }
+      }
+    }
+    pos++;
+  }
+  InvalidateCache();
+  return 1;
 }
 
-double HyperLogLog::FirstEstimate() const {
-  double estimate;
-  double sum = 0.0;
-  for (uint32_t i = 0; i < m_; i++) {
-    sum += 1.0 / (1 << register_[i]);
+bool HyperLogLog::SparseToRegisters(uint8_t* registers) const {
+  auto p = reinterpret_cast<const uint8_t*>(value_->data()) + kHeaderSize;
+  auto end = reinterpret_cast<const uint8_t*>(value_->data()) + value_->size();
+  int index = 0;
+  while (p < end) {
+    if (SparseIsZero(p)) {
+      index += SparseZeroLen(p);
+      p++;
+    } else if (SparseIsXZero(p)) {
+      index += SparseXZeroLen(p);
+      p += 2;
+    } else {
+      int runlen = SparseValLen(p);
+      auto val = static_cast<uint8_t>(SparseValValue(p));
+      if (index + runlen > kRegisters) {
+        return false;
+      }
+      while (runlen--) {
+        registers[index] = std::max(registers[index], val);
+        index++;
+      }
+      p++;
+    }
   }
+  return index == kRegisters;
+}
 
-  estimate = alpha_ * m_ * m_ / sum;
-  return estimate;
+bool HyperLogLog::SparseToDense() {
+  uint8_t registers[kRegisters] = {0};
+  if (!SparseToRegisters(registers)) {
+    return false;
+  }
+  EncodeDense(registers, value_);
+  InvalidateCache();
+  return true;
 }
 
-double HyperLogLog::Alpha() const {
-  switch (m_) {
-    case 16:
-      return 0.673;
-    case 32:
-      return 0.697;
-    case 64:
-      return 0.709;
-    default:
-      return 0.7213 / (1 + 1.079 / m_);
+bool HyperLogLog::MergeTo(uint8_t* max_registers) const {
+  if (!IsDense()) {
+    return SparseToRegisters(max_registers);
   }
+  auto dense = reinterpret_cast<const uint8_t*>(value_->data()) + kHeaderSize;
+  ForEachDenseGroup(dense, [max_registers](int i, uint8_t r0, uint8_t r1, uint8_t r2, uint8_t r3) {
+    max_registers[i] = std::max(max_registers[i], r0);
+    max_registers[i + 1] = std::max(max_registers[i + 1], r1);
+    max_registers[i + 2] = std::max(max_registers[i + 2], r2);
+    max_registers[i + 3] = std::max(max_registers[i + 3], r3);
+  });
+  return true;
 }
 
-uint32_t HyperLogLog::CountZero() const {
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < m_; i++) {
-    if (register_[i] == 0) {
-      count++;
+bool HyperLogLog::Count(uint64_t* card) const {
+  auto header = reinterpret_cast<const uint8_t*>(value_->data());
+  if ((header[15] & (1 << 7)) == 0) {
+    *card = 0;
+    for (int i = 7; i >= 0; i--) {
+      *card = (*card << 8) | header[8 + i];
     }
+    return true;
   }
-  return count;
+
+  int histogram[64] = {0};
+  if (IsDense()) {
+    ForEachDenseGroup(header + kHeaderSize, [&histogram](int i, uint8_t r0, uint8_t r1, uint8_t r2, uint8_t r3) {
+      histogram[r0]++;
+      histogram[r1]++;
+      histogram[r2]++;
+      histogram[r3]++;
+    });
+  } else {
+    const uint8_t* p = header + kHeaderSize;
+    const uint8_t* end = header + value_->size();
+    int index = 0;
+    while (p < end) {
+      if (SparseIsZero(p)) {
+        histogram[0] += SparseZeroLen(p);
+        index += SparseZeroLen(p);
+        p++;
+      } else if (SparseIsXZero(p)) {
+        histogram[0] += SparseXZeroLen(p);
+        index += SparseXZeroLen(p);
+        p += 2;
+      } else {
+        histogram[SparseValValue(p)] += SparseValLen(p);
+        index += SparseValLen(p);
+        p++;
+      }
+    }
+    if (index != kRegisters) {
+      return false;
+    }
+  }
+  *card = CountHistogram(histogram);
+  return true;
 }
 
-std::string HyperLogLog::Merge(const HyperLogLog& hll) {
-  if (m_ != hll.m_) {
-    // TODO(shq) the number of registers doesn't match
+void HyperLogLog::EncodeDense(const uint8_t* registers, std::string* value) {
+  value->assign(kDenseSize, '\0');
+  memcpy(value->data(), kMagic, 4);
+  (*value)[4] = static_cast<char>(kDense);
+  auto dense = reinterpret_cast<uint8_t*>(value->data()) + kHeaderSize;
+  for (int i = 0; i < kRegisters; i++) {
+    DenseSetRegister(dense, i, registers[i]);
+  }
+
+  uint64_t card = CountRegisters(registers);
+  for (int i = 0; i < 8; i++) {
+    (*value)[8 + i] = static_cast<char>((card >> (8 * i)) & 0xff);
   }
-  for (uint32_t r = 0; r < m_; r++) {
-    if (register_[r] < hll.register_[r]) {
-      register_[r] = static_cast<char>(register_[r] | hll.register_[r]);
+}
+
+uint64_t HyperLogLog::CountRegisters(const uint8_t* registers) {
+  int histogram[64] = {0};
+  for (int i = 0; i < kRegisters; i++) {
+    histogram[registers[i]]++;
+  }
+  return CountHistogram(histogram);
+}
+
+Status Redis::PfAdd(const Slice& key, const std::vector<std::string>& values, bool* update) {
+  *update = false;
+  std::string value;
+  uint64_t timestamp = 0;
+  ScopeRecordLock l(lock_mgr_, key);
+
+  BaseKey base_key(key);
+  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  if (s.ok()) {
+    ParsedStringsValue parsed_strings_value(&value);
+    if (parsed_strings_value.IsStale()) {
+      value.clear();
+    } else {
+      timestamp = parsed_strings_value.Etime();
+      parsed_strings_value.StripSuffix();
     }
+  } else if (!s.IsNotFound()) {
+    return s;
   }
 
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  // PFADD without elements creates the key
+  *update = value.empty();
+  HyperLogLog log(&value);
+  if (!log.IsValid()) {
+    return Status::InvalidArgument("WRONGTYPE Key is not a valid HyperLogLog string value.");
+  }
+  for (const auto& element : values) {
+    int ret = log.Add(element.data(), element.size());
+    if (ret == -1) {
+      return Status::Corruption("INVALIDOBJ Corrupted HLL object detected");
+    }
+    *update = *update || ret == 1;
   }
-  return result;
+  if (!*update) {
+    return Status::OK();
+  }
+
+  StringsValue strings_value(value);
+  strings_value.SetEtime(timestamp);
+  auto batch = Batch::CreateBatch(this);
+  batch->Put(kStringsCF, base_key.Encode(), strings_value.Encode());
+  return batch->Commit();
 }
 
-// ::__builtin_ctz(x): 返回右起第一个‘1’之后的0的个数
-uint8_t HyperLogLog::Nctz(uint32_t x, int b) { return static_cast<uint8_t>(std::min(b, ::__builtin_ctz(x))) + 1; }
+Status Redis::PfMerge(const Slice& dest, uint8_t* max_registers, std::string* value_to_dest) {
+  std::string value;
+  uint64_t timestamp = 0;
+  ScopeRecordLock l(lock_mgr_, dest);
+
+  BaseKey base_key(dest);
+  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  if (s.ok()) {
+    ParsedStringsValue parsed_strings_value(&value);
+    if (!parsed_strings_value.IsStale()) {
+      timestamp = parsed_strings_value.Etime();
+      parsed_strings_value.StripSuffix();
+      HyperLogLog log(&value);
+      if (!log.IsValid()) {
+        return Status::InvalidArgument("WRONGTYPE Key is not a valid HyperLogLog string value.");
+      }
+      if (!log.MergeTo(max_registers)) {
+        return Status::Corruption("INVALIDOBJ Corrupted HLL object detected");
+      }
+    }
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
+  HyperLogLog::EncodeDense(max_registers, value_to_dest);
+  StringsValue strings_value(*value_to_dest);
+  strings_value.SetEtime(timestamp);
+  auto batch = Batch::CreateBatch(this);
+  batch->Put(kStringsCF, base_key.Encode(), strings_value.Encode());
+  return batch->Commit();
+}
 
 }  // namespace storage
@@ -6,32 +6,64 @@
 #ifndef SRC_REDIS_HYPERLOGLOG_H_
 #define SRC_REDIS_HYPERLOGLOG_H_
 
+#include <cstddef>
 #include <cstdint>
-#include <iostream>
-#include <memory>
 #include <string>
 
 namespace storage {
 
+/*
+ * HyperLogLog in the Redis format, so values can be exchanged with Redis:
+ *
+ *   | "HYLL" | encoding (1B) | unused (3B) | cached cardinality (8B) | registers |
+ *
+ * There are 16384 registers of 6 bits. A dense value stores all of them
+ * packed (12KB), a sparse value stores run length opcodes and is used while
+ * the cardinality is low, it turns dense once it grows over kSparseMaxBytes.
+ *
+ * The object works in place on the string it is given, so adding elements
+ * never copies the registers.
+ */
 class HyperLogLog {
  public:
-  HyperLogLog(uint8_t precision, std::string origin_register);
-  ~HyperLogLog();
-
-  double Estimate() const;
-  double FirstEstimate() const;
-  uint32_t CountZero() const;
-  double Alpha() const;
-  uint8_t Nctz(uint32_t x, int b);
-
-  std::string Add(const char* value, uint32_t len);
-  std::string Merge(const HyperLogLog& hll);
-
- protected:
-  uint32_t m_ = 0;  // register bit width
-  uint32_t b_ = 0;  // regieter size
-  double alpha_ = 0;
-  std::unique_ptr<char[]> register_;
+  static constexpr int kP = 14;
+  static constexpr int kQ = 64 - kP;
+  static constexpr int kRegisters = 1 << kP;
+  static constexpr size_t kHeaderSize = 16;
+  static constexpr size_t kDenseSize = kHeaderSize + (kRegisters * 6 + 7) / 8;
+  static constexpr size_t kSparseMaxBytes = 3000;
+
+  // An empty *value is initialized as an empty sparse HyperLogLog
+  explicit HyperLogLog(std::string* value);
+
+  // Checks the header, and the size of a dense value
+  bool IsValid() const;
+
+  // Returns 1 if a register was updated, 0 if not and -1 if the value is corrupted
+  int Add(const char* element, size_t len);
+
+  // max_registers[i] = max(max_registers[i], register i), false if the value is corrupted
+  bool MergeTo(uint8_t* max_registers) const;
+
+  // Approximated cardinality, the cached one when it is still valid.
+  // Returns false if the value is corrupted.
+  bool Count(uint64_t* card) const;
+
+  // Replaces *value by a dense HyperLogLog of registers with its cardinality cached
+  static void EncodeDense(const uint8_t* registers, std::string* value);
+
+  // Cardinality of raw registers, one byte per register
+  static uint64_t CountRegisters(const uint8_t* registers);
+
+ private:
+  bool IsDense() const;
+  int DenseSet(uint32_t index, uint8_t count);
+  int SparseSet(uint32_t index, uint8_t count);
+  bool SparseToDense();
+  bool SparseToRegisters(uint8_t* registers) const;
+  void InvalidateCache();
+
+  std::string* value_;
 };
 
 }  // namespace storage
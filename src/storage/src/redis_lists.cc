@@ -33,6 +33,9 @@ Status Redis::ScanListsKeyNum(KeyInfo* key_info) {
 
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kListsMetaCF]);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!OwnsEntry(iter->key())) {
+      continue;
+    }
     ParsedListsMetaValue parsed_lists_meta_value(iter->value());
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
       invaild_keys++;
@@ -300,7 +303,7 @@ Status Redis::LPop(const Slice& key, int64_t count, std::vector<std::string>* el
   }
   if (batch->Count() != 0U) {
     s = batch->Commit();
-    UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
   }
   return s;
 }
@@ -645,7 +648,7 @@ Status Redis::LSet(const Slice& key, int64_t index, const Slice& value) {
       BaseDataValue i_val(value);
       batch->Put(kListsDataCF, lists_data_key.Encode(), i_val.Encode());
       statistic++;
-      UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
       return batch->Commit();
     }
   }
@@ -708,7 +711,7 @@ Status Redis::LTrim(const Slice& key, int64_t start, int64_t stop) {
   } else {
     return s;
   }
-  UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
   return batch->Commit();
 }
 
@@ -753,7 +756,7 @@ Status Redis::RPop(const Slice& key, int64_t count, std::vector<std::string>* el
   }
   if (batch->Count() != 0U) {
     s = batch->Commit();
-    UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
   }
   return s;
 }
@@ -796,7 +799,7 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
             parsed_lists_meta_value.ModifyLeftIndex(1);
             batch->Put(kListsMetaCF, base_source.Encode(), meta_value);
             s = batch->Commit();
-            UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
+            UpdateSpecificKeyStatistics(DataType::kLists, source, statistic);
             return s;
           }
         } else {
@@ -869,7 +872,7 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
   }
 
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kLists, source, statistic);
   if (s.ok()) {
     ParsedBaseDataValue parsed_value(&target);
     parsed_value.StripSuffix();
@@ -999,7 +1002,7 @@ Status Redis::ListsDel(const Slice& key) {
       uint32_t statistic = parsed_lists_meta_value.Count();
       parsed_lists_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kListsMetaCF], base_meta_key.Encode(), meta_value);
-      UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
     }
   }
   return s;
@@ -1101,12 +1104,12 @@ Status Redis::ListsRename(const Slice& key, Redis* new_inst, const Slice& newkey
     // copy a new list with newkey
     statistic = parsed_lists_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kListsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey, statistic);
 
     // ListsDel key
     parsed_lists_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kListsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
   }
   return s;
 }
@@ -1141,12 +1144,12 @@ Status Redis::ListsRenamenx(const Slice& key, Redis* new_inst, const Slice& newk
     // copy a new list with newkey
     statistic = parsed_lists_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kListsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kLists, newkey, statistic);
 
     // ListsDel key
     parsed_lists_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kListsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kLists, key, statistic);
   }
   return s;
 }
@@ -40,6 +40,9 @@ rocksdb::Status Redis::ScanSetsKeyNum(KeyInfo* key_info) {
 
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kSetsMetaCF]);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!OwnsEntry(iter->key())) {
+      continue;
+    }
     ParsedSetsMetaValue parsed_sets_meta_value(iter->value());
     if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
       invaild_keys++;
@@ -372,7 +375,7 @@ rocksdb::Status Redis::SDiffstore(const Slice& destination, const std::vector<st
   }
   *ret = static_cast<int32_t>(members.size());
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kSets, destination, statistic);
   value_to_dest = std::move(members);
   return s;
 }
@@ -567,7 +570,7 @@ rocksdb::Status Redis::SInterstore(const Slice& destination, const std::vector<s
   }
   *ret = static_cast<int32_t>(members.size());
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kSets, destination, statistic);
   value_to_dest = std::move(members);
   return s;
 }
@@ -624,7 +627,7 @@ rocksdb::Status Redis::SMembers(const Slice& key, std::vector<std::string>* memb
       version = parsed_sets_meta_value.Version();
       SetsMemberKey sets_member_key(key, version, Slice());
       Slice prefix = sets_member_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kSets, key);
       auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
@@ -666,7 +669,7 @@ Status Redis::SMembersWithTTL(const Slice& key, std::vector<std::string>* member
       version = parsed_sets_meta_value.Version();
       SetsMemberKey sets_member_key(key, version, Slice());
       Slice prefix = sets_member_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kSets, key);
       auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
@@ -771,7 +774,7 @@ rocksdb::Status Redis::SMove(const Slice& source, const Slice& destination, cons
     return s;
   }
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kSets, source.ToString(), 1);
+  UpdateSpecificKeyStatistics(DataType::kSets, source, 1);
   return s;
 }
 
@@ -830,7 +833,7 @@ rocksdb::Status Redis::SPop(const Slice& key, std::vector<std::string>* members,
 
         SetsMemberKey sets_member_key(key, version, Slice());
         int64_t del_count = 0;
-        KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+        KeyStatisticsDurationGuard guard(this, DataType::kSets, key);
         auto iter = db_->NewIterator(default_read_options_, handles_[kSetsDataCF]);
         for (iter->Seek(sets_member_key.EncodeSeekKey()); iter->Valid() && cur_index < size;
              iter->Next(), cur_index++) {
@@ -862,11 +865,98 @@ rocksdb::Status Redis::SPop(const Slice& key, std::vector<std::string>* members,
 rocksdb::Status Redis::ResetSpopCount(const std::string& key) { return spop_counts_store_->Remove(key); }
 
 rocksdb::Status Redis::AddAndGetSpopCount(const std::string& key, uint64_t* count) {
-  size_t old_count = 0;
-  spop_counts_store_->Lookup(key, &old_count);
-  spop_counts_store_->Insert(key, old_count + 1);
-  *count = old_count + 1;
-  return rocksdb::Status::OK();
+  return spop_counts_store_->Update(key, [count](size_t& spop_count) { *count = ++spop_count; });
+}
+
+rocksdb::Status Redis::SetsStore(const Slice& destination, const MemberSource& source, int32_t* ret) {
+  *ret = 0;
+  uint32_t statistic = 0;
+  uint64_t version = 0;
+  std::string meta_value;
+  std::string origin_value;
+  ScopeRecordLock l(lock_mgr_, destination);
+
+  bool live = false;
+  BaseMetaKey base_destination(destination);
+  rocksdb::Status s = db_->Get(default_read_options_, handles_[kSetsMetaCF], base_destination.Encode(), &meta_value);
+  if (s.ok()) {
+    origin_value = meta_value;
+    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+    statistic = parsed_sets_meta_value.Count();
+    live = parsed_sets_meta_value.IsValid();
+    version = parsed_sets_meta_value.InitialMetaValue();
+  } else if (s.IsNotFound()) {
+    char str[4];
+    EncodeFixed32(str, 0);
+    SetsMetaValue sets_meta_value(Slice(str, sizeof(int32_t)));
+    version = sets_meta_value.UpdateVersion();
+    meta_value = sets_meta_value.Encode().ToString();
+  } else {
+    return s;
+  }
+
+  // The members are staged under the new version, which no reader looks at
+  // until the last batch writes the meta value. The first staging batch marks
+  // the version in the meta value, the old one of a live destination or an
+  // empty one readers take as not found, so the compaction filters keep the
+  // staged members; a store that fails puts the old meta value back, and the
+  // members it staged are collected.
+  int32_t count = 0;
+  bool staged = false;
+  auto batch = Batch::CreateBatch(this);
+  auto stage = [&]() {
+    if (!staged) {
+      std::string staging_value = live ? origin_value : meta_value;
+      ParsedSetsMetaValue parsed_staging_value(&staging_value);
+      parsed_staging_value.SetStagingVersion(version);
+      batch->Put(kSetsMetaCF, base_destination.Encode(), staging_value);
+      staged = true;
+    }
+    rocksdb::Status commit_s = batch->Commit();
+    batch = Batch::CreateBatch(this);
+    return commit_s;
+  };
+
+  s = source([&](const Slice& member) {
+    if (count == INT32_MAX) {
+      return Status::InvalidArgument("set size overflow");
+    }
+    SetsMemberKey sets_member_key(destination, version, member);
+    BaseDataValue iter_value(Slice{});
+    batch->Put(kSetsDataCF, sets_member_key.Encode(), iter_value.Encode());
+    count++;
+    if (static_cast<size_t>(batch->Count()) >= STORE_BATCH_LIMIT) {
+      return stage();
+    }
+    return Status::OK();
+  });
+  if (s.ok() && count == 0 && origin_value.empty()) {
+    return s;  // nothing to store into a missing destination
+  }
+  if (s.ok()) {
+    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+    parsed_sets_meta_value.SetCount(count);
+    batch->Put(kSetsMetaCF, base_destination.Encode(), meta_value);
+    s = batch->Commit();
+  }
+  if (!s.ok()) {
+    if (staged) {
+      auto undo = Batch::CreateBatch(this);
+      if (origin_value.empty()) {
+        undo->Delete(kSetsMetaCF, base_destination.Encode());
+      } else {
+        ParsedSetsMetaValue parsed_origin_value(&origin_value);
+        parsed_origin_value.SetStagingVersion(0);
+        undo->Put(kSetsMetaCF, base_destination.Encode(), origin_value);
+      }
+      undo->Commit();
+    }
+    return s;
+  }
+
+  *ret = count;
+  UpdateSpecificKeyStatistics(DataType::kSets, destination, statistic);
+  return s;
 }
 
 rocksdb::Status Redis::SRandmember(const Slice& key, int32_t count, std::vector<std::string>* members) {
@@ -919,7 +1009,7 @@ rocksdb::Status Redis::SRandmember(const Slice& key, int32_t count, std::vector<
       int32_t cur_index = 0;
       int32_t idx = 0;
       SetsMemberKey sets_member_key(key, version, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kSets, key);
       auto iter = db_->NewIterator(default_read_options_, handles_[kSetsDataCF]);
       for (iter->Seek(sets_member_key.EncodeSeekKey()); iter->Valid() && cur_index < size; iter->Next(), cur_index++) {
         if (static_cast<size_t>(idx) >= targets.size()) {
@@ -986,7 +1076,7 @@ rocksdb::Status Redis::SRem(const Slice& key, const std::vector<std::string>& me
     return s;
   }
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kSets, key, statistic);
   return s;
 }
 
@@ -1115,7 +1205,7 @@ rocksdb::Status Redis::SUnionstore(const Slice& destination, const std::vector<s
   }
   *ret = static_cast<int32_t>(members.size());
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kSets, destination, statistic);
   value_to_dest = std::move(members);
   return s;
 }
@@ -1130,7 +1220,6 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
   }
 
   int64_t rest = count;
-  int64_t step_length = count;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
 
@@ -1151,7 +1240,6 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
       uint64_t version = parsed_sets_meta_value.Version();
       s = GetScanStartPoint(DataType::kSets, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -1163,7 +1251,7 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
       SetsMemberKey sets_member_prefix(key, version, sub_member);
       SetsMemberKey sets_member_key(key, version, start_point);
       std::string prefix = sets_member_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(sets_member_key.EncodeSeekKey()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1176,10 +1264,9 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
         std::string next_member = parsed_sets_member_key.member().ToString();
-        StoreScanNextPoint(DataType::kSets, key, pattern, *next_cursor, next_member);
+        *next_cursor = StoreScanNextPoint(DataType::kSets, key, pattern, next_member);
       } else {
         *next_cursor = 0;
       }
@@ -1233,7 +1320,7 @@ rocksdb::Status Redis::SetsDel(const Slice& key) {
       uint32_t statistic = parsed_sets_meta_value.Count();
       parsed_sets_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kSetsMetaCF], base_meta_key.Encode(), meta_value);
-      UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kSets, key, statistic);
     }
   }
   return s;
@@ -1336,12 +1423,12 @@ Status Redis::SetsRename(const Slice& key, Redis* new_inst, const Slice& newkey)
     // copy a new set with newkey
     statistic = parsed_sets_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kSetsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey, statistic);
 
     // SetsDel key
     parsed_sets_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kSetsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kSets, key, statistic);
   }
   return s;
 }
@@ -1376,12 +1463,12 @@ Status Redis::SetsRenamenx(const Slice& key, Redis* new_inst, const Slice& newke
     // copy a new set with newkey
     statistic = parsed_sets_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kSetsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kSets, newkey, statistic);
 
     // SetsDel key
     parsed_sets_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kSetsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kSets, key, statistic);
   }
   return s;
 }
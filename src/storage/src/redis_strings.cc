@@ -3,12 +3,15 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <array>
+#include <cstring>
 #include <memory>
 
 #include <fmt/core.h>
 
 #include "pstd/log.h"
 #include "src/base_key_format.h"
+#include "src/bitmap_kernels.h"
 #include "src/batch.h"
 #include "src/redis.h"
 #include "src/scope_record_lock.h"
@@ -37,6 +40,9 @@ Status Redis::ScanStringsKeyNum(KeyInfo* key_info) {
   // a parameter, use the default column family
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!OwnsEntry(iter->key())) {
+      continue;
+    }
     ParsedStringsValue parsed_strings_value(iter->value());
     if (parsed_strings_value.IsStale()) {
       invaild_keys++;
@@ -135,19 +141,7 @@ Status Redis::Append(const Slice& key, const Slice& value, int32_t* ret) {
 }
 
 int GetBitCount(const unsigned char* value, int64_t bytes) {
-  int bit_num = 0;
-  static const unsigned char bitsinbyte[256] = {
-      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2,
-      3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3,
-      3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5,
-      6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4,
-      3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4,
-      5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6,
-      6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
-  for (int i = 0; i < bytes; i++) {
-    bit_num += bitsinbyte[static_cast<unsigned int>(value[i])];
-  }
-  return bit_num;
+  return static_cast<int>(BestBitmapKernels().count(value, bytes));
 }
 
 Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range) {
@@ -197,44 +191,24 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
 }
 
 std::string BitOpOperate(BitOpType op, const std::vector<std::string>& src_values, int64_t max_len) {
-  char byte;
-  char output;
-  auto dest_value = std::make_unique<char[]>(max_len);
-  for (int64_t j = 0; j < max_len; j++) {
-    if (j < static_cast<int64_t>(src_values[0].size())) {
-      output = src_values[0][j];
-    } else {
-      output = 0;
-    }
-    if (op == kBitOpNot) {
-      output = static_cast<char>(~output);
-    }
-    for (size_t i = 1; i < src_values.size(); i++) {
-      if (static_cast<int64_t>(src_values[i].size()) - 1 >= j) {
-        byte = src_values[i][j];
-      } else {
-        byte = 0;
-      }
-      switch (op) {
-        case kBitOpNot:
-          break;
-        case kBitOpAnd:
-          output = static_cast<char>(output & byte);
-          break;
-        case kBitOpOr:
-          output = static_cast<char>(output | byte);
-          break;
-        case kBitOpXor:
-          output = static_cast<char>(output ^ byte);
-          break;
-        case kBitOpDefault:
-          break;
-      }
+  // the shorter values are padded with zero bytes up to max_len
+  std::string dest_value(max_len, '\0');
+  auto dest = reinterpret_cast<uint8_t*>(dest_value.data());
+  memcpy(dest, src_values[0].data(), std::min(static_cast<int64_t>(src_values[0].size()), max_len));
+  const auto& kernels = BestBitmapKernels();
+  if (op == kBitOpNot) {
+    kernels.bitop(op, dest, nullptr, max_len);
+    return dest_value;
+  }
+
+  for (size_t i = 1; i < src_values.size(); i++) {
+    auto src_len = std::min(static_cast<int64_t>(src_values[i].size()), max_len);
+    kernels.bitop(op, dest, reinterpret_cast<const uint8_t*>(src_values[i].data()), src_len);
+    if (op == kBitOpAnd) {
+      memset(dest + src_len, 0, max_len - src_len);
     }
-    dest_value[j] = output;
   }
-  std::string dest_str(dest_value.get(), max_len);
-  return dest_str;
+  return dest_value;
 }
 
 Status Redis::BitOp(BitOpType op, const std::string& dest_key, const std::vector<std::string>& src_keys,
@@ -341,6 +315,33 @@ Status Redis::Get(const Slice& key, std::string* value) {
   return s;
 }
 
+Status Redis::LookupKeyTypes(const Slice& key, bool* is_string, uint8_t* collection_types) {
+  *is_string = false;
+  *collection_types = 0;
+
+  BaseKey base_key(key);
+  Slice encoded_key = base_key.Encode();
+  std::array<rocksdb::ColumnFamilyHandle*, 2> column_families = {handles_[kStringsCF], handles_[kTypeDirectoryCF]};
+  std::array<Slice, 2> keys = {encoded_key, encoded_key};
+  std::array<rocksdb::PinnableSlice, 2> values;
+  std::array<Status, 2> statuses;
+  db_->MultiGet(default_read_options_, keys.size(), column_families.data(), keys.data(), values.data(),
+                statuses.data());
+
+  if (statuses[0].ok()) {
+    ParsedStringsValue parsed_strings_value(Slice(values[0].data(), values[0].size()));
+    *is_string = !parsed_strings_value.IsStale();
+  } else if (!statuses[0].IsNotFound()) {
+    return statuses[0];
+  }
+  if (statuses[1].ok()) {
+    *collection_types = values[1].empty() ? 0 : static_cast<uint8_t>(values[1][0]);
+  } else if (!statuses[1].IsNotFound()) {
+    return statuses[1];
+  }
+  return Status::OK();
+}
+
 Status Redis::GetWithTTL(const Slice& key, std::string* value, uint64_t* ttl) {
   value->clear();
   BaseKey base_key(key);
@@ -888,49 +889,12 @@ Status Redis::Strlen(const Slice& key, int32_t* len) {
 }
 
 int32_t GetBitPos(const unsigned char* s, unsigned int bytes, int bit) {
-  uint64_t word = 0;
-  uint64_t skip_val = 0;
-  auto value = const_cast<unsigned char*>(s);
-  auto l = reinterpret_cast<uint64_t*>(value);
-  int pos = 0;
-  if (bit == 0) {
-    skip_val = std::numeric_limits<uint64_t>::max();
-  } else {
-    skip_val = 0;
-  }
-  // skip 8 bytes at one time, find the first int64 that should not be skipped
-  while (bytes >= sizeof(*l)) {
-    if (*l != skip_val) {
-      break;
-    }
-    l++;
-    bytes = bytes - sizeof(*l);
-    pos += static_cast<int32_t>(8 * sizeof(*l));
-  }
-  auto c = reinterpret_cast<unsigned char*>(l);
-  for (size_t j = 0; j < sizeof(*l); j++) {
-    word = word << 8;
-    if (bytes != 0U) {
-      word = word | *c;
-      c++;
-      bytes--;
-    }
-  }
-  if (bit == 1 && word == 0) {
-    return -1;
-  }
-  // set each bit of mask to 0 except msb
-  uint64_t mask = std::numeric_limits<uint64_t>::max();
-  mask = mask >> 1;
-  mask = ~(mask);
-  while (mask != 0U) {
-    if (static_cast<int>((word & mask) != 0) == bit) {
-      return pos;
-    }
-    pos++;
-    mask = mask >> 1;
+  int64_t pos = BestBitmapKernels().find_first(s, bytes, bit);
+  if (pos == -1) {
+    // no set bit is -1, no clear bit is the bit right after the range
+    return bit == 1 ? -1 : static_cast<int32_t>(bytes * 8);
   }
-  return pos;
+  return static_cast<int32_t>(pos);
 }
 
 Status Redis::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
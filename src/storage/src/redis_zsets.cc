@@ -39,6 +39,9 @@ Status Redis::ScanZsetsKeyNum(KeyInfo* key_info) {
 
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kZsetsMetaCF]);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!OwnsEntry(iter->key())) {
+      continue;
+    }
     ParsedZSetsMetaValue parsed_zsets_meta_value(iter->value());
     if (parsed_zsets_meta_value.IsStale() || parsed_zsets_meta_value.Count() == 0) {
       invaild_keys++;
@@ -126,7 +129,7 @@ Status Redis::ZPopMax(const Slice& key, const int64_t count, std::vector<ScoreMe
       num = num <= count ? num : count;
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
       int32_t del_cnt = 0;
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && del_cnt < num; iter->Prev()) {
@@ -146,7 +149,7 @@ Status Redis::ZPopMax(const Slice& key, const int64_t count, std::vector<ScoreMe
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch->Put(kZsetsMetaCF, base_meta_key.Encode(), meta_value);
       s = batch->Commit();
-      UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
       return s;
     }
   } else {
@@ -174,7 +177,7 @@ Status Redis::ZPopMin(const Slice& key, const int64_t count, std::vector<ScoreMe
       num = num <= count ? num : count;
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
       int32_t del_cnt = 0;
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && del_cnt < num; iter->Next()) {
@@ -194,7 +197,7 @@ Status Redis::ZPopMin(const Slice& key, const int64_t count, std::vector<ScoreMe
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch->Put(kZsetsMetaCF, base_meta_key.Encode(), meta_value);
       s = batch->Commit();
-      UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
       return s;
     }
   } else {
@@ -301,7 +304,7 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
     return s;
   }
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -350,7 +353,7 @@ Status Redis::ZCount(const Slice& key, double min, double max, bool left_close,
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -448,7 +451,7 @@ Status Redis::ZIncrby(const Slice& key, const Slice& member, double increment, d
   batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), zsets_score_i_val.Encode());
   *ret = score;
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -483,7 +486,7 @@ Status Redis::ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<
       ScoreMember score_member;
 
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
@@ -540,7 +543,7 @@ Status Redis::ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::
       int32_t cur_index = 0;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
@@ -581,7 +584,7 @@ Status Redis::ZRangebyscore(const Slice& key, double min, double max, bool left_
       int64_t skipped = 0;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && index <= stop_index; iter->Next(), ++index) {
         bool left_pass = false;
@@ -648,7 +651,7 @@ Status Redis::ZRank(const Slice& key, const Slice& member, int32_t* rank) {
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && index <= stop_index; iter->Next(), ++index) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -727,7 +730,7 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -760,7 +763,7 @@ Status Redis::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int
         return s;
       }
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
@@ -784,7 +787,7 @@ Status Redis::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -811,7 +814,7 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -854,7 +857,7 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -888,7 +891,7 @@ Status Redis::ZRevrange(const Slice& key, int32_t start, int32_t stop, std::vect
       int32_t cur_index = count - 1;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && cur_index >= start_index;
            iter->Prev(), --cur_index) {
@@ -929,7 +932,7 @@ Status Redis::ZRevrangebyscore(const Slice& key, double min, double max, bool le
       int64_t skipped = 0;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::nextafter(max, std::numeric_limits<double>::max()), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && left > 0; iter->Prev(), --left) {
         bool left_pass = false;
@@ -995,7 +998,7 @@ Status Redis::ZRevrank(const Slice& key, const Slice& member, int32_t* rank) {
       int32_t left = parsed_zsets_meta_value.Count();
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && left >= 0; iter->Prev(), --left, ++rev_index) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -1182,7 +1185,7 @@ Status Redis::ZUnionstore(const Slice& destination, const std::vector<std::strin
   }
   *ret = static_cast<int32_t>(member_score_map.size());
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kZSets, destination.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, destination, statistic);
   value_to_dest = std::move(member_score_map);
   return s;
 }
@@ -1319,11 +1322,105 @@ Status Redis::ZInterstore(const Slice& destination, const std::vector<std::strin
   }
   *ret = static_cast<int32_t>(final_score_members.size());
   s = batch->Commit();
-  UpdateSpecificKeyStatistics(DataType::kZSets, destination.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, destination, statistic);
   value_to_dest = std::move(final_score_members);
   return s;
 }
 
+Status Redis::ZsetsStore(const Slice& destination, const ScoreMemberSource& source, int32_t* ret) {
+  *ret = 0;
+  uint32_t statistic = 0;
+  uint64_t version = 0;
+  std::string meta_value;
+  std::string origin_value;
+  ScopeRecordLock l(lock_mgr_, destination);
+
+  bool live = false;
+  BaseMetaKey base_destination(destination);
+  Status s = db_->Get(default_read_options_, handles_[kZsetsMetaCF], base_destination.Encode(), &meta_value);
+  if (s.ok()) {
+    origin_value = meta_value;
+    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+    statistic = parsed_zsets_meta_value.Count();
+    live = parsed_zsets_meta_value.IsValid();
+    version = parsed_zsets_meta_value.InitialMetaValue();
+  } else if (s.IsNotFound()) {
+    char buf[4];
+    EncodeFixed32(buf, 0);
+    ZSetsMetaValue zsets_meta_value(Slice(buf, sizeof(int32_t)));
+    version = zsets_meta_value.UpdateVersion();
+    meta_value = zsets_meta_value.Encode().ToString();
+  } else {
+    return s;
+  }
+
+  // As in SetsStore, the members and scores are staged under the new version
+  // marked in the meta value, and only the last batch writes the meta value
+  int32_t count = 0;
+  bool staged = false;
+  auto batch = Batch::CreateBatch(this);
+  auto stage = [&]() {
+    if (!staged) {
+      std::string staging_value = live ? origin_value : meta_value;
+      ParsedZSetsMetaValue parsed_staging_value(&staging_value);
+      parsed_staging_value.SetStagingVersion(version);
+      batch->Put(kZsetsMetaCF, base_destination.Encode(), staging_value);
+      staged = true;
+    }
+    Status commit_s = batch->Commit();
+    batch = Batch::CreateBatch(this);
+    return commit_s;
+  };
+
+  char score_buf[8];
+  s = source([&](const Slice& member, double score) {
+    if (count == INT32_MAX) {
+      return Status::InvalidArgument("zset size overflow");
+    }
+    ZSetsMemberKey zsets_member_key(destination, version, member);
+    const void* ptr_score = reinterpret_cast<const void*>(&score);
+    EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
+    BaseDataValue member_i_val(Slice(score_buf, sizeof(uint64_t)));
+    batch->Put(kZsetsDataCF, zsets_member_key.Encode(), member_i_val.Encode());
+
+    ZSetsScoreKey zsets_score_key(destination, version, score, member);
+    BaseDataValue score_i_val(Slice{});
+    batch->Put(kZsetsScoreCF, zsets_score_key.Encode(), score_i_val.Encode());
+    count++;
+    if (static_cast<size_t>(batch->Count()) >= STORE_BATCH_LIMIT) {
+      return stage();
+    }
+    return Status::OK();
+  });
+  if (s.ok() && count == 0 && origin_value.empty()) {
+    return s;  // nothing to store into a missing destination
+  }
+  if (s.ok()) {
+    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+    parsed_zsets_meta_value.SetCount(count);
+    batch->Put(kZsetsMetaCF, base_destination.Encode(), meta_value);
+    s = batch->Commit();
+  }
+  if (!s.ok()) {
+    if (staged) {
+      auto undo = Batch::CreateBatch(this);
+      if (origin_value.empty()) {
+        undo->Delete(kZsetsMetaCF, base_destination.Encode());
+      } else {
+        ParsedZSetsMetaValue parsed_origin_value(&origin_value);
+        parsed_origin_value.SetStagingVersion(0);
+        undo->Put(kZsetsMetaCF, base_destination.Encode(), origin_value);
+      }
+      undo->Commit();
+    }
+    return s;
+  }
+
+  *ret = count;
+  UpdateSpecificKeyStatistics(DataType::kZSets, destination, statistic);
+  return s;
+}
+
 Status Redis::ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                           std::vector<std::string>* members) {
   members->clear();
@@ -1348,7 +1445,7 @@ Status Redis::ZRangebylex(const Slice& key, const Slice& min, const Slice& max,
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       ZSetsMemberKey zsets_member_key(key, version, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -1411,7 +1508,7 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       ZSetsMemberKey zsets_member_key(key, version, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -1454,7 +1551,7 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+  UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   return s;
 }
 
@@ -1498,7 +1595,7 @@ Status Redis::ZsetsDel(const Slice& key) {
       uint32_t statistic = parsed_zsets_meta_value.Count();
       parsed_zsets_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kZsetsMetaCF], base_meta_key.Encode(), meta_value);
-      UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+      UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
     }
   }
   return s;
@@ -1538,7 +1635,6 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
   }
 
   int64_t rest = count;
-  int64_t step_length = count;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
 
@@ -1559,7 +1655,6 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
       uint64_t version = parsed_zsets_meta_value.Version();
       s = GetScanStartPoint(DataType::kZSets, key, pattern, cursor, &start_point);
       if (s.IsNotFound()) {
-        cursor = 0;
         if (isTailWildcard(pattern)) {
           start_point = pattern.substr(0, pattern.size() - 1);
         }
@@ -1571,7 +1666,7 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
       ZSetsMemberKey zsets_member_prefix(key, version, sub_member);
       ZSetsMemberKey zsets_member_key(key, version, start_point);
       std::string prefix = zsets_member_prefix.EncodeSeekKey().ToString();
-      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      KeyStatisticsDurationGuard guard(this, DataType::kZSets, key);
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1588,10 +1683,9 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
       }
 
       if (iter->Valid() && (iter->key().compare(prefix) <= 0 || iter->key().starts_with(prefix))) {
-        *next_cursor = cursor + step_length;
         ParsedZSetsMemberKey parsed_zsets_member_key(iter->key());
         std::string next_member = parsed_zsets_member_key.member().ToString();
-        StoreScanNextPoint(DataType::kZSets, key, pattern, *next_cursor, next_member);
+        *next_cursor = StoreScanNextPoint(DataType::kZSets, key, pattern, next_member);
       } else {
         *next_cursor = 0;
       }
@@ -1677,12 +1771,12 @@ Status Redis::ZsetsRename(const Slice& key, Redis* new_inst, const Slice& newkey
     // copy a new zset with newkey
     statistic = parsed_zsets_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kZsetsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey, statistic);
 
     // ZsetsDel key
     parsed_zsets_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kZsetsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   }
   return s;
 }
@@ -1717,12 +1811,12 @@ Status Redis::ZsetsRenamenx(const Slice& key, Redis* new_inst, const Slice& newk
     // copy a new zset with newkey
     statistic = parsed_zsets_meta_value.Count();
     s = new_inst->GetDB()->Put(default_write_options_, handles_[kZsetsMetaCF], base_meta_newkey.Encode(), meta_value);
-    new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey.ToString(), statistic);
+    new_inst->UpdateSpecificKeyStatistics(DataType::kZSets, newkey, statistic);
 
     // ZsetsDel key
     parsed_zsets_meta_value.InitialMetaValue();
     s = db_->Put(default_write_options_, handles_[kZsetsMetaCF], base_meta_key.Encode(), meta_value);
-    UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
+    UpdateSpecificKeyStatistics(DataType::kZSets, key, statistic);
   }
   return s;
 }
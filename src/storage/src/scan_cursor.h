@@ -0,0 +1,97 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SCAN_CURSOR_H_
+#define SRC_SCAN_CURSOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "rocksdb/slice.h"
+
+namespace storage {
+
+using Slice = rocksdb::Slice;
+
+/*
+ * A SCAN cursor carries the position the scan stopped at, so a scan can go on
+ * even when the exact position is no longer remembered by the cursor store:
+ *
+ *   | 0 (1b) | type index (3b) | prefix length (3b) | key prefix (40b) | id (17b) |
+ *
+ * The key prefix is the first kMaxPrefixLength bytes of the next key, seeking
+ * to it never skips a key that was not returned yet, at worst some keys are
+ * returned twice, which SCAN allows. A scan resumed from the prefix still
+ * stops after COUNT keys, the cursor it returns re-seeks the prefix only if it
+ * is evicted as well. The id is never 0, so a cursor is never mistaken for the
+ * start of a scan, and it tells apart the cursors of clients stopping at keys
+ * sharing a prefix.
+ */
+class ScanCursor {
+ public:
+  static constexpr size_t kMaxPrefixLength = 5;
+
+  ScanCursor() = default;
+  ScanCursor(int type_index, const Slice& next_key)
+      : type_index_(type_index), prefix_(next_key.data(), std::min(next_key.size(), kMaxPrefixLength)) {}
+
+  // Returns false if cursor was not built by Encode()
+  bool Decode(int64_t cursor) {
+    if (cursor <= 0 || (cursor & kIdMask) == 0) {
+      return false;
+    }
+    auto value = static_cast<uint64_t>(cursor);
+    type_index_ = static_cast<int>((value >> kTypeShift) & 0x7);
+    size_t len = (value >> kLengthShift) & 0x7;
+    if (len > kMaxPrefixLength) {
+      return false;
+    }
+    prefix_.clear();
+    for (size_t i = 0; i < len; i++) {
+      prefix_.push_back(static_cast<char>((value >> (kPrefixShift + (kMaxPrefixLength - 1 - i) * 8)) & 0xff));
+    }
+    return true;
+  }
+
+  // Each call returns a new cursor for the same position
+  int64_t Encode() const {
+    uint64_t value = static_cast<uint64_t>(type_index_ & 0x7) << kTypeShift;
+    value |= static_cast<uint64_t>(prefix_.size()) << kLengthShift;
+    for (size_t i = 0; i < prefix_.size(); i++) {
+      auto byte = static_cast<uint64_t>(static_cast<uint8_t>(prefix_[i]));
+      value |= byte << (kPrefixShift + (kMaxPrefixLength - 1 - i) * 8);
+    }
+    value |= NextId();
+    return static_cast<int64_t>(value);
+  }
+
+  int type_index() const { return type_index_; }
+
+  // Never greater than the key the scan stopped at
+  const std::string& prefix() const { return prefix_; }
+
+  // Whether key may be the position this cursor was built for
+  bool Matches(const Slice& key) const { return key.starts_with(prefix_); }
+
+ private:
+  static constexpr int kPrefixShift = 17;
+  static constexpr int kLengthShift = kPrefixShift + 8 * kMaxPrefixLength;
+  static constexpr int kTypeShift = kLengthShift + 3;
+  static constexpr uint64_t kIdMask = (1ULL << kPrefixShift) - 1;
+
+  static uint64_t NextId() {
+    static std::atomic<uint64_t> next_id{0};
+    return next_id.fetch_add(1, std::memory_order_relaxed) % kIdMask + 1;
+  }
+
+  int type_index_ = 0;
+  std::string prefix_;
+};
+
+}  // namespace storage
+
+#endif  // SRC_SCAN_CURSOR_H_
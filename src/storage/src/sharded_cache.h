@@ -0,0 +1,268 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SHARDED_CACHE_H_
+#define SRC_SHARDED_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "rocksdb/status.h"
+
+#include "pstd/pstd_mutex.h"
+
+namespace storage {
+
+/*
+ * A bounded cache of string keys split into shards, each with its own mutex,
+ * so that threads working on different keys seldom wait for each other.
+ *
+ * Each shard evicts with CLOCK: an entry is marked referenced when it is
+ * read or updated and the hand of the shard skips (and unmarks) referenced
+ * entries, a hit only sets a flag instead of moving the entry in a list.
+ *
+ * Keys are looked up as std::string_view, a string is only allocated when a
+ * new entry is inserted. The capacity is split evenly between the shards,
+ * so the cache holds up to kDefaultShards - 1 entries more than asked.
+ */
+template <typename V>
+class ShardedCache {
+ public:
+  static constexpr size_t kDefaultShards = 16;
+
+  // num_shards is rounded up to a power of two
+  explicit ShardedCache(size_t num_shards = kDefaultShards);
+
+  size_t Size();
+  size_t TotalCharge();
+  size_t Capacity();
+  void SetCapacity(size_t capacity);
+
+  rocksdb::Status Lookup(std::string_view key, V* value);
+  rocksdb::Status Insert(std::string_view key, const V& value, size_t charge = 1);
+  rocksdb::Status Remove(std::string_view key);
+  rocksdb::Status Clear();
+
+  // Calls update on the value of key, inserted as V() first if absent, under
+  // the lock of its shard, so read-modify-write needs a single lookup.
+  template <typename F>
+  rocksdb::Status Update(std::string_view key, F&& update, size_t charge = 1);
+
+ private:
+  struct Hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+  };
+
+  struct Entry;
+  using Table = std::unordered_map<std::string, Entry, Hash, std::equal_to<>>;
+  using Node = typename Table::value_type;
+  // Nodes of an unordered_map stay in place on rehash
+  using Clock = std::list<Node*>;
+
+  struct Entry {
+    V value;
+    size_t charge = 0;
+    bool referenced = false;
+    typename Clock::iterator clock_pos;
+  };
+
+  struct Shard {
+    pstd::Mutex mutex;
+    size_t capacity = 0;
+    size_t usage = 0;
+    Table table;
+    // Entries in the order the hand visits them, new ones are put right behind the hand
+    Clock clock;
+    typename Clock::iterator hand = clock.end();
+
+    Node* Find(std::string_view key);
+    // key must not be in the table yet
+    Node* Emplace(std::string_view key, size_t charge);
+    void Erase(Node* node);
+    void Trim();
+  };
+
+  Shard& GetShard(std::string_view key) { return shards_[Hash{}(key) & shard_mask_]; }
+
+  std::atomic<size_t> capacity_ = 0;
+  size_t shard_mask_ = 0;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+template <typename V>
+ShardedCache<V>::ShardedCache(size_t num_shards) {
+  size_t shards = 1;
+  while (shards < num_shards) {
+    shards <<= 1;
+  }
+  shard_mask_ = shards - 1;
+  shards_ = std::make_unique<Shard[]>(shards);
+}
+
+template <typename V>
+size_t ShardedCache<V>::Size() {
+  size_t size = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    std::lock_guard l(shards_[i].mutex);
+    size += shards_[i].table.size();
+  }
+  return size;
+}
+
+template <typename V>
+size_t ShardedCache<V>::TotalCharge() {
+  size_t usage = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    std::lock_guard l(shards_[i].mutex);
+    usage += shards_[i].usage;
+  }
+  return usage;
+}
+
+template <typename V>
+size_t ShardedCache<V>::Capacity() {
+  return capacity_.load(std::memory_order_relaxed);
+}
+
+template <typename V>
+void ShardedCache<V>::SetCapacity(size_t capacity) {
+  size_t shard_capacity = (capacity + shard_mask_) / (shard_mask_ + 1);
+  capacity_.store(capacity, std::memory_order_relaxed);
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    std::lock_guard l(shards_[i].mutex);
+    shards_[i].capacity = shard_capacity;
+    shards_[i].Trim();
+  }
+}
+
+template <typename V>
+rocksdb::Status ShardedCache<V>::Lookup(std::string_view key, V* const value) {
+  Shard& shard = GetShard(key);
+  std::lock_guard l(shard.mutex);
+  Node* node = shard.Find(key);
+  if (!node) {
+    return rocksdb::Status::NotFound();
+  }
+  node->second.referenced = true;
+  *value = node->second.value;
+  return rocksdb::Status::OK();
+}
+
+template <typename V>
+rocksdb::Status ShardedCache<V>::Insert(std::string_view key, const V& value, size_t charge) {
+  Shard& shard = GetShard(key);
+  std::lock_guard l(shard.mutex);
+  if (shard.capacity == 0) {
+    return rocksdb::Status::Corruption("capacity is empty");
+  }
+  Node* node = shard.Find(key);
+  if (node) {
+    shard.usage -= node->second.charge;
+    node->second.charge = charge;
+    node->second.referenced = true;
+    shard.usage += charge;
+  } else {
+    node = shard.Emplace(key, charge);
+  }
+  node->second.value = value;
+  shard.Trim();
+  return rocksdb::Status::OK();
+}
+
+template <typename V>
+template <typename F>
+rocksdb::Status ShardedCache<V>::Update(std::string_view key, F&& update, size_t charge) {
+  Shard& shard = GetShard(key);
+  std::lock_guard l(shard.mutex);
+  if (shard.capacity == 0) {
+    return rocksdb::Status::Corruption("capacity is empty");
+  }
+  Node* node = shard.Find(key);
+  if (node) {
+    node->second.referenced = true;
+  } else {
+    node = shard.Emplace(key, charge);
+  }
+  update(node->second.value);
+  shard.Trim();
+  return rocksdb::Status::OK();
+}
+
+template <typename V>
+rocksdb::Status ShardedCache<V>::Remove(std::string_view key) {
+  Shard& shard = GetShard(key);
+  std::lock_guard l(shard.mutex);
+  Node* node = shard.Find(key);
+  if (!node) {
+    return rocksdb::Status::NotFound();
+  }
+  shard.Erase(node);
+  return rocksdb::Status::OK();
+}
+
+template <typename V>
+rocksdb::Status ShardedCache<V>::Clear() {
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    std::lock_guard l(shards_[i].mutex);
+    shards_[i].table.clear();
+    shards_[i].clock.clear();
+    shards_[i].hand = shards_[i].clock.end();
+    shards_[i].usage = 0;
+  }
+  return rocksdb::Status::OK();
+}
+
+template <typename V>
+typename ShardedCache<V>::Node* ShardedCache<V>::Shard::Find(std::string_view key) {
+  auto iter = table.find(key);
+  return iter == table.end() ? nullptr : &*iter;
+}
+
+template <typename V>
+typename ShardedCache<V>::Node* ShardedCache<V>::Shard::Emplace(std::string_view key, size_t charge) {
+  Node* node = &*table.try_emplace(std::string(key)).first;
+  node->second.charge = charge;
+  node->second.referenced = true;
+  node->second.clock_pos = clock.insert(hand, node);
+  usage += charge;
+  return node;
+}
+
+template <typename V>
+void ShardedCache<V>::Shard::Erase(Node* node) {
+  if (hand == node->second.clock_pos) {
+    ++hand;
+  }
+  clock.erase(node->second.clock_pos);
+  usage -= node->second.charge;
+  table.erase(table.find(node->first));
+}
+
+template <typename V>
+void ShardedCache<V>::Shard::Trim() {
+  while (usage > capacity && !clock.empty()) {
+    if (hand == clock.end()) {
+      hand = clock.begin();
+    }
+    Node* node = *hand;
+    if (node->second.referenced) {
+      node->second.referenced = false;
+      ++hand;
+    } else {
+      Erase(node);
+    }
+  }
+}
+
+}  //  namespace storage
+#endif  // SRC_SHARDED_CACHE_H_
@@ -0,0 +1,202 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/slot_indexer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+#include <utility>
+
+#include "fmt/core.h"
+#include "rocksdb/env.h"
+
+namespace storage {
+
+// File format: the number of slots, then the instance of each slot, separated
+// by spaces. A second line has the number of migrating slots, then the slot and
+// the instance marked for each of them, tables saved before it have none.
+
+SlotIndexer::SlotIndexer(int32_t inst_num) : inst_num_(inst_num) {
+  assert(inst_num > 0);
+  slot_num_ = static_cast<uint32_t>(inst_num) * kSlotsPerInstance;
+  table_ = std::make_unique<std::atomic<uint32_t>[]>(slot_num_);
+  for (uint32_t slot = 0; slot < slot_num_; slot++) {
+    table_[slot].store(slot % inst_num_, std::memory_order_relaxed);
+  }
+  slot_mutexes_ = std::make_unique<std::shared_mutex[]>(slot_num_);
+  migrating_.assign(slot_num_, kNotMigrating);
+}
+
+rocksdb::Status SlotIndexer::Open(const std::string& db_path) {
+  path_ = db_path + "/" + kTableFile;
+  auto env = rocksdb::Env::Default();
+  if (!env->FileExists(path_).ok()) {
+    std::lock_guard lock(mutex_);
+    return Save();
+  }
+
+  std::string data;
+  auto s = rocksdb::ReadFileToString(env, path_, &data);
+  if (!s.ok()) {
+    return s;
+  }
+  std::istringstream in(data);
+  uint32_t slot_num = 0;
+  if (!(in >> slot_num) || slot_num == 0) {
+    return rocksdb::Status::Corruption("bad slot table " + path_);
+  }
+  auto table = std::make_unique<std::atomic<uint32_t>[]>(slot_num);
+  for (uint32_t slot = 0; slot < slot_num; slot++) {
+    uint32_t inst_id = 0;
+    if (!(in >> inst_id)) {
+      return rocksdb::Status::Corruption("bad slot table " + path_);
+    }
+    if (inst_id >= static_cast<uint32_t>(inst_num_)) {
+      return rocksdb::Status::InvalidArgument(
+          fmt::format("slot {} belongs to instance {}, only {} instances are opened", slot, inst_id, inst_num_));
+    }
+    table[slot].store(inst_id, std::memory_order_relaxed);
+  }
+  std::vector<int32_t> migrating(slot_num, kNotMigrating);
+  uint32_t migrating_num = 0;
+  if (in >> migrating_num) {
+    for (uint32_t i = 0; i < migrating_num; i++) {
+      uint32_t slot = 0;
+      uint32_t inst_id = 0;
+      if (!(in >> slot >> inst_id) || slot >= slot_num || inst_id >= static_cast<uint32_t>(inst_num_)) {
+        return rocksdb::Status::Corruption("bad migrating slots in slot table " + path_);
+      }
+      migrating[slot] = static_cast<int32_t>(inst_id);
+    }
+  }
+  if (slot_num != slot_num_) {
+    slot_mutexes_ = std::make_unique<std::shared_mutex[]>(slot_num);
+  }
+  slot_num_ = slot_num;
+  table_ = std::move(table);
+  migrating_ = std::move(migrating);
+  migrating_num_.store(
+      static_cast<uint32_t>(std::count_if(migrating_.begin(), migrating_.end(),
+                                          [](int32_t inst_id) { return inst_id != kNotMigrating; })),
+      std::memory_order_release);
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status SlotIndexer::MoveSlot(uint32_t slot, uint32_t inst_id) {
+  assert(slot < slot_num_ && inst_id < static_cast<uint32_t>(inst_num_));
+  std::lock_guard lock(mutex_);
+  uint32_t old_inst_id = table_[slot].exchange(inst_id, std::memory_order_acq_rel);
+  int32_t old_migrating = std::exchange(migrating_[slot], static_cast<int32_t>(old_inst_id));
+  if (old_migrating == kNotMigrating) {
+    migrating_num_.fetch_add(1, std::memory_order_acq_rel);
+  }
+  auto s = Save();
+  if (!s.ok()) {
+    table_[slot].store(old_inst_id, std::memory_order_release);
+    migrating_[slot] = old_migrating;
+    if (old_migrating == kNotMigrating) {
+      migrating_num_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  }
+  return s;
+}
+
+std::vector<uint32_t> SlotIndexer::GetSlotsOfInstance(uint32_t inst_id) const {
+  std::vector<uint32_t> slots;
+  for (uint32_t slot = 0; slot < slot_num_; slot++) {
+    if (table_[slot].load(std::memory_order_acquire) == inst_id) {
+      slots.push_back(slot);
+    }
+  }
+  return slots;
+}
+
+rocksdb::Status SlotIndexer::MarkMigrating(const std::vector<bool>& slots, uint32_t inst_id) {
+  assert(inst_id < static_cast<uint32_t>(inst_num_));
+  std::lock_guard lock(mutex_);
+  auto old_migrating = migrating_;
+  uint32_t marked = 0;
+  for (uint32_t slot = 0; slot < slots.size() && slot < slot_num_; slot++) {
+    if (!slots[slot]) {
+      continue;
+    }
+    if (migrating_[slot] == kNotMigrating) {
+      marked++;
+    }
+    migrating_[slot] = static_cast<int32_t>(inst_id);
+  }
+  // marked before the copies are written, a scan seeing them filters them out
+  migrating_num_.fetch_add(marked, std::memory_order_acq_rel);
+  auto s = Save();
+  if (!s.ok()) {
+    migrating_ = std::move(old_migrating);
+    migrating_num_.fetch_sub(marked, std::memory_order_acq_rel);
+  }
+  return s;
+}
+
+rocksdb::Status SlotIndexer::UnmarkMigrating(const std::vector<bool>& slots) {
+  std::lock_guard lock(mutex_);
+  auto old_migrating = migrating_;
+  uint32_t unmarked = 0;
+  for (uint32_t slot = 0; slot < slots.size() && slot < slot_num_; slot++) {
+    if (slots[slot] && migrating_[slot] != kNotMigrating) {
+      migrating_[slot] = kNotMigrating;
+      unmarked++;
+    }
+  }
+  if (unmarked == 0) {
+    return rocksdb::Status::OK();
+  }
+  auto s = Save();
+  if (!s.ok()) {
+    migrating_ = std::move(old_migrating);
+    return s;
+  }
+  migrating_num_.fetch_sub(unmarked, std::memory_order_acq_rel);
+  return s;
+}
+
+std::vector<std::vector<bool>> SlotIndexer::GetMigratingSlots() const {
+  std::lock_guard lock(mutex_);
+  std::vector<std::vector<bool>> slots(inst_num_);
+  for (uint32_t slot = 0; slot < slot_num_; slot++) {
+    if (migrating_[slot] == kNotMigrating) {
+      continue;
+    }
+    auto& inst_slots = slots[migrating_[slot]];
+    inst_slots.resize(slot_num_);
+    inst_slots[slot] = true;
+  }
+  return slots;
+}
+
+rocksdb::Status SlotIndexer::Save() const {
+  std::string data = std::to_string(slot_num_) + "\n";
+  for (uint32_t slot = 0; slot < slot_num_; slot++) {
+    data.append(std::to_string(table_[slot].load(std::memory_order_acquire)));
+    data.push_back(slot + 1 == slot_num_ ? '\n' : ' ');
+  }
+  std::string marks;
+  uint32_t migrating_num = 0;
+  for (uint32_t slot = 0; slot < slot_num_; slot++) {
+    if (migrating_[slot] != kNotMigrating) {
+      marks.append(fmt::format(" {} {}", slot, migrating_[slot]));
+      migrating_num++;
+    }
+  }
+  data.append(std::to_string(migrating_num) + marks + "\n");
+  // Written aside and renamed, a crash leaves either table
+  auto env = rocksdb::Env::Default();
+  std::string tmp_path = path_ + ".tmp";
+  auto s = rocksdb::WriteStringToFile(env, data, tmp_path, true);
+  if (!s.ok()) {
+    return s;
+  }
+  return env->RenameFile(tmp_path, path_);
+}
+
+}  // namespace storage
@@ -0,0 +1,330 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/slot_migration.h"
+
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#include "rocksdb/snapshot.h"
+
+#include "pstd/pikiwidb_slot.h"
+#include "src/base_key_format.h"
+#include "src/coding.h"
+#include "src/redis.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+namespace {
+
+// Entries put into a batch before it is written while copying or deleting slots
+constexpr uint32_t kMigrateBatchSize = 1024;
+
+// The reserve1 and encoded user key that every key of a user key starts with, empty if key is malformed
+Slice EntryKeyPrefix(const Slice& key) {
+  if (key.size() <= kPrefixReserveLength) {
+    return {};
+  }
+  const char* start = key.data() + kPrefixReserveLength;
+  const char* end = SeekUserkeyDelim(start, static_cast<int>(key.size() - kPrefixReserveLength));
+  if (end == start) {
+    return {};
+  }
+  return {key.data(), static_cast<size_t>(end - key.data())};
+}
+
+// Where the keys starting with prefix begin in column family cf_idx
+std::string SeekTarget(size_t cf_idx, const Slice& prefix) {
+  std::string target = prefix.ToString();
+  if (cf_idx == kZsetsScoreCF) {
+    // the score comparator reads a version and a score after the user key
+    char buf[kVersionLength + kScoreLength] = {0};
+    double lowest = -std::numeric_limits<double>::infinity();
+    uint64_t score = 0;
+    memcpy(&score, &lowest, sizeof(score));
+    EncodeFixed64(buf + kVersionLength, score);
+    target.append(buf, sizeof(buf));
+  }
+  return target;
+}
+
+// Collects the keys written by a batch
+class WrittenKeyCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  explicit WrittenKeyCollector(std::vector<Slice>* keys) : keys_(keys) {}
+
+  rocksdb::Status PutCF(uint32_t, const rocksdb::Slice& key, const rocksdb::Slice&) override { return Add(key); }
+  rocksdb::Status DeleteCF(uint32_t, const rocksdb::Slice& key) override { return Add(key); }
+  rocksdb::Status SingleDeleteCF(uint32_t, const rocksdb::Slice& key) override { return Add(key); }
+  rocksdb::Status DeleteRangeCF(uint32_t, const rocksdb::Slice& begin_key, const rocksdb::Slice&) override {
+    return Add(begin_key);
+  }
+  rocksdb::Status MergeCF(uint32_t, const rocksdb::Slice& key, const rocksdb::Slice&) override { return Add(key); }
+
+ private:
+  rocksdb::Status Add(const rocksdb::Slice& key) {
+    keys_->push_back(key);
+    return rocksdb::Status::OK();
+  }
+
+  std::vector<Slice>* keys_;
+};
+
+// Calls fn with the entries of the keys in slots and their slot, in every column family as of snapshot
+Status ForEachEntryOfSlots(
+    Redis* inst, const std::vector<bool>& slots, const rocksdb::Snapshot* snapshot,
+    const std::function<Status(uint32_t slot, size_t cf_idx, const Slice& key, const Slice& value)>& fn) {
+  auto db = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.fill_cache = false;
+
+  std::string user_key;
+  for (size_t cf_idx = 0; cf_idx < handles.size(); cf_idx++) {
+    std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(read_options, handles[cf_idx]));
+    // the entries of a user key are adjacent, its slot is computed once
+    std::string last_prefix;
+    uint32_t slot = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice prefix = EntryKeyPrefix(iter->key());
+      if (prefix.empty()) {
+        continue;
+      }
+      if (prefix != last_prefix) {
+        last_prefix.assign(prefix.data(), prefix.size());
+        DecodeKeyOfEntry(iter->key(), &user_key);
+        slot = GetSlotID(user_key) % slots.size();
+      }
+      if (!slots[slot]) {
+        continue;
+      }
+      Status s = fn(slot, cf_idx, iter->key(), iter->value());
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
+bool DecodeKeyOfEntry(const Slice& key, std::string* user_key) {
+  Slice prefix = EntryKeyPrefix(key);
+  if (prefix.empty()) {
+    return false;
+  }
+  DecodeUserKey(prefix.data() + kPrefixReserveLength, static_cast<int>(prefix.size() - kPrefixReserveLength),
+                user_key);
+  return true;
+}
+
+rocksdb::Status SlotTrackingDB::Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                                    const rocksdb::Slice& key, const rocksdb::Slice& value) {
+  auto s = rocksdb::StackableDB::Put(options, column_family, key, value);
+  Track(key);
+  return s;
+}
+
+rocksdb::Status SlotTrackingDB::Delete(const rocksdb::WriteOptions& options,
+                                       rocksdb::ColumnFamilyHandle* column_family, const rocksdb::Slice& key) {
+  auto s = rocksdb::StackableDB::Delete(options, column_family, key);
+  Track(key);
+  return s;
+}
+
+rocksdb::Status SlotTrackingDB::SingleDelete(const rocksdb::WriteOptions& options,
+                                             rocksdb::ColumnFamilyHandle* column_family, const rocksdb::Slice& key) {
+  auto s = rocksdb::StackableDB::SingleDelete(options, column_family, key);
+  Track(key);
+  return s;
+}
+
+rocksdb::Status SlotTrackingDB::Merge(const rocksdb::WriteOptions& options,
+                                      rocksdb::ColumnFamilyHandle* column_family, const rocksdb::Slice& key,
+                                      const rocksdb::Slice& value) {
+  auto s = rocksdb::StackableDB::Merge(options, column_family, key, value);
+  Track(key);
+  return s;
+}
+
+rocksdb::Status SlotTrackingDB::Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) {
+  auto s = rocksdb::StackableDB::Write(options, updates);
+  if (tracking_.load()) {
+    std::vector<Slice> keys;
+    WrittenKeyCollector collector(&keys);
+    updates->Iterate(&collector);
+    for (const auto& key : keys) {
+      Track(key);
+    }
+  }
+  return s;
+}
+
+void SlotTrackingDB::StartTracking(const std::vector<bool>& slots) {
+  std::lock_guard lock(mutex_);
+  slots_ = slots;
+  written_keys_.clear();
+  tracking_.store(true);
+}
+
+void SlotTrackingDB::StopTracking(uint32_t slot) {
+  std::lock_guard lock(mutex_);
+  if (slot < slots_.size()) {
+    slots_[slot] = false;
+  }
+  written_keys_.erase(slot);
+}
+
+void SlotTrackingDB::StopTracking() {
+  std::lock_guard lock(mutex_);
+  tracking_.store(false);
+  slots_.clear();
+  written_keys_.clear();
+}
+
+std::vector<std::string> SlotTrackingDB::TakeWrittenKeys(uint32_t slot) {
+  std::lock_guard lock(mutex_);
+  auto iter = written_keys_.find(slot);
+  if (iter == written_keys_.end()) {
+    return {};
+  }
+  std::vector<std::string> keys(iter->second.begin(), iter->second.end());
+  written_keys_.erase(iter);
+  return keys;
+}
+
+size_t SlotTrackingDB::WrittenKeyCount() const {
+  std::lock_guard lock(mutex_);
+  size_t count = 0;
+  for (const auto& [slot, keys] : written_keys_) {
+    count += keys.size();
+  }
+  return count;
+}
+
+void SlotTrackingDB::Track(const rocksdb::Slice& key) {
+  if (!tracking_.load()) {
+    return;
+  }
+  std::string user_key;
+  if (!DecodeKeyOfEntry(key, &user_key)) {
+    return;
+  }
+  std::lock_guard lock(mutex_);
+  if (slots_.empty()) {
+    return;
+  }
+  uint32_t slot = GetSlotID(user_key) % slots_.size();
+  if (slots_[slot]) {
+    written_keys_[slot].insert(std::move(user_key));
+  }
+}
+
+Status CopySlots(Redis* src, const std::vector<Redis*>& dsts, const rocksdb::Snapshot* snapshot) {
+  std::vector<bool> slots(dsts.size());
+  for (size_t slot = 0; slot < dsts.size(); slot++) {
+    slots[slot] = dsts[slot] != nullptr;
+  }
+  // A batch per destination, filled in a single pass over src
+  std::unordered_map<Redis*, rocksdb::WriteBatch> batches;
+  auto write = [](Redis* dst, rocksdb::WriteBatch* batch) {
+    Status s = dst->GetDB()->Write(rocksdb::WriteOptions(), batch);
+    batch->Clear();
+    return s;
+  };
+  // The meta column family of a type comes before its data ones, data is
+  // never copied without its meta value which the compaction filters look for
+  auto copy = [&](uint32_t slot, size_t cf_idx, const Slice& key, const Slice& value) {
+    Redis* dst = dsts[slot];
+    auto& batch = batches[dst];
+    batch.Put(dst->GetColumnFamilyHandles()[cf_idx], key, value);
+    return batch.Count() < kMigrateBatchSize ? Status::OK() : write(dst, &batch);
+  };
+  Status s = ForEachEntryOfSlots(src, slots, snapshot, copy);
+  for (auto& [dst, batch] : batches) {
+    if (s.ok() && batch.Count() != 0) {
+      s = write(dst, &batch);
+    }
+  }
+  return s;
+}
+
+Status CopyKeys(Redis* src, Redis* dst, const std::vector<std::string>& keys) {
+  if (keys.empty()) {
+    return Status::OK();
+  }
+  rocksdb::ManagedSnapshot snapshot(src->GetDB());
+  rocksdb::ReadOptions src_read_options;
+  src_read_options.snapshot = snapshot.snapshot();
+  rocksdb::ReadOptions dst_read_options;
+  const auto& src_handles = src->GetColumnFamilyHandles();
+  const auto& dst_handles = dst->GetColumnFamilyHandles();
+
+  rocksdb::WriteBatch batch;
+  for (const auto& key : keys) {
+    BaseKey base_key(key);
+    Slice encoded = base_key.Encode();
+    Slice prefix(encoded.data(), encoded.size() - kSuffixReserveLength);
+    for (size_t cf_idx = 0; cf_idx < dst_handles.size(); cf_idx++) {
+      std::string target = SeekTarget(cf_idx, prefix);
+      // a key is deleted and put again in one batch, readers see either version
+      std::unique_ptr<rocksdb::Iterator> dst_iter(dst->GetDB()->NewIterator(dst_read_options, dst_handles[cf_idx]));
+      for (dst_iter->Seek(target); dst_iter->Valid() && dst_iter->key().starts_with(prefix); dst_iter->Next()) {
+        batch.Delete(dst_handles[cf_idx], dst_iter->key());
+      }
+      if (!dst_iter->status().ok()) {
+        return dst_iter->status();
+      }
+      std::unique_ptr<rocksdb::Iterator> src_iter(src->GetDB()->NewIterator(src_read_options, src_handles[cf_idx]));
+      for (src_iter->Seek(target); src_iter->Valid() && src_iter->key().starts_with(prefix); src_iter->Next()) {
+        batch.Put(dst_handles[cf_idx], src_iter->key(), src_iter->value());
+      }
+      if (!src_iter->status().ok()) {
+        return src_iter->status();
+      }
+    }
+    if (batch.Count() >= kMigrateBatchSize) {
+      Status s = dst->GetDB()->Write(rocksdb::WriteOptions(), &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      batch.Clear();
+    }
+  }
+  if (batch.Count() == 0) {
+    return Status::OK();
+  }
+  return dst->GetDB()->Write(rocksdb::WriteOptions(), &batch);
+}
+
+Status DeleteSlots(Redis* inst, const std::vector<bool>& slots) {
+  auto db = inst->GetDB();
+  const auto& handles = inst->GetColumnFamilyHandles();
+  rocksdb::WriteBatch batch;
+  Status s = ForEachEntryOfSlots(inst, slots, nullptr, [&](uint32_t, size_t cf_idx, const Slice& key, const Slice&) {
+    batch.Delete(handles[cf_idx], key);
+    if (batch.Count() < kMigrateBatchSize) {
+      return Status::OK();
+    }
+    Status write_status = db->Write(rocksdb::WriteOptions(), &batch);
+    batch.Clear();
+    return write_status;
+  });
+  if (!s.ok() || batch.Count() == 0) {
+    return s;
+  }
+  return db->Write(rocksdb::WriteOptions(), &batch);
+}
+
+}  // namespace storage
@@ -0,0 +1,84 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SLOT_MIGRATION_H_
+#define SRC_SLOT_MIGRATION_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/utilities/stackable_db.h"
+#include "rocksdb/write_batch.h"
+
+#include "storage/storage.h"
+
+namespace storage {
+
+class Redis;
+
+// Decodes the user key of a key of any column family, false if key is malformed
+bool DecodeKeyOfEntry(const Slice& key, std::string* user_key);
+
+/*
+ * Wraps the DB of an instance to find the keys written to the slots being
+ * migrated away from it, from any write path. A key is recorded after its
+ * write, so a write is either seen by the snapshot the migration copies or
+ * recorded, when tracking started before the snapshot was taken.
+ */
+class SlotTrackingDB : public rocksdb::StackableDB {
+ public:
+  explicit SlotTrackingDB(rocksdb::DB* db) : rocksdb::StackableDB(db) {}
+
+  using rocksdb::StackableDB::Delete;
+  using rocksdb::StackableDB::Merge;
+  using rocksdb::StackableDB::Put;
+  using rocksdb::StackableDB::SingleDelete;
+  rocksdb::Status Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                      const rocksdb::Slice& key, const rocksdb::Slice& value) override;
+  rocksdb::Status Delete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                         const rocksdb::Slice& key) override;
+  rocksdb::Status SingleDelete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                               const rocksdb::Slice& key) override;
+  rocksdb::Status Merge(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                        const rocksdb::Slice& key, const rocksdb::Slice& value) override;
+  rocksdb::Status Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) override;
+
+  // Records the keys written to the slots set in slots, indexed by slot
+  void StartTracking(const std::vector<bool>& slots);
+  void StopTracking(uint32_t slot);
+  void StopTracking();
+
+  // The user keys of slot written since the last call
+  std::vector<std::string> TakeWrittenKeys(uint32_t slot);
+  size_t WrittenKeyCount() const;
+
+ private:
+  void Track(const rocksdb::Slice& key);
+
+  std::atomic<bool> tracking_ = false;
+  mutable std::mutex mutex_;
+  std::vector<bool> slots_;
+  std::unordered_map<uint32_t, std::unordered_set<std::string>> written_keys_;
+};
+
+// Copies the entries src has as of snapshot of the keys of each slot to dsts[slot], in a single pass over src.
+// The slots with a null destination are left out, the destinations must hold no copies of the others.
+Status CopySlots(Redis* src, const std::vector<Redis*>& dsts, const rocksdb::Snapshot* snapshot);
+
+// Replaces the entries of user keys in dst by the ones src has now
+Status CopyKeys(Redis* src, Redis* dst, const std::vector<std::string>& keys);
+
+// Deletes the entries of the keys in the slots set in slots
+Status DeleteSlots(Redis* inst, const std::vector<bool>& slots);
+
+}  // namespace storage
+
+#endif  // SRC_SLOT_MIGRATION_H_
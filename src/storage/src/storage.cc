@@ -4,25 +4,37 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <future>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "binlog.pb.h"
 #include "config.h"
+#include "db/write_batch_internal.h"
+#include "fmt/core.h"
 #include "pstd/log.h"
 #include "pstd/pikiwidb_slot.h"
 #include "pstd/pstd_string.h"
+#include "pstd/pstd_util.h"
 #include "rocksdb/utilities/checkpoint.h"
 #include "scope_snapshot.h"
-#include "src/lru_cache.h"
 #include "src/mutex_impl.h"
 #include "src/options_helper.h"
 #include "src/redis.h"
 #include "src/redis_hyperloglog.h"
+#include "src/scan_cursor.h"
+#include "src/sharded_cache.h"
+#include "src/slot_migration.h"
+#include "src/type_directory.h"
+#include "src/member_iterator.h"
 #include "src/type_iterator.h"
+#include "storage/async_commit.h"
+#include "storage/flat_binlog.h"
 #include "storage/slot_indexer.h"
 #include "storage/storage.h"
 #include "storage/util.h"
@@ -61,7 +73,7 @@ Status StorageOptions::ResetOptions(const OptionType& option_type,
 }
 
 Storage::Storage() {
-  cursors_store_ = std::make_unique<LRUCache<std::string, std::string>>();
+  cursors_store_ = std::make_unique<ShardedCache<std::string>>();
   cursors_store_->SetCapacity(5000);
 
   Status s = StartBGThread();
@@ -74,6 +86,8 @@ Storage::~Storage() {
   INFO("Storage begin to clear storage!");
   bg_tasks_should_exit_.store(true);
   bg_tasks_cond_var_.notify_one();
+  StopBigKeysScan();
+  StopSlotsMigration();
   if (is_opened_.load()) {
     INFO("Storage begin to clear all instances!");
     int ret = 0;
@@ -146,9 +160,15 @@ Status Storage::Open(const StorageOptions& storage_options, const std::string& d
   LogIndexAndSequenceCollector::max_gap_.store(storage_options.max_gap);
   storage_options.options.write_buffer_manager =
       std::make_shared<rocksdb::WriteBufferManager>(storage_options.mem_manager_size);
+  slot_indexer_ = std::make_unique<SlotIndexer>(db_instance_num_);
+  Status s = slot_indexer_->Open(db_path);
+  if (!s.ok()) {
+    ERROR("open slot table failed {}", s.ToString());
+    return s;
+  }
   for (size_t index = 0; index < db_instance_num_; index++) {
     insts_.emplace_back(std::make_unique<Redis>(this, index));
-    Status s = insts_.back()->Open(storage_options, AppendSubDirectory(db_path, index));
+    s = insts_.back()->Open(storage_options, AppendSubDirectory(db_path, index));
     if (!s.ok()) {
       ERROR("open RocksDB{} failed {}", index, s.ToString());
       return Status::IOError();
@@ -156,20 +176,29 @@ Status Storage::Open(const StorageOptions& storage_options, const std::string& d
     INFO("open RocksDB{} success!", index);
   }
 
-  slot_indexer_ = std::make_unique<SlotIndexer>(db_instance_num_);
   db_id_ = storage_options.db_id;
 
+  s = DeleteMigratingSlots();
+  if (!s.ok()) {
+    ERROR("delete the copies of migrating slots failed {}", s.ToString());
+    return s;
+  }
+
   is_opened_.store(true);
   return Status::OK();
 }
 
-std::vector<std::future<Status>> Storage::CreateCheckpoint(const std::string& checkpoint_path) {
+std::vector<std::future<Status>> Storage::CreateCheckpoint(const std::string& checkpoint_path,
+                                                           const std::vector<int32_t>& inst_ids) {
   INFO("DB{} begin to generate a checkpoint to {}", db_id_, checkpoint_path);
   //  auto source_dir = AppendSubDirectory(checkpoint_path, db_id_);
 
   std::vector<std::future<Status>> result;
   result.reserve(db_instance_num_);
   for (int i = 0; i < db_instance_num_; ++i) {
+    if (!inst_ids.empty() && std::find(inst_ids.begin(), inst_ids.end(), i) == inst_ids.end()) {
+      continue;
+    }
     // In a new thread, create a checkpoint for the specified rocksdb i.
     auto res = std::async(std::launch::async, &Storage::CreateCheckpointInternal, this, checkpoint_path, i);
     result.push_back(std::move(res));
@@ -203,6 +232,14 @@ Status Storage::CreateCheckpointInternal(const std::string& checkpoint_path, int
     WARN("DB{}'s RocksDB {} create checkpoint failed!. Error: {}", db_id_, index, s.ToString());
     return s;
   }
+  // The checkpoint holds the type directory, mark it built so that loading it does not rebuild it
+  if (db->GetEnv()->FileExists(db->GetName() + "/" + kTypeDirectoryBuiltFile).ok()) {
+    s = rocksdb::WriteStringToFile(db->GetEnv(), rocksdb::Slice(), tmp_dir + "/" + kTypeDirectoryBuiltFile, true);
+    if (!s.ok()) {
+      WARN("DB{}'s RocksDB {} mark the type directory of checkpoint failed!. Error: {}", db_id_, index, s.ToString());
+      return s;
+    }
+  }
 
   // 4) Make sure the source directory does not exist
   if (!pstd::DeleteDirIfExist(source_dir)) {
@@ -228,11 +265,15 @@ Status Storage::CreateCheckpointInternal(const std::string& checkpoint_path, int
 }
 
 std::vector<std::future<Status>> Storage::LoadCheckpoint(const std::string& checkpoint_sub_path,
-                                                         const std::string& db_sub_path) {
+                                                         const std::string& db_sub_path,
+                                                         const std::vector<int32_t>& inst_ids) {
   INFO("DB{} begin to load a checkpoint from {} to {}", db_id_, checkpoint_sub_path, db_sub_path);
   std::vector<std::future<Status>> result;
   result.reserve(db_instance_num_);
   for (int i = 0; i < db_instance_num_; ++i) {
+    if (!inst_ids.empty() && std::find(inst_ids.begin(), inst_ids.end(), i) == inst_ids.end()) {
+      continue;
+    }
     // In a new thread, Load a checkpoint for the specified rocksdb i
     auto res =
         std::async(std::launch::async, &Storage::LoadCheckpointInternal, this, checkpoint_sub_path, db_sub_path, i);
@@ -277,23 +318,34 @@ Status Storage::LoadCheckpointInternal(const std::string& checkpoint_sub_path, c
 }
 
 Status Storage::LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key) {
+  ScanCursor scan_cursor;
+  if (!scan_cursor.Decode(cursor) || scan_cursor.type_index() >= static_cast<int>(sizeof(DataTypeTag))) {
+    return Status::NotFound();
+  }
+  *type = DataTypeTag[scan_cursor.type_index()];
+
   std::string index_key = DataTypeTag[dtype] + std::to_string(cursor);
   std::string index_value;
   Status s = cursors_store_->Lookup(index_key, &index_value);
-  if (!s.ok() || index_value.size() < 3) {
-    return s;
+  if (s.ok() && !index_value.empty() && index_value[0] == *type &&
+      scan_cursor.Matches(Slice(index_value.data() + 1, index_value.size() - 1))) {
+    *start_key = index_value.substr(1);
+  } else {
+    // The exact position is gone from the store, go on from the one carried by the cursor
+    *start_key = scan_cursor.prefix();
   }
-  *type = index_value[0];
-  *start_key = index_value.substr(1);
-  return s;
+  return Status::OK();
 }
 
-Status Storage::StoreCursorStartKey(const DataType& dtype, int64_t cursor, char type, const std::string& next_key) {
+int64_t Storage::StoreCursorStartKey(const DataType& dtype, char type, const std::string& next_key) {
+  auto type_index = std::find(std::begin(DataTypeTag), std::end(DataTypeTag), type) - std::begin(DataTypeTag);
+  int64_t cursor = ScanCursor(static_cast<int>(type_index), next_key).Encode();
   std::string index_key = DataTypeTag[dtype] + std::to_string(cursor);
   // format: data_type tag(1B) | start_key
   std::string index_value(1, type);
   index_value.append(next_key);
-  return cursors_store_->Insert(index_key, index_value);
+  cursors_store_->Insert(index_key, index_value);
+  return cursor;
 }
 
 std::unique_ptr<Redis>& Storage::GetDBInstance(const Slice& key) { return GetDBInstance(key.ToString()); }
@@ -303,46 +355,352 @@ std::unique_ptr<Redis>& Storage::GetDBInstance(const std::string& key) {
   return insts_[inst_index];
 }
 
+uint32_t Storage::GetSlot(const std::string& key) const { return slot_indexer_->GetSlot(GetSlotID(key)); }
+
+InstanceRef Storage::LockDBInstance(const Slice& key, const InstanceRef* locked) {
+  if (auto commit = AsyncCommit::Current(); commit) {
+    commit->WaitForWritesOf(key.ToString());
+  }
+  auto slot = slot_indexer_->GetSlot(GetSlotID(key.ToString()));
+  std::shared_lock<std::shared_mutex> lock;
+  if (!locked || locked->slot() != slot) {
+    lock = std::shared_lock(slot_indexer_->GetSlotMutex(slot));
+  }
+  return {insts_[slot_indexer_->GetInstanceID(slot)], slot, std::move(lock)};
+}
+
+int32_t Storage::CountMovingSlots(const std::vector<int32_t>& targets) {
+  return static_cast<int32_t>(std::count_if(targets.begin(), targets.end(), [](int32_t t) { return t != kNoTarget; }));
+}
+
+Status Storage::MigrateSlots(const std::vector<uint32_t>& slots, int32_t inst_id) {
+  std::vector<int32_t> targets;
+  Status s = PlanSlotsMigration(slots, inst_id, &targets);
+  if (!s.ok()) {
+    return s;
+  }
+  return MigrateSlotsTo(targets);
+}
+
+Status Storage::PlanSlotsMigration(const std::vector<uint32_t>& slots, int32_t inst_id,
+                                   std::vector<int32_t>* targets) const {
+  if (insts_.front()->GetAppendLogFunction()) {
+    return Status::NotSupported("slots can not be migrated with raft");
+  }
+  if (inst_id < 0 || inst_id >= static_cast<int32_t>(db_instance_num_)) {
+    return Status::InvalidArgument(fmt::format("no instance {}", inst_id));
+  }
+  targets->assign(slot_indexer_->SlotNum(), kNoTarget);
+  for (auto slot : slots) {
+    if (slot >= slot_indexer_->SlotNum()) {
+      return Status::InvalidArgument(fmt::format("no slot {}", slot));
+    }
+    if (static_cast<int32_t>(slot_indexer_->GetInstanceID(slot)) != inst_id) {
+      (*targets)[slot] = inst_id;
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::MigrateSlotsTo(const std::vector<int32_t>& targets) {
+  std::lock_guard lock(migrate_mutex_);
+  {
+    std::lock_guard l(migrate_report_mutex_);
+    migrate_report_.running = true;
+    migrate_report_.start_time = pstd::UnixTimestamp();
+    migrate_report_.end_time = 0;
+    migrate_report_.slots = CountMovingSlots(targets);
+    migrate_report_.moved_slots = 0;
+    migrate_report_.error.clear();
+  }
+
+  // a slot is marked with one instance holding its copies at a time
+  Status s = DeleteMigratingSlots();
+  // the slots to move out of each instance, each instance is read once
+  std::vector<std::vector<int32_t>> moving(db_instance_num_);
+  for (uint32_t slot = 0; slot < targets.size(); slot++) {
+    auto src_id = slot_indexer_->GetInstanceID(slot);
+    if (targets[slot] == kNoTarget || targets[slot] == static_cast<int32_t>(src_id)) {
+      continue;  // moved meanwhile by another migration
+    }
+    moving[src_id].resize(targets.size(), kNoTarget);
+    moving[src_id][slot] = targets[slot];
+  }
+  for (int32_t src_id = 0; s.ok() && src_id < static_cast<int32_t>(db_instance_num_); src_id++) {
+    if (!moving[src_id].empty()) {
+      s = MigrateSlotsFrom(src_id, moving[src_id]);
+    }
+  }
+
+  std::lock_guard l(migrate_report_mutex_);
+  migrate_report_.running = false;
+  migrate_report_.end_time = pstd::UnixTimestamp();
+  if (!s.ok()) {
+    migrate_report_.error = s.ToString();
+  }
+  return s;
+}
+
+Status Storage::MigrateSlotsFrom(int32_t src_id, const std::vector<int32_t>& targets) {
+  // Rounds of copying the keys written during the last one, before the slots are switched over
+  constexpr int kMaxCatchUpRounds = 8;
+  // Written keys left to copy while a slot is locked
+  constexpr size_t kSwitchWrittenKeys = 128;
+
+  Redis* src = insts_[src_id].get();
+  auto tracking_db = src->GetSlotTrackingDB();
+  std::vector<bool> slots(targets.size());
+  std::vector<Redis*> dsts(targets.size());
+  std::vector<std::vector<bool>> slots_of_dst(db_instance_num_);
+  for (uint32_t slot = 0; slot < targets.size(); slot++) {
+    if (targets[slot] == kNoTarget) {
+      continue;
+    }
+    slots[slot] = true;
+    dsts[slot] = insts_[targets[slot]].get();
+    slots_of_dst[targets[slot]].resize(targets.size());
+    slots_of_dst[targets[slot]][slot] = true;
+  }
+  INFO("DB{} begins to migrate {} slots from RocksDB{}", db_id_, std::count(slots.begin(), slots.end(), true),
+       src_id);
+
+  // 1) Copy the slots from a snapshot taken after tracking started, once they
+  // are marked so that the copies are left out of scans and deleted at open
+  Status s;
+  for (int32_t dst_id = 0; s.ok() && dst_id < static_cast<int32_t>(db_instance_num_); dst_id++) {
+    if (!slots_of_dst[dst_id].empty()) {
+      s = slot_indexer_->MarkMigrating(slots_of_dst[dst_id], dst_id);
+    }
+  }
+  if (!s.ok()) {
+    // the slots marked so far hold no copies yet
+    slot_indexer_->UnmarkMigrating(slots);
+    return s;
+  }
+  tracking_db->StartTracking(slots);
+  {
+    rocksdb::ManagedSnapshot snapshot(src->GetDB());
+    s = CopySlots(src, dsts, snapshot.snapshot());
+  }
+
+  // 2) Catch up with the writes made meanwhile
+  for (int round = 0; s.ok() && round < kMaxCatchUpRounds; round++) {
+    if (tracking_db->WrittenKeyCount() <= kSwitchWrittenKeys) {
+      break;
+    }
+    for (uint32_t slot = 0; s.ok() && slot < slots.size(); slot++) {
+      if (slots[slot]) {
+        s = CopyKeys(src, dsts[slot], tracking_db->TakeWrittenKeys(slot));
+      }
+    }
+  }
+
+  // 3) Switch each slot over once nobody uses it
+  std::vector<bool> moved(slots.size());
+  for (uint32_t slot = 0; s.ok() && slot < slots.size(); slot++) {
+    if (!slots[slot]) {
+      continue;
+    }
+    if (migrate_should_exit_.load(std::memory_order_relaxed)) {
+      s = Status::Incomplete("the storage is closing");
+      break;
+    }
+    std::unique_lock slot_lock(slot_indexer_->GetSlotMutex(slot));
+    s = CopyKeys(src, dsts[slot], tracking_db->TakeWrittenKeys(slot));
+    if (s.ok()) {
+      s = slot_indexer_->MoveSlot(slot, targets[slot]);
+    }
+    if (s.ok()) {
+      tracking_db->StopTracking(slot);
+      moved[slot] = true;
+      std::lock_guard l(migrate_report_mutex_);
+      migrate_report_.moved_slots++;
+    }
+  }
+  tracking_db->StopTracking();
+
+  // 4) Drop the keys from the instance not owning them
+  Status cleanup = DeleteSlots(src, moved);
+  if (cleanup.ok()) {
+    cleanup = slot_indexer_->UnmarkMigrating(moved);
+  }
+  for (int32_t dst_id = 0; cleanup.ok() && !s.ok() && dst_id < static_cast<int32_t>(db_instance_num_); dst_id++) {
+    auto& failed = slots_of_dst[dst_id];
+    if (failed.empty()) {
+      continue;
+    }
+    for (uint32_t slot = 0; slot < failed.size(); slot++) {
+      failed[slot] = failed[slot] && !moved[slot];
+    }
+    cleanup = DeleteSlots(insts_[dst_id].get(), failed);
+    if (cleanup.ok()) {
+      cleanup = slot_indexer_->UnmarkMigrating(failed);
+    }
+  }
+  if (!s.ok()) {
+    ERROR("DB{} failed to migrate slots from RocksDB{}: {}", db_id_, src_id, s.ToString());
+    return s;
+  }
+  if (!cleanup.ok()) {
+    WARN("DB{} failed to delete migrated slots: {}", db_id_, cleanup.ToString());
+  }
+  INFO("DB{} migrated slots from RocksDB{}", db_id_, src_id);
+  return Status::OK();
+}
+
+Status Storage::DeleteMigratingSlots() {
+  if (!slot_indexer_->HasMigratingSlots()) {
+    return Status::OK();
+  }
+  auto migrating = slot_indexer_->GetMigratingSlots();
+  for (size_t inst_id = 0; inst_id < migrating.size(); inst_id++) {
+    if (migrating[inst_id].empty()) {
+      continue;
+    }
+    WARN("DB{} deletes the copies of {} slots left in RocksDB{}", db_id_,
+         std::count(migrating[inst_id].begin(), migrating[inst_id].end(), true), inst_id);
+    Status s = DeleteSlots(insts_[inst_id].get(), migrating[inst_id]);
+    if (s.ok()) {
+      s = slot_indexer_->UnmarkMigrating(migrating[inst_id]);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::RebalanceSlots(int32_t inst_num, int32_t* moved) {
+  std::vector<int32_t> targets;
+  Status s = PlanSlotsRebalance(inst_num, &targets);
+  if (!s.ok()) {
+    return s;
+  }
+  *moved = CountMovingSlots(targets);
+  return MigrateSlotsTo(targets);
+}
+
+Status Storage::PlanSlotsRebalance(int32_t inst_num, std::vector<int32_t>* targets) const {
+  if (insts_.front()->GetAppendLogFunction()) {
+    return Status::NotSupported("slots can not be migrated with raft");
+  }
+  if (inst_num <= 0 || inst_num > static_cast<int32_t>(db_instance_num_)) {
+    return Status::InvalidArgument(fmt::format("instance number should be in [1, {}]", db_instance_num_));
+  }
+  uint32_t slot_num = slot_indexer_->SlotNum();
+  // Instances keep their own slots up to their share, the rest go to the
+  // instances short of their share
+  std::vector<uint32_t> spare;
+  std::vector<size_t> shortage(inst_num);
+  for (int32_t inst_id = 0; inst_id < static_cast<int32_t>(db_instance_num_); inst_id++) {
+    auto owned = slot_indexer_->GetSlotsOfInstance(inst_id);
+    size_t share = 0;
+    if (inst_id < inst_num) {
+      share = slot_num / inst_num + (inst_id < static_cast<int32_t>(slot_num % inst_num) ? 1 : 0);
+    }
+    if (owned.size() > share) {
+      spare.insert(spare.end(), owned.begin() + static_cast<int64_t>(share), owned.end());
+    } else {
+      shortage[inst_id] = share - owned.size();
+    }
+  }
+
+  targets->assign(slot_num, kNoTarget);
+  auto next = spare.begin();
+  for (int32_t inst_id = 0; inst_id < inst_num; inst_id++) {
+    for (size_t i = 0; i < shortage[inst_id]; i++) {
+      (*targets)[*next++] = inst_id;
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::StartSlotsMigration(const std::vector<uint32_t>& slots, int32_t inst_id) {
+  std::vector<int32_t> targets;
+  Status s = PlanSlotsMigration(slots, inst_id, &targets);
+  if (!s.ok()) {
+    return s;
+  }
+  return StartMigrateThread(std::move(targets));
+}
+
+Status Storage::StartSlotsRebalance(int32_t inst_num, int32_t* moving) {
+  std::vector<int32_t> targets;
+  Status s = PlanSlotsRebalance(inst_num, &targets);
+  if (!s.ok()) {
+    return s;
+  }
+  *moving = CountMovingSlots(targets);
+  return StartMigrateThread(std::move(targets));
+}
+
+Status Storage::StartMigrateThread(std::vector<int32_t>&& targets) {
+  std::lock_guard l(migrate_report_mutex_);
+  if (migrate_report_.running) {
+    return Status::Busy("a slots migration is running");
+  }
+  if (migrate_thread_.joinable()) {
+    migrate_thread_.join();
+  }
+  migrate_report_ = SlotsMigrationReport();
+  migrate_report_.running = true;
+  migrate_report_.start_time = pstd::UnixTimestamp();
+  migrate_thread_ = std::thread([this, targets = std::move(targets)] { MigrateSlotsTo(targets); });
+  return Status::OK();
+}
+
+SlotsMigrationReport Storage::GetSlotsMigrationReport() {
+  std::lock_guard l(migrate_report_mutex_);
+  return migrate_report_;
+}
+
+void Storage::StopSlotsMigration() {
+  migrate_should_exit_.store(true);
+  if (migrate_thread_.joinable()) {
+    migrate_thread_.join();
+  }
+}
+
 // Strings Commands
 Status Storage::Set(const Slice& key, const Slice& value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Set(key, value);
 }
 
 Status Storage::Setxx(const Slice& key, const Slice& value, int32_t* ret, const uint64_t ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Setxx(key, value, ret, ttl);
 }
 
 Status Storage::Get(const Slice& key, std::string* value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Get(key, value);
 }
 
 Status Storage::GetWithTTL(const Slice& key, std::string* value, uint64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->GetWithTTL(key, value, ttl);
 }
 
 Status Storage::GetSet(const Slice& key, const Slice& value, std::string* old_value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->GetSet(key, value, old_value);
 }
 
 Status Storage::SetBit(const Slice& key, int64_t offset, int32_t value, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SetBit(key, offset, value, ret);
 }
 
 Status Storage::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->GetBit(key, offset, ret);
 }
 
 Status Storage::MSet(const std::vector<KeyValue>& kvs) {
   Status s;
   for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
+    auto inst = LockDBInstance(kv.key);
     s = inst->Set(Slice(kv.key), Slice(kv.value));
     if (!s.ok()) {
       return s;
@@ -355,7 +713,7 @@ Status Storage::MGet(const std::vector<std::string>& keys, std::vector<ValueStat
   vss->clear();
   Status s;
   for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
+    auto inst = LockDBInstance(key);
     std::string value;
     s = inst->Get(key, &value);
     if (s.ok()) {
@@ -374,7 +732,7 @@ Status Storage::MGetWithTTL(const std::vector<std::string>& keys, std::vector<Va
   vss->clear();
   Status s;
   for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
+    auto inst = LockDBInstance(key);
     std::string value;
     uint64_t ttl;
     s = inst->GetWithTTL(key, &value, &ttl);
@@ -391,7 +749,7 @@ Status Storage::MGetWithTTL(const std::vector<std::string>& keys, std::vector<Va
 }
 
 Status Storage::Setnx(const Slice& key, const Slice& value, int32_t* ret, const uint64_t ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Setnx(key, value, ret, ttl);
 }
 
@@ -399,7 +757,7 @@ Status Storage::Setnx(const Slice& key, const Slice& value, int32_t* ret, const
 Status Storage::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
   Status s;
   for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
+    auto inst = LockDBInstance(kv.key);
     std::string value;
     s = inst->Get(Slice(kv.key), &value);
     if (s.ok() || !s.IsNotFound()) {
@@ -408,7 +766,7 @@ Status Storage::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
   }
 
   for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
+    auto inst = LockDBInstance(kv.key);
     s = inst->Set(Slice(kv.key), Slice(kv.value));
     if (!s.ok()) {
       return s;
@@ -421,38 +779,38 @@ Status Storage::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
 }
 
 Status Storage::Setvx(const Slice& key, const Slice& value, const Slice& new_value, int32_t* ret, const uint64_t ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Setvx(key, value, new_value, ret, ttl);
 }
 
 Status Storage::Delvx(const Slice& key, const Slice& value, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Delvx(key, value, ret);
 }
 
 Status Storage::Setrange(const Slice& key, int64_t start_offset, const Slice& value, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Setrange(key, start_offset, value, ret);
 }
 
 Status Storage::Getrange(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Getrange(key, start_offset, end_offset, ret);
 }
 
 Status Storage::GetrangeWithValue(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret,
                                   std::string* value, uint64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->GetrangeWithValue(key, start_offset, end_offset, ret, value, ttl);
 }
 
 Status Storage::Append(const Slice& key, const Slice& value, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Append(key, value, ret);
 }
 
 Status Storage::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->BitCount(key, start_offset, end_offset, ret, have_range);
 }
 
@@ -464,7 +822,7 @@ Status Storage::BitOp(BitOpType op, const std::string& dest_key, const std::vect
   int64_t value_len = 0;
   std::vector<std::string> src_vlaues;
   for (const auto& src_key : src_keys) {
-    auto& inst = GetDBInstance(src_key);
+    auto inst = LockDBInstance(src_key);
     std::string value;
     s = inst->Get(Slice(src_key), &value);
     if (s.ok()) {
@@ -483,297 +841,432 @@ Status Storage::BitOp(BitOpType op, const std::string& dest_key, const std::vect
   value_to_dest = dest_value;
   *ret = dest_value.size();
 
-  auto& dest_inst = GetDBInstance(dest_key);
+  auto dest_inst = LockDBInstance(dest_key);
   return dest_inst->Set(Slice(dest_key), Slice(dest_value));
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->BitPos(key, bit, ret);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->BitPos(key, bit, start_offset, ret);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_t end_offset, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->BitPos(key, bit, start_offset, end_offset, ret);
 }
 
 Status Storage::Decrby(const Slice& key, int64_t value, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Decrby(key, value, ret);
 }
 
 Status Storage::Incrby(const Slice& key, int64_t value, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Incrby(key, value, ret);
 }
 
 Status Storage::Incrbyfloat(const Slice& key, const Slice& value, std::string* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Incrbyfloat(key, value, ret);
 }
 
 Status Storage::Setex(const Slice& key, const Slice& value, uint64_t ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Setex(key, value, ttl);
 }
 
 Status Storage::Strlen(const Slice& key, int32_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->Strlen(key, len);
 }
 
 Status Storage::PKSetexAt(const Slice& key, const Slice& value, uint64_t timestamp) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->PKSetexAt(key, value, timestamp);
 }
 
 // Hashes Commands
 Status Storage::HSet(const Slice& key, const Slice& field, const Slice& value, int32_t* res) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HSet(key, field, value, res);
 }
 
 Status Storage::HGet(const Slice& key, const Slice& field, std::string* value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HGet(key, field, value);
 }
 
 Status Storage::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HMSet(key, fvs);
 }
 
 Status Storage::HMGet(const Slice& key, const std::vector<std::string>& fields, std::vector<ValueStatus>* vss) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HMGet(key, fields, vss);
 }
 
 Status Storage::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HGetall(key, fvs);
 }
 
 Status Storage::HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, uint64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HGetallWithTTL(key, fvs, ttl);
 }
 
 Status Storage::HKeys(const Slice& key, std::vector<std::string>* fields) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HKeys(key, fields);
 }
 
 Status Storage::HVals(const Slice& key, std::vector<std::string>* values) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HVals(key, values);
 }
 
 Status Storage::HSetnx(const Slice& key, const Slice& field, const Slice& value, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HSetnx(key, field, value, ret);
 }
 
 Status Storage::HLen(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HLen(key, ret);
 }
 
 Status Storage::HStrlen(const Slice& key, const Slice& field, int32_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HStrlen(key, field, len);
 }
 
 Status Storage::HExists(const Slice& key, const Slice& field) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HExists(key, field);
 }
 
 Status Storage::HIncrby(const Slice& key, const Slice& field, int64_t value, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HIncrby(key, field, value, ret);
 }
 
 Status Storage::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by, std::string* new_value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HIncrbyfloat(key, field, by, new_value);
 }
 
 Status Storage::HDel(const Slice& key, const std::vector<std::string>& fields, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HDel(key, fields, ret);
 }
 
 Status Storage::HScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<FieldValue>* field_values, int64_t* next_cursor) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HScan(key, cursor, pattern, count, field_values, next_cursor);
 }
 
 Status Storage::HScanx(const Slice& key, const std::string& start_field, const std::string& pattern, int64_t count,
                        std::vector<FieldValue>* field_values, std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HScanx(key, start_field, pattern, count, field_values, next_field);
 }
 
 Status Storage::HRandField(const Slice& key, int64_t count, bool with_values, std::vector<std::string>* res) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->HRandField(key, count, with_values, res);
 }
 
 Status Storage::PKHScanRange(const Slice& key, const Slice& field_start, const std::string& field_end,
                              const Slice& pattern, int32_t limit, std::vector<FieldValue>* field_values,
                              std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->PKHScanRange(key, field_start, field_end, pattern, limit, field_values, next_field);
 }
 
 Status Storage::PKHRScanRange(const Slice& key, const Slice& field_start, const std::string& field_end,
                               const Slice& pattern, int32_t limit, std::vector<FieldValue>* field_values,
                               std::string* next_field) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->PKHRScanRange(key, field_start, field_end, pattern, limit, field_values, next_field);
 }
 
 // Sets Commands
-Status Storage::SAdd(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
-  return inst->SAdd(key, members, ret);
+namespace {
+
+using MemberIters = std::vector<std::unique_ptr<MemberIterator>>;
+
+// Below this many members in total the iterators are positioned serially
+constexpr int64_t kParallelSeekThreshold = 4096;
+
+Status MemberItersStatus(const MemberIters& iters) {
+  for (const auto& iter : iters) {
+    if (iter && !iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  return Status::OK();
 }
 
-Status Storage::SCard(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
-  return inst->SCard(key, ret);
+// Members of the first set which are not in any of the successive sets,
+// the successive iterators only move forward along with the first one.
+Status MergeDiff(const MemberIters& iters, const MemberSink& sink) {
+  if (iters.empty() || !iters[0]) {
+    return Status::OK();
+  }
+
+  auto& first = iters[0];
+  for (; first->Valid(); first->Next()) {
+    Slice member = first->member();
+    bool exist = false;
+    for (size_t idx = 1; idx < iters.size() && !exist; idx++) {
+      auto& iter = iters[idx];
+      if (!iter) {
+        continue;
+      }
+      iter->SeekForward(member);
+      if (!iter->Valid() && !iter->status().ok()) {
+        return iter->status();
+      }
+      exist = iter->Valid() && iter->member() == member;
+    }
+    if (!exist) {
+      Status s = sink(member);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return MemberItersStatus(iters);
 }
 
-Status Storage::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  if (keys.empty()) {
-    return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
+// Leapfrog intersection driven by the smallest set: every other iterator is
+// moved forward to the candidate, and a larger member becomes the next candidate.
+// When a member is in all the sets, sink is called with every iterator on it.
+Status MergeInter(const MemberIters& iters, const MemberSink& sink) {
+  if (iters.empty() || std::any_of(iters.begin(), iters.end(), [](const auto& iter) { return !iter; })) {
+    return Status::OK();
   }
-  members->clear();
+  std::vector<MemberIterator*> order;
+  order.reserve(iters.size());
+  for (const auto& iter : iters) {
+    order.push_back(iter.get());
+  }
+  std::sort(order.begin(), order.end(), [](const auto a, const auto b) { return a->Count() < b->Count(); });
+
+  auto lead = order[0];
+  std::string target;
+  while (lead->Valid()) {
+    target.assign(lead->member().data(), lead->member().size());
+    bool matched = true;
+    for (size_t idx = 1; idx < order.size(); idx++) {
+      auto iter = order[idx];
+      iter->SeekForward(target);
+      if (!iter->Valid()) {
+        return MemberItersStatus(iters);
+      }
+      if (iter->member() != target) {
+        target.assign(iter->member().data(), iter->member().size());
+        matched = false;
+        break;
+      }
+    }
+    if (matched) {
+      Status s = sink(target);
+      if (!s.ok()) {
+        return s;
+      }
+      lead->Next();
+    } else {
+      lead->SeekForward(target);
+    }
+  }
+  return MemberItersStatus(iters);
+}
 
-  Status s;
-  auto& inst = GetDBInstance(keys[0]);
-  std::vector<std::string> keys0_members;
-  s = inst->SMembers(Slice(keys[0]), &keys0_members);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+class MemberMinComparator {
+ public:
+  bool operator()(MemberIterator* a, MemberIterator* b) const { return a->member().compare(b->member()) > 0; }
+};
+
+// K-way merge of all the sets, a member shared by several sets is emitted once.
+Status MergeUnion(const MemberIters& iters, const MemberSink& sink) {
+  rocksdb::BinaryHeap<MemberIterator*, MemberMinComparator> min_heap;
+  for (const auto& iter : iters) {
+    if (iter && iter->Valid()) {
+      min_heap.push(iter.get());
+    }
   }
 
-  for (const auto& member : keys0_members) {
-    int32_t exist = 0;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey = Slice(keys[idx]);
-      auto& inst = GetDBInstance(pkey);
-      s = inst->SIsmember(pkey, Slice(member), &exist);
-      if (!s.ok() && !s.IsNotFound()) {
+  std::string last_member;
+  bool has_last = false;
+  while (!min_heap.empty()) {
+    MemberIterator* top = min_heap.top();
+    Slice member = top->member();
+    if (!has_last || member != Slice(last_member)) {
+      Status s = sink(member);
+      if (!s.ok()) {
         return s;
       }
-      if (exist) break;
+      last_member.assign(member.data(), member.size());
+      has_last = true;
     }
-    if (!exist) {
-      members->push_back(member);
+    top->Next();
+    if (top->Valid()) {
+      min_heap.replace_top(top);
+    } else {
+      min_heap.pop();
     }
   }
-  return Status::OK();
+  return MemberItersStatus(iters);
 }
 
-Status Storage::SDiffstore(const Slice& destination, const std::vector<std::string>& keys,
-                           std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
+}  // namespace
 
-  s = SDiff(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
-  }
+Status Storage::OpenMemberIterators(const DataType& dtype, const std::vector<std::string>& keys,
+                                    std::vector<std::unique_ptr<MemberIterator>>* iters) {
+  iters->clear();
+  iters->resize(keys.size());
 
-  auto& inst = GetDBInstance(destination);
-  s = inst->SetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+  int64_t total_count = 0;
+  std::unordered_map<Redis*, std::vector<MemberIterator*>> inst_iters;
+  for (size_t idx = 0; idx < keys.size(); idx++) {
+    auto inst = LockDBInstance(keys[idx]);
+    Status s = inst->NewMemberIterator(dtype, keys[idx], &(*iters)[idx]);
+    if (s.IsNotFound()) {
+      continue;
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    total_count += (*iters)[idx]->Count();
+    inst_iters[inst.get()].push_back((*iters)[idx].get());
+  }
+
+  // Positioning an iterator reads its first data blocks, overlap these reads
+  // across instances when the inputs are large.
+  if (inst_iters.size() > 1 && total_count >= kParallelSeekThreshold) {
+    std::vector<std::future<void>> futures;
+    futures.reserve(inst_iters.size());
+    for (auto& [inst, inst_group] : inst_iters) {
+      futures.push_back(std::async(std::launch::async, [&inst_group]() {
+        for (auto iter : inst_group) {
+          iter->SeekToFirst();
+        }
+      }));
+    }
+    for (auto& future : futures) {
+      future.wait();
+    }
+  } else {
+    for (auto& iter : *iters) {
+      if (iter) {
+        iter->SeekToFirst();
+      }
+    }
   }
+  return Status::OK();
+}
 
-  s = inst->SAdd(destination, value_to_dest, ret);
-  return s;
+Status Storage::SAdd(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
+  auto inst = LockDBInstance(key);
+  return inst->SAdd(key, members, ret);
 }
 
-Status Storage::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  Status s;
-  members->clear();
+Status Storage::SCard(const Slice& key, int32_t* ret) {
+  auto inst = LockDBInstance(key);
+  return inst->SCard(key, ret);
+}
 
-  std::vector<std::string> key0_members;
-  auto& inst = GetDBInstance(keys[0]);
-  s = inst->SMembers(keys[0], &key0_members);
-  if (s.IsNotFound()) {
-    return Status::OK();
+Status Storage::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
   }
+  members->clear();
+
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
   if (!s.ok()) {
     return s;
   }
+  return MergeDiff(iters, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
+}
 
-  for (const auto member : key0_members) {
-    int32_t exist = 1;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey(keys[idx]);
-      auto& inst = GetDBInstance(keys[idx]);
-      s = inst->SIsmember(keys[idx], member, &exist);
-      if (s.ok() && exist > 0) {
-        continue;
-      } else if (!s.IsNotFound()) {
-        return s;
-      } else {
-        break;
-      }
-    }
-    if (exist > 0) {
-      members->push_back(member);
-    }
+Status Storage::SDiffstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SDiffstore invalid parameter, no keys");
   }
-  return Status::OK();
+
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
+  if (!s.ok()) {
+    return s;
+  }
+  auto dest_inst = LockDBInstance(destination);
+  return dest_inst->SetsStore(
+      destination, [&iters](const MemberSink& sink) { return MergeDiff(iters, sink); }, ret);
 }
 
-Status Storage::SInterstore(const Slice& destination, const std::vector<std::string>& keys,
-                            std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
+Status Storage::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SInter invalid parameter, no keys");
+  }
+  members->clear();
 
-  s = SInter(keys, &value_to_dest);
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
   if (!s.ok()) {
     return s;
   }
+  return MergeInter(iters, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
+}
 
-  auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->SetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+Status Storage::SInterstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SInterstore invalid parameter, no keys");
   }
 
-  s = dest_inst->SAdd(destination, value_to_dest, ret);
-  return s;
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
+  if (!s.ok()) {
+    return s;
+  }
+  auto dest_inst = LockDBInstance(destination);
+  return dest_inst->SetsStore(
+      destination, [&iters](const MemberSink& sink) { return MergeInter(iters, sink); }, ret);
 }
 
 Status Storage::SIsmember(const Slice& key, const Slice& member, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SIsmember(key, member, ret);
 }
 
 Status Storage::SMembers(const Slice& key, std::vector<std::string>* members) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SMembers(key, members);
 }
 
 Status Storage::SMembersWithTTL(const Slice& key, std::vector<std::string>* members, uint64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SMembersWithTTL(key, members, ttl);
 }
 
 Status Storage::SMove(const Slice& source, const Slice& destination, const Slice& member, int32_t* ret) {
   Status s;
 
-  auto& src_inst = GetDBInstance(source);
+  auto src_inst = LockDBInstance(source);
   s = src_inst->SIsmember(source, member, ret);
   if (s.IsNotFound()) {
     *ret = 0;
@@ -782,155 +1275,139 @@ Status Storage::SMove(const Slice& source, const Slice& destination, const Slice
   if (!s.ok()) {
     return s;
   }
+  if (source.compare(destination) == 0) {
+    return s;  // moving to the same set changes nothing
+  }
 
   s = src_inst->SRem(source, std::vector<std::string>{member.ToString()}, ret);
   if (!s.ok()) {
     return s;
   }
-  auto& dest_inst = GetDBInstance(destination);
+  auto dest_inst = LockDBInstance(destination, &src_inst);
   int unused_ret;
   return dest_inst->SAdd(destination, std::vector<std::string>{member.ToString()}, &unused_ret);
 }
 
 Status Storage::SPop(const Slice& key, std::vector<std::string>* members, int64_t count) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   Status status = inst->SPop(key, members, count);
   return status;
 }
 
 Status Storage::SRandmember(const Slice& key, int32_t count, std::vector<std::string>* members) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SRandmember(key, count, members);
 }
 
 Status Storage::SRem(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SRem(key, members, ret);
 }
 
 Status Storage::SUnion(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  Status s;
   members->clear();
 
-  using Iter = std::vector<std::string>::iterator;
-  using Uset = std::unordered_set<std::string>;
-  Uset member_set;
-  for (const auto& key : keys) {
-    std::vector<std::string> vec;
-    auto& inst = GetDBInstance(key);
-    s = inst->SMembers(key, &vec);
-    if (s.IsNotFound()) {
-      continue;
-    }
-    if (!s.ok()) {
-      return s;
-    }
-    std::copy(std::move_iterator<Iter>(vec.begin()), std::move_iterator<Iter>(vec.end()),
-              std::insert_iterator<Uset>(member_set, member_set.begin()));
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
+  if (!s.ok()) {
+    return s;
   }
-
-  std::copy(member_set.begin(), member_set.end(), std::back_inserter(*members));
-  return Status::OK();
+  return MergeUnion(iters, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
 }
 
-Status Storage::SUnionstore(const Slice& destination, const std::vector<std::string>& keys,
-                            std::vector<std::string>& value_to_dest, int32_t* ret) {
-  Status s;
-  value_to_dest.clear();
-
-  s = SUnion(keys, &value_to_dest);
+Status Storage::SUnionstore(const Slice& destination, const std::vector<std::string>& keys, int32_t* ret) {
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kSets, keys, &iters);
   if (!s.ok()) {
     return s;
   }
-  *ret = value_to_dest.size();
-  auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->SetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-  int unused_ret;
-  return dest_inst->SAdd(destination, value_to_dest, &unused_ret);
+  auto dest_inst = LockDBInstance(destination);
+  return dest_inst->SetsStore(
+      destination, [&iters](const MemberSink& sink) { return MergeUnion(iters, sink); }, ret);
 }
 
 Status Storage::SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<std::string>* members, int64_t* next_cursor) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->SScan(key, cursor, pattern, count, members, next_cursor);
 }
 
 Status Storage::LPush(const Slice& key, const std::vector<std::string>& values, uint64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LPush(key, values, ret);
 }
 
 Status Storage::RPush(const Slice& key, const std::vector<std::string>& values, uint64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->RPush(key, values, ret);
 }
 
 Status Storage::LRange(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret) {
   ret->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LRange(key, start, stop, ret);
 }
 
 Status Storage::LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::vector<std::string>* ret,
                               uint64_t* ttl) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LRangeWithTTL(key, start, stop, ret, ttl);
 }
 
 Status Storage::LTrim(const Slice& key, int64_t start, int64_t stop) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LTrim(key, start, stop);
 }
 
 Status Storage::LLen(const Slice& key, uint64_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LLen(key, len);
 }
 
 Status Storage::LPop(const Slice& key, int64_t count, std::vector<std::string>* elements) {
   elements->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LPop(key, count, elements);
 }
 
 Status Storage::RPop(const Slice& key, int64_t count, std::vector<std::string>* elements) {
   elements->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->RPop(key, count, elements);
 }
 
 Status Storage::LIndex(const Slice& key, int64_t index, std::string* element) {
   element->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LIndex(key, index, element);
 }
 
 Status Storage::LInsert(const Slice& key, const BeforeOrAfter& before_or_after, const std::string& pivot,
                         const std::string& value, int64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LInsert(key, before_or_after, pivot, value, ret);
 }
 
 Status Storage::LPushx(const Slice& key, const std::vector<std::string>& values, uint64_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LPushx(key, values, len);
 }
 
 Status Storage::RPushx(const Slice& key, const std::vector<std::string>& values, uint64_t* len) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->RPushx(key, values, len);
 }
 
 Status Storage::LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LRem(key, count, value, ret);
 }
 
 Status Storage::LSet(const Slice& key, int64_t index, const Slice& value) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->LSet(key, index, value);
 }
 
@@ -938,7 +1415,7 @@ Status Storage::RPoplpush(const Slice& source, const Slice& destination, std::st
   Status s;
   element->clear();
 
-  auto& source_inst = GetDBInstance(source);
+  auto source_inst = LockDBInstance(source);
   if (source.compare(destination) == 0) {
     s = source_inst->RPoplpush(source, destination, element);
     return s;
@@ -950,7 +1427,7 @@ Status Storage::RPoplpush(const Slice& source, const Slice& destination, std::st
     return s;
   }
   *element = elements.front();
-  auto& dest_inst = GetDBInstance(destination);
+  auto dest_inst = LockDBInstance(destination, &source_inst);
   uint64_t ret;
   s = dest_inst->LPush(destination, elements, &ret);
   return s;
@@ -958,45 +1435,45 @@ Status Storage::RPoplpush(const Slice& source, const Slice& destination, std::st
 
 Status Storage::ZPopMax(const Slice& key, const int64_t count, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZPopMax(key, count, score_members);
 }
 
 Status Storage::ZPopMin(const Slice& key, const int64_t count, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZPopMin(key, count, score_members);
 }
 
 Status Storage::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_members, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZAdd(key, score_members, ret);
 }
 
 Status Storage::ZCard(const Slice& key, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZCard(key, ret);
 }
 
 Status Storage::ZCount(const Slice& key, double min, double max, bool left_close, bool right_close, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZCount(key, min, max, left_close, right_close, ret);
 }
 
 Status Storage::ZIncrby(const Slice& key, const Slice& member, double increment, double* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZIncrby(key, member, increment, ret);
 }
 
 Status Storage::ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRange(key, start, stop, score_members);
 }
 Status Storage::ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members,
                               uint64_t* ttl) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRangeWithTTL(key, start, stop, score_members, ttl);
 }
 
@@ -1004,7 +1481,7 @@ Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool lef
                               std::vector<ScoreMember>* score_members) {
   // maximum number of zset is std::numeric_limits<int32_t>::max()
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRangebyscore(key, min, max, left_close, right_close, std::numeric_limits<int32_t>::max(), 0,
                              score_members);
 }
@@ -1012,41 +1489,41 @@ Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool lef
 Status Storage::ZRangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close,
                               int64_t count, int64_t offset, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRangebyscore(key, min, max, left_close, right_close, count, offset, score_members);
 }
 
 Status Storage::ZRank(const Slice& key, const Slice& member, int32_t* rank) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRank(key, member, rank);
 }
 
 Status Storage::ZRem(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRem(key, members, ret);
 }
 
 Status Storage::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRemrangebyrank(key, start, stop, ret);
 }
 
 Status Storage::ZRemrangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close,
                                  int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRemrangebyscore(key, min, max, left_close, right_close, ret);
 }
 
 Status Storage::ZRevrangebyscore(const Slice& key, double min, double max, bool left_close, bool right_close,
                                  int64_t count, int64_t offset, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRevrangebyscore(key, min, max, left_close, right_close, count, offset, score_members);
 }
 
 Status Storage::ZRevrange(const Slice& key, int32_t start, int32_t stop, std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRevrange(key, start, stop, score_members);
 }
 
@@ -1054,156 +1531,162 @@ Status Storage::ZRevrangebyscore(const Slice& key, double min, double max, bool
                                  std::vector<ScoreMember>* score_members) {
   // maximum number of zset is std::numeric_limits<int32_t>::max()
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRevrangebyscore(key, min, max, left_close, right_close, std::numeric_limits<int32_t>::max(), 0,
                                 score_members);
 }
 
 Status Storage::ZRevrank(const Slice& key, const Slice& member, int32_t* rank) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRevrank(key, member, rank);
 }
 
 Status Storage::ZScore(const Slice& key, const Slice& member, double* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZScore(key, member, ret);
 }
 
-Status Storage::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
-                            const std::vector<double>& weights, const AGGREGATE agg,
-                            std::map<std::string, double>& value_to_dest, int32_t* ret) {
-  value_to_dest.clear();
-  Status s;
+namespace {
 
-  for (int idx = 0; idx < keys.size(); idx++) {
-    Slice key = Slice(keys[idx]);
-    auto& inst = GetDBInstance(key);
-    std::map<std::string, double> member_to_score;
-    double weight = idx >= weights.size() ? 1 : weights[idx];
-    s = inst->ZGetAll(key, weight, &member_to_score);
-    if (!s.ok() && !s.IsNotFound()) {
-      return s;
-    }
-    for (const auto& key_score : member_to_score) {
-      const std::string& member = key_score.first;
-      double score = key_score.second;
-      if (value_to_dest.find(member) == value_to_dest.end()) {
-        value_to_dest[member] = score;
-        continue;
-      }
-      switch (agg) {
-        case SUM:
-          score += value_to_dest[member];
-          break;
-        case MIN:
-          score = std::min(value_to_dest[member], score);
-          break;
-        case MAX:
-          score = std::max(value_to_dest[member], score);
-          break;
-      }
-      value_to_dest[member] = (score == -0.0) ? 0 : score;
-    }
-  }
+struct WeightedMember {
+  MemberIterator* iter;
+  double weight;
+};
 
-  BaseMetaKey base_destination(destination);
-  auto& inst = GetDBInstance(destination);
-  s = inst->ZsetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+class WeightedMemberMinComparator {
+ public:
+  bool operator()(const WeightedMember& a, const WeightedMember& b) const {
+    return a.iter->member().compare(b.iter->member()) > 0;
   }
-  std::vector<ScoreMember> score_members;
-  std::for_each(value_to_dest.begin(), value_to_dest.end(),
-                [&score_members](auto kv) { score_members.emplace_back(kv.second, kv.first); });
-  *ret = score_members.size();
-  int unused_ret;
-  return inst->ZAdd(destination, score_members, &unused_ret);
+};
+
+double MemberScore(const MemberIterator& iter) {
+  uint64_t tmp = DecodeFixed64(iter.value().data());
+  const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
+  return *reinterpret_cast<const double*>(ptr_tmp);
 }
 
-Status Storage::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
-                            const std::vector<double>& weights, const AGGREGATE agg,
-                            std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
-  Status s;
-  value_to_dest.clear();
-
-  Slice key = Slice(keys[0]);
-  auto& inst = GetDBInstance(key);
-  std::map<std::string, double> member_to_score;
-  double weight = weights.empty() ? 1 : weights[0];
-  s = inst->ZGetAll(key, weight, &member_to_score);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
+double AggregateScore(AGGREGATE agg, double score, double other) {
+  switch (agg) {
+    case SUM:
+      score += other;
+      break;
+    case MIN:
+      score = std::min(score, other);
+      break;
+    case MAX:
+      score = std::max(score, other);
+      break;
   }
+  return score;
+}
 
-  for (const auto member_score : member_to_score) {
-    std::string member = member_score.first;
-    double score = member_score.second;
-    bool reliable = true;
+// -0 is stored as 0, and so is the nan of inf + (-inf) or 0 * inf
+double NormalizeScore(double score) { return (score == -0.0 || std::isnan(score)) ? 0 : score; }
 
-    for (int idx = 1; idx < keys.size(); idx++) {
-      double weight = idx >= weights.size() ? 1 : weights[idx];
-      auto& inst = GetDBInstance(keys[idx]);
-      double ret_score;
-      s = inst->ZScore(keys[idx], member, &ret_score);
-      if (!s.ok() && !s.IsNotFound()) {
-        return s;
-      }
-      if (s.IsNotFound()) {
-        reliable = false;
-        break;
-      }
-      switch (agg) {
-        case SUM:
-          score += ret_score * weight;
-          break;
-        case MIN:
-          score = std::min(score, ret_score * weight);
-          break;
-        case MAX:
-          score = std::max(score, ret_score * weight);
-          break;
+// K-way merge of the sorted sets, the weighted scores of a member shared by
+// several sets are aggregated before it is emitted.
+Status MergeZUnion(const MemberIters& iters, const std::vector<double>& weights, AGGREGATE agg,
+                   const ScoreMemberSink& sink) {
+  rocksdb::BinaryHeap<WeightedMember, WeightedMemberMinComparator> min_heap;
+  for (size_t idx = 0; idx < iters.size(); idx++) {
+    if (iters[idx] && iters[idx]->Valid()) {
+      min_heap.push({iters[idx].get(), idx < weights.size() ? weights[idx] : 1});
+    }
+  }
+
+  std::string member;
+  while (!min_heap.empty()) {
+    member.assign(min_heap.top().iter->member().data(), min_heap.top().iter->member().size());
+    double score = 0;
+    bool first = true;
+    do {
+      WeightedMember top = min_heap.top();
+      double weighted_score = NormalizeScore(top.weight * MemberScore(*top.iter));
+      score = first ? weighted_score : AggregateScore(agg, score, weighted_score);
+      first = false;
+      top.iter->Next();
+      if (top.iter->Valid()) {
+        min_heap.replace_top(top);
+      } else {
+        min_heap.pop();
       }
+    } while (!min_heap.empty() && min_heap.top().iter->member() == Slice(member));
+
+    Status s = sink(member, NormalizeScore(score));
+    if (!s.ok()) {
+      return s;
     }
-    if (reliable) {
-      value_to_dest.emplace_back(score, member);
+  }
+  return MemberItersStatus(iters);
+}
+
+Status MergeZInter(const MemberIters& iters, const std::vector<double>& weights, AGGREGATE agg,
+                   const ScoreMemberSink& sink) {
+  return MergeInter(iters, [&](const Slice& member) {
+    double score = 0;
+    for (size_t idx = 0; idx < iters.size(); idx++) {
+      double weight = idx < weights.size() ? weights[idx] : 1;
+      double weighted_score = NormalizeScore(weight * MemberScore(*iters[idx]));
+      score = idx == 0 ? weighted_score : AggregateScore(agg, score, weighted_score);
     }
+    return sink(member, NormalizeScore(score));
+  });
+}
+
+}  // namespace
+
+Status Storage::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
+                            const std::vector<double>& weights, const AGGREGATE agg, int32_t* ret) {
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kZSets, keys, &iters);
+  if (!s.ok()) {
+    return s;
   }
+  auto dest_inst = LockDBInstance(destination);
+  return dest_inst->ZsetsStore(
+      destination, [&](const ScoreMemberSink& sink) { return MergeZUnion(iters, weights, agg, sink); }, ret);
+}
 
-  BaseMetaKey base_destination(destination);
-  auto& dinst = GetDBInstance(destination);
+Status Storage::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
+                            const std::vector<double>& weights, const AGGREGATE agg, int32_t* ret) {
+  if (keys.empty()) {
+    return Status::Corruption("ZInterstore invalid parameter, no keys");
+  }
 
-  s = dinst->ZsetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
+  MemberIters iters;
+  Status s = OpenMemberIterators(DataType::kZSets, keys, &iters);
+  if (!s.ok()) {
     return s;
   }
-  *ret = value_to_dest.size();
-  int unused_ret;
-  return dinst->ZAdd(destination, value_to_dest, &unused_ret);
+  auto dest_inst = LockDBInstance(destination);
+  return dest_inst->ZsetsStore(
+      destination, [&](const ScoreMemberSink& sink) { return MergeZInter(iters, weights, agg, sink); }, ret);
 }
 
 Status Storage::ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                             std::vector<std::string>* members) {
   members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRangebylex(key, min, max, left_close, right_close, members);
 }
 
 Status Storage::ZLexcount(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                           int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZLexcount(key, min, max, left_close, right_close, ret);
 }
 
 Status Storage::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
                                int32_t* ret) {
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZRemrangebylex(key, min, max, left_close, right_close, ret);
 }
 
 Status Storage::ZScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<ScoreMember>* score_members, int64_t* next_cursor) {
   score_members->clear();
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   return inst->ZScan(key, cursor, pattern, count, score_members, next_cursor);
 }
 
@@ -1211,7 +1694,7 @@ int32_t Storage::Expire(const Slice& key, uint64_t ttl) {
   int32_t ret = 0;
   bool is_corruption = false;
 
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   // Strings
   Status s = inst->StringsExpire(key, ttl);
   if (s.ok()) {
@@ -1260,50 +1743,40 @@ int32_t Storage::Expire(const Slice& key, uint64_t ttl) {
 }
 
 int64_t Storage::Del(const std::vector<std::string>& keys) {
-  Status s;
-  int64_t count = 0;
-  bool is_corruption = false;
-
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    // Strings
-    Status s = inst->StringsDel(key);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
-    }
-
-    // Hashes
-    s = inst->HashesDel(key);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
-    }
-
-    // Sets
-    s = inst->SetsDel(key);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
-    }
+  int64_t count = 0;
+  bool is_corruption = false;
 
-    // Lists
-    s = inst->ListsDel(key);
+  auto count_deleted = [&](const Status& s) {
     if (s.ok()) {
       count++;
     } else if (!s.IsNotFound()) {
       is_corruption = true;
     }
+  };
 
-    // ZSets
-    s = inst->ZsetsDel(key);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
+  for (const auto& key : keys) {
+    auto inst = LockDBInstance(key);
+    bool is_string = false;
+    uint8_t collection_types = 0;
+    Status s = inst->LookupKeyTypes(key, &is_string, &collection_types);
+    if (!s.ok()) {
       is_corruption = true;
+      continue;
+    }
+    if (is_string) {
+      count_deleted(inst->StringsDel(key));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kHashes)) {
+      count_deleted(inst->HashesDel(key));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kSets)) {
+      count_deleted(inst->SetsDel(key));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kLists)) {
+      count_deleted(inst->ListsDel(key));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kZSets)) {
+      count_deleted(inst->ZsetsDel(key));
     }
   }
 
@@ -1320,7 +1793,7 @@ int64_t Storage::DelByType(const std::vector<std::string>& keys, const DataType&
   bool is_corruption = false;
 
   for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
+    auto inst = LockDBInstance(key);
     switch (type) {
       // Strings
       case DataType::kStrings: {
@@ -1389,45 +1862,39 @@ int64_t Storage::Exists(const std::vector<std::string>& keys) {
   int64_t count = 0;
   int32_t ret;
   uint64_t llen;
-  std::string value;
-  Status s;
   bool is_corruption = false;
 
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    s = inst->Get(key, &value);
+  auto count_existing = [&](const Status& s) {
     if (s.ok()) {
       count++;
     } else if (!s.IsNotFound()) {
       is_corruption = true;
     }
+  };
 
-    s = inst->HLen(key, &ret);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
+  for (const auto& key : keys) {
+    auto inst = LockDBInstance(key);
+    bool is_string = false;
+    uint8_t collection_types = 0;
+    Status s = inst->LookupKeyTypes(key, &is_string, &collection_types);
+    if (!s.ok()) {
       is_corruption = true;
+      continue;
     }
-
-    s = inst->SCard(key, &ret);
-    if (s.ok()) {
+    if (is_string) {
       count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
     }
-
-    s = inst->LLen(key, &llen);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
+    if (collection_types & TypeDirectoryBit(DataType::kHashes)) {
+      count_existing(inst->HLen(key, &ret));
     }
-
-    s = inst->ZCard(key, &ret);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
-      is_corruption = true;
+    if (collection_types & TypeDirectoryBit(DataType::kSets)) {
+      count_existing(inst->SCard(key, &ret));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kLists)) {
+      count_existing(inst->LLen(key, &llen));
+    }
+    if (collection_types & TypeDirectoryBit(DataType::kZSets)) {
+      count_existing(inst->ZCard(key, &ret));
     }
   }
 
@@ -1443,7 +1910,6 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
   keys->clear();
   bool is_finish;
   int64_t leftover_visits = count;
-  int64_t step_length = count;
   int64_t cursor_ret = 0;
   std::string start_key;
   std::string next_key;
@@ -1462,7 +1928,8 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
     // If want to scan all the databases, we start with the strings database
     key_type = dtype == DataType::kAll ? DataTypeTag[DataType::kStrings] : DataTypeTag[dtype];
     start_key = prefix;
-    cursor = 0;
+  } else if (start_key < prefix) {
+    start_key = prefix;
   }
 
   // collect types to scan
@@ -1510,9 +1977,7 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
     // store cursor
     if (!is_finish) {
       next_key = miter.Key();
-      cursor_ret = cursor + step_length;
-      StoreCursorStartKey(dtype, cursor_ret, type, next_key);
-      return cursor_ret;
+      return StoreCursorStartKey(dtype, type, next_key);
     }
 
     // for all type scan, move to next type, reset start_key
@@ -1694,7 +2159,7 @@ int32_t Storage::Expireat(const Slice& key, uint64_t timestamp) {
   int32_t count = 0;
   bool is_corruption = false;
 
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   s = inst->StringsExpireat(key, timestamp);
   if (s.ok()) {
     count++;
@@ -1741,7 +2206,7 @@ int32_t Storage::Persist(const Slice& key, std::map<DataType, Status>* type_stat
   int32_t count = 0;
   bool is_corruption = false;
 
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   s = inst->StringsPersist(key);
   if (s.ok()) {
     count++;
@@ -1794,7 +2259,7 @@ std::map<DataType, int64_t> Storage::TTL(const Slice& key, std::map<DataType, St
   std::map<DataType, int64_t> ret;
   uint64_t timestamp = 0;
 
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
   s = inst->StringsTTL(key, &timestamp);
   if (s.ok() || s.IsNotFound()) {
     ret[DataType::kStrings] = timestamp;
@@ -1840,58 +2305,67 @@ std::map<DataType, int64_t> Storage::TTL(const Slice& key, std::map<DataType, St
 Status Storage::GetType(const std::string& key, bool single, std::vector<std::string>& types) {
   types.clear();
 
-  Status s;
-  std::string value;
-  auto& inst = GetDBInstance(key);
-  s = inst->Get(key, &value);
-  if (s.ok()) {
-    types.emplace_back("string");
-  } else if (!s.IsNotFound()) {
-    return s;
-  }
-  if (single && !types.empty()) {
+  auto inst = LockDBInstance(key);
+  bool is_string = false;
+  uint8_t collection_types = 0;
+  Status s = inst->LookupKeyTypes(key, &is_string, &collection_types);
+  if (!s.ok()) {
     return s;
   }
-
-  int32_t hashes_len = 0;
-  s = inst->HLen(key, &hashes_len);
-  if (s.ok() && hashes_len != 0) {
-    types.emplace_back("hash");
-  } else if (!s.IsNotFound()) {
-    return s;
+  if (is_string) {
+    types.emplace_back("string");
   }
   if (single && !types.empty()) {
     return s;
   }
 
-  uint64_t lists_len = 0;
-  s = inst->LLen(key, &lists_len);
-  if (s.ok() && lists_len != 0) {
-    types.emplace_back("list");
-  } else if (!s.IsNotFound()) {
-    return s;
-  }
-  if (single && !types.empty()) {
-    return s;
+  if (collection_types & TypeDirectoryBit(DataType::kHashes)) {
+    int32_t hashes_len = 0;
+    s = inst->HLen(key, &hashes_len);
+    if (s.ok() && hashes_len != 0) {
+      types.emplace_back("hash");
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+    if (single && !types.empty()) {
+      return s;
+    }
   }
 
-  int32_t zsets_size = 0;
-  s = inst->ZCard(key, &zsets_size);
-  if (s.ok() && zsets_size != 0) {
-    types.emplace_back("zset");
-  } else if (!s.IsNotFound()) {
-    return s;
+  if (collection_types & TypeDirectoryBit(DataType::kLists)) {
+    uint64_t lists_len = 0;
+    s = inst->LLen(key, &lists_len);
+    if (s.ok() && lists_len != 0) {
+      types.emplace_back("list");
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+    if (single && !types.empty()) {
+      return s;
+    }
   }
-  if (single && !types.empty()) {
-    return s;
+
+  if (collection_types & TypeDirectoryBit(DataType::kZSets)) {
+    int32_t zsets_size = 0;
+    s = inst->ZCard(key, &zsets_size);
+    if (s.ok() && zsets_size != 0) {
+      types.emplace_back("zset");
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+    if (single && !types.empty()) {
+      return s;
+    }
   }
 
-  int32_t sets_size = 0;
-  s = inst->SCard(key, &sets_size);
-  if (s.ok() && sets_size != 0) {
-    types.emplace_back("set");
-  } else if (!s.IsNotFound()) {
-    return s;
+  if (collection_types & TypeDirectoryBit(DataType::kSets)) {
+    int32_t sets_size = 0;
+    s = inst->SCard(key, &sets_size);
+    if (s.ok() && sets_size != 0) {
+      types.emplace_back("set");
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
   }
   if (single && types.empty()) {
     types.emplace_back("none");
@@ -1932,9 +2406,13 @@ Status Storage::Keys(const DataType& data_type, const std::string& pattern, std:
 }
 
 Status Storage::Rename(const std::string& key, const std::string& newkey) {
+  if (key == newkey) {  // renaming a key to itself changes nothing
+    auto exists = Exists({key});
+    return exists < 0 ? Status::Corruption("lookup key fail") : exists == 0 ? Status::NotFound() : Status::OK();
+  }
   Status ret = Status::NotFound();
-  auto& inst = GetDBInstance(key);
-  auto& new_inst = GetDBInstance(newkey);
+  auto inst = LockDBInstance(key);
+  auto new_inst = LockDBInstance(newkey, &inst);
 
   // Strings
   Status s = inst->StringsRename(key, new_inst.get(), newkey);
@@ -1980,9 +2458,13 @@ Status Storage::Rename(const std::string& key, const std::string& newkey) {
 }
 
 Status Storage::Renamenx(const std::string& key, const std::string& newkey) {
+  if (key == newkey) {  // the new key is the existing key
+    auto exists = Exists({key});
+    return exists < 0 ? Status::IOError("lookup key fail") : exists == 0 ? Status::NotFound() : Status::Corruption();
+  }
   Status ret = Status::NotFound();
-  auto& inst = GetDBInstance(key);
-  auto& new_inst = GetDBInstance(newkey);
+  auto inst = LockDBInstance(key);
+  auto new_inst = LockDBInstance(newkey, &inst);
 
   // Strings
   Status s = inst->StringsRenamenx(key, new_inst.get(), newkey);
@@ -2063,30 +2545,31 @@ Status Storage::PfAdd(const Slice& key, const std::vector<std::string>& values,
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  std::string value;
-  std::string registers;
-  std::string result;
-  auto& inst = GetDBInstance(key);
-  Status s = inst->Get(key, &value);
-  if (s.ok()) {
-    registers = value;
-  } else if (s.IsNotFound()) {
-    registers = "";
-  } else {
-    return s;
-  }
-  HyperLogLog log(kPrecision, registers);
-  auto previous = static_cast<int32_t>(log.Estimate());
-  for (const auto& value : values) {
-    result = log.Add(value.data(), value.size());
-  }
-  HyperLogLog update_log(kPrecision, result);
-  auto now = static_cast<int32_t>(update_log.Estimate());
-  if (previous != now || (s.IsNotFound() && values.empty())) {
-    *update = true;
+  auto inst = LockDBInstance(key);
+  return inst->PfAdd(key, values, update);
+}
+
+// Max of the registers of keys, one byte per register. The values are read
+// from their own instances without locks, as the other read commands do.
+Status Storage::PfMergeRegisters(const std::vector<std::string>& keys, uint8_t* max_registers) {
+  for (const auto& key : keys) {
+    std::string value;
+    auto inst = LockDBInstance(key);
+    Status s = inst->Get(key, &value);
+    if (s.IsNotFound()) {
+      continue;
+    } else if (!s.ok()) {
+      return s;
+    }
+    HyperLogLog log(&value);
+    if (!log.IsValid()) {
+      return Status::InvalidArgument("WRONGTYPE Key is not a valid HyperLogLog string value.");
+    }
+    if (!log.MergeTo(max_registers)) {
+      return Status::Corruption("INVALIDOBJ Corrupted HLL object detected");
+    }
   }
-  s = inst->Set(key, result);
-  return s;
+  return Status::OK();
 }
 
 Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
@@ -2094,33 +2577,35 @@ Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  std::string value;
-  std::string first_registers;
-  auto& inst = GetDBInstance(keys[0]);
-  Status s = inst->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
-  }
-
-  HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
+  *result = 0;
+  if (keys.size() == 1) {
+    // a single key may use the cached cardinality
     std::string value;
-    std::string registers;
-    auto& inst = GetDBInstance(keys[i]);
-    s = inst->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = value;
-    } else if (s.IsNotFound()) {
-      continue;
-    } else {
+    auto inst = LockDBInstance(keys[0]);
+    Status s = inst->Get(keys[0], &value);
+    if (s.IsNotFound()) {
+      return Status::OK();
+    } else if (!s.ok()) {
       return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    first_log.Merge(log);
+    HyperLogLog log(&value);
+    if (!log.IsValid()) {
+      return Status::InvalidArgument("WRONGTYPE Key is not a valid HyperLogLog string value.");
+    }
+    uint64_t card = 0;
+    if (!log.Count(&card)) {
+      return Status::Corruption("INVALIDOBJ Corrupted HLL object detected");
+    }
+    *result = static_cast<int64_t>(card);
+    return Status::OK();
+  }
+
+  std::vector<uint8_t> max_registers(HyperLogLog::kRegisters, 0);
+  Status s = PfMergeRegisters(keys, max_registers.data());
+  if (!s.ok()) {
+    return s;
   }
-  *result = static_cast<int32_t>(first_log.Estimate());
+  *result = static_cast<int64_t>(HyperLogLog::CountRegisters(max_registers.data()));
   return Status::OK();
 }
 
@@ -2129,39 +2614,14 @@ Status Storage::PfMerge(const std::vector<std::string>& keys, std::string& value
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  Status s;
-  std::string value;
-  std::string first_registers;
-  std::string result;
-  auto& inst = GetDBInstance(keys[0]);
-  s = inst->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
-  }
-
-  result = first_registers;
-  HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
-    std::string value;
-    std::string registers;
-    auto& tmp_inst = GetDBInstance(keys[i]);
-    s = tmp_inst->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = std::string(value.data(), value.size());
-    } else if (s.IsNotFound()) {
-      continue;
-    } else {
-      return s;
-    }
-    HyperLogLog log(kPrecision, registers);
-    result = first_log.Merge(log);
+  // keys[0] is both the destination and a source, it is merged under its lock
+  std::vector<uint8_t> max_registers(HyperLogLog::kRegisters, 0);
+  Status s = PfMergeRegisters(std::vector<std::string>(keys.begin() + 1, keys.end()), max_registers.data());
+  if (!s.ok()) {
+    return s;
   }
-  auto& ninst = GetDBInstance(keys[0]);
-  s = ninst->Set(keys[0], result);
-  value_to_dest = std::move(result);
-  return s;
+  auto inst = LockDBInstance(keys[0]);
+  return inst->PfMerge(keys[0], max_registers.data(), &value_to_dest);
 }
 
 static void* StartBGThreadWrapper(void* arg) {
@@ -2294,7 +2754,7 @@ Status Storage::CompactRange(const DataType& type, const std::string& start, con
 
 Status Storage::DoCompactSpecificKey(const DataType& type, const std::string& key) {
   Status s;
-  auto& inst = GetDBInstance(key);
+  auto inst = LockDBInstance(key);
 
   std::string start_key;
   std::string end_key;
@@ -2366,6 +2826,39 @@ Status Storage::GetUsage(const std::string& property, std::map<int, uint64_t>* c
   return Status::OK();
 }
 
+Status Storage::GetAggregatedUsage(const std::string& property, std::map<int, uint64_t>* const inst_result) {
+  inst_result->clear();
+  for (const auto& inst : insts_) {
+    uint64_t value = 0;
+    Status s = inst->GetAggregatedProperty(property, &value);
+    if (!s.ok()) {
+      return s;
+    }
+    (*inst_result)[inst->GetIndex()] = value;
+  }
+  return Status::OK();
+}
+
+Status Storage::GetSstFileOptions(int inst_id, std::map<std::string, rocksdb::Options>* const file_options) {
+  file_options->clear();
+  if (inst_id < 0 || inst_id >= static_cast<int>(insts_.size())) {
+    return Status::InvalidArgument("no instance " + std::to_string(inst_id));
+  }
+  auto db = insts_[inst_id]->GetDB();
+  std::map<std::string, rocksdb::Options> cf_options;
+  for (auto handle : insts_[inst_id]->GetColumnFamilyHandles()) {
+    cf_options.emplace(handle->GetName(), db->GetOptions(handle));
+  }
+  std::vector<rocksdb::LiveFileMetaData> files;
+  db->GetLiveFilesMetaData(&files);
+  for (const auto& file : files) {
+    if (auto it = cf_options.find(file.column_family_name); it != cf_options.end()) {
+      file_options->emplace(file.relative_filename, it->second);
+    }
+  }
+  return Status::OK();
+}
+
 uint64_t Storage::GetProperty(const std::string& property) {
   uint64_t out = 0;
   uint64_t result = 0;
@@ -2404,6 +2897,117 @@ Status Storage::StopScanKeyNum() {
   return Status::OK();
 }
 
+void Storage::RecordHotKey(const Slice& key, uint64_t weight) {
+  auto inst = LockDBInstance(key);
+  inst->GetHotKeys().Record(key, weight);
+}
+
+std::vector<std::pair<std::string, uint64_t>> Storage::GetHotKeys(size_t count) {
+  // a key migrated lately may be counted by two instances
+  std::map<std::string, uint64_t> merged;
+  for (const auto& inst : insts_) {
+    for (auto& [key, accesses] : inst->GetHotKeys().Top(count)) {
+      merged[std::move(key)] += accesses;
+    }
+  }
+  std::vector<std::pair<std::string, uint64_t>> hot_keys(merged.begin(), merged.end());
+  std::sort(hot_keys.begin(), hot_keys.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+  if (hot_keys.size() > count) {
+    hot_keys.resize(count);
+  }
+  return hot_keys;
+}
+
+void Storage::ClearHotKeys() {
+  for (const auto& inst : insts_) {
+    inst->GetHotKeys().Clear();
+  }
+}
+
+Status Storage::StartBigKeysScan(size_t top, uint64_t keys_per_second) {
+  std::lock_guard l(bigkeys_mutex_);
+  if (bigkeys_report_.running) {
+    return Status::Busy("a big keys scan is running");
+  }
+  if (bigkeys_thread_.joinable()) {
+    bigkeys_thread_.join();
+  }
+  bigkeys_report_ = BigKeysReport();
+  bigkeys_report_.running = true;
+  bigkeys_report_.start_time = pstd::UnixTimestamp();
+  bigkeys_thread_ = std::thread([this, top, keys_per_second] { DoScanBigKeys(top, keys_per_second); });
+  return Status::OK();
+}
+
+Status Storage::DoScanBigKeys(size_t top, uint64_t keys_per_second) {
+  // paced by batches of a hundredth of a second
+  uint64_t batch = keys_per_second == 0 ? 1024 : std::max<uint64_t>(keys_per_second / 100, 1);
+  uint64_t scanned = 0;
+  uint64_t batch_start = pstd::NowMicros();
+  auto pace = [&]() {
+    if (bigkeys_should_exit_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    if (++scanned % batch != 0) {
+      return true;
+    }
+    if (keys_per_second != 0) {
+      uint64_t expected = batch * 1000000 / keys_per_second;
+      uint64_t elapsed = pstd::NowMicros() - batch_start;
+      if (elapsed < expected) {
+        std::this_thread::sleep_for(std::chrono::microseconds(expected - elapsed));
+      }
+      batch_start = pstd::NowMicros();
+    }
+    std::lock_guard l(bigkeys_mutex_);
+    bigkeys_report_.scanned_keys = scanned;
+    return true;
+  };
+
+  Status s;
+  std::vector<BigKeyInfo> keys;
+  for (auto type : {DataType::kHashes, DataType::kSets, DataType::kZSets, DataType::kLists}) {
+    std::vector<BigKeyInfo> type_keys;
+    for (const auto& inst : insts_) {
+      s = inst->ScanBigKeys(type, top, pace, &type_keys);
+      if (!s.ok()) {
+        break;
+      }
+    }
+    if (!s.ok()) {
+      break;
+    }
+    std::sort(type_keys.begin(), type_keys.end(), [](const auto& a, const auto& b) { return a.count > b.count; });
+    if (type_keys.size() > top) {
+      type_keys.resize(top);
+    }
+    keys.insert(keys.end(), std::make_move_iterator(type_keys.begin()), std::make_move_iterator(type_keys.end()));
+  }
+
+  std::lock_guard l(bigkeys_mutex_);
+  bigkeys_report_.running = false;
+  bigkeys_report_.end_time = pstd::UnixTimestamp();
+  bigkeys_report_.scanned_keys = scanned;
+  if (s.ok()) {
+    bigkeys_report_.keys = std::move(keys);
+  } else {
+    bigkeys_report_.error = s.ToString();
+  }
+  return s;
+}
+
+BigKeysReport Storage::GetBigKeysReport() {
+  std::lock_guard l(bigkeys_mutex_);
+  return bigkeys_report_;
+}
+
+void Storage::StopBigKeysScan() {
+  bigkeys_should_exit_.store(true);
+  if (bigkeys_thread_.joinable()) {
+    bigkeys_thread_.join();
+  }
+}
+
 rocksdb::DB* Storage::GetDBByIndex(int index) {
   if (index < 0 || index >= db_instance_num_) {
     WARN("Invalid DB Index: {} total: {}", index, db_instance_num_);
@@ -2432,37 +3036,37 @@ void Storage::GetRocksDBInfo(std::string& info) {
 }
 
 int64_t Storage::IsExist(const Slice& key, std::map<DataType, Status>* type_status) {
-  std::string value;
   int32_t ret = 0;
   int64_t type_count = 0;
-  auto& inst = GetDBInstance(key);
-  Status s = inst->Get(key, &value);
-  (*type_status)[DataType::kStrings] = s;
-  if (s.ok()) {
-    type_count++;
-  }
-  s = inst->HLen(key, &ret);
-  (*type_status)[DataType::kHashes] = s;
-  if (s.ok()) {
-    type_count++;
-  }
-  s = inst->SCard(key, &ret);
-  (*type_status)[DataType::kSets] = s;
-  if (s.ok()) {
-    type_count++;
-  }
-  uint64_t llen = 0;
-  s = inst->LLen(key, &llen);
-  (*type_status)[DataType::kLists] = s;
-  if (s.ok()) {
-    type_count++;
+  auto inst = LockDBInstance(key);
+  bool is_string = false;
+  uint8_t collection_types = 0;
+  Status s = inst->LookupKeyTypes(key, &is_string, &collection_types);
+  if (!s.ok()) {
+    for (auto dtype : {DataType::kStrings, DataType::kHashes, DataType::kSets, DataType::kLists, DataType::kZSets}) {
+      (*type_status)[dtype] = s;
+    }
+    return type_count;
   }
+  // types missing from the directory are reported as not found without being read
+  auto lookup = [&](const DataType& dtype, auto&& read) {
+    s = (collection_types & TypeDirectoryBit(dtype)) ? read() : Status::NotFound();
+    (*type_status)[dtype] = s;
+    if (s.ok()) {
+      type_count++;
+    }
+  };
 
-  s = inst->ZCard(key, &ret);
-  (*type_status)[DataType::kZSets] = s;
+  s = is_string ? Status::OK() : Status::NotFound();
+  (*type_status)[DataType::kStrings] = s;
   if (s.ok()) {
     type_count++;
   }
+  lookup(DataType::kHashes, [&] { return inst->HLen(key, &ret); });
+  lookup(DataType::kSets, [&] { return inst->SCard(key, &ret); });
+  uint64_t llen = 0;
+  lookup(DataType::kLists, [&] { return inst->LLen(key, &llen); });
+  lookup(DataType::kZSets, [&] { return inst->ZCard(key, &ret); });
   return type_count;
 }
 
@@ -2472,48 +3076,161 @@ void Storage::DisableWal(const bool is_wal_disable) {
   }
 }
 
-Status Storage::OnBinlogWrite(const pikiwidb::Binlog& log, LogIndex log_idx) {
-  auto& inst = insts_[log.slot_idx()];
+namespace {
 
-  rocksdb::WriteBatch batch;
-  bool is_finished_start = true;
-  auto seqno = inst->GetDB()->GetLatestSequenceNumber();
-  for (const auto& entry : log.entries()) {
-    if (inst->IsRestarting() && inst->IsApplied(entry.cf_idx(), log_idx)) [[unlikely]] {
-      // If the starting phase is over, the log must not have been applied
-      // If the starting phase is not over and the log has been applied, skip it.
-      WARN("Log {} has been applied", log_idx);
-      is_finished_start = false;
-      continue;
+// Walks the entries of a binlog before it is written, recording the log index of their column families. While the
+// instance restarts, only the entries whose column family has not persisted the log yet are copied into *pending.
+class BinlogApplier : public rocksdb::WriteBatch::Handler {
+ public:
+  BinlogApplier(Redis* inst, LogIndex log_idx, rocksdb::SequenceNumber seqno, rocksdb::WriteBatch* pending)
+      : inst_(inst), log_idx_(log_idx), seqno_(seqno), pending_(pending) {}
+
+  Status PutCF(uint32_t cf_idx, const Slice& key, const Slice& value) override { return Apply(cf_idx, key, &value); }
+  Status DeleteCF(uint32_t cf_idx, const Slice& key) override { return Apply(cf_idx, key, nullptr); }
+
+  bool skipped() const { return skipped_; }
+  bool has_directory_merge() const { return has_directory_merge_; }
+
+ private:
+  Status Apply(uint32_t cf_idx, const Slice& key, const Slice* value) {
+    if (cf_idx >= kColumnFamilyNum) {
+      static constexpr std::string_view msg = "Unknown column family in binlog";
+      ERROR(msg);
+      return Status::Incomplete(msg);
+    }
+    if (pending_) {
+      const auto& handles = inst_->GetColumnFamilyHandles();
+      if (inst_->IsApplied(cf_idx, log_idx_)) {
+        // If the starting phase is over, the log must not have been applied
+        // If the starting phase is not over and the log has been applied, skip it.
+        WARN("Log {} has been applied", log_idx_);
+        skipped_ = true;
+        // the directory may have been flushed behind the meta column family it covers
+        DataType dtype = MetaColumnFamilyType(static_cast<int>(cf_idx));
+        if (value && dtype != DataType::kAll && !inst_->IsApplied(kTypeDirectoryCF, log_idx_)) {
+          char bit = static_cast<char>(TypeDirectoryBit(dtype));
+          pending_->Merge(handles[kTypeDirectoryCF], key, Slice(&bit, 1));
+          has_directory_merge_ = true;
+          ++seqno_;
+        }
+        return Status::OK();
+      }
+      if (value) {
+        pending_->Put(handles[cf_idx], key, *value);
+      } else {
+        pending_->Delete(handles[cf_idx], key);
+      }
     }
+    inst_->UpdateAppliedLogIndexOfColumnFamily(cf_idx, log_idx_, ++seqno_);
+    return Status::OK();
+  }
 
+  Redis* inst_ = nullptr;
+  LogIndex log_idx_ = 0;
+  rocksdb::SequenceNumber seqno_ = 0;
+  rocksdb::WriteBatch* pending_ = nullptr;
+  bool skipped_ = false;
+  bool has_directory_merge_ = false;
+};
+
+}  // namespace
+
+Status Storage::ToFlatBinlog(const pikiwidb::Binlog& log, FlatBinlog* flat_log) const {
+  const auto& handles = insts_[log.slot_idx()]->GetColumnFamilyHandles();
+
+  *flat_log = FlatBinlog(log.db_id(), log.slot_idx());
+  for (const auto& entry : log.entries()) {
+    if (entry.cf_idx() >= kColumnFamilyNum) {
+      static constexpr std::string_view msg = "Unknown column family in binlog";
+      ERROR(msg);
+      return Status::Incomplete(msg);
+    }
     switch (entry.op_type()) {
       case pikiwidb::OperateType::kPut: {
         assert(entry.has_value());
-        batch.Put(inst->GetColumnFamilyHandles()[entry.cf_idx()], entry.key(), entry.value());
+        flat_log->batch()->Put(handles[entry.cf_idx()], entry.key(), entry.value());
       } break;
       case pikiwidb::OperateType::kDelete: {
         assert(!entry.has_value());
-        batch.Delete(inst->GetColumnFamilyHandles()[entry.cf_idx()], entry.key());
+        flat_log->batch()->Delete(handles[entry.cf_idx()], entry.key());
       } break;
       default:
         static constexpr std::string_view msg = "Unknown operate type in binlog";
         ERROR(msg);
         return Status::Incomplete(msg);
     }
-    inst->UpdateAppliedLogIndexOfColumnFamily(entry.cf_idx(), log_idx, ++seqno);
   }
-  if (inst->IsRestarting() && is_finished_start) [[unlikely]] {
-    INFO("Redis {} finished start phase", inst->GetIndex());
-    inst->StartingPhaseEnd();
+  return Status::OK();
+}
+
+Status Storage::OnBinlogWrite(FlatBinlog&& log, LogIndex log_idx) {
+  std::vector<std::pair<FlatBinlog, LogIndex>> logs;
+  logs.emplace_back(std::move(log), log_idx);
+  return OnBinlogWrite(std::move(logs));
+}
+
+Status Storage::OnBinlogWrite(std::vector<std::pair<FlatBinlog, LogIndex>>&& logs) {
+  if (logs.empty()) {
+    return Status::OK();
+  }
+  auto slot_idx = logs.front().first.slot_idx();
+  for (const auto& [log, log_idx] : logs) {
+    if (log.slot_idx() != slot_idx) {
+      return Status::InvalidArgument("Binlogs of several instances");
+    }
   }
+  auto& inst = insts_[slot_idx];
+
+  // The batches received are written as is, unless some entries must be skipped
+  // while restarting. Several logs are appended to one batch and written at once.
+  rocksdb::WriteBatch group;
+  // The index in batch of the first entry of each log
+  std::vector<uint32_t> offsets;
+  offsets.reserve(logs.size());
+  bool has_directory_merge = false;
   auto first_seqno = inst->GetDB()->GetLatestSequenceNumber() + 1;
-  auto s = inst->GetDB()->Write(inst->GetWriteOptions(), &batch);
+  for (auto& [log, log_idx] : logs) {
+    auto offset = static_cast<uint32_t>(group.Count());
+    rocksdb::WriteBatch pending;
+    bool is_restarting = inst->IsRestarting();
+    BinlogApplier applier(inst.get(), log_idx, first_seqno - 1 + offset, is_restarting ? &pending : nullptr);
+    auto s = log.batch()->Iterate(&applier);
+    if (!s.ok()) {
+      return s;
+    }
+    if (is_restarting) [[unlikely]] {
+      if (!applier.skipped()) {
+        INFO("Redis {} finished start phase", inst->GetIndex());
+        inst->StartingPhaseEnd();
+      }
+    }
+    has_directory_merge = has_directory_merge || applier.has_directory_merge();
+
+    rocksdb::WriteBatch* entries = is_restarting ? &pending : log.batch();
+    if (logs.size() == 1) {
+      group = std::move(*entries);
+    } else {
+      s = rocksdb::WriteBatchInternal::Append(&group, entries);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    offsets.push_back(offset);
+  }
+
+  auto written = group.Count();
+  auto s = inst->GetDB()->Write(inst->GetWriteOptions(), &group);
   if (!s.ok()) {
     // TODO(longfar): What we should do if the write operation failed ? 💥
     return s;
   }
-  inst->UpdateLogIndex(log_idx, first_seqno);
+  if (has_directory_merge || group.Count() > written) {
+    // the type directory merges were appended after the entries of the logs
+    inst->UpdateAppliedLogIndexOfColumnFamily(kTypeDirectoryCF, logs.back().second, first_seqno + group.Count() - 1);
+  }
+  for (size_t i = 0; i < logs.size(); i++) {
+    inst->UpdateLogIndex(logs[i].second, first_seqno + offsets[i]);
+  }
   return s;
 }
 
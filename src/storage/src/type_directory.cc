@@ -0,0 +1,233 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/type_directory.h"
+
+#include <string>
+
+#include "pstd/log.h"
+#include "src/base_meta_value_format.h"
+#include "src/lists_meta_value_format.h"
+
+namespace storage {
+
+namespace {
+
+// Meta values read before a batch of directory merges is written while building
+constexpr uint32_t kBuildBatchSize = 1024;
+
+// Collects the keys of the meta values put by a write batch
+class MetaPutCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  MetaPutCollector(const std::vector<std::pair<uint32_t, DataType>>& meta_cfs,
+                   std::vector<std::pair<std::string, DataType>>* puts)
+      : meta_cfs_(meta_cfs), puts_(puts) {}
+
+  rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice&) override {
+    for (const auto& [id, dtype] : meta_cfs_) {
+      if (id == column_family_id) {
+        puts_->emplace_back(key.ToString(), dtype);
+        break;
+      }
+    }
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status DeleteCF(uint32_t, const rocksdb::Slice&) override { return rocksdb::Status::OK(); }
+  rocksdb::Status SingleDeleteCF(uint32_t, const rocksdb::Slice&) override { return rocksdb::Status::OK(); }
+  rocksdb::Status DeleteRangeCF(uint32_t, const rocksdb::Slice&, const rocksdb::Slice&) override {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status MergeCF(uint32_t, const rocksdb::Slice&, const rocksdb::Slice&) override {
+    return rocksdb::Status::OK();
+  }
+
+ private:
+  const std::vector<std::pair<uint32_t, DataType>>& meta_cfs_;
+  std::vector<std::pair<std::string, DataType>>* puts_;
+};
+
+}  // namespace
+
+DataType MetaColumnFamilyType(int cf_idx) {
+  switch (cf_idx) {
+    case kHashesMetaCF:
+      return DataType::kHashes;
+    case kSetsMetaCF:
+      return DataType::kSets;
+    case kListsMetaCF:
+      return DataType::kLists;
+    case kZsetsMetaCF:
+      return DataType::kZSets;
+    default:
+      return DataType::kAll;
+  }
+}
+
+bool TypeDirectoryMergeOperator::Merge(const rocksdb::Slice&, const rocksdb::Slice* existing_value,
+                                       const rocksdb::Slice& value, std::string* new_value, rocksdb::Logger*) const {
+  uint8_t bits = value.empty() ? 0 : static_cast<uint8_t>(value[0]);
+  if (existing_value && !existing_value->empty()) {
+    bits |= static_cast<uint8_t>((*existing_value)[0]);
+  }
+  new_value->assign(1, static_cast<char>(bits));
+  return true;
+}
+
+bool TypeDirectoryFilter::IsValidMeta(int cf_idx, const rocksdb::Slice& key) const {
+  if (meta_iters_.empty()) {
+    meta_iters_.resize(cf_handles_ptr_->size());
+  }
+  auto& iter = meta_iters_[cf_idx];
+  if (!iter) {
+    iter.reset(db_->NewIterator(rocksdb::ReadOptions(), (*cf_handles_ptr_)[cf_idx]));
+    iter->Seek(key);
+  } else if (iter->Valid() && iter->key().compare(key) < 0) {
+    // the next meta key is usually the one of the next directory entry
+    iter->Next();
+    if (iter->Valid() && iter->key().compare(key) < 0) {
+      iter->Seek(key);
+    }
+  } else if (!iter->Valid()) {
+    if (!iter->status().ok()) {
+      return true;
+    }
+    // past the last meta key, keys of the compaction only grow
+    return false;
+  }
+  if (!iter->status().ok()) {
+    // keep the bit of a key we could not read
+    return true;
+  }
+  if (!iter->Valid() || iter->key() != key) {
+    return false;
+  }
+  std::string meta_value = iter->value().ToString();
+  if (cf_idx == kListsMetaCF) {
+    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+    return parsed_lists_meta_value.IsValid();
+  }
+  ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+  return parsed_base_meta_value.IsValid();
+}
+
+bool TypeDirectoryFilter::Filter(int, const rocksdb::Slice& key, const rocksdb::Slice& value,
+                                 std::string* new_value, bool* value_changed) const {
+  // destroyed when closing the database, keep the entry
+  if (value.empty() || cf_handles_ptr_->empty()) {
+    return false;
+  }
+  auto bits = static_cast<uint8_t>(value[0]);
+  uint8_t kept = 0;
+  for (int cf_idx : {kHashesMetaCF, kSetsMetaCF, kListsMetaCF, kZsetsMetaCF}) {
+    uint8_t bit = TypeDirectoryBit(MetaColumnFamilyType(cf_idx));
+    if ((bits & bit) != 0 && IsValidMeta(cf_idx, key)) {
+      kept |= bit;
+    }
+  }
+  if (kept == 0) {
+    return true;
+  }
+  if (kept != bits) {
+    new_value->assign(1, static_cast<char>(kept));
+    *value_changed = true;
+  }
+  return false;
+}
+
+TypeDirectoryDB::TypeDirectoryDB(rocksdb::DB* db, const std::vector<rocksdb::ColumnFamilyHandle*>& handles)
+    : rocksdb::StackableDB(db), directory_(handles[kTypeDirectoryCF]) {
+  for (int cf_idx = 0; cf_idx < static_cast<int>(handles.size()); cf_idx++) {
+    DataType dtype = MetaColumnFamilyType(cf_idx);
+    if (dtype != DataType::kAll) {
+      meta_cfs_.emplace_back(handles[cf_idx]->GetID(), dtype);
+      meta_handles_.push_back(handles[cf_idx]);
+    }
+  }
+}
+
+DataType TypeDirectoryDB::ColumnFamilyIdType(uint32_t cf_id) const {
+  for (const auto& [id, dtype] : meta_cfs_) {
+    if (id == cf_id) {
+      return dtype;
+    }
+  }
+  return DataType::kAll;
+}
+
+rocksdb::Status TypeDirectoryDB::Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                                     const rocksdb::Slice& key, const rocksdb::Slice& value) {
+  DataType dtype = ColumnFamilyIdType(column_family->GetID());
+  if (dtype == DataType::kAll) {
+    return rocksdb::StackableDB::Put(options, column_family, key, value);
+  }
+  rocksdb::WriteBatch batch;
+  batch.Put(column_family, key, value);
+  char bit = static_cast<char>(TypeDirectoryBit(dtype));
+  batch.Merge(directory_, key, rocksdb::Slice(&bit, 1));
+  return rocksdb::StackableDB::Write(options, &batch);
+}
+
+rocksdb::Status TypeDirectoryDB::Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) {
+  AddTypeBits(updates);
+  return rocksdb::StackableDB::Write(options, updates);
+}
+
+int TypeDirectoryDB::AddTypeBits(rocksdb::WriteBatch* updates) const {
+  std::vector<std::pair<std::string, DataType>> puts;
+  MetaPutCollector collector(meta_cfs_, &puts);
+  updates->Iterate(&collector);
+  for (const auto& [key, dtype] : puts) {
+    char bit = static_cast<char>(TypeDirectoryBit(dtype));
+    updates->Merge(directory_, key, rocksdb::Slice(&bit, 1));
+  }
+  return static_cast<int>(puts.size());
+}
+
+rocksdb::Status TypeDirectoryDB::BuildIfNeeded(const std::string& db_path, bool created) {
+  rocksdb::Env* env = GetEnv();
+  std::string built_file = db_path + "/" + kTypeDirectoryBuiltFile;
+  if (env->FileExists(built_file).ok()) {
+    return rocksdb::Status::OK();
+  }
+
+  if (!created) {
+    INFO("building the type directory of {} from the meta column families", db_path);
+    uint64_t count = 0;
+    rocksdb::Status s;
+    for (size_t i = 0; i < meta_handles_.size(); i++) {
+      char bit = static_cast<char>(TypeDirectoryBit(meta_cfs_[i].second));
+      std::unique_ptr<rocksdb::Iterator> iter(NewIterator(rocksdb::ReadOptions(), meta_handles_[i]));
+      rocksdb::WriteBatch batch;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        batch.Merge(directory_, iter->key(), rocksdb::Slice(&bit, 1));
+        count++;
+        if (batch.Count() == kBuildBatchSize) {
+          s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+          if (!s.ok()) {
+            return s;
+          }
+          batch.Clear();
+        }
+      }
+      if (!iter->status().ok()) {
+        return iter->status();
+      }
+      s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    // the file below must not outlive the merges if the WAL is disabled
+    s = Flush(rocksdb::FlushOptions(), directory_);
+    if (!s.ok()) {
+      return s;
+    }
+    INFO("type directory of {} built from {} meta values", db_path, count);
+  }
+  // a file rather than a key, so that opening a new database writes nothing to it
+  return rocksdb::WriteStringToFile(env, rocksdb::Slice(), built_file, true);
+}
+
+}  // namespace storage
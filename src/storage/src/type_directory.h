@@ -0,0 +1,137 @@
+//  Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_TYPE_DIRECTORY_H_
+#define SRC_TYPE_DIRECTORY_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+#include "rocksdb/env.h"
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/utilities/stackable_db.h"
+#include "rocksdb/write_batch.h"
+
+#include "storage/storage.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * The type directory column family maps the encoded meta key of a user key
+ * to a one byte bitmap of the collection types (hash, set, list, zset) that
+ * may hold the key, so TYPE, EXISTS and DEL read one entry instead of probing
+ * every meta column family. Strings are left out: the strings column family
+ * is read in the same MultiGet, and SET does not pay for the directory.
+ *
+ * Bits are added with a merge whenever a meta value is put, and only cleared
+ * by compactions once the meta value is gone or no longer valid. A bit may
+ * outlive its key (deleted or expired) until then, so a set bit is a
+ * candidate that is checked in its meta column family, a clear bit is never
+ * wrong: a meta value put after the compaction read it comes with a newer
+ * merge setting the bit again.
+ */
+constexpr const char* kTypeDirectoryCFName = "type_directory_cf";
+
+// Created in the directory of an instance once the type directory covers all its meta values
+constexpr const char* kTypeDirectoryBuiltFile = "TYPE_DIRECTORY";
+
+// Merges of a key kept in a memtable before they are folded into a value, the
+// bit of a hot collection is merged again on every write to it
+constexpr size_t kTypeDirectoryMaxSuccessiveMerges = 4;
+
+inline uint8_t TypeDirectoryBit(const DataType& dtype) { return static_cast<uint8_t>(1U << dtype); }
+
+// The collection type whose meta values live in cf_idx, kAll if there is none
+DataType MetaColumnFamilyType(int cf_idx);
+
+// ORs the bitmaps merged into an entry
+class TypeDirectoryMergeOperator : public rocksdb::AssociativeMergeOperator {
+ public:
+  bool Merge(const rocksdb::Slice& key, const rocksdb::Slice* existing_value, const rocksdb::Slice& value,
+             std::string* new_value, rocksdb::Logger* logger) const override;
+  const char* Name() const override { return "TypeDirectoryMergeOperator"; }
+};
+
+// Clears the bits of the types whose meta value is missing or not valid, and
+// drops the entries left with none.
+//
+// A compaction hands its keys in order, so the meta values are read with one
+// iterator per type, created on the first key with its bit, that moves forward
+// with the compaction instead of a point lookup per bit. The iterators read
+// from the time they are created, after the input of the compaction is fixed,
+// so a meta value put later comes with a merge the compaction does not see.
+class TypeDirectoryFilter : public rocksdb::CompactionFilter {
+ public:
+  TypeDirectoryFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr) {}
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override;
+  const char* Name() const override { return "TypeDirectoryFilter"; }
+
+ private:
+  // Positions the iterator of cf_idx at key, returns whether the meta value of key is valid
+  bool IsValidMeta(int cf_idx, const rocksdb::Slice& key) const;
+
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  // Iterators of the meta column families, indexed by column family
+  mutable std::vector<std::unique_ptr<rocksdb::Iterator>> meta_iters_;
+};
+
+class TypeDirectoryFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  TypeDirectoryFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {}
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::make_unique<TypeDirectoryFilter>(*db_ptr_, cf_handles_ptr_);
+  }
+  const char* Name() const override { return "TypeDirectoryFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+};
+
+/*
+ * Wraps the DB of an instance so that every write putting a meta value, from
+ * any write path, also merges the type bit of the key into the directory in
+ * the same atomic write.
+ */
+class TypeDirectoryDB : public rocksdb::StackableDB {
+ public:
+  TypeDirectoryDB(rocksdb::DB* db, const std::vector<rocksdb::ColumnFamilyHandle*>& handles);
+
+  using rocksdb::StackableDB::Put;
+  rocksdb::Status Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                      const rocksdb::Slice& key, const rocksdb::Slice& value) override;
+  rocksdb::Status Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) override;
+
+  // Appends the directory merges of the meta values put by updates, returns how many were added
+  int AddTypeBits(rocksdb::WriteBatch* updates) const;
+
+  // Fills the directory from the meta column families, for databases written
+  // before the directory existed, unless it was already done. A database
+  // created by this open has nothing to fill.
+  rocksdb::Status BuildIfNeeded(const std::string& db_path, bool created);
+
+ private:
+  DataType ColumnFamilyIdType(uint32_t cf_id) const;
+
+  rocksdb::ColumnFamilyHandle* directory_ = nullptr;
+  // (column family id, type) of the meta column families
+  std::vector<std::pair<uint32_t, DataType>> meta_cfs_;
+  std::vector<rocksdb::ColumnFamilyHandle*> meta_handles_;
+};
+
+}  // namespace storage
+
+#endif  // SRC_TYPE_DIRECTORY_H_
@@ -6,6 +6,7 @@
 #ifndef TYPE_ITERATOR_H_
 #define TYPE_ITERATOR_H_
 
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -42,48 +43,51 @@ class TypeIterator {
 
   virtual void Seek(const std::string& start_key) {
     raw_iter_->Seek(Slice(start_key));
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Next();
     }
   }
 
   void SeekToFirst() {
     raw_iter_->SeekToFirst();
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Next();
     }
   }
 
   void SeekToLast() {
     raw_iter_->SeekToLast();
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Prev();
     }
   }
 
   virtual void SeekForPrev(const std::string& start_key) {
     raw_iter_->SeekForPrev(Slice(start_key));
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Prev();
     }
   }
 
   void Next() {
     raw_iter_->Next();
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Next();
     }
   }
 
   void Prev() {
     raw_iter_->Prev();
-    while (raw_iter_->Valid() && ShouldSkip()) {
+    while (raw_iter_->Valid() && Skip()) {
       raw_iter_->Prev();
     }
   }
 
   virtual bool ShouldSkip() { return false; }
 
+  // Skips the keys owns returns false for, the copies of the slots being migrated
+  void SetOwnership(std::function<bool(const Slice&)> owns) { owns_ = std::move(owns); }
+
   virtual std::string Key() const { return user_key_; }
 
   virtual std::string Value() const { return user_value_; }
@@ -97,6 +101,11 @@ class TypeIterator {
   std::string user_key_;
   std::string user_value_;
   Direction direction_ = kForward;
+
+ private:
+  bool Skip() { return ShouldSkip() || (owns_ && !owns_(raw_iter_->key())); }
+
+  std::function<bool(const Slice&)> owns_;
 };
 
 class StringsIterator : public TypeIterator {
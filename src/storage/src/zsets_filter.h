@@ -54,6 +54,7 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
         ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
         cur_meta_version_ = parsed_zsets_meta_value.Version();
         cur_meta_etime_ = parsed_zsets_meta_value.Etime();
+        cur_staging_version_ = parsed_zsets_meta_value.StagingVersion();
       } else if (s.IsNotFound()) {
         meta_not_found_ = true;
       } else {
@@ -68,6 +69,12 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
       return true;
     }
 
+    // Staged by ZsetsStore, see BaseDataFilter
+    if (cur_staging_version_ != 0 && cur_staging_version_ == parsed_zsets_score_key.Version()) {
+      TRACE("Reserve[score_key_version == staging_version]");
+      return false;
+    }
+
     int64_t unix_time;
     rocksdb::Env::Default()->GetCurrentTime(&unix_time);
     if (cur_meta_etime_ != 0 && cur_meta_etime_ < static_cast<uint64_t>(unix_time)) {
@@ -77,6 +84,9 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
     if (cur_meta_version_ > parsed_zsets_score_key.Version()) {
       TRACE("Drop[score_key_version < cur_meta_version]");
       return true;
+    } else if (cur_meta_version_ < parsed_zsets_score_key.Version()) {
+      TRACE("Drop[score_key_version > cur_meta_version]");
+      return true;
     } else {
       TRACE("Reserve[score_key_version == cur_meta_version]");
       return false;
@@ -93,6 +103,7 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
   mutable bool meta_not_found_ = false;
   mutable uint64_t cur_meta_version_ = 0;
   mutable uint64_t cur_meta_etime_ = 0;
+  mutable uint64_t cur_staging_version_ = 0;
   int meta_cf_index_ = 0;
 };
 
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "storage/async_commit.h"
+#include "storage/flat_binlog.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./async_commit_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+using storage::AsyncCommit;
+using storage::Status;
+
+// Holds the logs appended until the test applies them
+class AsyncCommitTest : public ::testing::Test {
+ public:
+  AsyncCommitTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 1;
+    options_.raft_timeout_s = 10000;
+    options_.append_log_function = [this](storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+      std::lock_guard lock(mutex_);
+      logs_.emplace_back(std::move(log), std::move(done));
+    };
+    options_.do_snapshot_function = [](int32_t inst_id, int64_t log_index, bool sync) {};
+  }
+
+  ~AsyncCommitTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    auto s = db_.Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  size_t Appended() {
+    std::lock_guard lock(mutex_);
+    return logs_.size();
+  }
+
+  // Applies the logs appended so far, the first one fails with status if given
+  void ApplyAll(const std::optional<Status>& status = std::nullopt) {
+    std::vector<std::pair<storage::FlatBinlog, storage::CommitCallback>> logs;
+    {
+      std::lock_guard lock(mutex_);
+      logs.swap(logs_);
+    }
+    for (size_t i = 0; i < logs.size(); i++) {
+      auto& [log, done] = logs[i];
+      if (i == 0 && status) {
+        done(*status);
+        continue;
+      }
+      done(db_.OnBinlogWrite(std::move(log), ++log_idx_));
+    }
+  }
+
+  std::string db_path_{"./test_db/async_commit_test"};
+  storage::StorageOptions options_;
+  storage::Storage db_;
+  std::mutex mutex_;
+  std::vector<std::pair<storage::FlatBinlog, storage::CommitCallback>> logs_;
+  int64_t log_idx_ = 0;
+};
+
+TEST_F(AsyncCommitTest, ReplyAfterApply) {
+  std::atomic<int> done_times = 0;
+  Status result = Status::Aborted();
+  auto commit = AsyncCommit::Begin([&](const Status& s) {
+    result = s;
+    done_times++;
+  });
+  int32_t ret = 0;
+  ASSERT_TRUE(db_.HSet("key", "field", "value", &ret).ok());
+  EXPECT_EQ(ret, 1);
+  ASSERT_TRUE(db_.Set("string_key", "value").ok());
+  commit->Finish();
+  EXPECT_EQ(AsyncCommit::Current(), nullptr);
+
+  // the writes are in flight
+  EXPECT_EQ(Appended(), 2);
+  EXPECT_EQ(done_times, 0);
+  std::string value;
+  EXPECT_TRUE(db_.HGet("key", "field", &value).IsNotFound());
+
+  ApplyAll();
+  EXPECT_EQ(done_times, 1);
+  EXPECT_TRUE(result.ok());
+  ASSERT_TRUE(db_.HGet("key", "field", &value).ok());
+  EXPECT_EQ(value, "value");
+}
+
+TEST_F(AsyncCommitTest, NothingWritten) {
+  std::atomic<int> done_times = 0;
+  auto commit = AsyncCommit::Begin([&](const Status& s) {
+    EXPECT_TRUE(s.ok());
+    done_times++;
+  });
+  std::string value;
+  EXPECT_TRUE(db_.Get("key", &value).IsNotFound());
+  commit->Finish();
+  EXPECT_EQ(done_times, 1);
+}
+
+TEST_F(AsyncCommitTest, KeyLockedUntilApplied) {
+  auto commit = AsyncCommit::Begin([](const Status&) {});
+  int32_t ret = 0;
+  ASSERT_TRUE(db_.HSet("key", "field1", "value1", &ret).ok());
+  commit->Finish();
+
+  // a write of the same key waits for the first one, it must not read the hash without it
+  std::atomic<bool> written = false;
+  std::thread writer([&] {
+    int32_t ret = 0;
+    EXPECT_TRUE(db_.HSet("key", "field2", "value2", &ret).ok());
+    EXPECT_EQ(ret, 1);
+    written = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(Appended(), 1);
+
+  ApplyAll();
+  while (!written) {
+    ApplyAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  writer.join();
+
+  int32_t len = 0;
+  ASSERT_TRUE(db_.HLen("key", &len).ok());
+  EXPECT_EQ(len, 2);
+}
+
+TEST_F(AsyncCommitTest, FirstErrorReported) {
+  Status result;
+  auto commit = AsyncCommit::Begin([&](const Status& s) { result = s; });
+  ASSERT_TRUE(db_.Set("key1", "value").ok());
+  ASSERT_TRUE(db_.Set("key2", "value").ok());
+  commit->Finish();
+
+  ApplyAll(Status::Incomplete("not leader"));
+  EXPECT_TRUE(result.IsIncomplete());
+  std::string value;
+  EXPECT_TRUE(db_.Get("key1", &value).IsNotFound());
+  ASSERT_TRUE(db_.Get("key2", &value).ok());
+}
+
+TEST_F(AsyncCommitTest, RelockedKeyReadsOwnWrite) {
+  // a command writing two types of a key locks it again once its first write is applied
+  std::atomic<int> done_times = 0;
+  std::atomic<bool> finished = false;
+  std::thread command([&] {
+    auto commit = AsyncCommit::Begin([&](const Status& s) {
+      EXPECT_TRUE(s.ok());
+      done_times++;
+    });
+    EXPECT_TRUE(db_.Set("key", "value").ok());
+    int32_t ret = 0;
+    EXPECT_TRUE(db_.HSet("key", "field", "value", &ret).ok());
+    commit->Finish();
+    finished = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_FALSE(finished);
+  EXPECT_EQ(Appended(), 1);
+  while (!finished) {
+    ApplyAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  command.join();
+  ApplyAll();
+  EXPECT_EQ(done_times, 1);
+
+  // RENAME of a key to itself reads it as the command left it
+  finished = false;
+  command = std::thread([&] {
+    auto commit = AsyncCommit::Begin([&](const Status& s) {
+      EXPECT_TRUE(s.ok());
+      done_times++;
+    });
+    EXPECT_TRUE(db_.Set("key", "value2").ok());
+    EXPECT_TRUE(db_.Rename("key", "key").ok());
+    commit->Finish();
+    finished = true;
+  });
+  while (!finished) {
+    ApplyAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  command.join();
+  ApplyAll();
+  EXPECT_EQ(done_times, 2);
+  std::string value;
+  ASSERT_TRUE(db_.Get("key", &value).ok());
+  EXPECT_EQ(value, "value2");
+  ASSERT_TRUE(db_.HGet("key", "field", &value).ok());
+  EXPECT_EQ(value, "value");
+
+  // another thread waits for the last write of the key
+  auto commit = AsyncCommit::Begin([&](const Status& s) {
+    EXPECT_TRUE(s.ok());
+    done_times++;
+  });
+  ASSERT_TRUE(db_.Set("key", "value3").ok());
+  commit->Finish();
+  std::atomic<bool> written = false;
+  std::thread writer([&] {
+    EXPECT_TRUE(db_.Set("key", "value4").ok());
+    written = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_FALSE(written);
+
+  ApplyAll();
+  EXPECT_EQ(done_times, 3);
+  while (!written) {
+    ApplyAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  writer.join();
+  ASSERT_TRUE(db_.Get("key", &value).ok());
+  EXPECT_EQ(value, "value4");
+}
+
+TEST_F(AsyncCommitTest, SMoveToSameSet) {
+  int32_t ret = 0;
+  {
+    auto commit = AsyncCommit::Begin([](const Status&) {});
+    ASSERT_TRUE(db_.SAdd("set", {"member"}, &ret).ok());
+    commit->Finish();
+  }
+  ApplyAll();
+
+  auto commit = AsyncCommit::Begin([](const Status&) {});
+  ASSERT_TRUE(db_.SMove("set", "set", "member", &ret).ok());
+  EXPECT_EQ(ret, 1);
+  commit->Finish();
+  EXPECT_EQ(Appended(), 0);
+  ASSERT_TRUE(db_.SIsmember("set", "member", &ret).ok());
+  EXPECT_EQ(ret, 1);
+}
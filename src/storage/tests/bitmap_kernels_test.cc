@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/bitmap_kernels.h"
+
+using storage::BitmapKernels;
+
+class BitmapKernelsTest : public ::testing::Test {
+ public:
+  // random, all zero or all one bytes, sometimes with a single flipped bit,
+  // starting at an unaligned offset of buf
+  const uint8_t* MakeBitmap(std::string* buf, size_t len) {
+    size_t offset = rng_() % 8;
+    buf->resize(offset + len);
+    int mode = static_cast<int>(rng_() % 3);
+    for (auto& c : *buf) {
+      c = static_cast<char>(mode == 0 ? rng_() : (mode == 1 ? 0 : 0xff));
+    }
+    if (len > 0 && rng_() % 2 == 0) {
+      (*buf)[offset + rng_() % len] ^= static_cast<char>(1 << (rng_() % 8));
+    }
+    return reinterpret_cast<const uint8_t*>(buf->data()) + offset;
+  }
+
+  size_t RandomLength() { return rng_() % 1024; }
+
+  static uint8_t ByteOp(storage::BitOpType op, uint8_t a, uint8_t b) {
+    switch (op) {
+      case storage::kBitOpAnd:
+        return a & b;
+      case storage::kBitOpOr:
+        return a | b;
+      case storage::kBitOpXor:
+        return a ^ b;
+      case storage::kBitOpNot:
+        return static_cast<uint8_t>(~a);
+      default:
+        return a;
+    }
+  }
+
+  std::mt19937_64 rng_{20240601};
+  std::vector<const BitmapKernels*> kernels_ = storage::SupportedBitmapKernels();
+  const BitmapKernels& scalar_ = storage::ScalarBitmapKernels();
+};
+
+TEST_F(BitmapKernelsTest, ScalarTest) {
+  // bit 0 is the most significant bit of the first byte
+  const uint8_t data[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xff};
+  ASSERT_EQ(scalar_.count(data, sizeof(data)), 9);
+  ASSERT_EQ(scalar_.find_first(data, sizeof(data), 1), 75);
+  ASSERT_EQ(scalar_.find_first(data, sizeof(data), 0), 0);
+  ASSERT_EQ(scalar_.find_first(data + 10, 1, 0), -1);
+  ASSERT_EQ(scalar_.find_first(data, 9, 1), -1);
+
+  for (int i = 0; i < 200; i++) {
+    std::string buf;
+    size_t len = RandomLength();
+    const uint8_t* bitmap = MakeBitmap(&buf, len);
+    uint64_t count = 0;
+    int64_t first[2] = {-1, -1};
+    for (size_t bit_offset = 0; bit_offset < len * 8; bit_offset++) {
+      int bit = (bitmap[bit_offset / 8] >> (7 - bit_offset % 8)) & 1;
+      count += bit;
+      if (first[bit] == -1) {
+        first[bit] = static_cast<int64_t>(bit_offset);
+      }
+    }
+    ASSERT_EQ(scalar_.count(bitmap, len), count);
+    ASSERT_EQ(scalar_.find_first(bitmap, len, 0), first[0]);
+    ASSERT_EQ(scalar_.find_first(bitmap, len, 1), first[1]);
+  }
+}
+
+TEST_F(BitmapKernelsTest, CountTest) {
+  for (int i = 0; i < 1000; i++) {
+    std::string buf;
+    size_t len = RandomLength();
+    const uint8_t* bitmap = MakeBitmap(&buf, len);
+    for (const auto kernel : kernels_) {
+      ASSERT_EQ(kernel->count(bitmap, len), scalar_.count(bitmap, len)) << kernel->name << " len " << len;
+    }
+  }
+}
+
+TEST_F(BitmapKernelsTest, FindFirstTest) {
+  for (int i = 0; i < 1000; i++) {
+    std::string buf;
+    size_t len = RandomLength();
+    const uint8_t* bitmap = MakeBitmap(&buf, len);
+    for (const auto kernel : kernels_) {
+      for (int bit = 0; bit <= 1; bit++) {
+        ASSERT_EQ(kernel->find_first(bitmap, len, bit), scalar_.find_first(bitmap, len, bit))
+            << kernel->name << " len " << len << " bit " << bit;
+      }
+    }
+  }
+}
+
+TEST_F(BitmapKernelsTest, BitOpTest) {
+  for (int i = 0; i < 500; i++) {
+    std::string dst_buf;
+    std::string src_buf;
+    size_t len = RandomLength();
+    const uint8_t* dst = MakeBitmap(&dst_buf, len);
+    const uint8_t* src = MakeBitmap(&src_buf, len);
+    for (auto op : {storage::kBitOpAnd, storage::kBitOpOr, storage::kBitOpXor, storage::kBitOpNot}) {
+      std::string expect(reinterpret_cast<const char*>(dst), len);
+      scalar_.bitop(op, reinterpret_cast<uint8_t*>(expect.data()), op == storage::kBitOpNot ? nullptr : src, len);
+      for (size_t j = 0; j < len; j++) {
+        ASSERT_EQ(static_cast<uint8_t>(expect[j]), ByteOp(op, dst[j], src[j]));
+      }
+
+      for (const auto kernel : kernels_) {
+        std::string result(reinterpret_cast<const char*>(dst), len);
+        kernel->bitop(op, reinterpret_cast<uint8_t*>(result.data()), op == storage::kBitOpNot ? nullptr : src, len);
+        ASSERT_EQ(result, expect) << kernel->name << " len " << len << " op " << op;
+      }
+    }
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "storage/flat_binlog.h"
+
+using storage::FlatBinlog;
+
+namespace {
+
+// Collects the entries of a batch as "cf:op:key[:value]"
+class EntryCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  rocksdb::Status PutCF(uint32_t cf_idx, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    entries.push_back(std::to_string(cf_idx) + ":put:" + key.ToString() + ":" + value.ToString());
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status DeleteCF(uint32_t cf_idx, const rocksdb::Slice& key) override {
+    entries.push_back(std::to_string(cf_idx) + ":delete:" + key.ToString());
+    return rocksdb::Status::OK();
+  }
+
+  std::vector<std::string> entries;
+};
+
+// What raft carries: the rep of the batch followed by the trailer
+std::string Serialize(const FlatBinlog& log) { return log.batch().Data() + log.EncodeTrailer(); }
+
+}  // namespace
+
+TEST(FlatBinlogTest, EncodeDecode) {
+  FlatBinlog log(3, 7);
+  ASSERT_TRUE(log.batch()->Put("key1", "value1").ok());
+  ASSERT_TRUE(log.batch()->Delete("key2").ok());
+  std::string data = Serialize(log);
+  ASSERT_TRUE(FlatBinlog::IsFlat(data[0]));
+
+  FlatBinlog decoded;
+  ASSERT_TRUE(FlatBinlog::Decode(std::move(data), &decoded).ok());
+  EXPECT_EQ(decoded.db_id(), 3);
+  EXPECT_EQ(decoded.slot_idx(), 7);
+  EXPECT_EQ(decoded.batch().Count(), 2);
+  EXPECT_EQ(decoded.batch().Data(), log.batch().Data());
+
+  EntryCollector collector;
+  ASSERT_TRUE(decoded.batch().Iterate(&collector).ok());
+  EXPECT_EQ(collector.entries, (std::vector<std::string>{"0:put:key1:value1", "0:delete:key2"}));
+}
+
+TEST(FlatBinlogTest, EmptyBatch) {
+  FlatBinlog log(0, 1);
+  FlatBinlog decoded;
+  ASSERT_TRUE(FlatBinlog::Decode(Serialize(log), &decoded).ok());
+  EXPECT_EQ(decoded.slot_idx(), 1);
+  EXPECT_EQ(decoded.batch().Count(), 0);
+}
+
+TEST(FlatBinlogTest, Malformed) {
+  FlatBinlog log(0, 2);
+  ASSERT_TRUE(log.batch()->Put("key", "value").ok());
+  std::string data = Serialize(log);
+
+  FlatBinlog decoded;
+  EXPECT_TRUE(FlatBinlog::Decode(data.substr(0, 8), &decoded).IsCorruption());
+
+  std::string bad_magic = data;
+  bad_magic.back() = 'X';
+  EXPECT_TRUE(FlatBinlog::Decode(std::move(bad_magic), &decoded).IsCorruption());
+
+  std::string newer = data;
+  newer[newer.size() - 2] = static_cast<char>(FlatBinlog::kVersion + 1);
+  EXPECT_TRUE(FlatBinlog::Decode(std::move(newer), &decoded).IsNotSupported());
+}
@@ -25,6 +25,7 @@
 #include "pstd/thread_pool.h"
 #include "src/log_index.h"
 #include "src/redis.h"
+#include "storage/flat_binlog.h"
 #include "storage/storage.h"
 #include "storage/util.h"
 
@@ -42,15 +43,16 @@ using LogIndex = int64_t;
 
 class LogQueue : public pstd::noncopyable {
  public:
-  using WriteCallback = std::function<rocksdb::Status(const pikiwidb::Binlog&, LogIndex idx)>;
+  using WriteCallback = std::function<rocksdb::Status(storage::FlatBinlog&&, LogIndex idx)>;
 
   explicit LogQueue(WriteCallback&& cb) : write_cb_(std::move(cb)) { consumer_.SetMaxIdleThread(1); }
 
-  void AppendLog(const pikiwidb::Binlog& log, std::promise<rocksdb::Status>&& promise) {
-    auto task = [&] {
+  void AppendLog(storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+    // done is a temporary of the caller, it is taken over with the log
+    auto task = [this, log = std::move(log), done = std::move(done)]() mutable {
       auto idx = next_log_idx_.fetch_add(1);
-      auto s = write_cb_(log, idx);
-      promise.set_value(s);
+      auto s = write_cb_(std::move(log), idx);
+      done(s);
     };
     consumer_.ExecuteTask(std::move(task));
   }
@@ -64,15 +66,17 @@ class LogQueue : public pstd::noncopyable {
 class FlushOldestCFTest : public ::testing::Test {
  public:
   FlushOldestCFTest()
-      : log_queue_([this](const pikiwidb::Binlog& log, LogIndex log_idx) { return db_.OnBinlogWrite(log, log_idx); }) {
+      : log_queue_([this](storage::FlatBinlog&& log, LogIndex log_idx) {
+          return db_.OnBinlogWrite(std::move(log), log_idx);
+        }) {
     options_.options.create_if_missing = true;
     options_.options.max_background_jobs = 10;
     options_.db_instance_num = 1;
     options_.raft_timeout_s = 9000000;
-    options_.append_log_function = [this](const pikiwidb::Binlog& log, std::promise<rocksdb::Status>&& promise) {
-      log_queue_.AppendLog(log, std::move(promise));
+    options_.append_log_function = [this](storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+      log_queue_.AppendLog(std::move(log), std::move(done));
     };
-    options_.do_snapshot_function = [](int64_t log_index, bool sync) {};
+    options_.do_snapshot_function = [](int32_t inst_id, int64_t log_index, bool sync) {};
     options_.max_gap = 15;
     write_options_.disableWAL = true;
   }
@@ -163,13 +167,16 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
   }
 
   {
+    // A hash write puts the meta value, the field and merges the type bit of the key into the type directory (cf 10)
+    //
     //  type     kv            kv         hash        hash                 hash
-    // entry   [1:1] -> ... [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    // entry   [1:1] -> ... [10:10]  -> [11:11]  -> [12:14]  -> ...  -> [30:68]
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
     //  0           0                    0                        10                   10
-    //  1           0                    0                        30                   49
-    //  2           0                    0                        30                   50
+    //  1           0                    0                        30                   68
+    //  2           0                    0                        30                   69
+    //  10          0                    0                        30                   70
     // other        0                    0                        0                    0
     //
     // last_flush_index   log_index    sequencenumber
@@ -183,13 +190,19 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
     ASSERT_EQ(cf_1_status.flushed_index.log_index, 0);
     ASSERT_EQ(cf_1_status.flushed_index.seqno, 0);
     ASSERT_EQ(cf_1_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_1_status.applied_index.seqno, 49);
+    ASSERT_EQ(cf_1_status.applied_index.seqno, 68);
 
     auto& cf_2_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kHashesDataCF);
     ASSERT_EQ(cf_2_status.flushed_index.log_index, 0);
     ASSERT_EQ(cf_2_status.flushed_index.seqno, 0);
     ASSERT_EQ(cf_2_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_2_status.applied_index.seqno, 50);
+    ASSERT_EQ(cf_2_status.applied_index.seqno, 69);
+
+    auto& cf_10_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kTypeDirectoryCF);
+    ASSERT_EQ(cf_10_status.flushed_index.log_index, 0);
+    ASSERT_EQ(cf_10_status.flushed_index.seqno, 0);
+    ASSERT_EQ(cf_10_status.applied_index.log_index, 30);
+    ASSERT_EQ(cf_10_status.applied_index.seqno, 70);
 
     auto [smallest_applied_log_index_cf, smallest_applied_log_index, smallest_flushed_log_index_cf,
           smallest_flushed_log_index, smallest_flushed_seqno] =
@@ -208,7 +221,7 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
 
   {
     //  type    kv            kv         hash        hash                 hash
-    // entry  [1:1] -> ... [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    // entry  [1:1] -> ... [10:10]  -> [11:11]  -> [12:14]  -> ...  -> [30:68]
     auto cur_par = rocksdb->GetCollector().GetList().begin();
     auto logindex = 1;
     auto seq = 1;
@@ -223,7 +236,7 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
     for (int i = 11; i <= 30; i++) {
       ASSERT_EQ(cur_par->GetAppliedLogIndex(), logindex);
       ASSERT_EQ(cur_par->GetSequenceNumber(), seq);
-      seq += 2;
+      seq += 3;
       logindex++;
       cur_par = std::next(cur_par);
     }
@@ -231,12 +244,13 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
 
   {
     //  type       kv            kv         hash        hash                 hash
-    // entry     [1:1] -> ... [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    // entry     [1:1] -> ... [10:10]  -> [11:11]  -> [12:14]  -> ...  -> [30:68]
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
     //  0           0                    0                        10                   10
-    //  1           0                    0                        30                   49
-    //  2           0                    0                        30                   50
+    //  1           0                    0                        30                   68
+    //  2           0                    0                        30                   69
+    //  10          0                    0                        30                   70
     // other        0                    0                        0                    0
     //
     // last_flush_index   log_index    sequencenumber
@@ -246,178 +260,118 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
     ASSERT_EQ(gap, 30);
     flush_cf(1);
     sleep(5);  // sleep flush complete.
-    // 1) 根据 cf 1 的 latest SequenceNumber = 49 查到对应的 log index 为 30. 设置 cf 1 的 flushed_log_index 和
-    // flushed_sequence_number 为 30 49.
-    //
-    //  type     kv            kv         hash        hash                 hash
-    // entry   [1:1] -> ... [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    // 1) 根据 cf 1 的 latest SequenceNumber = 68 查到对应的 log index 为 30. 设置 cf 1 的 flushed_log_index 和
+    // flushed_sequence_number 为 30 68.
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
     //  0           0                    0                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           0                    0                        30                   50
+    //  1           30                   68                       30                   68
+    //  2           0                    0                        30                   69
+    //  10          0                    0                        30                   70
     // other        0                    0                        0                    0
     //
-    // last_flush_index   log_index    sequencenumber
-    //                       0               0
-
     // 2) 查找到此时的 smallest_applied_log_index_cf = 0 smallest_applied_log_index = 10
-    // smallest_flushed_log_index_cf = 0
-    //               smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
+    // smallest_flushed_log_index_cf = 0 smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
     // 根据 smallest_applied_log_index = 10 在队列长度 >= 2 的前提下, 持续删除 log_index < 10 的条目.
     //
     //  type      kv         hash        hash                 hash
-    // entry   [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    // entry   [10:10]  -> [11:11]  -> [12:14]  -> ...  -> [30:68]
     //
-    //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           0                    0                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           0                    0                        30                   50
-    // other        0                    0                        0                    0
-    //
-    // last_flush_index   log_index    sequencenumber
-    //                       0               0
-
-    // 3) 根据 smallest_flushed_log_index_cf =  0 smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
+    // 3) 根据 smallest_flushed_log_index_cf = 0 smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
     // 设置 last_flush_index 为 0, 0
     //
-    //  type      kv         hash        hash                 hash
-    // entry   [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
-    //
-    //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           0                    0                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           0                    0                        30                   50
-    // other        0                    0                        0                    0
-    //
-    // last_flush_index   log_index    sequencenumber
-    //                       0              0
-
     // 4) 检测到队列中 logindex 的最大差值超过阈值, 触发 smallest_flushed_log_index_cf flush . 该 case 中对应 cf 为 0.
     //  根据 cf 0 的 latest SequenceNumber = 10 查到对应的 log index 为 10. 设置 cf 0 的 flushed_log_index 和
     //  flushed_sequence_number 为 10 10.
     //
-    //  type      kv         hash        hash                 hash
-    // entry   [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
-    //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
     //  0           10                   10                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           0                    0                        30                   50
+    //  1           30                   68                       30                   68
+    //  2           0                    0                        30                   69
+    //  10          0                    0                        30                   70
     // other        0                    0                        0                    0
     //
-    // last_flush_index   log_index    sequencenumber
-    //                       0              0
-
     // 5) 查找到此时的 smallest_applied_log_index_cf = 0 smallest_applied_log_index = 10
     // smallest_flushed_log_index_cf = 2 smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
     // 根据 smallest_applied_log_index = 10 在队列长度 >= 2 的前提下, 删除 log_index < 10 的条目, 不变.
     //
-    //  type      kv         hash        hash                 hash
-    // entry   [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
-    //
-    //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           10                   10                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           0                    0                        30                   50
-    // other        0                    0                        0                    0
-    //
-    // last_flush_index   log_index    sequencenumber
-    //                       0              0
-
     // 6) 检测到队列中 logindex 的最大差值超过阈值, 触发 smallest_flushed_log_index_cf flush . 该 case 中对应 cf 为 2.
-    //  根据 cf 2 的 latest SequenceNumber = 50 查到对应的 log index 为 30. 设置 cf 2 的 flushed_log_index 和
-    //  flushed_sequence_number 为 30 50.
-    //
-    //  type      kv         hash        hash                 hash
-    // entry   [10:10]  -> [11:11]  -> [12:13]  -> ...  -> [30:49]
+    //  根据 cf 2 的 latest SequenceNumber = 69 查到对应的 log index 为 30. 设置 cf 2 的 flushed_log_index 和
+    //  flushed_sequence_number 为 30 69.
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
     //  0           10                   10                        10                   10
-    //  1           30                   49                       30                   49
-    //  2           30                   50                        30                   50
+    //  1           30                   68                       30                   68
+    //  2           30                   69                       30                   69
+    //  10          0                    0                        30                   70
     // other        0                    0                        0                    0
     //
-    // last_flush_index   log_index    sequencenumber
-    //                       0              0
-
     // 7) 查找到此时的 smallest_applied_log_index_cf = 2 smallest_applied_log_index = 30
-    // smallest_flushed_log_index_cf = 2 smallest_flushed_log_index = 30 smallest_flushed_seqno = 50
-    // 根据 smallest_applied_log_index = 30 在队列长度 >= 2 的前提下, 删除 log_index < 50 的条目.
+    // smallest_flushed_log_index_cf = 10 smallest_flushed_log_index = 0 smallest_flushed_seqno = 0
+    // 根据 smallest_applied_log_index = 30 在队列长度 >= 2 的前提下, 删除 log_index < 30 的条目.
     //
     //  type     hash
-    // entry   [30:49]
+    // entry   [30:68]
     //
-    //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           10                   10                      10                   10
-    //  1           30                   49                      30                   49
-    //  2           30                   50                      30                   50
-    // other        0                    0                       0                    0
-    //
-    // last_flush_index   log_index    sequencenumber
-    //                       0              0
+    // 8) 检测到队列长度未超过阈值, 结束 flush. cf 10 还未持久化, last_flush_index 仍为 0, 0.
+    auto after_flush_size = rocksdb->GetCollector().GetSize();
+    ASSERT_EQ(after_flush_size, 1);
 
-    // 8) 根据 smallest_flushed_log_index_cf = 2 smallest_flushed_log_index = 30 smallest_flushed_seqno = 50
-    // 设置 last_flush_index 为 30, 50.
-    //
-    //  type     hash
-    // entry   [30:49]
-    //
-    //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           10                   10                      10                   10
-    //  1           30                   49                      30                   49
-    //  2           30                   50                      30                   50
-    // other        0                    0                       0                    0
-    //
-    // last_flush_index   log_index    sequencenumber
-    //                       30              50
+    auto& last_flush_index = rocksdb->GetLogIndexOfColumnFamilies().GetLastFlushIndex();
+    ASSERT_EQ(last_flush_index.log_index.load(), 0);
+    ASSERT_EQ(last_flush_index.seqno.load(), 0);
 
-    // 9) 当设置 last_flush_index 为 30, 50 时, 会同时拉高没有数据的 cf 的 flushed_index, 该 case 为 cf 0, cf 1,
-    // 将 cf 0 的 flushed_index 从 10 10 提高为 30 50.
-    // 将 cf 1 的 flushed index 从 30 49 提升到 30 50.
-    // 其他没有写入的 cf flushed index 从 0 0 提升到 30 50.
+    flush_cf(storage::kTypeDirectoryCF);
+    sleep(1);  // sleep flush complete.
+    // 9) 根据 cf 10 的 latest SequenceNumber = 70 查到对应的 log index 为 30. 设置 cf 10 的 flushed_log_index 和
+    // flushed_sequence_number 为 30 70.
+    //
+    // 10) 根据 smallest_flushed_log_index_cf = 10 smallest_flushed_log_index = 30 smallest_flushed_seqno = 70
+    // 设置 last_flush_index 为 30, 70. 同时拉高没有数据的 cf 的 flushed_index:
+    // 将 cf 0 的 flushed_index 从 10 10 提高为 30 70.
+    // 将 cf 1 的 flushed index 从 30 68 提升到 30 70.
+    // 将 cf 2 的 flushed index 从 30 69 提升到 30 70.
+    // 其他没有写入的 cf flushed index 从 0 0 提升到 30 70.
     //
     //  type     hash
-    // entry   [30:49]
+    // entry   [30:68]
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           30                   50                      10                   10
-    //  1           30                   50                      30                   49
-    //  2           30                   50                      30                   50
-    // other        30                   50                       0                    0
+    //  0           30                   70                      10                   10
+    //  1           30                   70                      30                   68
+    //  2           30                   70                      30                   69
+    //  10          30                   70                      30                   70
+    // other        30                   70                       0                    0
     //
     // last_flush_index   log_index    sequencenumber
-    //                       30              50
-
-    // 9) 检测到队列长度未超过阈值, 结束 flush.
-    auto after_flush_size = rocksdb->GetCollector().GetSize();
+    //                       30              70
+    after_flush_size = rocksdb->GetCollector().GetSize();
     ASSERT_EQ(after_flush_size, 1);
 
     auto& cf_0_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kStringsCF);
     ASSERT_EQ(cf_0_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_0_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_0_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_0_status.applied_index.log_index, 10);
     ASSERT_EQ(cf_0_status.applied_index.seqno, 10);
 
     auto& cf_1_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kHashesMetaCF);
     ASSERT_EQ(cf_1_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_1_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_1_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_1_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_1_status.applied_index.seqno, 49);
+    ASSERT_EQ(cf_1_status.applied_index.seqno, 68);
 
     auto& cf_2_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kHashesDataCF);
     ASSERT_EQ(cf_2_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_2_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_2_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_2_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_2_status.applied_index.seqno, 50);
+    ASSERT_EQ(cf_2_status.applied_index.seqno, 69);
 
-    auto& last_flush_index = rocksdb->GetLogIndexOfColumnFamilies().GetLastFlushIndex();
     ASSERT_EQ(last_flush_index.log_index.load(), 30);
-    ASSERT_EQ(last_flush_index.seqno.load(), 50);
+    ASSERT_EQ(last_flush_index.seqno.load(), 70);
 
     auto& cf_3_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kSetsMetaCF);
     ASSERT_EQ(cf_3_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_3_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_3_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_3_status.applied_index.log_index, 0);
     ASSERT_EQ(cf_3_status.applied_index.seqno, 0);
   }
@@ -425,41 +379,42 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
   {
     add_kvs(30, 35);
     //  type     hash    ->   kv    ->  ...  ->  kv
-    // entry   [30:49]     [31:51]             [35:55]
+    // entry   [30:68]     [31:71]             [35:75]
     //
     //  cf   flushed_log_index  flushed_sequence_number  applied_log_index  applied_sequence_number
-    //  0           30                   50                      35                   55
-    //  1           30                   50                      30                   49
-    //  2           30                   50                      30                   50
-    // other        30                   50                       0                    0
+    //  0           30                   70                      35                   75
+    //  1           30                   70                      30                   68
+    //  2           30                   70                      30                   69
+    //  10          30                   70                      30                   70
+    // other        30                   70                       0                    0
     //
     // last_flush_index   log_index    sequencenumber
-    //                       30              50
+    //                       30              70
     auto& last_flush_index = rocksdb->GetLogIndexOfColumnFamilies().GetLastFlushIndex();
     ASSERT_EQ(last_flush_index.log_index.load(), 30);
-    ASSERT_EQ(last_flush_index.seqno.load(), 50);
+    ASSERT_EQ(last_flush_index.seqno.load(), 70);
 
     auto& cf_0_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kStringsCF);
     ASSERT_EQ(cf_0_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_0_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_0_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_0_status.applied_index.log_index, 35);
-    ASSERT_EQ(cf_0_status.applied_index.seqno, 55);
+    ASSERT_EQ(cf_0_status.applied_index.seqno, 75);
 
     auto& cf_1_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kHashesMetaCF);
     ASSERT_EQ(cf_1_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_1_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_1_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_1_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_1_status.applied_index.seqno, 49);
+    ASSERT_EQ(cf_1_status.applied_index.seqno, 68);
 
     auto& cf_2_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kHashesDataCF);
     ASSERT_EQ(cf_2_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_2_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_2_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_2_status.applied_index.log_index, 30);
-    ASSERT_EQ(cf_2_status.applied_index.seqno, 50);
+    ASSERT_EQ(cf_2_status.applied_index.seqno, 69);
 
     auto& cf_3_status = rocksdb->GetLogIndexOfColumnFamilies().GetCFStatus(storage::kSetsMetaCF);
     ASSERT_EQ(cf_3_status.flushed_index.log_index, 30);
-    ASSERT_EQ(cf_3_status.flushed_index.seqno, 50);
+    ASSERT_EQ(cf_3_status.flushed_index.seqno, 70);
     ASSERT_EQ(cf_3_status.applied_index.log_index, 0);
     ASSERT_EQ(cf_3_status.applied_index.seqno, 0);
 
@@ -473,7 +428,7 @@ TEST_F(FlushOldestCFTest, SimpleTest) {
 
     ASSERT_EQ(smallest_flushed_log_index_cf, 0);
     ASSERT_EQ(smallest_flushed_log_index, 30);
-    ASSERT_EQ(smallest_flushed_seqno, 50);
+    ASSERT_EQ(smallest_flushed_seqno, 70);
 
     auto size = rocksdb->GetCollector().GetSize();
     ASSERT_EQ(size, 6);
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/hot_keys.h"
+
+using storage::HotKeys;
+
+TEST(HotKeysTest, TopTest) {
+  HotKeys hot_keys;
+  ASSERT_TRUE(hot_keys.Top(10).empty());
+
+  // many more cold keys than the top list holds, and three hot ones
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 1000; i++) {
+      hot_keys.Record("cold" + std::to_string(round * 1000 + i), 1);
+    }
+    hot_keys.Record("hot1", 30);
+    hot_keys.Record("hot2", 20);
+    hot_keys.Record("hot3", 10);
+  }
+
+  auto top = hot_keys.Top(3);
+  ASSERT_EQ(top.size(), 3);
+  ASSERT_EQ(top[0].first, "hot1");
+  ASSERT_EQ(top[1].first, "hot2");
+  ASSERT_EQ(top[2].first, "hot3");
+  ASSERT_GT(top[0].second, top[1].second);
+  ASSERT_GT(top[1].second, top[2].second);
+  ASSERT_EQ(hot_keys.Top(HotKeys::kTopK * 2).size(), HotKeys::kTopK);
+
+  hot_keys.Clear();
+  ASSERT_TRUE(hot_keys.Top(10).empty());
+}
+
+TEST(HotKeysTest, AgingTest) {
+  HotKeys hot_keys;
+  for (int i = 0; i < 100; i++) {
+    hot_keys.Record("old", 10);
+  }
+  // the keys hot lately overtake the one hot long ago
+  for (int64_t i = 0; i < HotKeys::kAgingSamples * 4; i++) {
+    hot_keys.Record("new", 1);
+  }
+  auto top = hot_keys.Top(1);
+  ASSERT_EQ(top.size(), 1);
+  ASSERT_EQ(top[0].first, "new");
+}
+
+TEST(HotKeysTest, ConcurrentTest) {
+  HotKeys hot_keys;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&hot_keys, t] {
+      for (int i = 0; i < 100000; i++) {
+        hot_keys.Record(i % 10 == 0 ? "hot" : "key" + std::to_string(t * 100000 + i), 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto top = hot_keys.Top(1);
+  ASSERT_EQ(top.size(), 1);
+  ASSERT_EQ(top[0].first, "hot");
+}
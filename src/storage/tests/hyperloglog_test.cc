@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "src/redis_hyperloglog.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./hyperloglog_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+class HyperLogLogTest : public ::testing::Test {
+ public:
+  HyperLogLogTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 3;
+  }
+
+  ~HyperLogLogTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    auto s = db_.Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  static std::vector<std::string> MakeElements(int start, int end) {
+    std::vector<std::string> elements;
+    for (int i = start; i < end; i++) {
+      elements.push_back("element_" + std::to_string(i));
+    }
+    return elements;
+  }
+
+  void PfAdd(const std::string& key, int start, int end) {
+    bool update = false;
+    auto elements = MakeElements(start, end);
+    // keep every call under kMaxKeys elements
+    for (size_t i = 0; i < elements.size(); i += 200) {
+      std::vector<std::string> part(elements.begin() + i, elements.begin() + std::min(i + 200, elements.size()));
+      ASSERT_TRUE(db_.PfAdd(key, part, &update).ok());
+    }
+  }
+
+  static void ExpectNear(int64_t count, int64_t expect) {
+    // the standard error of 16384 registers is 0.81%
+    ASSERT_LE(std::abs(count - expect), expect * 0.03 + 1) << "count " << count << " expect " << expect;
+  }
+
+  std::string db_path_{"./test_db/hyperloglog_test"};
+  storage::StorageOptions options_;
+  storage::Storage db_;
+};
+
+TEST_F(HyperLogLogTest, PfAddTest) {
+  bool update = false;
+  ASSERT_TRUE(db_.PfAdd("hll_key", {}, &update).ok());
+  ASSERT_TRUE(update);
+  ASSERT_TRUE(db_.PfAdd("hll_key", {"a", "b", "c"}, &update).ok());
+  ASSERT_TRUE(update);
+  ASSERT_TRUE(db_.PfAdd("hll_key", {"a", "b"}, &update).ok());
+  ASSERT_FALSE(update);
+
+  int64_t count = 0;
+  ASSERT_TRUE(db_.PfCount({"hll_key"}, &count).ok());
+  ASSERT_EQ(count, 3);
+
+  // low cardinalities stay sparse and small
+  std::string value;
+  ASSERT_TRUE(db_.Get("hll_key", &value).ok());
+  ASSERT_LT(value.size(), 64);
+
+  ASSERT_TRUE(db_.Set("hll_string", "not a hyperloglog").ok());
+  ASSERT_TRUE(db_.PfAdd("hll_string", {"a"}, &update).IsInvalidArgument());
+  ASSERT_TRUE(db_.PfCount({"hll_string"}, &count).IsInvalidArgument());
+}
+
+TEST_F(HyperLogLogTest, SparseToDenseTest) {
+  PfAdd("hll_dense", 0, 20000);
+  int64_t count = 0;
+  ASSERT_TRUE(db_.PfCount({"hll_dense"}, &count).ok());
+  ExpectNear(count, 20000);
+
+  std::string value;
+  ASSERT_TRUE(db_.Get("hll_dense", &value).ok());
+  ASSERT_EQ(value.size(), storage::HyperLogLog::kDenseSize);
+}
+
+TEST_F(HyperLogLogTest, PfCountPfMergeTest) {
+  // one key of each encoding, spread over the instances
+  PfAdd("hll_merge1", 0, 10000);
+  PfAdd("hll_merge2", 5000, 5100);
+  PfAdd("hll_merge3", 9000, 30000);
+
+  int64_t count = 0;
+  ASSERT_TRUE(db_.PfCount({"hll_merge1", "hll_merge2", "hll_merge3", "hll_not_exist"}, &count).ok());
+  ExpectNear(count, 30000);
+
+  std::string value_to_dest;
+  ASSERT_TRUE(db_.PfMerge({"hll_merge2", "hll_merge1", "hll_not_exist"}, value_to_dest).ok());
+  ASSERT_TRUE(db_.PfCount({"hll_merge2"}, &count).ok());
+  ExpectNear(count, 10000);
+
+  int64_t union_count = 0;
+  ASSERT_TRUE(db_.PfCount({"hll_merge1", "hll_merge2"}, &union_count).ok());
+  ASSERT_EQ(union_count, count);
+}
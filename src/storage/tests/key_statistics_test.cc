@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "src/key_statistics.h"
+
+using storage::DataType;
+using storage::KeyStatistics;
+
+TEST(KeyStatisticsTest, DisabledTest) {
+  KeyStatistics statistics;
+  KeyStatistics::Activity activity;
+  ASSERT_EQ(statistics.Capacity(), 0);
+  ASSERT_FALSE(statistics.AddModifyCount(DataType::kHashes, "key", 1, &activity));
+  ASSERT_FALSE(statistics.AddDuration(DataType::kHashes, "key", 1, &activity));
+  ASSERT_EQ(statistics.EstimateActivity(DataType::kHashes, "key"), 0);
+}
+
+TEST(KeyStatisticsTest, ModifyCountAndDurationTest) {
+  KeyStatistics statistics;
+  statistics.SetCapacity(100);
+  KeyStatistics::Activity activity;
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(statistics.AddModifyCount(DataType::kHashes, "key", 3, &activity));
+  }
+  ASSERT_EQ(activity.modify_count, 30);
+  ASSERT_EQ(activity.avg_duration, 0);
+
+  // the same key of another type is tracked apart
+  ASSERT_TRUE(statistics.AddModifyCount(DataType::kSets, "key", 1, &activity));
+  ASSERT_EQ(activity.modify_count, 1);
+
+  // the smallest and the largest durations of the window are left out
+  for (size_t i = 0; i < KeyStatistics::kDurationWindow - 2; i++) {
+    ASSERT_TRUE(statistics.AddDuration(DataType::kHashes, "key", 100, &activity));
+    ASSERT_EQ(activity.avg_duration, 0);
+  }
+  ASSERT_TRUE(statistics.AddDuration(DataType::kHashes, "key", 1, &activity));
+  ASSERT_TRUE(statistics.AddDuration(DataType::kHashes, "key", 100000, &activity));
+  ASSERT_EQ(activity.avg_duration, 100);
+  ASSERT_EQ(activity.modify_count, 30);
+
+  statistics.Remove(DataType::kHashes, "key");
+  ASSERT_TRUE(statistics.AddModifyCount(DataType::kHashes, "key", 1, &activity));
+  ASSERT_EQ(activity.modify_count, 1);
+  ASSERT_EQ(activity.avg_duration, 0);
+}
+
+TEST(KeyStatisticsTest, HotKeysStayTrackedTest) {
+  KeyStatistics statistics;
+  statistics.SetCapacity(64);
+  KeyStatistics::Activity activity;
+  for (int round = 0; round < 100; round++) {
+    for (int hot = 0; hot < 16; hot++) {
+      statistics.AddModifyCount(DataType::kZSets, "hot_" + std::to_string(hot), 1, &activity);
+    }
+    // a scan over many cold keys
+    for (int cold = 0; cold < 100; cold++) {
+      statistics.AddModifyCount(DataType::kZSets, "cold_" + std::to_string(round * 100 + cold), 1, &activity);
+    }
+  }
+
+  for (int hot = 0; hot < 16; hot++) {
+    std::string key = "hot_" + std::to_string(hot);
+    ASSERT_GT(statistics.EstimateActivity(DataType::kZSets, key),
+              statistics.EstimateActivity(DataType::kZSets, "cold_0"));
+    ASSERT_TRUE(statistics.AddModifyCount(DataType::kZSets, key, 1, &activity));
+    // admitted early and never evicted by the cold keys
+    ASSERT_GE(activity.modify_count, 90);
+  }
+}
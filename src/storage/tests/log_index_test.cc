@@ -23,6 +23,7 @@
 #include "pstd/thread_pool.h"
 #include "src/log_index.h"
 #include "src/redis.h"
+#include "storage/flat_binlog.h"
 #include "storage/storage.h"
 #include "storage/util.h"
 
@@ -75,15 +76,16 @@ TEST(TablePropertyTest, SimpleTest) {
 
 class LogQueue : public pstd::noncopyable {
  public:
-  using WriteCallback = std::function<rocksdb::Status(const pikiwidb::Binlog&, LogIndex idx)>;
+  using WriteCallback = std::function<rocksdb::Status(storage::FlatBinlog&&, LogIndex idx)>;
 
   explicit LogQueue(WriteCallback&& cb) : write_cb_(std::move(cb)) { consumer_.SetMaxIdleThread(1); }
 
-  void AppendLog(const pikiwidb::Binlog& log, std::promise<rocksdb::Status>&& promise) {
-    auto task = [&] {
+  void AppendLog(storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+    // done is a temporary of the caller, it is taken over with the log
+    auto task = [this, log = std::move(log), done = std::move(done)]() mutable {
       auto idx = next_log_idx_.fetch_add(1);
-      auto s = write_cb_(log, idx);
-      promise.set_value(s);
+      auto s = write_cb_(std::move(log), idx);
+      done(s);
     };
     consumer_.ExecuteTask(std::move(task));
   }
@@ -97,14 +99,16 @@ class LogQueue : public pstd::noncopyable {
 class LogIndexTest : public ::testing::Test {
  public:
   LogIndexTest()
-      : log_queue_([this](const pikiwidb::Binlog& log, LogIndex log_idx) { return db_.OnBinlogWrite(log, log_idx); }) {
+      : log_queue_([this](storage::FlatBinlog&& log, LogIndex log_idx) {
+          return db_.OnBinlogWrite(std::move(log), log_idx);
+        }) {
     options_.options.create_if_missing = true;
     options_.db_instance_num = 1;
     options_.raft_timeout_s = 10000;
-    options_.append_log_function = [this](const pikiwidb::Binlog& log, std::promise<rocksdb::Status>&& promise) {
-      log_queue_.AppendLog(log, std::move(promise));
+    options_.append_log_function = [this](storage::FlatBinlog&& log, storage::CommitCallback&& done) {
+      log_queue_.AppendLog(std::move(log), std::move(done));
     };
-    options_.do_snapshot_function = [](int64_t log_index, bool sync) {};
+    options_.do_snapshot_function = [](int32_t inst_id, int64_t log_index, bool sync) {};
   }
   ~LogIndexTest() override { DeleteFiles(db_path_.c_str()); }
 
@@ -151,6 +155,7 @@ TEST_F(LogIndexTest, DoNothing) {}
 
 TEST_F(LogIndexTest, SimpleTest) {  // NOLINT
   auto& redis = db_.GetDBInstance(key_);
+  // every HSet takes 3 sequence numbers: the meta value, the field and the type directory merge
   auto add_kvs = [&](int start, int end) {
     for (int i = start; i < end; i++) {
       auto key = CreateRandomKey(i, 256);
@@ -211,7 +216,7 @@ TEST_F(LogIndexTest, SimpleTest) {  // NOLINT
     EXPECT_TRUE(res.has_value());
     assert(res.has_value());
     EXPECT_EQ(res->GetAppliedLogIndex(), 10000);
-    EXPECT_EQ(res->GetSequenceNumber(), 19999);
+    EXPECT_EQ(res->GetSequenceNumber(), 29998);
 
     properties.clear();
     s = redis->GetDB()->GetPropertiesOfAllTables(redis->GetColumnFamilyHandles()[kHashesDataCF], &properties);
@@ -220,7 +225,7 @@ TEST_F(LogIndexTest, SimpleTest) {  // NOLINT
     EXPECT_TRUE(res.has_value());
     assert(res.has_value());
     EXPECT_EQ(res->GetAppliedLogIndex(), 10000);
-    EXPECT_EQ(res->GetSequenceNumber(), 20000);
+    EXPECT_EQ(res->GetSequenceNumber(), 29999);
   }
 
   // more flush
@@ -259,7 +264,7 @@ TEST_F(LogIndexTest, SimpleTest) {  // NOLINT
       EXPECT_TRUE(res.has_value());
       assert(res.has_value());
       EXPECT_EQ(res->GetAppliedLogIndex(), end);
-      EXPECT_EQ(res->GetSequenceNumber(), end * 2 - 1);
+      EXPECT_EQ(res->GetSequenceNumber(), end * 3 - 2);
 
       properties.clear();
       s = redis->GetDB()->GetPropertiesOfAllTables(redis->GetColumnFamilyHandles()[kHashesDataCF], &properties);
@@ -268,7 +273,45 @@ TEST_F(LogIndexTest, SimpleTest) {  // NOLINT
       EXPECT_TRUE(res.has_value());
       assert(res.has_value());
       EXPECT_EQ(res->GetAppliedLogIndex(), end);
-      EXPECT_EQ(res->GetSequenceNumber(), end * 2);
+      EXPECT_EQ(res->GetSequenceNumber(), end * 3 - 1);
     }
   }
 }
+
+TEST_F(LogIndexTest, GroupedApply) {  // NOLINT
+  auto& redis = db_.GetDBInstance(key_);
+  const auto& handles = redis->GetColumnFamilyHandles();
+
+  // log 1 takes sequence number 1, log 2 takes 2 and 3, log 3 takes 4
+  std::vector<std::pair<FlatBinlog, LogIndex>> logs;
+  for (int i = 1; i <= 3; i++) {
+    FlatBinlog log(0, redis->GetIndex());
+    ASSERT_TRUE(log.batch()->Put(handles[kStringsCF], "key" + std::to_string(i), "value").ok());
+    if (i == 2) {
+      ASSERT_TRUE(log.batch()->Delete(handles[kStringsCF], "key1").ok());
+    }
+    logs.emplace_back(std::move(log), i);
+  }
+  ASSERT_TRUE(db_.OnBinlogWrite(std::move(logs)).ok());
+  EXPECT_TRUE(redis->IsApplied(kStringsCF, 2));
+  EXPECT_FALSE(redis->IsApplied(kStringsCF, 3));
+
+  std::string value;
+  EXPECT_TRUE(redis->GetDB()->Get(read_options_, handles[kStringsCF], "key1", &value).IsNotFound());
+  ASSERT_TRUE(redis->GetDB()->Get(read_options_, handles[kStringsCF], "key3", &value).ok());
+  EXPECT_EQ(value, "value");
+
+  ASSERT_TRUE(redis->GetDB()->Flush(rocksdb::FlushOptions(), handles[kStringsCF]).ok());
+  rocksdb::TablePropertiesCollection properties;
+  ASSERT_TRUE(redis->GetDB()->GetPropertiesOfAllTables(handles[kStringsCF], &properties).ok());
+  auto res = LogIndexTablePropertiesCollector::GetLargestLogIndexFromTableCollection(properties);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res->GetAppliedLogIndex(), 3);
+  EXPECT_EQ(res->GetSequenceNumber(), 4);
+
+  // the logs of a group must all be of the same instance
+  std::vector<std::pair<FlatBinlog, LogIndex>> mixed;
+  mixed.emplace_back(FlatBinlog(0, redis->GetIndex()), 4);
+  mixed.emplace_back(FlatBinlog(0, redis->GetIndex() + 1), 5);
+  EXPECT_TRUE(db_.OnBinlogWrite(std::move(mixed)).IsInvalidArgument());
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "src/scan_cursor.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./scan_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+class ScanTest : public ::testing::Test {
+ public:
+  ScanTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 3;
+  }
+
+  ~ScanTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    auto s = db_.Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  // Goes on with cursor until the scan ends, adding the keys to *keys
+  void ScanToEnd(const storage::DataType& dtype, int64_t cursor, const std::string& pattern,
+                 std::set<std::string>* keys) {
+    std::vector<std::string> part;
+    do {
+      cursor = db_.Scan(dtype, cursor, pattern, 7, &part);
+      keys->insert(part.begin(), part.end());
+    } while (cursor != 0);
+  }
+
+  std::string db_path_{"./test_db/scan_test"};
+  storage::StorageOptions options_;
+  storage::Storage db_;
+};
+
+TEST(ScanCursorTest, EncodeDecodeTest) {
+  std::vector<std::string> keys = {"", "a", "scan_key_123", std::string(6, '\xff')};
+  for (const auto& key : keys) {
+    for (int type_index = 0; type_index < 6; type_index++) {
+      int64_t cursor = storage::ScanCursor(type_index, key).Encode();
+      ASSERT_GT(cursor, 0);
+      ASSERT_NE(cursor, storage::ScanCursor(type_index, key).Encode());
+
+      storage::ScanCursor decoded;
+      ASSERT_TRUE(decoded.Decode(cursor));
+      ASSERT_EQ(decoded.type_index(), type_index);
+      ASSERT_EQ(decoded.prefix(), key.substr(0, storage::ScanCursor::kMaxPrefixLength));
+      ASSERT_TRUE(decoded.Matches(key));
+    }
+  }
+
+  storage::ScanCursor decoded;
+  ASSERT_FALSE(decoded.Decode(0));
+  ASSERT_FALSE(decoded.Decode(-1));
+}
+
+TEST_F(ScanTest, ScanAllTypesTest) {
+  std::set<std::string> expect;
+  int32_t ret = 0;
+  for (int i = 0; i < 50; i++) {
+    std::string index = std::to_string(i);
+    ASSERT_TRUE(db_.Set("scan_string_" + index, "value").ok());
+    ASSERT_TRUE(db_.HSet("scan_hash_" + index, "field", "value", &ret).ok());
+    ASSERT_TRUE(db_.SAdd("scan_set_" + index, {"member"}, &ret).ok());
+    expect.insert({"scan_string_" + index, "scan_hash_" + index, "scan_set_" + index});
+  }
+
+  std::set<std::string> keys;
+  ScanToEnd(storage::DataType::kAll, 0, "*", &keys);
+  ASSERT_EQ(keys, expect);
+
+  keys.clear();
+  ScanToEnd(storage::DataType::kSets, 0, "scan_set_1*", &keys);
+  ASSERT_EQ(keys.size(), 11);
+}
+
+TEST_F(ScanTest, EvictedCursorTest) {
+  std::set<std::string> expect;
+  for (int i = 0; i < 100; i++) {
+    std::string key = "scan_evicted_" + std::to_string(i);
+    ASSERT_TRUE(db_.Set(key, "value").ok());
+    expect.insert(key);
+  }
+
+  std::vector<std::string> part;
+  std::set<std::string> keys;
+  int64_t cursor = db_.Scan(storage::DataType::kStrings, 0, "*", 10, &part);
+  ASSERT_NE(cursor, 0);
+  keys.insert(part.begin(), part.end());
+
+  // more concurrent scans than the cursor store keeps
+  for (int i = 0; i < 6000; i++) {
+    ASSERT_NE(db_.Scan(storage::DataType::kStrings, 0, "*", 1, &part), 0);
+  }
+
+  // the evicted cursor goes on from its key prefix instead of the beginning,
+  // without returning more keys than asked for
+  cursor = db_.Scan(storage::DataType::kStrings, cursor, "*", 10, &part);
+  ASSERT_NE(cursor, 0);
+  ASSERT_LE(part.size(), 10);
+  keys.insert(part.begin(), part.end());
+  ScanToEnd(storage::DataType::kStrings, cursor, "*", &keys);
+  ASSERT_EQ(keys, expect);
+}
+
+TEST_F(ScanTest, HScanSScanTest) {
+  int32_t ret = 0;
+  std::vector<std::string> members;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(db_.HSet("scan_hash", "field_" + std::to_string(i), "value", &ret).ok());
+    members.push_back("member_" + std::to_string(i));
+  }
+  ASSERT_TRUE(db_.SAdd("scan_set", members, &ret).ok());
+
+  std::set<std::string> fields;
+  int64_t cursor = 0;
+  do {
+    std::vector<storage::FieldValue> field_values;
+    ASSERT_TRUE(db_.HScan("scan_hash", cursor, "field_*", 9, &field_values, &cursor).ok());
+    for (const auto& fv : field_values) {
+      fields.insert(fv.field);
+    }
+  } while (cursor != 0);
+  ASSERT_EQ(fields.size(), 100);
+
+  std::set<std::string> scanned;
+  cursor = 0;
+  do {
+    std::vector<std::string> part;
+    ASSERT_TRUE(db_.SScan("scan_set", cursor, "*", 9, &part, &cursor).ok());
+    scanned.insert(part.begin(), part.end());
+  } while (cursor != 0);
+  ASSERT_EQ(scanned, std::set<std::string>(members.begin(), members.end()));
+}
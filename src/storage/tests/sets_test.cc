@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./sets_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+class SetsTest : public ::testing::Test {
+ public:
+  SetsTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 3;
+  }
+
+  ~SetsTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    auto s = db_.Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  void AddMembers(const std::string& key, const std::set<std::string>& members) {
+    int32_t ret = 0;
+    auto s = db_.SAdd(key, std::vector<std::string>(members.begin(), members.end()), &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, members.size());
+  }
+
+  std::set<std::string> Members(const std::string& key) {
+    std::vector<std::string> members;
+    auto s = db_.SMembers(key, &members);
+    EXPECT_TRUE(s.ok() || s.IsNotFound());
+    return {members.begin(), members.end()};
+  }
+
+  static std::set<std::string> MakeMembers(int start, int end, int step) {
+    std::set<std::string> members;
+    for (int i = start; i < end; i += step) {
+      members.insert("member_" + std::to_string(i));
+    }
+    return members;
+  }
+
+  std::string db_path_{"./test_db/sets_test"};
+  storage::StorageOptions options_;
+  storage::Storage db_;
+};
+
+TEST_F(SetsTest, SDiffSInterSUnionTest) {
+  // the keys are spread over different instances
+  std::set<std::string> set1 = MakeMembers(0, 3000, 1);
+  std::set<std::string> set2 = MakeMembers(0, 3000, 2);
+  std::set<std::string> set3 = MakeMembers(0, 6000, 3);
+  AddMembers("sets_key1", set1);
+  AddMembers("sets_key2", set2);
+  AddMembers("sets_key3", set3);
+  std::vector<std::string> keys{"sets_key1", "sets_key2", "sets_key3"};
+
+  std::vector<std::string> expect;
+  std::vector<std::string> members;
+  std::set<std::string> tmp;
+  std::set_difference(set1.begin(), set1.end(), set2.begin(), set2.end(), std::inserter(tmp, tmp.end()));
+  std::set_difference(tmp.begin(), tmp.end(), set3.begin(), set3.end(), std::back_inserter(expect));
+  ASSERT_TRUE(db_.SDiff(keys, &members).ok());
+  ASSERT_EQ(members, expect);
+
+  expect.clear();
+  tmp.clear();
+  std::set_intersection(set1.begin(), set1.end(), set2.begin(), set2.end(), std::inserter(tmp, tmp.end()));
+  std::set_intersection(tmp.begin(), tmp.end(), set3.begin(), set3.end(), std::back_inserter(expect));
+  ASSERT_TRUE(db_.SInter(keys, &members).ok());
+  ASSERT_EQ(members, expect);
+
+  expect.clear();
+  tmp.clear();
+  std::set_union(set1.begin(), set1.end(), set2.begin(), set2.end(), std::inserter(tmp, tmp.end()));
+  std::set_union(tmp.begin(), tmp.end(), set3.begin(), set3.end(), std::back_inserter(expect));
+  ASSERT_TRUE(db_.SUnion(keys, &members).ok());
+  ASSERT_EQ(members, expect);
+
+  // a missing key is an empty set
+  keys.emplace_back("sets_not_exist");
+  ASSERT_TRUE(db_.SInter(keys, &members).ok());
+  ASSERT_TRUE(members.empty());
+  ASSERT_TRUE(db_.SUnion(keys, &members).ok());
+  ASSERT_EQ(members, expect);
+  ASSERT_TRUE(db_.SDiff({"sets_not_exist", "sets_key1"}, &members).ok());
+  ASSERT_TRUE(members.empty());
+}
+
+TEST_F(SetsTest, StoreTest) {
+  // larger than storage::STORE_BATCH_LIMIT so that the destination is written in several batches
+  std::set<std::string> set1 = MakeMembers(0, 2000, 1);
+  std::set<std::string> set2 = MakeMembers(0, 2000, 4);
+  AddMembers("sets_store_key1", set1);
+  AddMembers("sets_store_key2", set2);
+  AddMembers("sets_store_dest", MakeMembers(5000, 5010, 1));
+  std::vector<std::string> keys{"sets_store_key1", "sets_store_key2"};
+
+  int32_t ret = 0;
+  std::set<std::string> expect;
+  std::set_difference(set1.begin(), set1.end(), set2.begin(), set2.end(), std::inserter(expect, expect.end()));
+  ASSERT_TRUE(db_.SDiffstore("sets_store_dest", keys, &ret).ok());
+  ASSERT_EQ(ret, expect.size());
+  ASSERT_EQ(Members("sets_store_dest"), expect);
+
+  ASSERT_TRUE(db_.SInterstore("sets_store_dest", keys, &ret).ok());
+  ASSERT_EQ(ret, set2.size());
+  ASSERT_EQ(Members("sets_store_dest"), set2);
+  int32_t card = 0;
+  ASSERT_TRUE(db_.SCard("sets_store_dest", &card).ok());
+  ASSERT_EQ(card, set2.size());
+
+  // the destination may also be one of the sources
+  keys.emplace_back("sets_store_dest");
+  ASSERT_TRUE(db_.SUnionstore("sets_store_dest", keys, &ret).ok());
+  ASSERT_EQ(ret, set1.size());
+  ASSERT_EQ(Members("sets_store_dest"), set1);
+
+  // an empty result leaves no destination
+  ASSERT_TRUE(db_.SInterstore("sets_store_dest", {"sets_store_key1", "sets_not_exist"}, &ret).ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(db_.SCard("sets_store_dest", &card).IsNotFound());
+}
+
+TEST_F(SetsTest, StoreCompactTest) {
+  std::set<std::string> set1 = MakeMembers(0, 2000, 1);
+  AddMembers("sets_compact_key1", set1);
+  AddMembers("sets_compact_dest", MakeMembers(5000, 5010, 1));
+
+  // the members staged in several batches are kept by the compaction, the
+  // replaced ones are collected
+  int32_t ret = 0;
+  ASSERT_TRUE(db_.SUnionstore("sets_compact_dest", {"sets_compact_key1"}, &ret).ok());
+  ASSERT_EQ(ret, set1.size());
+  ASSERT_TRUE(db_.Compact(storage::DataType::kSets, true).ok());
+  ASSERT_EQ(Members("sets_compact_dest"), set1);
+  ASSERT_TRUE(db_.SUnionstore("sets_compact_new", {"sets_compact_key1"}, &ret).ok());
+  ASSERT_TRUE(db_.Compact(storage::DataType::kSets, true).ok());
+  ASSERT_EQ(Members("sets_compact_new"), set1);
+
+  // an empty result writes nothing to a missing destination
+  ASSERT_TRUE(db_.SInterstore("sets_compact_none", {"sets_compact_key1", "sets_not_exist"}, &ret).ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(db_.Exists({"sets_compact_none"}), 0);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "src/sharded_cache.h"
+
+using storage::ShardedCache;
+
+TEST(ShardedCacheTest, LookupInsertRemoveTest) {
+  ShardedCache<std::string> cache(4);
+  ASSERT_TRUE(cache.Insert("k1", "v1").IsCorruption());
+
+  cache.SetCapacity(100);
+  ASSERT_EQ(cache.Capacity(), 100);
+  ASSERT_TRUE(cache.Insert("k1", "v1").ok());
+  ASSERT_TRUE(cache.Insert("k2", "v2", 3).ok());
+  ASSERT_EQ(cache.Size(), 2);
+  ASSERT_EQ(cache.TotalCharge(), 4);
+
+  std::string value;
+  ASSERT_TRUE(cache.Lookup("k1", &value).ok());
+  ASSERT_EQ(value, "v1");
+  ASSERT_TRUE(cache.Lookup(std::string_view("k2"), &value).ok());
+  ASSERT_EQ(value, "v2");
+  ASSERT_TRUE(cache.Lookup("k3", &value).IsNotFound());
+
+  ASSERT_TRUE(cache.Insert("k1", "v1_new").ok());
+  ASSERT_TRUE(cache.Lookup("k1", &value).ok());
+  ASSERT_EQ(value, "v1_new");
+  ASSERT_EQ(cache.Size(), 2);
+
+  ASSERT_TRUE(cache.Remove("k1").ok());
+  ASSERT_TRUE(cache.Remove("k1").IsNotFound());
+  ASSERT_TRUE(cache.Lookup("k1", &value).IsNotFound());
+  ASSERT_EQ(cache.TotalCharge(), 3);
+
+  ASSERT_TRUE(cache.Clear().ok());
+  ASSERT_EQ(cache.Size(), 0);
+  ASSERT_EQ(cache.TotalCharge(), 0);
+}
+
+TEST(ShardedCacheTest, UpdateTest) {
+  ShardedCache<size_t> cache;
+  cache.SetCapacity(100);
+  for (size_t i = 1; i <= 5; i++) {
+    size_t count = 0;
+    ASSERT_TRUE(cache.Update("counter", [&](size_t& value) { count = ++value; }).ok());
+    ASSERT_EQ(count, i);
+  }
+  ASSERT_EQ(cache.Size(), 1);
+}
+
+TEST(ShardedCacheTest, ClockEvictionTest) {
+  // a single shard makes the eviction order predictable
+  ShardedCache<int> cache(1);
+  cache.SetCapacity(3);
+  ASSERT_TRUE(cache.Insert("k1", 1).ok());
+  ASSERT_TRUE(cache.Insert("k2", 2).ok());
+  ASSERT_TRUE(cache.Insert("k3", 3).ok());
+
+  // k4 clears every reference bit then evicts the oldest entry
+  ASSERT_TRUE(cache.Insert("k4", 4).ok());
+  int value = 0;
+  ASSERT_TRUE(cache.Lookup("k1", &value).IsNotFound());
+
+  // k2 is used again, so k3 goes first
+  ASSERT_TRUE(cache.Lookup("k2", &value).ok());
+  ASSERT_TRUE(cache.Insert("k5", 5).ok());
+  ASSERT_TRUE(cache.Lookup("k2", &value).ok());
+  ASSERT_TRUE(cache.Lookup("k3", &value).IsNotFound());
+  ASSERT_EQ(cache.Size(), 3);
+
+  cache.SetCapacity(1);
+  ASSERT_EQ(cache.Size(), 1);
+  cache.SetCapacity(0);
+  ASSERT_EQ(cache.Size(), 0);
+}
+
+TEST(ShardedCacheTest, ConcurrentUpdateTest) {
+  ShardedCache<size_t> cache;
+  cache.SetCapacity(1000);
+  constexpr int kThreads = 8;
+  constexpr int kUpdates = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&cache] {
+      for (int i = 0; i < kUpdates; i++) {
+        cache.Update("key_" + std::to_string(i % 100), [](size_t& value) { value++; });
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < 100; i++) {
+    size_t value = 0;
+    ASSERT_TRUE(cache.Lookup("key_" + std::to_string(i), &value).ok());
+    total += value;
+  }
+  ASSERT_EQ(total, kThreads * kUpdates);
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "src/redis.h"
+#include "src/type_directory.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./type_directory_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+class TypeDirectoryTest : public ::testing::Test {
+ public:
+  TypeDirectoryTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 1;
+  }
+
+  ~TypeDirectoryTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    Reopen();
+  }
+
+  void Reopen() {
+    db_ = std::make_unique<storage::Storage>();
+    auto s = db_->Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  // Writes one key of each type
+  void AddKeys() {
+    int32_t ret = 0;
+    uint64_t len = 0;
+    ASSERT_TRUE(db_->Set("string_key", "value").ok());
+    ASSERT_TRUE(db_->HSet("hash_key", "field", "value", &ret).ok());
+    ASSERT_TRUE(db_->SAdd("set_key", {"member"}, &ret).ok());
+    ASSERT_TRUE(db_->RPush("list_key", {"value"}, &len).ok());
+    ASSERT_TRUE(db_->ZAdd("zset_key", {{1, "member"}}, &ret).ok());
+  }
+
+  std::string Type(const std::string& key) {
+    std::vector<std::string> types;
+    auto s = db_->GetType(key, true, types);
+    EXPECT_TRUE(s.ok());
+    return types.empty() ? "" : types[0];
+  }
+
+  std::string db_path_{"./test_db/type_directory_test"};
+  storage::StorageOptions options_;
+  std::unique_ptr<storage::Storage> db_;
+};
+
+TEST_F(TypeDirectoryTest, TypeExistsDel) {
+  AddKeys();
+  const std::map<std::string, std::string> key_types = {{"string_key", "string"}, {"hash_key", "hash"},
+                                                        {"set_key", "set"},       {"list_key", "list"},
+                                                        {"zset_key", "zset"},     {"missing_key", "none"}};
+  for (const auto& [key, type] : key_types) {
+    EXPECT_EQ(Type(key), type);
+  }
+
+  std::vector<std::string> keys = {"string_key", "hash_key", "set_key", "list_key", "zset_key", "missing_key"};
+  EXPECT_EQ(db_->Exists(keys), 5);
+
+  std::map<storage::DataType, storage::Status> type_status;
+  EXPECT_EQ(db_->IsExist("hash_key", &type_status), 1);
+  EXPECT_TRUE(type_status[storage::DataType::kHashes].ok());
+  EXPECT_TRUE(type_status[storage::DataType::kStrings].IsNotFound());
+  EXPECT_TRUE(type_status[storage::DataType::kSets].IsNotFound());
+
+  EXPECT_EQ(db_->Del(keys), 5);
+  EXPECT_EQ(db_->Exists(keys), 0);
+  for (const auto& key : keys) {
+    EXPECT_EQ(Type(key), "none");
+  }
+}
+
+TEST_F(TypeDirectoryTest, KeyOfSeveralTypes) {
+  int32_t ret = 0;
+  ASSERT_TRUE(db_->HSet("multi_key", "field", "value", &ret).ok());
+  ASSERT_TRUE(db_->SAdd("multi_key", {"member"}, &ret).ok());
+
+  std::vector<std::string> types;
+  ASSERT_TRUE(db_->GetType("multi_key", false, types).ok());
+  EXPECT_EQ(types, (std::vector<std::string>{"hash", "set"}));
+  EXPECT_EQ(db_->Exists({"multi_key"}), 2);
+  EXPECT_EQ(db_->Del({"multi_key"}), 2);
+  EXPECT_EQ(Type("multi_key"), "none");
+}
+
+TEST_F(TypeDirectoryTest, StaleBit) {
+  // the hash bit of the key outlives the hash, it must not be reported
+  int32_t ret = 0;
+  ASSERT_TRUE(db_->HSet("stale_key", "field", "value", &ret).ok());
+  ASSERT_EQ(db_->Expire("stale_key", 1), 1);
+  sleep(2);
+  EXPECT_EQ(Type("stale_key"), "none");
+  EXPECT_EQ(db_->Exists({"stale_key"}), 0);
+  EXPECT_EQ(db_->Del({"stale_key"}), 0);
+
+  ASSERT_TRUE(db_->Set("stale_key", "value").ok());
+  EXPECT_EQ(Type("stale_key"), "string");
+  EXPECT_EQ(db_->Exists({"stale_key"}), 1);
+}
+
+TEST_F(TypeDirectoryTest, BuildOnOpen) {
+  AddKeys();
+
+  // turn the instance into one written before the directory existed
+  auto& inst = db_->GetDBInstance(std::string("hash_key"));
+  auto directory = inst->GetColumnFamilyHandles()[storage::kTypeDirectoryCF];
+  std::unique_ptr<rocksdb::Iterator> iter(inst->GetDB()->NewIterator(rocksdb::ReadOptions(), directory));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(inst->GetDB()->Delete(rocksdb::WriteOptions(), directory, iter->key()).ok());
+  }
+  iter.reset();
+  EXPECT_EQ(Type("hash_key"), "none");
+
+  db_.reset();
+  std::string built_file = db_path_ + "/0/" + storage::kTypeDirectoryBuiltFile;
+  ASSERT_TRUE(std::filesystem::remove(built_file));
+  Reopen();
+
+  EXPECT_TRUE(std::filesystem::exists(built_file));
+  EXPECT_EQ(Type("string_key"), "string");
+  EXPECT_EQ(Type("hash_key"), "hash");
+  EXPECT_EQ(Type("set_key"), "set");
+  EXPECT_EQ(Type("list_key"), "list");
+  EXPECT_EQ(Type("zset_key"), "zset");
+}
+
+TEST_F(TypeDirectoryTest, CompactionClearsStaleBits) {
+  int32_t ret = 0;
+  ASSERT_TRUE(db_->HSet("deleted_key", "field", "value", &ret).ok());
+  ASSERT_TRUE(db_->HSet("emptied_key", "field", "value", &ret).ok());
+  ASSERT_TRUE(db_->SAdd("emptied_key", {"member"}, &ret).ok());
+  ASSERT_TRUE(db_->HSet("kept_key", "field", "value", &ret).ok());
+  ASSERT_EQ(db_->Del({"deleted_key"}), 1);
+  ASSERT_TRUE(db_->HDel("emptied_key", {"field"}, &ret).ok());
+
+  // the merges are folded by the first compaction, the second one filters the value
+  auto& inst = db_->GetDBInstance(std::string("emptied_key"));
+  auto directory = inst->GetColumnFamilyHandles()[storage::kTypeDirectoryCF];
+  rocksdb::CompactRangeOptions compact_options;
+  compact_options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(inst->GetDB()->CompactRange(compact_options, directory, nullptr, nullptr).ok());
+  }
+
+  std::string bits;
+  storage::BaseMetaKey deleted_key("deleted_key");
+  EXPECT_TRUE(inst->GetDB()->Get(rocksdb::ReadOptions(), directory, deleted_key.Encode(), &bits).IsNotFound());
+  storage::BaseMetaKey emptied_key("emptied_key");
+  ASSERT_TRUE(inst->GetDB()->Get(rocksdb::ReadOptions(), directory, emptied_key.Encode(), &bits).ok());
+  EXPECT_EQ(bits, std::string(1, static_cast<char>(storage::TypeDirectoryBit(storage::DataType::kSets))));
+  EXPECT_EQ(Type("emptied_key"), "set");
+  EXPECT_EQ(Type("kept_key"), "hash");
+}
+
+TEST_F(TypeDirectoryTest, CheckpointIsMarkedBuilt) {
+  AddKeys();
+  std::string checkpoint_path = db_path_ + "_checkpoint";
+  std::filesystem::remove_all(checkpoint_path);
+  std::filesystem::create_directories(checkpoint_path);
+  for (auto& result : db_->CreateCheckpoint(checkpoint_path, {})) {
+    ASSERT_TRUE(result.get().ok());
+  }
+  EXPECT_TRUE(std::filesystem::exists(checkpoint_path + "/0/" + storage::kTypeDirectoryBuiltFile));
+  std::filesystem::remove_all(checkpoint_path);
+}
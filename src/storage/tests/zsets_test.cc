@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2024-present, Qihoo, Inc.  All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "pstd/log.h"
+#include "storage/storage.h"
+
+class LogIniter {
+ public:
+  LogIniter() {
+    logger::Init("./zsets_test.log");
+    spdlog::set_level(spdlog::level::info);
+  }
+};
+
+LogIniter log_initer;
+
+using ScoreMap = std::map<std::string, double>;
+
+class ZSetsTest : public ::testing::Test {
+ public:
+  ZSetsTest() {
+    options_.options.create_if_missing = true;
+    options_.db_instance_num = 3;
+  }
+
+  ~ZSetsTest() override { std::filesystem::remove_all(db_path_); }
+
+  void SetUp() override {
+    if (access(db_path_.c_str(), F_OK) == 0) {
+      std::filesystem::remove_all(db_path_.c_str());
+    }
+    mkdir(db_path_.c_str(), 0755);
+    auto s = db_.Open(options_, db_path_);
+    ASSERT_TRUE(s.ok());
+  }
+
+  void AddMembers(const std::string& key, const ScoreMap& members) {
+    std::vector<storage::ScoreMember> score_members;
+    for (const auto& [member, score] : members) {
+      score_members.push_back({score, member});
+    }
+    int32_t ret = 0;
+    ASSERT_TRUE(db_.ZAdd(key, score_members, &ret).ok());
+    ASSERT_EQ(ret, members.size());
+  }
+
+  void CheckMembers(const std::string& key, const ScoreMap& expect) {
+    int32_t card = 0;
+    auto s = db_.ZCard(key, &card);
+    if (expect.empty()) {
+      ASSERT_TRUE(s.IsNotFound());
+      return;
+    }
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(card, expect.size());
+
+    // ZRANGE walks the score column family, so this also checks the score keys
+    std::vector<storage::ScoreMember> score_members;
+    ASSERT_TRUE(db_.ZRange(key, 0, -1, &score_members).ok());
+    ASSERT_EQ(score_members.size(), expect.size());
+    for (const auto& sm : score_members) {
+      auto it = expect.find(sm.member);
+      ASSERT_NE(it, expect.end());
+      ASSERT_DOUBLE_EQ(sm.score, it->second);
+      double score = 0;
+      ASSERT_TRUE(db_.ZScore(key, sm.member, &score).ok());
+      ASSERT_DOUBLE_EQ(score, it->second);
+    }
+  }
+
+  static ScoreMap MakeMembers(int start, int end, int step, double score_factor) {
+    ScoreMap members;
+    for (int i = start; i < end; i += step) {
+      members["member_" + std::to_string(i)] = i * score_factor;
+    }
+    return members;
+  }
+
+  std::string db_path_{"./test_db/zsets_test"};
+  storage::StorageOptions options_;
+  storage::Storage db_;
+};
+
+TEST_F(ZSetsTest, ZUnionstoreTest) {
+  // larger than storage::STORE_BATCH_LIMIT so that the destination is written in several batches
+  ScoreMap zset1 = MakeMembers(0, 1500, 1, 1);
+  ScoreMap zset2 = MakeMembers(0, 3000, 2, -0.5);
+  AddMembers("zsets_union_key1", zset1);
+  AddMembers("zsets_union_key2", zset2);
+  std::vector<std::string> keys{"zsets_union_key1", "zsets_union_key2", "zsets_not_exist"};
+  std::vector<double> weights{2, 3};
+
+  for (auto agg : {storage::SUM, storage::MIN, storage::MAX}) {
+    ScoreMap expect;
+    for (const auto& [member, score] : zset1) {
+      expect[member] = score * 2;
+    }
+    for (const auto& [member, score] : zset2) {
+      auto it = expect.find(member);
+      if (it == expect.end()) {
+        expect[member] = score * 3;
+      } else if (agg == storage::SUM) {
+        it->second += score * 3;
+      } else if (agg == storage::MIN) {
+        it->second = std::min(it->second, score * 3);
+      } else {
+        it->second = std::max(it->second, score * 3);
+      }
+    }
+
+    int32_t ret = 0;
+    ASSERT_TRUE(db_.ZUnionstore("zsets_union_dest", keys, weights, agg, &ret).ok());
+    ASSERT_EQ(ret, expect.size());
+    CheckMembers("zsets_union_dest", expect);
+  }
+}
+
+TEST_F(ZSetsTest, ZInterstoreTest) {
+  ScoreMap zset1 = MakeMembers(0, 2000, 1, 1);
+  ScoreMap zset2 = MakeMembers(0, 2000, 3, 2);
+  ScoreMap zset3 = MakeMembers(0, 4000, 2, 4);
+  AddMembers("zsets_inter_key1", zset1);
+  AddMembers("zsets_inter_key2", zset2);
+  AddMembers("zsets_inter_key3", zset3);
+  AddMembers("zsets_inter_dest", MakeMembers(5000, 5010, 1, 1));
+  std::vector<std::string> keys{"zsets_inter_key1", "zsets_inter_key2", "zsets_inter_key3"};
+  std::vector<double> weights{1, 2};
+
+  ScoreMap expect;
+  for (const auto& [member, score] : zset1) {
+    if (zset2.count(member) && zset3.count(member)) {
+      expect[member] = std::max({score, zset2[member] * 2, zset3[member]});
+    }
+  }
+
+  int32_t ret = 0;
+  ASSERT_TRUE(db_.ZInterstore("zsets_inter_dest", keys, weights, storage::MAX, &ret).ok());
+  ASSERT_EQ(ret, expect.size());
+  CheckMembers("zsets_inter_dest", expect);
+
+  // the destination may also be one of the sources
+  keys.emplace_back("zsets_inter_dest");
+  ASSERT_TRUE(db_.ZInterstore("zsets_inter_dest", keys, {}, storage::MIN, &ret).ok());
+  ASSERT_EQ(ret, expect.size());
+  for (auto& [member, score] : expect) {
+    score = std::min({zset1[member], zset2[member], zset3[member], score});
+  }
+  CheckMembers("zsets_inter_dest", expect);
+
+  // a missing key makes the intersection empty
+  keys.emplace_back("zsets_not_exist");
+  ASSERT_TRUE(db_.ZInterstore("zsets_inter_dest", keys, {}, storage::SUM, &ret).ok());
+  ASSERT_EQ(ret, 0);
+  CheckMembers("zsets_inter_dest", {});
+}
+
+TEST_F(ZSetsTest, StoreCompactTest) {
+  ScoreMap zset1 = MakeMembers(0, 1500, 1, 1);
+  AddMembers("zsets_compact_key1", zset1);
+  AddMembers("zsets_compact_dest", MakeMembers(5000, 5010, 1, 1));
+
+  // the members and scores staged in several batches are kept by the
+  // compaction, the replaced ones are collected
+  int32_t ret = 0;
+  std::vector<double> weights{1};
+  ASSERT_TRUE(db_.ZUnionstore("zsets_compact_dest", {"zsets_compact_key1"}, weights, storage::SUM, &ret).ok());
+  ASSERT_EQ(ret, zset1.size());
+  ASSERT_TRUE(db_.Compact(storage::DataType::kZSets, true).ok());
+  CheckMembers("zsets_compact_dest", zset1);
+  ASSERT_TRUE(db_.ZUnionstore("zsets_compact_new", {"zsets_compact_key1"}, weights, storage::SUM, &ret).ok());
+  ASSERT_TRUE(db_.Compact(storage::DataType::kZSets, true).ok());
+  CheckMembers("zsets_compact_new", zset1);
+
+  // an empty result writes nothing to a missing destination
+  ASSERT_TRUE(
+      db_.ZInterstore("zsets_compact_none", {"zsets_compact_key1", "zsets_not_exist"}, weights, storage::SUM, &ret)
+          .ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_EQ(db_.Exists({"zsets_compact_none"}), 0);
+}
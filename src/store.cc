@@ -51,7 +51,7 @@ void PStore::HandleTaskSpecificDB(const TasksVector& tasks) {
         }
         auto path = task.args.find(kCheckpointPath)->second;
         pstd::TrimSlash(path);
-        db->CreateCheckpoint(path, task.sync);
+        db->CreateCheckpoint(path, task.sync, task.instances);
         break;
       }
       case kLoadDBFromCheckpoint: {
@@ -61,7 +61,7 @@ void PStore::HandleTaskSpecificDB(const TasksVector& tasks) {
         }
         auto path = task.args.find(kCheckpointPath)->second;
         pstd::TrimSlash(path);
-        db->LoadDBFromCheckpoint(path, task.sync);
+        db->LoadDBFromCheckpoint(path, task.sync, task.instances);
         break;
       }
       case kEmpty: {
@@ -29,6 +29,7 @@ struct TaskContext {
   TaskType type = kEmpty;
   int db = -1;
   std::map<TaskArg, std::string> args;
+  std::vector<int32_t> instances;  // the storage instances of db the task is about, all if empty
   bool sync = false;
   TaskContext() = delete;
   TaskContext(TaskType t, bool s = false) : type(t), sync(s) {}
@@ -839,6 +839,90 @@ var _ = Describe("Consistency", Ordered, func() {
 	})
 })
 
+var _ = Describe("Raft Commit Failure", Ordered, func() {
+	var (
+		ctx     = context.TODO()
+		servers []*util.Server
+	)
+
+	BeforeAll(func() {
+		for i := 0; i < 3; i++ {
+			config := util.GetConfPath(false, int64(i))
+			s := util.StartServer(config, map[string]string{"port": strconv.Itoa(13000 + (i+1)*111),
+				"use-raft": "yes"}, true)
+			Expect(s).NotTo(BeNil())
+			servers = append(servers, s)
+		}
+
+		c := servers[0].NewClient()
+		Expect(c.Do(ctx, "RAFT.CLUSTER", "INIT").Val()).To(Equal(OK))
+		Expect(c.Close()).NotTo(HaveOccurred())
+		for _, s := range servers[1:] {
+			c := s.NewClient()
+			Expect(c.Do(ctx, "RAFT.CLUSTER", "JOIN", "127.0.0.1:13111").Val()).To(Equal(OK))
+			Expect(c.Close()).NotTo(HaveOccurred())
+		}
+	})
+
+	AfterAll(func() {
+		for _, s := range servers {
+			if err := s.Close(); err != nil {
+				log.Println("Close Server fail.", err.Error())
+			}
+		}
+	})
+
+	It("Reads the writes pipelined before", func() {
+		const testKey = "PipelineTestKey"
+		c := servers[0].NewClient()
+		defer c.Close()
+
+		p := c.Pipeline()
+		set := p.Set(ctx, testKey, "v1", 0)
+		get := p.Get(ctx, testKey)
+		incr := p.Incr(ctx, testKey+"Counter")
+		getCounter := p.Get(ctx, testKey+"Counter")
+		rename := p.Rename(ctx, testKey, testKey)
+		getRenamed := p.Get(ctx, testKey)
+		_, err := p.Exec(ctx)
+		Expect(err).NotTo(HaveOccurred())
+		Expect(set.Val()).To(Equal(OK))
+		Expect(get.Val()).To(Equal("v1"))
+		Expect(incr.Val()).To(Equal(int64(1)))
+		Expect(getCounter.Val()).To(Equal("1"))
+		Expect(rename.Val()).To(Equal(OK))
+		Expect(getRenamed.Val()).To(Equal("v1"))
+	})
+
+	It("Replies once to a write whose commit fails", func() {
+		const testKey = "CommitFailureTestKey"
+		c := servers[0].NewClient()
+		defer c.Close()
+		Expect(c.Set(ctx, testKey, "v1", 0).Val()).To(Equal(OK))
+
+		// without its followers the leader cannot commit, it steps down and fails the write
+		for _, s := range servers[1:] {
+			Expect(s.Close()).NotTo(HaveOccurred())
+		}
+		servers = servers[:1]
+
+		// the failed write must not drop the replies of the commands pipelined after it,
+		// nor the read see the write before it is committed
+		p := c.Pipeline()
+		set := p.Set(ctx, testKey, "v2", 0)
+		get := p.Get(ctx, testKey)
+		ping := p.Ping(ctx)
+		_, err := p.Exec(ctx)
+		Expect(err).To(HaveOccurred())
+		Expect(set.Err()).To(HaveOccurred())
+		Expect(get.Val()).To(Equal("v1"))
+		Expect(ping.Val()).To(Equal("PONG"))
+
+		// a second reply to the write would be read as the reply to the next command
+		Expect(c.Ping(ctx).Val()).To(Equal("PONG"))
+	})
+})
+
 func readChecker(check func(*redis.Client)) {
 	// read on leader
 	check(leader)
@@ -865,3 +949,80 @@ func reverse(src []string) []string {
 
 	return a
 }
+
+var _ = Describe("Raft Groups", Ordered, func() {
+	var (
+		ctx     = context.TODO()
+		servers []*util.Server
+	)
+
+	BeforeAll(func() {
+		for i := 0; i < 3; i++ {
+			config := util.GetConfPath(false, int64(i))
+			s := util.StartServer(config, map[string]string{"port": strconv.Itoa(14000 + (i+1)*111),
+				"use-raft": "yes", "raft-group-num": "2"}, true)
+			Expect(s).NotTo(BeNil())
+			servers = append(servers, s)
+		}
+
+		c := servers[0].NewClient()
+		Expect(c.Do(ctx, "RAFT.CLUSTER", "INIT").Val()).To(Equal(OK))
+		Expect(c.Close()).NotTo(HaveOccurred())
+		for _, s := range servers[1:] {
+			c := s.NewClient()
+			Expect(c.Do(ctx, "RAFT.CLUSTER", "JOIN", "127.0.0.1:14111").Val()).To(Equal(OK))
+			Expect(c.Close()).NotTo(HaveOccurred())
+		}
+	})
+
+	AfterAll(func() {
+		for _, s := range servers {
+			if err := s.Close(); err != nil {
+				log.Println("Close Server fail.", err.Error())
+			}
+		}
+	})
+
+	It("Redirects to the leader of each group", func() {
+		c := servers[0].NewClient()
+		defer c.Close()
+		Expect(c.FlushDB(ctx).Err()).NotTo(HaveOccurred())
+
+		// the group 1 led by another node, the keys of its slots are redirected there
+		Eventually(func() error {
+			return c.Do(ctx, "RAFT.GROUP", "TRANSFER", "1", "127.0.0.1:14232").Err()
+		}, 10*time.Second, 500*time.Millisecond).ShouldNot(HaveOccurred())
+		Eventually(func() error {
+			return c.FlushDB(ctx).Err()
+		}, 10*time.Second, 500*time.Millisecond).Should(MatchError(ContainSubstring("RAFT.GROUP TRANSFER")))
+		moved := 0
+		for i := 0; i < 20; i++ {
+			err := c.Set(ctx, "RaftGroupsKey"+strconv.Itoa(i), "v", 0).Err()
+			if err != nil {
+				Expect(err.Error()).To(Equal("ERR MOVED 127.0.0.1:14222"))
+				moved++
+			}
+		}
+		Expect(moved).To(BeNumerically(">", 0))
+		Expect(moved).To(BeNumerically("<", 20))
+
+		// a node leading no group sends the keyless writes to the node leading them all
+		Eventually(func() error {
+			return c.Do(ctx, "RAFT.GROUP", "TRANSFER", "1", "127.0.0.1:14121").Err()
+		}, 10*time.Second, 500*time.Millisecond).ShouldNot(HaveOccurred())
+		Eventually(func() error {
+			return c.FlushDB(ctx).Err()
+		}, 10*time.Second, 500*time.Millisecond).ShouldNot(HaveOccurred())
+		f := servers[2].NewClient()
+		defer f.Close()
+		Expect(f.FlushDB(ctx).Err().Error()).To(Equal("ERR MOVED 127.0.0.1:14111"))
+	})
+
+	It("Keeps the slots of each group", func() {
+		c := servers[0].NewClient()
+		defer c.Close()
+
+		Expect(c.Do(ctx, "SLOTS", "MIGRATE", "0", "1").Err()).To(MatchError("ERR SLOTS MIGRATE is not replicated by raft"))
+		Expect(c.Do(ctx, "SLOTS", "REBALANCE").Err()).To(MatchError("ERR SLOTS REBALANCE is not replicated by raft"))
+	})
+})